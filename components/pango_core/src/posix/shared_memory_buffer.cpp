@@ -69,6 +69,11 @@ public:
     return _ptr;
   }
 
+  size_t size() override
+  {
+    return _size;
+  }
+
   std::string name() override
   {
     return _name;
@@ -100,8 +105,13 @@ std::shared_ptr<SharedMemoryBufferInterface> create_named_shared_memory_buffer(c
     return ptr;
   }
 
-  unsigned char *buffer = reinterpret_cast<unsigned char *>(mmap(NULL, size,
-      PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0));
+  void *mapped = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == mapped) {
+    close(fd);
+    shm_unlink(name.c_str());
+    return ptr;
+  }
+  unsigned char *buffer = reinterpret_cast<unsigned char *>(mapped);
 
   ptr.reset(new PosixSharedMemoryBuffer(fd, buffer, size, true, name));
   return ptr;
@@ -124,8 +134,12 @@ std::shared_ptr<SharedMemoryBufferInterface> open_named_shared_memory_buffer(con
   }
 
   size_t size = sbuf.st_size;
-  unsigned char *buffer = reinterpret_cast<unsigned char *>(mmap(NULL, size,
-      PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0));
+  void *mapped = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == mapped) {
+    close(fd);
+    return ptr;
+  }
+  unsigned char *buffer = reinterpret_cast<unsigned char *>(mapped);
 
   ptr.reset(new PosixSharedMemoryBuffer(fd, buffer, size, false, name));
   return ptr;
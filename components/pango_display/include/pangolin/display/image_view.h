@@ -4,6 +4,8 @@
 #include <pangolin/gl/glpixformat.h>
 #include <pangolin/gl/glformattraits.h>
 #include <pangolin/gl/glsl.h>
+#include <pangolin/gl/glpixelconvert.h>
+#include <pangolin/gl/glpixelunpackring.h>
 #include <pangolin/handler/handler_image.h>
 #include <pangolin/image/image_utils.h>
 
@@ -31,6 +33,10 @@ class PANGOLIN_EXPORT ImageView : public pangolin::View, public pangolin::ImageV
 
     ImageView& SetImage(const pangolin::Image<unsigned char>& img, const pangolin::GlPixFormat& glfmt, bool delayed_upload = false);
 
+    // Raw camera formats without a GlPixFormat equivalent (YUYV, NV12, packed
+    // 10/12 bit, bayer) are converted to RGBA on the GPU by converter.
+    ImageView& SetImage(const pangolin::Image<unsigned char>& img, const pangolin::PixelFormat& fmt, bool delayed_upload = false);
+
     template<typename T> inline
     ImageView& SetImage(const pangolin::Image<T>& img, bool delayed_upload = false)
     {
@@ -53,12 +59,35 @@ class PANGOLIN_EXPORT ImageView : public pangolin::View, public pangolin::ImageV
 
     void SetRenderOverlay(const bool& val);
 
+    // Statistics for images streamed through the pixel buffer ring
+    GlPixelUnpackRing::Stats GetUploadStats() const;
+
+    void ResetUploadStats();
+
 //  private:
+    void UploadTexture(const void* ptr, size_t w, size_t h, size_t pitch, const pangolin::GlPixFormat& img_fmt);
+
+    void UploadConverted(const pangolin::Image<unsigned char>& img, const pangolin::PixelFormat& raw_fmt);
+
+    // Shader based conversion for raw formats. Use converter.SetBayerPattern()
+    // to demosaic single channel images.
+    pangolin::GlPixelConverter converter;
+
+    // Raw image awaiting GPU conversion on the next render cycle
+    pangolin::ManagedImage<unsigned char> raw_to_load;
+    pangolin::PixelFormat raw_fmt_to_load;
+    bool raw_to_load_pending;
+
+    // Persistently mapped pixel buffers which SetImage() copies into directly
+    // when available, from any thread. Uploaded from LoadPending().
+    pangolin::GlPixelUnpackRing pbo_ring;
+
     // img_to_load contains image data that should be uploaded to the texture on
-    // the next render cycle. The data is owned by this object and should be
-    // freed after use.
+    // the next render cycle when the pixel buffer ring cannot be used. The
+    // allocation is kept between frames and only grown when needed.
     pangolin::ManagedImage<unsigned char> img_to_load;
     pangolin::GlPixFormat img_fmt_to_load;
+    bool img_to_load_pending;
 
     std::pair<float, float> offset_scale;
     pangolin::GlPixFormat fmt;
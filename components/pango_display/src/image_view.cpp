@@ -3,11 +3,13 @@
 #include <pangolin/image/image_convert.h>
 #include <pangolin/gl/glsl_utilities.h>
 
+#include <cstring>
+
 namespace pangolin
 {
 
 ImageView::ImageView(const std::string & title)
-    : pangolin::ImageViewHandler(title), offset_scale(0.0f, 1.0f), lastPressed(false), mouseReleased(false), mousePressed(false), overlayRender(true)
+    : pangolin::ImageViewHandler(title), raw_to_load_pending(false), img_to_load_pending(false), offset_scale(0.0f, 1.0f), lastPressed(false), mouseReleased(false), mousePressed(false), overlayRender(true)
 {
     SetHandler(this);
 }
@@ -122,25 +124,61 @@ ImageView& ImageView::SetImage(void* ptr, size_t w, size_t h, size_t pitch, pang
             pangolin::GlFormatChannels(img_fmt.glformat) * pangolin::GlDataTypeBytes(img_fmt.gltype);
 
     const bool convert_first = (img_fmt.gltype == GL_DOUBLE);
+    const bool upload_now = !delayed_upload && pangolin::GetBoundWindow();
+
+    if(!convert_first && !IsDevicePtr(ptr))
+    {
+        // Copy straight into GPU visible memory if a pixel buffer is free.
+        int slot;
+        if(unsigned char* dst = pbo_ring.BeginWrite(w * pix_bytes * h, slot)) {
+            PitchedCopy((char*)dst, w * pix_bytes, (char*)ptr, pitch, w * pix_bytes, h);
+            pbo_ring.EndWrite(slot, {w, h, w * pix_bytes, img_fmt});
+            if(upload_now) {
+                LoadPending();
+            }
+            return *this;
+        }
+    }
+
+    // This frame bypasses the pixel buffer ring, so older frames still
+    // queued there must not be uploaded over it.
+    pbo_ring.DiscardReady();
 
-    if(delayed_upload || !pangolin::GetBoundWindow() || IsDevicePtr(ptr) || convert_first )
+    if(!upload_now || IsDevicePtr(ptr) || convert_first )
     {
-        texlock.lock();
+        std::lock_guard<std::mutex> l(texlock);
+        // Any older raw frame must not be converted over this one
+        raw_to_load_pending = false;
         if(!convert_first) {
-            img_to_load = ManagedImage<unsigned char>(w,h,w*pix_bytes);
+            img_to_load.Reinitialise(w, h, w*pix_bytes);
             PitchedCopy((char*)img_to_load.ptr, img_to_load.pitch, (char*)ptr, pitch, w * pix_bytes, h);
             img_fmt_to_load = img_fmt;
+            img_to_load_pending = true;
         }else if(img_fmt.gltype == GL_DOUBLE) {
             Image<double> double_image( (double*)ptr, w, h, pitch);
             img_to_load.OwnAndReinterpret(ImageConvert<float>(double_image));
             img_fmt_to_load = GlPixFormat::FromType<float>();
+            img_to_load_pending = true;
         }else{
             pango_print_warn("TextureView: Unable to display image.\n");
         }
-        texlock.unlock();
         return *this;
     }
 
+    {
+        std::lock_guard<std::mutex> l(texlock);
+        img_to_load_pending = false;
+        raw_to_load_pending = false;
+    }
+    UploadTexture(ptr, w, h, pitch, img_fmt);
+    return *this;
+}
+
+void ImageView::UploadTexture(const void* ptr, size_t w, size_t h, size_t pitch, const pangolin::GlPixFormat& img_fmt)
+{
+    const size_t pix_bytes =
+            pangolin::GlFormatChannels(img_fmt.glformat) * pangolin::GlDataTypeBytes(img_fmt.gltype);
+
     PANGO_ASSERT(pitch % pix_bytes == 0);
     const size_t stride = pitch / pix_bytes;
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
@@ -153,7 +191,7 @@ ImageView& ImageView::SetImage(void* ptr, size_t w, size_t h, size_t pitch, pang
         fmt = img_fmt;
         SetDimensions(w, h);
         SetAspect((float)w / (float)h);
-        tex.Reinitialise(w, h, img_fmt.scalable_internal_format, true, 0, img_fmt.glformat, img_fmt.gltype, ptr);
+        tex.Reinitialise(w, h, img_fmt.scalable_internal_format, true, 0, img_fmt.glformat, img_fmt.gltype, (GLvoid*)ptr);
     }
     else
     {
@@ -161,7 +199,6 @@ ImageView& ImageView::SetImage(void* ptr, size_t w, size_t h, size_t pitch, pang
     }
 
     glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    return *this;
 }
 
 ImageView& ImageView::SetImage(const pangolin::Image<unsigned char>& img, const pangolin::GlPixFormat& glfmt, bool delayed_upload )
@@ -169,9 +206,48 @@ ImageView& ImageView::SetImage(const pangolin::Image<unsigned char>& img, const
     return SetImage(img.ptr, img.w, img.h, img.pitch, glfmt, delayed_upload);
 }
 
+ImageView& ImageView::SetImage(const pangolin::Image<unsigned char>& img, const pangolin::PixelFormat& raw_fmt, bool delayed_upload )
+{
+    if(converter.MethodForFormat(raw_fmt) == GlPixelConverter::Method::None) {
+        return SetImage(img.ptr, img.w, img.h, img.pitch, pangolin::GlPixFormat(raw_fmt), delayed_upload);
+    }
+
+    pbo_ring.DiscardReady();
+
+    if(delayed_upload || !pangolin::GetBoundWindow())
+    {
+        std::lock_guard<std::mutex> l(texlock);
+        raw_to_load.Reinitialise(img.w, img.h, img.pitch);
+        std::memcpy(raw_to_load.ptr, img.ptr, img.pitch * img.h);
+        raw_fmt_to_load = raw_fmt;
+        raw_to_load_pending = true;
+        img_to_load_pending = false;
+        return *this;
+    }
+
+    {
+        std::lock_guard<std::mutex> l(texlock);
+        img_to_load_pending = false;
+        raw_to_load_pending = false;
+    }
+    UploadConverted(img, raw_fmt);
+    return *this;
+}
+
 ImageView& ImageView::SetImage(const pangolin::TypedImage& img, bool delayed_upload )
 {
-    return SetImage(img.ptr, img.w, img.h, img.pitch, pangolin::GlPixFormat(img.fmt), delayed_upload);
+    return SetImage(img, img.fmt, delayed_upload);
+}
+
+void ImageView::UploadConverted(const pangolin::Image<unsigned char>& img, const pangolin::PixelFormat& raw_fmt)
+{
+    const bool resized = !tex.tid || tex.width != (int)img.w || tex.height != (int)img.h;
+    converter.Convert(img, raw_fmt, tex);
+    if(resized) {
+        fmt = GlPixFormat(PixelFormatFromString("RGBA32"));
+        SetDimensions(img.w, img.h);
+        SetAspect((float)img.w / (float)img.h);
+    }
 }
 
 ImageView& ImageView::SetImage(const pangolin::GlTexture& texture)
@@ -193,18 +269,30 @@ ImageView& ImageView::SetImage(const pangolin::GlTexture& texture)
 
 void ImageView::LoadPending()
 {
-    if(img_to_load.ptr)
     {
-        // Scoped lock
-        texlock.lock();
-        SetImage(img_to_load, img_fmt_to_load, false);
-        img_to_load.Deallocate();
-        texlock.unlock();
+        std::lock_guard<std::mutex> l(texlock);
+        if(img_to_load_pending) {
+            UploadTexture(img_to_load.ptr, img_to_load.w, img_to_load.h, img_to_load.pitch, img_fmt_to_load);
+            img_to_load_pending = false;
+        }
+        if(raw_to_load_pending) {
+            UploadConverted(raw_to_load, raw_fmt_to_load);
+            raw_to_load_pending = false;
+        }
+    }
+
+    // Frames in the pixel buffer ring are uploaded asynchronously by the driver
+    // directly from the mapped buffer (data pointer is an offset into the PBO).
+    GlPixelUnpackRing::Frame frame;
+    if(pbo_ring.BeginUpload(frame)) {
+        UploadTexture(nullptr, frame.w, frame.h, frame.pitch, frame.fmt);
+        pbo_ring.EndUpload();
     }
 }
 
 ImageView& ImageView::Clear()
 {
+    pbo_ring.Free();
     tex.Delete();
     return *this;
 }
@@ -225,4 +313,12 @@ void ImageView::SetRenderOverlay(const bool& val) {
     overlayRender = val;
 }
 
+GlPixelUnpackRing::Stats ImageView::GetUploadStats() const {
+    return pbo_ring.GetStats();
+}
+
+void ImageView::ResetUploadStats() {
+    pbo_ring.ResetStats();
+}
+
 }
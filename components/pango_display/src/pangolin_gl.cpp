@@ -28,6 +28,7 @@
 #include "pangolin_gl.h"
 #include <pangolin/display/display.h>
 #include <pangolin/console/ConsoleView.h>
+#include <pangolin/gl/gltexturecache.h>
 
 namespace pangolin
 {
@@ -70,6 +71,8 @@ void PangolinGl::FinishFrame()
         SaveWindowNow(fv.first, fv.second);
     }
 
+    TextureCache::I().NextFrame();
+
     if(window) {
         window->SwapBuffers();
         window->ProcessEvents();
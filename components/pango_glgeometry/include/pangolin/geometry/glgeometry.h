@@ -30,6 +30,11 @@
 #include <pangolin/geometry/geometry.h>
 #include <pangolin/gl/gl.h>
 #include <pangolin/gl/glsl.h>
+#include <pangolin/utils/assert.h>
+
+#include <map>
+#include <string>
+#include <vector>
 
 namespace pangolin {
 
@@ -78,10 +83,97 @@ struct GlGeometry
     std::map<std::string, GlTexture> textures;
 };
 
+// Per-instance attributes for drawing many copies of a GlGeometry with one
+// instanced draw call per object. Shaders receive them through the attributes
+// 'mat4 instance_T' (instance to world) and, if colours were given,
+// 'vec4 instance_color'.
+struct GlGeometryInstances
+{
+    // T_wi: 16 floats per instance, column major. colors: 4 floats per instance or nullptr.
+    void Update(size_t num_instances, const float* T_wi, const float* colors = nullptr);
+
+#ifdef HAVE_EIGEN
+    void Update(const std::vector<Eigen::Matrix4f>& T_wi, const std::vector<Eigen::Vector4f>& colors = {})
+    {
+        PANGO_ENSURE(colors.empty() || colors.size() == T_wi.size());
+        Update(T_wi.size(), T_wi.empty() ? nullptr : T_wi[0].data(), colors.empty() ? nullptr : colors[0].data());
+    }
+#endif
+
+    size_t num_instances = 0;
+    bool has_colors = false;
+    GlBufferData transforms;
+    GlBufferData colors;
+};
+
+// Many geometries sharing the same vertex attributes, packed into common
+// buffers and drawn with a single glMultiDrawElementsIndirect call (or one
+// call per geometry where unsupported). Geometry i is drawn with its own
+// 'instance_T' / 'instance_color', so the same shader can be used as for
+// GlGeometryInstances. Textures are ignored.
+class GlGeometryBatch
+{
+public:
+    GlGeometryBatch();
+
+    // Append geom, returning its index. Its attributes must match those
+    // already in the batch by name, type and size.
+    size_t Add(const Geometry& geom, const float* T_wg = nullptr, const float* color = nullptr);
+
+    void SetTransform(size_t i, const float* T_wg);
+
+    void SetColor(size_t i, const float* color);
+
+    size_t Size() const;
+
+    void Clear();
+
+    // Upload anything that changed and draw all geometries. GL thread only.
+    void Draw(GlSlProgram& prog);
+
+protected:
+    struct Attribute
+    {
+        GLenum gltype;
+        size_t count_per_element;
+        size_t element_bytes;
+        std::vector<uint8_t> data;
+        GlBufferData bo;
+    };
+
+    // Layout defined by glMultiDrawElementsIndirect
+    struct Command
+    {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    std::map<std::string, Attribute> attributes;
+    std::vector<uint32_t> indices;
+    std::vector<Command> commands;
+    std::vector<float> transforms;
+    std::vector<float> colors;
+    size_t num_vertices;
+
+    GlBufferData ibo;
+    GlBufferData command_bo;
+    GlGeometryInstances instances;
+    bool geometry_dirty;
+    bool instances_dirty;
+    // -1: unknown, 0: unsupported, 1: supported
+    int multi_draw_indirect;
+};
+
 GlGeometry::Element ToGlGeometry(const Geometry::Element& el, GlBufferType buffertype);
 
 GlGeometry ToGlGeometry(const Geometry& geom);
 
 void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture *matcap);
 
+// Draw instances.num_instances copies of geom. Requires OpenGL 3.3.
+void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlGeometryInstances& instances, const GlTexture *matcap);
+
 }
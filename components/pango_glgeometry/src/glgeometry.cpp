@@ -29,8 +29,122 @@
 
 #include <pangolin/gl/glformattraits.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace pangolin {
 
+namespace {
+
+const char* INSTANCE_TRANSFORM_NAME = "instance_T";
+const char* INSTANCE_COLOR_NAME = "instance_color";
+
+bool HaveMultiDrawIndirect()
+{
+#ifdef HAVE_GLES
+    return false;
+#else
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    glGetError(); // Ignore error from legacy contexts which don't know these enums
+    if(major > 4 || (major == 4 && minor >= 3)) {
+        return true;
+    }
+#  ifdef HAVE_EPOXY
+    return epoxy_has_gl_extension("GL_ARB_multi_draw_indirect");
+#  elif defined(HAVE_GLEW)
+    return GLEW_ARB_multi_draw_indirect;
+#  else
+    return false;
+#  endif
+#endif
+}
+
+void UploadGrow(GlBufferData& bo, GlBufferType type, const void* data, size_t size_bytes)
+{
+    if(!size_bytes) return;
+    if(!bo.IsValid() || (size_t)bo.SizeBytes() < size_bytes) {
+        bo.Reinitialise(type, size_bytes, GL_DYNAMIC_DRAW, data);
+    }else{
+        bo.Upload(data, size_bytes);
+    }
+}
+
+// Point the per-instance attributes at instance first_instance onwards.
+// Attributes not used by the shader are skipped silently.
+void BindInstanceAttributes(GlSlProgram& prog, const GlGeometryInstances& instances, size_t first_instance)
+{
+    const GLint T_handle = glGetAttribLocation(prog.ProgramId(), INSTANCE_TRANSFORM_NAME);
+    if(T_handle >= 0) {
+        instances.transforms.Bind();
+        for(GLint c=0; c < 4; ++c) {
+            const size_t offset = (16*first_instance + 4*c) * sizeof(float);
+            glEnableVertexAttribArray(T_handle + c);
+            glVertexAttribPointer(T_handle + c, 4, GL_FLOAT, GL_FALSE, 16*sizeof(float), reinterpret_cast<uint8_t*>(offset));
+            glVertexAttribDivisor(T_handle + c, 1);
+        }
+        instances.transforms.Unbind();
+    }
+
+    const GLint color_handle = glGetAttribLocation(prog.ProgramId(), INSTANCE_COLOR_NAME);
+    if(color_handle >= 0) {
+        if(instances.has_colors) {
+            instances.colors.Bind();
+            glEnableVertexAttribArray(color_handle);
+            glVertexAttribPointer(color_handle, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<uint8_t*>(4*first_instance*sizeof(float)));
+            glVertexAttribDivisor(color_handle, 1);
+            instances.colors.Unbind();
+        }else{
+            glVertexAttrib4f(color_handle, 1.0f, 1.0f, 1.0f, 1.0f);
+        }
+    }
+}
+
+void UnbindInstanceAttributes(GlSlProgram& prog, const GlGeometryInstances& instances)
+{
+    const GLint T_handle = glGetAttribLocation(prog.ProgramId(), INSTANCE_TRANSFORM_NAME);
+    if(T_handle >= 0) {
+        for(GLint c=0; c < 4; ++c) {
+            glVertexAttribDivisor(T_handle + c, 0);
+            glDisableVertexAttribArray(T_handle + c);
+        }
+    }
+    const GLint color_handle = glGetAttribLocation(prog.ProgramId(), INSTANCE_COLOR_NAME);
+    if(color_handle >= 0 && instances.has_colors) {
+        glVertexAttribDivisor(color_handle, 0);
+        glDisableVertexAttribArray(color_handle);
+    }
+}
+
+int BindTextures(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
+{
+    int num_tex_bound = 0;
+    for(auto& tex : geom.textures) {
+        glActiveTexture(GL_TEXTURE0 + num_tex_bound);
+        tex.second.Bind();
+        prog.SetUniform(tex.first, (int)num_tex_bound);
+        ++num_tex_bound;
+    }
+
+    if(matcap) {
+        glActiveTexture(GL_TEXTURE0 + num_tex_bound);
+        matcap->Bind();
+        prog.SetUniform("matcap", (int)num_tex_bound);
+        ++num_tex_bound;
+    }
+    return num_tex_bound;
+}
+
+void UnbindTextures()
+{
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+}
+
 GlGeometry::Element ToGlGeometryElement(const Geometry::Element& el, GlBufferType buffertype)
 {
     GlGeometry::Element glel(buffertype, el.SizeBytes(), GL_STATIC_DRAW, el.ptr );
@@ -94,21 +208,7 @@ void UnbindGlElements(GlSlProgram& prog, const GlGeometry::Element& el)
 
 void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
 {
-    // Bind textures
-    int num_tex_bound = 0;
-    for(auto& tex : geom.textures) {
-        glActiveTexture(GL_TEXTURE0 + num_tex_bound);
-        tex.second.Bind();
-        prog.SetUniform(tex.first, (int)num_tex_bound);
-        ++num_tex_bound;
-    }
-
-    if(matcap) {
-        glActiveTexture(GL_TEXTURE0 + num_tex_bound);
-        matcap->Bind();
-        prog.SetUniform("matcap", (int)num_tex_bound);
-        ++num_tex_bound;
-    }
+    BindTextures(prog, geom, matcap);
 
     // Bind all attribute buffers
     for(auto& buffer : geom.buffers) {
@@ -134,9 +234,224 @@ void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlTexture* matcap)
         UnbindGlElements(prog, buffer.second);
     }
 
-    // Unbind textures
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glActiveTexture(GL_TEXTURE0);
+    UnbindTextures();
+}
+
+void GlDraw(GlSlProgram& prog, const GlGeometry& geom, const GlGeometryInstances& instances, const GlTexture* matcap)
+{
+    if(!instances.num_instances) return;
+
+    BindTextures(prog, geom, matcap);
+
+    for(auto& buffer : geom.buffers) {
+        BindGlElement(prog, buffer.second);
+    }
+    BindInstanceAttributes(prog, instances, 0);
+
+    for(auto& buffer : geom.objects) {
+        auto it_indices = buffer.second.attributes.find("vertex_indices");
+        if(it_indices != buffer.second.attributes.end()) {
+            buffer.second.Bind();
+            auto& attrib = it_indices->second;
+            glDrawElementsInstanced(
+               GL_TRIANGLES, attrib.count_per_element * attrib.num_elements,
+               attrib.gltype, reinterpret_cast<uint8_t*>(attrib.offset),
+               (GLsizei)instances.num_instances
+            );
+            buffer.second.Unbind();
+        }
+    }
+
+    UnbindInstanceAttributes(prog, instances);
+    for(auto& buffer : geom.buffers) {
+        UnbindGlElements(prog, buffer.second);
+    }
+
+    UnbindTextures();
+}
+
+void GlGeometryInstances::Update(size_t n, const float* T_wi, const float* cols)
+{
+    num_instances = n;
+    has_colors = (cols != nullptr);
+    UploadGrow(transforms, GlArrayBuffer, T_wi, n * 16 * sizeof(float));
+    if(cols) {
+        UploadGrow(colors, GlArrayBuffer, cols, n * 4 * sizeof(float));
+    }
+}
+
+GlGeometryBatch::GlGeometryBatch()
+    : num_vertices(0), geometry_dirty(true), instances_dirty(true), multi_draw_indirect(-1)
+{
+}
+
+size_t GlGeometryBatch::Add(const Geometry& geom, const float* T_wg, const float* color)
+{
+    // Validate and append vertex attributes
+    size_t geom_vertices = 0;
+    size_t num_attributes = 0;
+    for(const auto& b : geom.buffers) {
+        for(const auto& attrib_variant : b.second.attributes) {
+            visit([&](auto&& attrib){
+                using T = std::decay_t<decltype(attrib)>;
+                const GLenum gltype = GlFormatTraits<typename T::PixelType>::gltype;
+                const size_t element_bytes = attrib.w * sizeof(typename T::PixelType);
+
+                auto it = attributes.find(attrib_variant.first);
+                if(it == attributes.end()) {
+                    if(!commands.empty()) {
+                        throw std::runtime_error("GlGeometryBatch: Attribute '" + attrib_variant.first + "' not in other geometry.");
+                    }
+                    it = attributes.emplace(attrib_variant.first, Attribute()).first;
+                    it->second.gltype = gltype;
+                    it->second.count_per_element = attrib.w;
+                    it->second.element_bytes = element_bytes;
+                }else if(it->second.gltype != gltype || it->second.count_per_element != attrib.w) {
+                    throw std::runtime_error("GlGeometryBatch: Attribute '" + attrib_variant.first + "' doesn't match other geometry.");
+                }
+
+                if(num_attributes && attrib.h != geom_vertices) {
+                    throw std::runtime_error("GlGeometryBatch: Attributes have different numbers of vertices.");
+                }
+                geom_vertices = attrib.h;
+
+                std::vector<uint8_t>& data = it->second.data;
+                const size_t start = data.size();
+                data.resize(start + attrib.h * element_bytes);
+                for(size_t i=0; i < attrib.h; ++i) {
+                    std::memcpy(&data[start + i*element_bytes], attrib.RowPtr(i), element_bytes);
+                }
+            }, attrib_variant.second);
+            ++num_attributes;
+        }
+    }
+    if(num_attributes != attributes.size()) {
+        throw std::runtime_error("GlGeometryBatch: Geometry is missing attributes.");
+    }
+
+    // Append triangle indices from all objects, relative to this geometry's first vertex
+    Command cmd;
+    cmd.first_index = (GLuint)indices.size();
+    cmd.instance_count = 1;
+    cmd.base_vertex = (GLint)num_vertices;
+    cmd.base_instance = (GLuint)commands.size();
+    for(const auto& o : geom.objects) {
+        auto it_indices = o.second.attributes.find("vertex_indices");
+        if(it_indices != o.second.attributes.end()) {
+            visit([&](auto&& attrib){
+                for(size_t r=0; r < attrib.h; ++r) {
+                    for(size_t c=0; c < attrib.w; ++c) {
+                        indices.push_back((uint32_t)attrib.RowPtr(r)[c]);
+                    }
+                }
+            }, it_indices->second);
+        }
+    }
+    cmd.count = (GLuint)indices.size() - cmd.first_index;
+    commands.push_back(cmd);
+    num_vertices += geom_vertices;
+
+    const float identity[] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+    const float white[] = {1,1,1,1};
+    transforms.insert(transforms.end(), T_wg ? T_wg : identity, (T_wg ? T_wg : identity) + 16);
+    colors.insert(colors.end(), color ? color : white, (color ? color : white) + 4);
+
+    geometry_dirty = true;
+    instances_dirty = true;
+    return commands.size() - 1;
+}
+
+void GlGeometryBatch::SetTransform(size_t i, const float* T_wg)
+{
+    PANGO_ASSERT(i < commands.size());
+    std::copy(T_wg, T_wg + 16, &transforms[16*i]);
+    instances_dirty = true;
+}
+
+void GlGeometryBatch::SetColor(size_t i, const float* color)
+{
+    PANGO_ASSERT(i < commands.size());
+    std::copy(color, color + 4, &colors[4*i]);
+    instances_dirty = true;
+}
+
+size_t GlGeometryBatch::Size() const
+{
+    return commands.size();
+}
+
+void GlGeometryBatch::Clear()
+{
+    attributes.clear();
+    indices.clear();
+    commands.clear();
+    transforms.clear();
+    colors.clear();
+    num_vertices = 0;
+    geometry_dirty = true;
+    instances_dirty = true;
+}
+
+void GlGeometryBatch::Draw(GlSlProgram& prog)
+{
+#ifdef HAVE_GLES
+    PANGOLIN_UNUSED(prog);
+    throw std::runtime_error("GlGeometryBatch: Drawing requires desktop OpenGL.");
+#else
+    if(commands.empty()) return;
+
+    if(geometry_dirty) {
+        for(auto& a : attributes) {
+            UploadGrow(a.second.bo, GlArrayBuffer, a.second.data.data(), a.second.data.size());
+        }
+        UploadGrow(ibo, GlElementArrayBuffer, indices.data(), indices.size() * sizeof(uint32_t));
+        UploadGrow(command_bo, GlArrayBuffer, commands.data(), commands.size() * sizeof(Command));
+        geometry_dirty = false;
+    }
+    if(instances_dirty) {
+        instances.Update(commands.size(), transforms.data(), colors.data());
+        instances_dirty = false;
+    }
+
+    std::vector<GLint> handles;
+    for(auto& a : attributes) {
+        const GLint handle = glGetAttribLocation(prog.ProgramId(), a.first.c_str());
+        if(handle >= 0) {
+            a.second.bo.Bind();
+            glEnableVertexAttribArray(handle);
+            glVertexAttribPointer(handle, a.second.count_per_element, a.second.gltype, GL_TRUE, 0, 0);
+            handles.push_back(handle);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    ibo.Bind();
+
+    if(multi_draw_indirect < 0) {
+        multi_draw_indirect = HaveMultiDrawIndirect() ? 1 : 0;
+    }
+
+    if(multi_draw_indirect) {
+        BindInstanceAttributes(prog, instances, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_bo.bo);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, (GLsizei)commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }else{
+        // Without base instance support, offset the instance attributes instead
+        for(const Command& cmd : commands) {
+            BindInstanceAttributes(prog, instances, cmd.base_instance);
+            glDrawElementsInstancedBaseVertex(
+                GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT,
+                reinterpret_cast<uint8_t*>(cmd.first_index * sizeof(uint32_t)), 1, cmd.base_vertex
+            );
+        }
+    }
+
+    UnbindInstanceAttributes(prog, instances);
+    ibo.Unbind();
+    for(GLint handle : handles) {
+        glDisableVertexAttribArray(handle);
+    }
+#endif
 }
 
 }
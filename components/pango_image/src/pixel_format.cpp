@@ -48,6 +48,7 @@ const PixelFormat SupportedPixelFormats[] =
     {"BGR48", 3, {16,16,16}, 48, 16, false},
     {"YUYV422", 3, {4,2,2}, 16, 8, false},
     {"UYVY422", 3, {4,2,2}, 16, 8, false},
+    {"NV12", 3, {8,2,2}, 12, 8, true},
     {"RGBA32",  4, {8,8,8,8}, 32, 8, false},
     {"BGRA32",  4, {8,8,8,8}, 32, 8, false},
     {"RGBA64",  4, {16,16,16,16}, 64, 16, false},
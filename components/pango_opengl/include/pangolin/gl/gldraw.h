@@ -28,6 +28,7 @@
 #pragma once
 
 #include <pangolin/gl/glinclude.h>
+#include <pangolin/gl/gldrawbatch.h>
 #include <pangolin/gl/glformattraits.h>
 #include <pangolin/gl/opengl_render_state.h>
 
@@ -46,6 +47,22 @@
 namespace pangolin
 {
 
+// Record the untextured drawing functions below into batch instead of drawing
+// them, for the calling thread, until glEndDrawBatch(). Colour is taken from
+// the current glColor and glSetFrameOfReference() / glUnsetFrameOfReference()
+// are applied to the batch transform. Other changes to the modelview matrix
+// while recording are not seen by the batch.
+void glBeginDrawBatch(GlDrawBatch& batch);
+
+// As above, but record in colour, changed with batch.SetColour(), instead of
+// querying glColor for every primitive. Recording then needs no GL context.
+void glBeginDrawBatch(GlDrawBatch& batch, const Colour& colour);
+
+void glEndDrawBatch();
+
+// Batch being recorded into on this thread, or nullptr
+GlDrawBatch* glCurrentDrawBatch();
+
 // h [0,360)
 // s [0,1]
 // v [0,1]
@@ -90,6 +107,14 @@ inline void glDrawVertices(
         PANGO_ENSURE(vertex_ptr != nullptr);
         PANGO_ENSURE(mode != GL_LINES || num_vertices % 2 == 0, "number of vertices (%) must be even in GL_LINES mode", num_vertices );
 
+        if(GlDrawBatch* batch = glCurrentDrawBatch()) {
+            if(batch->FollowsGlColour()) {
+                batch->SetColourFromGl();
+            }
+            batch->AddVertices(mode, num_vertices, GlFormatTraits<T>::gltype, vertex_ptr, elements_per_vertex, vertex_stride_bytes);
+            return;
+        }
+
         glVertexPointer((GLint)elements_per_vertex, GlFormatTraits<T>::gltype, (GLsizei)vertex_stride_bytes, vertex_ptr);
         glEnableClientState(GL_VERTEX_ARRAY);
         glDrawArrays(mode, 0, (GLsizei)num_vertices);
@@ -105,7 +130,13 @@ inline void glDrawColoredVertices(
     size_t vertex_stride_bytes = 0,
     size_t color_stride_bytes = 0
 ) {
-    if(color_ptr) {
+    GlDrawBatch* batch = glCurrentDrawBatch();
+    if(color_ptr && batch) {
+        batch->AddVertices(
+            mode, num_vertices, GlFormatTraits<TV>::gltype, vertex_ptr, elements_per_vertex, vertex_stride_bytes,
+            GlFormatTraits<TC>::gltype, color_ptr, elements_per_color, color_stride_bytes
+        );
+    }else if(color_ptr) {
         glColorPointer((GLint)elements_per_color, GlFormatTraits<TC>::gltype, (GLsizei)color_stride_bytes, color_ptr);
         glEnableClientState(GL_COLOR_ARRAY);
         glDrawVertices<TV>(num_vertices, vertex_ptr, mode, elements_per_vertex, vertex_stride_bytes);
@@ -141,6 +172,11 @@ inline void glDrawCross( GLfloat x, GLfloat y, GLfloat z, GLfloat rad )
 
 inline void glDrawAxis(float s)
 {
+    if(GlDrawBatch* batch = glCurrentDrawBatch()) {
+        batch->AddAxis(s);
+        return;
+    }
+
     const GLfloat cols[]  = { 1,0,0, 1,0,0, 0,1,0, 0,1,0, 0,0,1, 0,0,1 };
     const GLfloat verts[] = { 0,0,0, s,0,0, 0,0,0, 0,s,0, 0,0,0, 0,0,s };
     glDrawColoredVertices<float,float>(6, verts, cols, GL_LINES, 3, 3);
@@ -184,11 +220,8 @@ inline void glDrawCircle( GLfloat x, GLfloat y, GLfloat rad )
     }
     
     // Render filled shape and outline (to make it look smooth)
-    glVertexPointer(2, GL_FLOAT, 0, verts);
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, N);
-    glDrawArrays(GL_LINE_STRIP, 0, N);
-    glDisableClientState(GL_VERTEX_ARRAY);
+    glDrawVertices<float>(N, verts, GL_TRIANGLE_FAN, 2);
+    glDrawVertices<float>(N, verts, GL_LINE_STRIP, 2);
 }
 
 inline void glDrawColouredCube(GLfloat axis_min=-0.5f, GLfloat axis_max = +0.5f)
@@ -252,6 +285,14 @@ inline void glDraw_z0(GLfloat scale, int grid)
 
 inline void glDrawFrustum( GLfloat u0, GLfloat v0, GLfloat fu, GLfloat fv, int w, int h, GLfloat scale )
 {
+    if(GlDrawBatch* batch = glCurrentDrawBatch()) {
+        if(batch->FollowsGlColour()) {
+            batch->SetColourFromGl();
+        }
+        batch->AddFrustum(u0, v0, fu, fv, w, h, scale);
+        return;
+    }
+
     const GLfloat xl = scale * u0;
     const GLfloat xh = scale * (w*fu + u0);
     const GLfloat yl = scale * v0;
@@ -396,6 +437,10 @@ inline void glDrawCirclePerimeter( const Eigen::Vector2d& p, double radius = 5.0
 
 inline void glSetFrameOfReference( const Eigen::Matrix4f& T_wf )
 {
+    if(GlDrawBatch* batch = glCurrentDrawBatch()) {
+        batch->PushTransform(T_wf.data());
+        return;
+    }
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
     glMultMatrixf( T_wf.data() );
@@ -403,6 +448,10 @@ inline void glSetFrameOfReference( const Eigen::Matrix4f& T_wf )
 
 inline void glSetFrameOfReference( const Eigen::Matrix4d& T_wf )
 {
+    if(GlDrawBatch* batch = glCurrentDrawBatch()) {
+        batch->PushTransform(OpenGlMatrix(T_wf));
+        return;
+    }
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
 #ifndef HAVE_GLES
@@ -415,6 +464,10 @@ inline void glSetFrameOfReference( const Eigen::Matrix4d& T_wf )
 
 inline void glSetFrameOfReference( const pangolin::OpenGlMatrix& T_wf )
 {
+    if(GlDrawBatch* batch = glCurrentDrawBatch()) {
+        batch->PushTransform(T_wf);
+        return;
+    }
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
     glMultMatrixd( T_wf.m );
@@ -422,6 +475,10 @@ inline void glSetFrameOfReference( const pangolin::OpenGlMatrix& T_wf )
 
 inline void glUnsetFrameOfReference()
 {
+    if(GlDrawBatch* batch = glCurrentDrawBatch()) {
+        batch->PopTransform();
+        return;
+    }
     glPopMatrix();
 }
 
@@ -0,0 +1,200 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <pangolin/gl/colour.h>
+#include <pangolin/gl/gl.h>
+#include <pangolin/gl/glsl.h>
+#include <pangolin/gl/opengl_render_state.h>
+
+#include <array>
+#include <memory>
+#include <vector>
+
+namespace pangolin
+{
+
+// Retained collection of untextured primitives which is submitted in a
+// handful of draw calls. Points, lines and triangles are accumulated into
+// typed vertex buffers, and camera frustums and coordinate axes are stored as
+// per-instance transforms drawn with instancing. Buffers are kept between
+// frames and only re-uploaded after the batch has changed, so static scenery
+// can be recorded once and drawn every frame.
+//
+// Primitives are recorded relative to the top of the batch transform stack
+// (identity by default) and are drawn with the modelview projection given to
+// Draw(). The free functions in gldraw.h can be redirected into a batch with
+// glBeginDrawBatch() / glEndDrawBatch().
+//
+// Requires desktop OpenGL 3.3 / GLSL 1.30 for drawing. Recording through the
+// methods below has no GL dependency, except SetColourFromGl(), and may be
+// done from any thread, though not concurrently. The redirected gldraw.h
+// functions read glColor unless the batch colour is given explicitly.
+class PANGOLIN_EXPORT GlDrawBatch
+{
+public:
+    struct Stats
+    {
+        size_t vertices = 0;
+        size_t instances = 0;
+        size_t draw_calls = 0;
+        size_t bytes_uploaded = 0;
+    };
+
+    GlDrawBatch();
+
+    // Remove all recorded primitives. Buffer capacity is kept.
+    void Clear();
+
+    bool Empty() const;
+
+    // Colour applied to subsequently recorded primitives.
+    void SetColour(float r, float g, float b, float a = 1.0f);
+
+    void SetColour(const Colour& c);
+
+    // Take the colour from the current fixed-function glColor state. This is
+    // how the redirected gldraw.h functions pick up colour, unless disabled
+    // with FollowGlColour(false). Queries GL, so GL thread only.
+    void SetColourFromGl();
+
+    // Whether the redirected gldraw.h functions call SetColourFromGl() before
+    // each primitive (default true). Otherwise they record in the colour last
+    // given to SetColour(), without touching GL.
+    void FollowGlColour(bool follow);
+
+    bool FollowsGlColour() const;
+
+    // Post-multiply the current transform by T (column major) and push it.
+    void PushTransform(const OpenGlMatrix& T);
+
+    void PushTransform(const float* T);
+
+    void PopTransform();
+
+    // Record num_vertices vertices of 2 or 3 components of gltype as read by
+    // glVertexPointer(). Any of GL_POINTS, GL_LINES, GL_LINE_STRIP,
+    // GL_LINE_LOOP, GL_TRIANGLES, GL_TRIANGLE_STRIP and GL_TRIANGLE_FAN.
+    // Optional colours (3 or 4 components, normalized if integral) override
+    // the current colour per vertex.
+    void AddVertices(
+        GLenum mode, size_t num_vertices,
+        GLenum gltype, const void* vertex_ptr, size_t elements_per_vertex, size_t vertex_stride_bytes = 0,
+        GLenum colour_gltype = 0, const void* colour_ptr = nullptr, size_t elements_per_colour = 4, size_t colour_stride_bytes = 0
+    );
+
+    void AddPoint(float x, float y, float z = 0.0f);
+
+    void AddLine(float x1, float y1, float z1, float x2, float y2, float z2);
+
+    void AddTriangle(const float* p1, const float* p2, const float* p3);
+
+    // Unit RGB coordinate axes of length scale, drawn as one instance.
+    void AddAxis(float scale);
+
+    void AddAxis(const OpenGlMatrix& T_wf, float scale);
+
+    // Camera frustum with inverse intrinsics (fu, fv, u0, v0) as in glDrawFrustum(),
+    // drawn as one instance in the current colour.
+    void AddFrustum(float u0, float v0, float fu, float fv, int w, int h, float scale);
+
+    void AddFrustum(const OpenGlMatrix& T_wf, float u0, float v0, float fu, float fv, int w, int h, float scale);
+
+    // Upload any changes and draw everything with the given modelview projection.
+    // GL thread only.
+    void Draw(const OpenGlMatrix& mvp);
+
+#ifndef HAVE_GLES
+    // Draw using the current fixed-function projection and modelview matrices.
+    void Draw();
+#endif
+
+    // Statistics for the most recent Draw()
+    const Stats& LastDrawStats() const;
+
+    // Release GL resources. GL thread only.
+    void Free();
+
+protected:
+    using Mat4 = std::array<float,16>;
+
+    struct Vertex
+    {
+        float p[3];
+        unsigned char c[4];
+    };
+
+    struct Instance
+    {
+        float T[16];
+        float params[4];
+        unsigned char c[4];
+    };
+
+    enum Shape { ShapeAxis = 1, ShapeFrustum = 2 };
+
+    struct GpuBuffer
+    {
+        GlBufferData bo;
+        bool dirty = true;
+    };
+
+    void PushVertex(std::vector<Vertex>& vs, const float* p, const unsigned char* c);
+    void PushInstance(std::vector<Instance>& is, const Mat4& T, float scale, const float* params);
+    GlSlProgram& Program(int shape);
+    size_t Upload(GpuBuffer& buffer, const void* data, size_t size_bytes);
+    void SetupVao();
+
+    // Recorded geometry, positions already transformed
+    std::vector<Vertex> points;
+    std::vector<Vertex> lines;
+    std::vector<Vertex> triangles;
+    std::vector<Instance> axes;
+    std::vector<Instance> frustums;
+
+    std::vector<Mat4> transforms;
+    unsigned char colour[4];
+    bool follow_gl_colour;
+
+    // GL resources, created lazily on first Draw()
+    GpuBuffer vbo_points;
+    GpuBuffer vbo_lines;
+    GpuBuffer vbo_triangles;
+    GpuBuffer vbo_axes;
+    GpuBuffer vbo_frustums;
+    GlBufferData vbo_axis_template;
+    GlBufferData vbo_frustum_template;
+    std::unique_ptr<GlVertexArrayObject> vao;
+    std::unique_ptr<GlSlProgram> prog_vertices;
+    std::unique_ptr<GlSlProgram> prog_axis;
+    std::unique_ptr<GlSlProgram> prog_frustum;
+
+    Stats stats;
+};
+
+}
@@ -0,0 +1,97 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <pangolin/gl/gl.h>
+#include <pangolin/gl/glsl.h>
+#include <pangolin/image/image.h>
+#include <pangolin/image/pixel_format.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace pangolin
+{
+
+// Converts raw camera buffers into RGBA textures on the GPU. The raw bytes are
+// uploaded unchanged and a fragment shader performs the per-pixel work
+// (YUV to RGB, demosaicing, bit unpacking and offset / scale), writing the
+// result into a texture through a framebuffer object.
+//
+// Requires desktop OpenGL 3.0 / GLSL 1.30. On GLES MethodForFormat() always
+// returns None and callers should convert on the CPU as before.
+class PANGOLIN_EXPORT GlPixelConverter
+{
+public:
+    enum class Method
+    {
+        None,       // Format maps directly to a GlPixFormat
+        YUYV,       // YUYV422
+        UYVY,       // UYVY422
+        NV12,       // Y plane followed by interleaved UV plane at half resolution
+        Bayer,      // GRAY8 / GRAY16LE colour filter array, see SetBayerPattern()
+        Packed10,   // GRAY10, 4 pixels in 5 bytes
+        Packed12,   // GRAY12, 2 pixels in 3 bytes
+        Gray16      // GRAY16LE holding fewer than 16 significant bits
+    };
+
+    GlPixelConverter();
+
+    //! Conversion shader to use for fmt given the current bayer pattern,
+    //! or None if the format can be uploaded directly.
+    Method MethodForFormat(const PixelFormat& fmt) const;
+
+    //! One of "RGGB", "BGGR", "GRBG", "GBRG" to demosaic single channel 8 and
+    //! 16 bit images, or empty to treat them as greyscale (default).
+    void SetBayerPattern(const std::string& pattern);
+
+    const std::string& BayerPattern() const;
+
+    //! Offset and scale applied to normalized intensities before output
+    void SetOffsetScale(float offset, float scale);
+
+    //! Upload img and render its RGBA conversion into out, (re)initialising out
+    //! if it is not an RGBA8 texture of matching size. GL thread only.
+    void Convert(const Image<unsigned char>& img, const PixelFormat& fmt, GlTexture& out);
+
+protected:
+    GlSlProgram& Program(Method method);
+
+    std::string bayer_pattern;
+    float offset;
+    float scale;
+
+    GlTexture raw;
+    GlFramebuffer fbo;
+    GLuint fbo_tex;
+    std::unique_ptr<GlVertexArrayObject> vao;
+    std::map<Method, std::unique_ptr<GlSlProgram>> programs;
+};
+
+}
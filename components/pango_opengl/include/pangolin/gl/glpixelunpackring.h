@@ -0,0 +1,139 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <pangolin/gl/glplatform.h>
+#include <pangolin/gl/glpixformat.h>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace pangolin
+{
+
+// Ring of persistently mapped pixel unpack buffers for streaming images into
+// textures. Producers on any thread write pixels straight into GPU visible
+// memory with BeginWrite() / EndWrite(). The thread owning the GL context
+// uploads the newest complete frame with BeginUpload() / EndUpload(), which
+// fences the buffer so that it isn't handed out again until the GPU is done.
+//
+// Buffers are (re)allocated lazily from BeginUpload() once a producer has asked
+// for a larger size. Until then, or if the context does not support
+// GL_ARB_buffer_storage, BeginWrite() returns nullptr and callers should fall
+// back to a CPU copy.
+class PANGOLIN_EXPORT GlPixelUnpackRing
+{
+public:
+    struct Frame
+    {
+        size_t w;
+        size_t h;
+        size_t pitch;
+        GlPixFormat fmt;
+    };
+
+    struct Stats
+    {
+        size_t frames_uploaded = 0;
+        size_t frames_dropped = 0;
+        size_t bytes_uploaded = 0;
+        // Time between EndWrite() and the texture upload being issued
+        double mean_latency_ms = 0.0;
+        double max_latency_ms = 0.0;
+    };
+
+    GlPixelUnpackRing(size_t num_slots = 4);
+
+    // Must be destroyed with the owning GL context bound (as with GlTexture)
+    ~GlPixelUnpackRing();
+
+    // Returns pointer to at least size_bytes of mapped memory and sets slot, or
+    // nullptr if no buffer is currently available. May be called from any thread.
+    unsigned char* BeginWrite(size_t size_bytes, int& slot);
+
+    // Publish the frame written to slot. May be called from any thread.
+    void EndWrite(int slot, const Frame& frame);
+
+    // Abandon the write to slot without publishing it.
+    void CancelWrite(int slot);
+
+    // Drop frames written but not yet uploaded, for when a newer frame has
+    // reached the texture another way. May be called from any thread.
+    void DiscardReady();
+
+    // GL thread only. Allocates requested buffers, recycles buffers whose
+    // transfer has completed and, if a new frame is available, binds its buffer
+    // to GL_PIXEL_UNPACK_BUFFER and returns true. The caller should issue its
+    // glTex(Sub)Image call with a null data pointer followed by EndUpload().
+    bool BeginUpload(Frame& frame);
+
+    // GL thread only. Fence the buffer bound by BeginUpload() and unbind it.
+    void EndUpload();
+
+    // Release all GL resources. GL thread only.
+    void Free();
+
+    Stats GetStats() const;
+
+    void ResetStats();
+
+protected:
+    enum class SlotState { Free, Writing, Ready, InFlight };
+
+    struct Slot
+    {
+        GLuint pbo = 0;
+        unsigned char* ptr = nullptr;
+#ifdef HAVE_GLES
+        void* fence = nullptr;
+#else
+        GLsync fence = 0;
+#endif
+        SlotState state = SlotState::Free;
+        size_t seq = 0;
+        Frame frame;
+        std::chrono::steady_clock::time_point written;
+    };
+
+    void Reallocate(size_t size_bytes);
+    void RetireCompleted(bool block);
+
+    mutable std::mutex lock;
+    std::vector<Slot> slots;
+    size_t buffer_bytes;
+    size_t requested_bytes;
+    size_t next_seq;
+    int uploading;
+    // -1: unknown, 0: unsupported, 1: supported
+    int supported;
+    Stats stats;
+    double total_latency_ms;
+};
+
+}
@@ -32,41 +32,44 @@
 #include <pangolin/gl/glpixformat.h>
 #include <pangolin/image/image.h>
 
-#include <memory>
 #include <map>
+#include <memory>
+#include <mutex>
 
 namespace pangolin
 {
 
+// Pool of scratch textures for uploading and displaying images. Textures are
+// keyed by format and power-of-two size class so that differently sized images
+// can share allocations, and least recently used textures are released once
+// the pool exceeds its memory budget. Textures used since the last call to
+// NextFrame() are never evicted, so references returned by GlTex() remain
+// valid at least until the end of the frame.
+//
+// Access is serialised with a mutex. As GL objects belong to a context,
+// textures are only usable from contexts sharing objects with the one that
+// created them and eviction must happen with such a context bound.
 class PANGOLIN_EXPORT TextureCache
 {
 public:
+    struct Stats
+    {
+        // Counters for the most recently completed frame
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t bytes_allocated = 0;
+
+        // Pool state at the end of that frame
+        size_t textures_resident = 0;
+        size_t bytes_resident = 0;
+    };
+
     static TextureCache& I();
 
-    GlTexture& GlTex(GLsizei w, GLsizei h, GLint internal_format, GLint glformat, GLenum gltype)
-    {
-        const long key =
-            (((long)internal_format)<<20) ^
-            (((long)glformat)<<10) ^ gltype;
-
-        // Lookup texture
-        std::shared_ptr<GlTexture>& ptex = texture_map[key];
-        if(!ptex) {
-            ptex = std::shared_ptr<GlTexture>(new GlTexture());
-        }
-        GlTexture& tex = *ptex;
-
-        // Initialise if it didn't already exist or the size was too small
-        if(!tex.tid || tex.width < w || tex.height < h) {
-            tex.Reinitialise(
-                std::max(tex.width,w), std::max(tex.height,h),
-                internal_format, default_sampling_linear, 0,
-                glformat, gltype
-            );
-        }
-
-        return tex;
-    }
+    // Returns a texture at least w x h of the given format. Only the region
+    // (0,0,w,h) is meaningful; its contents are undefined until uploaded.
+    GlTexture& GlTex(GLsizei w, GLsizei h, GLint internal_format, GLint glformat, GLenum gltype);
 
     template<typename T>
     GlTexture& GlTex(GLsizei w, GLsizei h)
@@ -78,15 +81,57 @@ public:
         );
     }
 
+    // Mark the end of a frame, evicting textures to within budget and updating
+    // FrameStats(). Called by pangolin::FinishFrame().
+    void NextFrame();
+
+    // Approximate video memory the pool may hold across frames (default 256MB)
+    void SetBudgetBytes(size_t bytes);
+
+    size_t BudgetBytes() const;
+
+    Stats FrameStats() const;
+
+    // Release all textures. Requires a context sharing the pool's textures.
+    void Clear();
+
 protected:
+    struct Key
+    {
+        GLint internal_format;
+        GLint glformat;
+        GLenum gltype;
+        GLsizei w;
+        GLsizei h;
+
+        bool operator<(const Key& o) const;
+    };
+
+    struct Entry
+    {
+        std::unique_ptr<GlTexture> tex;
+        size_t bytes;
+        size_t last_use;
+        size_t last_frame;
+    };
+
+    // Evict least recently used textures not used this frame until bytes_resident + incoming_bytes fits budget
+    void EvictToBudget(size_t incoming_bytes);
+
     bool default_sampling_linear;
-    std::map<long, std::shared_ptr<GlTexture> > texture_map;
+    std::map<Key, Entry> texture_map;
+
+    mutable std::mutex lock;
+    size_t budget_bytes;
+    size_t bytes_resident;
+    size_t use_counter;
+    size_t frame;
+    GLint max_texture_size;
+    Stats current;
+    Stats last_frame;
 
     // Protected constructor
-    TextureCache()
-        : default_sampling_linear(true)
-    {
-    }
+    TextureCache();
 };
 
 template<typename T>
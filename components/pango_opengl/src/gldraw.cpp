@@ -27,11 +27,42 @@
 
 
 #include <pangolin/gl/gldraw.h>
+#include <pangolin/utils/assert.h>
 #include <pangolin/utils/timer.h>
 
 namespace pangolin
 {
 
+namespace
+{
+thread_local GlDrawBatch* current_draw_batch = nullptr;
+}
+
+void glBeginDrawBatch(GlDrawBatch& batch)
+{
+    PANGO_ASSERT(!current_draw_batch, "glBeginDrawBatch() calls can't be nested");
+    batch.FollowGlColour(true);
+    current_draw_batch = &batch;
+}
+
+void glBeginDrawBatch(GlDrawBatch& batch, const Colour& colour)
+{
+    PANGO_ASSERT(!current_draw_batch, "glBeginDrawBatch() calls can't be nested");
+    batch.FollowGlColour(false);
+    batch.SetColour(colour);
+    current_draw_batch = &batch;
+}
+
+void glEndDrawBatch()
+{
+    current_draw_batch = nullptr;
+}
+
+GlDrawBatch* glCurrentDrawBatch()
+{
+    return current_draw_batch;
+}
+
 void glRecordGraphic(float x, float y, float radius)
 {
     const int ticks = static_cast<int>(TimeNow_s());
@@ -0,0 +1,560 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/gl/gldrawbatch.h>
+#include <pangolin/utils/assert.h>
+#include <pangolin/utils/log.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+#ifdef HAVE_GLES_2
+#  include <pangolin/gl/compat/gl2engine.h>
+#endif
+
+namespace pangolin
+{
+
+namespace
+{
+
+// Plain vertices are already in batch coordinates. Instanced shapes expand a
+// small template of line vertices by a per-instance transform (which includes
+// the scale) and, for frustums, the image plane extents (x0,y0,x1,y1) at z=1.
+const char* draw_batch_shader = R"Shader(
+@start vertex
+#version 130
+#expect SHAPE
+
+#define SHAPE_VERTICES 0
+#define SHAPE_AXIS     1
+#define SHAPE_FRUSTUM  2
+
+uniform mat4 u_mvp;
+in vec3 a_position;
+in vec4 a_color;
+#if SHAPE != SHAPE_VERTICES
+in mat4 a_instance_T;
+in vec4 a_instance_params;
+in vec4 a_instance_color;
+#endif
+out vec4 v_color;
+
+void main() {
+#if SHAPE == SHAPE_VERTICES
+    gl_Position = u_mvp * vec4(a_position, 1.0);
+    v_color = a_color;
+#else
+#  if SHAPE == SHAPE_FRUSTUM
+    vec4 p = a_instance_params;
+    vec3 local = a_position.z * vec3(mix(p.x, p.z, a_position.x), mix(p.y, p.w, a_position.y), 1.0);
+#  else
+    vec3 local = a_position;
+#  endif
+    gl_Position = u_mvp * (a_instance_T * vec4(local, 1.0));
+    v_color = a_color * a_instance_color;
+#endif
+}
+
+@start fragment
+#version 130
+in vec4 v_color;
+out vec4 FragColor;
+
+void main() {
+    FragColor = v_color;
+}
+)Shader";
+
+const GLuint LOCATION_INSTANCE_T      = 4; // Occupies 4 consecutive locations
+const GLuint LOCATION_INSTANCE_PARAMS = 8;
+const GLuint LOCATION_INSTANCE_COLOUR = 9;
+
+struct TemplateVertex
+{
+    float p[3];
+    unsigned char c[4];
+};
+
+const TemplateVertex axis_template[] = {
+    {{0,0,0},{255,0,0,255}}, {{1,0,0},{255,0,0,255}},
+    {{0,0,0},{0,255,0,255}}, {{0,1,0},{0,255,0,255}},
+    {{0,0,0},{0,0,255,255}}, {{0,0,1},{0,0,255,255}}
+};
+
+// (a,b,z): image plane corner (a,b) in [0,1]^2 at depth z, or the camera centre
+const TemplateVertex frustum_template[] = {
+    {{0,0,1},{255,255,255,255}}, {{1,0,1},{255,255,255,255}},
+    {{1,0,1},{255,255,255,255}}, {{1,1,1},{255,255,255,255}},
+    {{1,1,1},{255,255,255,255}}, {{0,1,1},{255,255,255,255}},
+    {{0,1,1},{255,255,255,255}}, {{0,0,1},{255,255,255,255}},
+    {{0,0,0},{255,255,255,255}}, {{0,0,1},{255,255,255,255}},
+    {{0,0,0},{255,255,255,255}}, {{1,0,1},{255,255,255,255}},
+    {{0,0,0},{255,255,255,255}}, {{1,1,1},{255,255,255,255}},
+    {{0,0,0},{255,255,255,255}}, {{0,1,1},{255,255,255,255}}
+};
+
+const size_t axis_template_size = sizeof(axis_template) / sizeof(TemplateVertex);
+const size_t frustum_template_size = sizeof(frustum_template) / sizeof(TemplateVertex);
+
+unsigned char ToByte(float v)
+{
+    return (unsigned char)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+template<typename T>
+void ReadComponents(const void* ptr, size_t stride_bytes, size_t first, size_t num, size_t count, float* out, bool normalize)
+{
+    const size_t stride = stride_bytes ? stride_bytes : count * sizeof(T);
+    const float norm = (normalize && std::numeric_limits<T>::is_integer) ? 1.0f / (float)std::numeric_limits<T>::max() : 1.0f;
+    for(size_t i=0; i < num; ++i) {
+        const T* v = (const T*)((const unsigned char*)ptr + (first+i)*stride);
+        for(size_t c=0; c < count; ++c) {
+            out[4*i+c] = (float)v[c] * norm;
+        }
+    }
+}
+
+// Reads elements [first, first+num) of count components of gltype into
+// 4-strided floats
+void ReadComponents(GLenum gltype, const void* ptr, size_t stride_bytes, size_t first, size_t num, size_t count, float* out, bool normalize)
+{
+    PANGO_ENSURE(count >= 1 && count <= 4, "Unsupported component count (%)", count);
+    switch(gltype) {
+    case GL_BYTE:           ReadComponents<signed char>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    case GL_UNSIGNED_BYTE:  ReadComponents<unsigned char>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    case GL_SHORT:          ReadComponents<short>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    case GL_UNSIGNED_SHORT: ReadComponents<unsigned short>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    case GL_INT:            ReadComponents<int>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    case GL_UNSIGNED_INT:   ReadComponents<unsigned int>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    case GL_FLOAT:          ReadComponents<float>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    case GL_DOUBLE:         ReadComponents<double>(ptr, stride_bytes, first, num, count, out, normalize); break;
+    default:
+        throw std::runtime_error("GlDrawBatch: Unsupported vertex type.");
+    }
+}
+
+}
+
+GlDrawBatch::GlDrawBatch()
+    : transforms(1, Mat4{1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1}), colour{255,255,255,255}, follow_gl_colour(true)
+{
+}
+
+void GlDrawBatch::Clear()
+{
+    points.clear();
+    lines.clear();
+    triangles.clear();
+    axes.clear();
+    frustums.clear();
+    for(GpuBuffer* b : {&vbo_points, &vbo_lines, &vbo_triangles, &vbo_axes, &vbo_frustums}) {
+        b->dirty = true;
+    }
+}
+
+bool GlDrawBatch::Empty() const
+{
+    return points.empty() && lines.empty() && triangles.empty() && axes.empty() && frustums.empty();
+}
+
+void GlDrawBatch::SetColour(float r, float g, float b, float a)
+{
+    colour[0] = ToByte(r);
+    colour[1] = ToByte(g);
+    colour[2] = ToByte(b);
+    colour[3] = ToByte(a);
+}
+
+void GlDrawBatch::SetColour(const Colour& c)
+{
+    SetColour(c.r, c.g, c.b, c.a);
+}
+
+void GlDrawBatch::SetColourFromGl()
+{
+#if defined(HAVE_GLES_2)
+    const float* c = glEngine().color;
+    SetColour(c[0], c[1], c[2], c[3]);
+#elif !defined(HAVE_GLES)
+    GLfloat c[4];
+    glGetFloatv(GL_CURRENT_COLOR, c);
+    SetColour(c[0], c[1], c[2], c[3]);
+#endif
+}
+
+void GlDrawBatch::FollowGlColour(bool follow)
+{
+    follow_gl_colour = follow;
+}
+
+bool GlDrawBatch::FollowsGlColour() const
+{
+    return follow_gl_colour;
+}
+
+void GlDrawBatch::PushTransform(const OpenGlMatrix& T)
+{
+    float Tf[16];
+    std::copy(T.m, T.m + 16, Tf);
+    PushTransform(Tf);
+}
+
+void GlDrawBatch::PushTransform(const float* T)
+{
+    const Mat4& A = transforms.back();
+    Mat4 AT;
+    for(int c=0; c < 4; ++c) {
+        for(int r=0; r < 4; ++r) {
+            float s = 0.0f;
+            for(int k=0; k < 4; ++k) {
+                s += A[4*k+r] * T[4*c+k];
+            }
+            AT[4*c+r] = s;
+        }
+    }
+    transforms.push_back(AT);
+}
+
+void GlDrawBatch::PopTransform()
+{
+    PANGO_ASSERT(transforms.size() > 1, "Unbalanced GlDrawBatch::PopTransform()");
+    transforms.pop_back();
+}
+
+void GlDrawBatch::PushVertex(std::vector<Vertex>& vs, const float* p, const unsigned char* c)
+{
+    const Mat4& T = transforms.back();
+    Vertex v;
+    for(int r=0; r < 3; ++r) {
+        v.p[r] = T[r]*p[0] + T[4+r]*p[1] + T[8+r]*p[2] + T[12+r];
+    }
+    std::copy(c, c+4, v.c);
+    vs.push_back(v);
+}
+
+void GlDrawBatch::PushInstance(std::vector<Instance>& is, const Mat4& T, float scale, const float* params)
+{
+    Instance inst;
+    for(int i=0; i < 12; ++i) inst.T[i] = T[i] * scale;
+    for(int i=12; i < 16; ++i) inst.T[i] = T[i];
+    for(int i=0; i < 4; ++i) inst.params[i] = params ? params[i] : 0.0f;
+    std::copy(colour, colour+4, inst.c);
+    is.push_back(inst);
+}
+
+void GlDrawBatch::AddVertices(
+    GLenum mode, size_t num_vertices,
+    GLenum gltype, const void* vertex_ptr, size_t elements_per_vertex, size_t vertex_stride_bytes,
+    GLenum colour_gltype, const void* colour_ptr, size_t elements_per_colour, size_t colour_stride_bytes
+) {
+    if(num_vertices == 0) return;
+    PANGO_ENSURE(vertex_ptr != nullptr);
+
+    std::vector<Vertex>* vs = nullptr;
+    switch(mode) {
+    case GL_POINTS: vs = &points; vbo_points.dirty = true; break;
+    case GL_LINES: case GL_LINE_STRIP: case GL_LINE_LOOP: vs = &lines; vbo_lines.dirty = true; break;
+    case GL_TRIANGLES: case GL_TRIANGLE_STRIP: case GL_TRIANGLE_FAN: vs = &triangles; vbo_triangles.dirty = true; break;
+    default:
+        throw std::runtime_error("GlDrawBatch: Unsupported primitive mode.");
+    }
+
+    // Decode straight onto the end of the list, a block at a time through the
+    // stack. z and w default as in glVertexPointer.
+    const size_t n = num_vertices;
+    const size_t base = vs->size();
+    const size_t block = 64;
+    float p[4*block];
+    float cf[4*block];
+    for(size_t first=0; first < n; first += block) {
+        const size_t num = std::min(block, n - first);
+        std::fill(p, p + 4*num, 0.0f);
+        ReadComponents(gltype, vertex_ptr, vertex_stride_bytes, first, num, elements_per_vertex, p, false);
+        if(colour_ptr) {
+            std::fill(cf, cf + 4*num, 1.0f);
+            ReadComponents(colour_gltype, colour_ptr, colour_stride_bytes, first, num, elements_per_colour, cf, true);
+        }
+        for(size_t i=0; i < num; ++i) {
+            unsigned char c[4];
+            if(colour_ptr) {
+                std::transform(cf + 4*i, cf + 4*i + 4, c, ToByte);
+            }else{
+                std::copy(colour, colour+4, c);
+            }
+            PushVertex(*vs, p + 4*i, c);
+        }
+    }
+
+    // Everything is stored as independent points, lines or triangles. Lists
+    // are used as decoded, whilst strips, loops and fans are expanded after
+    // the decoded vertices, which are then removed.
+    auto push = [&](size_t i) {
+        const Vertex v = (*vs)[base + i];
+        vs->push_back(v);
+    };
+
+    switch(mode) {
+    case GL_POINTS:
+        return;
+    case GL_LINES:
+        vs->resize(base + n - n % 2);
+        return;
+    case GL_TRIANGLES:
+        vs->resize(base + n - n % 3);
+        return;
+    case GL_LINE_STRIP:
+    case GL_LINE_LOOP:
+        for(size_t i=1; i < n; ++i) { push(i-1); push(i); }
+        if(mode == GL_LINE_LOOP && n > 2) { push(n-1); push(0); }
+        break;
+    case GL_TRIANGLE_STRIP:
+        // Swap every other triangle to keep a consistent winding
+        for(size_t i=2; i < n; ++i) {
+            if(i % 2 == 0) { push(i-2); push(i-1); }
+            else           { push(i-1); push(i-2); }
+            push(i);
+        }
+        break;
+    case GL_TRIANGLE_FAN:
+        for(size_t i=2; i < n; ++i) { push(0); push(i-1); push(i); }
+        break;
+    }
+    vs->erase(vs->begin() + base, vs->begin() + base + n);
+}
+
+void GlDrawBatch::AddPoint(float x, float y, float z)
+{
+    const float p[] = {x,y,z};
+    PushVertex(points, p, colour);
+    vbo_points.dirty = true;
+}
+
+void GlDrawBatch::AddLine(float x1, float y1, float z1, float x2, float y2, float z2)
+{
+    const float p1[] = {x1,y1,z1};
+    const float p2[] = {x2,y2,z2};
+    PushVertex(lines, p1, colour);
+    PushVertex(lines, p2, colour);
+    vbo_lines.dirty = true;
+}
+
+void GlDrawBatch::AddTriangle(const float* p1, const float* p2, const float* p3)
+{
+    PushVertex(triangles, p1, colour);
+    PushVertex(triangles, p2, colour);
+    PushVertex(triangles, p3, colour);
+    vbo_triangles.dirty = true;
+}
+
+void GlDrawBatch::AddAxis(float scale)
+{
+    // Axis colours come from the template
+    unsigned char c[4];
+    std::copy(colour, colour+4, c);
+    std::fill(colour, colour+4, 255);
+    PushInstance(axes, transforms.back(), scale, nullptr);
+    std::copy(c, c+4, colour);
+    vbo_axes.dirty = true;
+}
+
+void GlDrawBatch::AddAxis(const OpenGlMatrix& T_wf, float scale)
+{
+    PushTransform(T_wf);
+    AddAxis(scale);
+    PopTransform();
+}
+
+void GlDrawBatch::AddFrustum(float u0, float v0, float fu, float fv, int w, int h, float scale)
+{
+    const float params[] = {u0, v0, w*fu + u0, h*fv + v0};
+    PushInstance(frustums, transforms.back(), scale, params);
+    vbo_frustums.dirty = true;
+}
+
+void GlDrawBatch::AddFrustum(const OpenGlMatrix& T_wf, float u0, float v0, float fu, float fv, int w, int h, float scale)
+{
+    PushTransform(T_wf);
+    AddFrustum(u0, v0, fu, fv, w, h, scale);
+    PopTransform();
+}
+
+GlSlProgram& GlDrawBatch::Program(int shape)
+{
+    std::unique_ptr<GlSlProgram>& prog =
+        (shape == ShapeAxis) ? prog_axis : (shape == ShapeFrustum) ? prog_frustum : prog_vertices;
+    if(!prog) {
+        prog.reset(new GlSlProgram());
+        prog->AddShader(GlSlAnnotatedShader, draw_batch_shader, {{"SHAPE", std::to_string(shape)}});
+        glBindAttribLocation(prog->ProgramId(), LOCATION_INSTANCE_T, "a_instance_T");
+        glBindAttribLocation(prog->ProgramId(), LOCATION_INSTANCE_PARAMS, "a_instance_params");
+        glBindAttribLocation(prog->ProgramId(), LOCATION_INSTANCE_COLOUR, "a_instance_color");
+        prog->BindPangolinDefaultAttribLocationsAndLink();
+    }
+    return *prog;
+}
+
+size_t GlDrawBatch::Upload(GpuBuffer& buffer, const void* data, size_t size_bytes)
+{
+    if(!buffer.dirty) return 0;
+    buffer.dirty = false;
+    if(!size_bytes) return 0;
+
+    if(!buffer.bo.IsValid() || (size_t)buffer.bo.SizeBytes() < size_bytes) {
+        // Grow geometrically so that steadily growing scenes don't reallocate every frame
+        const size_t capacity = std::max(size_bytes, 2 * (size_t)buffer.bo.SizeBytes());
+        buffer.bo.Reinitialise(GlArrayBuffer, capacity, GL_DYNAMIC_DRAW);
+    }
+    buffer.bo.Upload(data, size_bytes);
+    return size_bytes;
+}
+
+void GlDrawBatch::SetupVao()
+{
+    vao.reset(new GlVertexArrayObject());
+    vbo_axis_template.Reinitialise(GlArrayBuffer, sizeof(axis_template), GL_STATIC_DRAW, axis_template);
+    vbo_frustum_template.Reinitialise(GlArrayBuffer, sizeof(frustum_template), GL_STATIC_DRAW, frustum_template);
+}
+
+void GlDrawBatch::Draw(const OpenGlMatrix& mvp)
+{
+#ifdef HAVE_GLES
+    PANGOLIN_UNUSED(mvp);
+    throw std::runtime_error("GlDrawBatch: Drawing requires desktop OpenGL.");
+#else
+    stats = Stats();
+    if(Empty()) return;
+    if(!vao) SetupVao();
+
+    vao->Bind();
+
+    auto vertex_attribs = [](const GlBufferData& bo, size_t stride) {
+        bo.Bind();
+        glVertexAttribPointer(DEFAULT_LOCATION_POSITION, 3, GL_FLOAT, GL_FALSE, (GLsizei)stride, (void*)offsetof(Vertex,p));
+        glVertexAttribPointer(DEFAULT_LOCATION_COLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE, (GLsizei)stride, (void*)offsetof(Vertex,c));
+        glEnableVertexAttribArray(DEFAULT_LOCATION_POSITION);
+        glEnableVertexAttribArray(DEFAULT_LOCATION_COLOUR);
+    };
+    static_assert(sizeof(TemplateVertex) == sizeof(Vertex), "Template and batch vertices share a layout");
+
+    // Independent primitives, one draw call each
+    {
+        GlSlProgram& prog = Program(0);
+        prog.Bind();
+        prog.SetUniform("u_mvp", mvp);
+
+        struct { GpuBuffer& buffer; const std::vector<Vertex>& verts; GLenum mode; } lists[] = {
+            {vbo_triangles, triangles, GL_TRIANGLES},
+            {vbo_lines, lines, GL_LINES},
+            {vbo_points, points, GL_POINTS}
+        };
+        for(auto& l : lists) {
+            if(l.verts.empty()) continue;
+            stats.bytes_uploaded += Upload(l.buffer, l.verts.data(), l.verts.size() * sizeof(Vertex));
+            vertex_attribs(l.buffer.bo, sizeof(Vertex));
+            glDrawArrays(l.mode, 0, (GLsizei)l.verts.size());
+            stats.vertices += l.verts.size();
+            ++stats.draw_calls;
+        }
+        prog.Unbind();
+    }
+
+    // Instanced shapes, one draw call per shape
+    struct { int shape; GpuBuffer& buffer; const std::vector<Instance>& instances; const GlBufferData& tmpl; size_t tmpl_size; } shapes[] = {
+        {ShapeAxis, vbo_axes, axes, vbo_axis_template, axis_template_size},
+        {ShapeFrustum, vbo_frustums, frustums, vbo_frustum_template, frustum_template_size}
+    };
+    for(auto& s : shapes) {
+        if(s.instances.empty()) continue;
+        GlSlProgram& prog = Program(s.shape);
+        prog.Bind();
+        prog.SetUniform("u_mvp", mvp);
+
+        vertex_attribs(s.tmpl, sizeof(TemplateVertex));
+
+        stats.bytes_uploaded += Upload(s.buffer, s.instances.data(), s.instances.size() * sizeof(Instance));
+        s.buffer.bo.Bind();
+        for(GLuint c=0; c < 4; ++c) {
+            glVertexAttribPointer(LOCATION_INSTANCE_T + c, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(offsetof(Instance,T) + 4*c*sizeof(float)));
+        }
+        glVertexAttribPointer(LOCATION_INSTANCE_PARAMS, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance,params));
+        glVertexAttribPointer(LOCATION_INSTANCE_COLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), (void*)offsetof(Instance,c));
+        for(GLuint l=LOCATION_INSTANCE_T; l <= LOCATION_INSTANCE_COLOUR; ++l) {
+            glEnableVertexAttribArray(l);
+            glVertexAttribDivisor(l, 1);
+        }
+
+        glDrawArraysInstanced(GL_LINES, 0, (GLsizei)s.tmpl_size, (GLsizei)s.instances.size());
+        stats.vertices += s.tmpl_size * s.instances.size();
+        stats.instances += s.instances.size();
+        ++stats.draw_calls;
+
+        for(GLuint l=LOCATION_INSTANCE_T; l <= LOCATION_INSTANCE_COLOUR; ++l) {
+            glDisableVertexAttribArray(l);
+        }
+        prog.Unbind();
+    }
+
+    glDisableVertexAttribArray(DEFAULT_LOCATION_POSITION);
+    glDisableVertexAttribArray(DEFAULT_LOCATION_COLOUR);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    vao->Unbind();
+#endif
+}
+
+#ifndef HAVE_GLES
+void GlDrawBatch::Draw()
+{
+    OpenGlMatrix P, MV;
+    glGetDoublev(GL_PROJECTION_MATRIX, P.m);
+    glGetDoublev(GL_MODELVIEW_MATRIX, MV.m);
+    Draw(P * MV);
+}
+#endif
+
+const GlDrawBatch::Stats& GlDrawBatch::LastDrawStats() const
+{
+    return stats;
+}
+
+void GlDrawBatch::Free()
+{
+    for(GpuBuffer* b : {&vbo_points, &vbo_lines, &vbo_triangles, &vbo_axes, &vbo_frustums}) {
+        b->bo.Free();
+        b->dirty = true;
+    }
+    vbo_axis_template.Free();
+    vbo_frustum_template.Free();
+    vao.reset();
+    prog_vertices.reset();
+    prog_axis.reset();
+    prog_frustum.reset();
+}
+
+}
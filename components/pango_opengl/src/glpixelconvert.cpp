@@ -0,0 +1,321 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pangolin/gl/glpixelconvert.h>
+#include <pangolin/utils/assert.h>
+
+namespace pangolin
+{
+
+namespace
+{
+
+// Vertex shader emits a single triangle covering the viewport; the fragment
+// shader addresses raw texels directly from gl_FragCoord.
+const char* pixel_convert_shader = R"Shader(
+@start vertex
+#version 130
+
+void main() {
+    vec2 p = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+
+@start fragment
+#version 130
+#expect METHOD
+
+#define METHOD_YUYV     1
+#define METHOD_UYVY     2
+#define METHOD_NV12     3
+#define METHOD_BAYER    4
+#define METHOD_PACKED10 5
+#define METHOD_PACKED12 6
+#define METHOD_GRAY16   7
+
+uniform sampler2D u_raw;
+uniform ivec2 u_size;
+uniform ivec2 u_red;
+uniform float u_gain;
+uniform float u_offset;
+uniform float u_scale;
+
+int RawByte(int x, int y) {
+    return int(texelFetch(u_raw, ivec2(x,y), 0).r * 255.0 + 0.5);
+}
+
+float Raw(ivec2 p) {
+    return texelFetch(u_raw, clamp(p, ivec2(0), u_size - ivec2(1)), 0).r;
+}
+
+// BT.601 full range
+vec3 YuvToRgb(float y, float u, float v) {
+    u -= 0.5;
+    v -= 0.5;
+    return vec3(y + 1.402*v, y - 0.344136*u - 0.714136*v, y + 1.772*u);
+}
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec3 rgb;
+
+#if METHOD == METHOD_YUYV
+    vec4 t = texelFetch(u_raw, ivec2(p.x/2, p.y), 0);
+    rgb = YuvToRgb((p.x & 1) == 0 ? t.r : t.b, t.g, t.a);
+#elif METHOD == METHOD_UYVY
+    vec4 t = texelFetch(u_raw, ivec2(p.x/2, p.y), 0);
+    rgb = YuvToRgb((p.x & 1) == 0 ? t.g : t.a, t.r, t.b);
+#elif METHOD == METHOD_NV12
+    ivec2 uv = ivec2((p.x/2)*2, u_size.y + p.y/2);
+    rgb = YuvToRgb(
+        texelFetch(u_raw, p, 0).r,
+        texelFetch(u_raw, uv, 0).r,
+        texelFetch(u_raw, uv + ivec2(1,0), 0).r
+    );
+#elif METHOD == METHOD_BAYER
+    // Bilinear demosaic. c is (0,0) on red sites and (1,1) on blue sites.
+    ivec2 c = (p + u_red) & ivec2(1);
+    float C = Raw(p);
+    float H = 0.5 * (Raw(p + ivec2(-1,0)) + Raw(p + ivec2(1,0)));
+    float V = 0.5 * (Raw(p + ivec2(0,-1)) + Raw(p + ivec2(0,1)));
+    float X = 0.25 * (Raw(p + ivec2(-1,-1)) + Raw(p + ivec2(1,-1)) + Raw(p + ivec2(-1,1)) + Raw(p + ivec2(1,1)));
+    float N = 0.5 * (H + V);
+    if(c.x == 0 && c.y == 0) {
+        rgb = vec3(C, N, X);
+    }else if(c.x == 1 && c.y == 1) {
+        rgb = vec3(X, N, C);
+    }else if(c.y == 0) {
+        rgb = vec3(H, C, V);
+    }else{
+        rgb = vec3(V, C, H);
+    }
+    rgb *= u_gain;
+#elif METHOD == METHOD_PACKED10
+    // 4 pixels in 5 little endian bytes
+    int bit = 10 * (p.x & 3);
+    int i = 5 * (p.x / 4) + bit / 8;
+    int word = RawByte(i, p.y) | (RawByte(i+1, p.y) << 8);
+    rgb = vec3(float((word >> (bit & 7)) & 0x3FF) / 1023.0);
+#elif METHOD == METHOD_PACKED12
+    // 2 pixels in 3 little endian bytes
+    int i = 3 * (p.x / 2);
+    int b1 = RawByte(i+1, p.y);
+    int v = (p.x & 1) == 0 ?
+        (RawByte(i, p.y) | ((b1 & 0xF) << 8)) :
+        ((b1 >> 4) | (RawByte(i+2, p.y) << 4));
+    rgb = vec3(float(v) / 4095.0);
+#elif METHOD == METHOD_GRAY16
+    rgb = vec3(texelFetch(u_raw, p, 0).r * u_gain);
+#endif
+
+    gl_FragColor = vec4((rgb + vec3(u_offset)) * u_scale, 1.0);
+}
+)Shader";
+
+}
+
+GlPixelConverter::GlPixelConverter()
+    : offset(0.0f), scale(1.0f), fbo_tex(0)
+{
+}
+
+GlPixelConverter::Method GlPixelConverter::MethodForFormat(const PixelFormat& fmt) const
+{
+#ifdef HAVE_GLES
+    PANGOLIN_UNUSED(fmt);
+    return Method::None;
+#else
+    if(fmt.format == "YUYV422") {
+        return Method::YUYV;
+    }else if(fmt.format == "UYVY422") {
+        return Method::UYVY;
+    }else if(fmt.format == "NV12") {
+        return Method::NV12;
+    }else if(fmt.format == "GRAY10") {
+        return Method::Packed10;
+    }else if(fmt.format == "GRAY12") {
+        return Method::Packed12;
+    }else if(fmt.format == "GRAY8" || fmt.format == "GRAY16LE") {
+        if(!bayer_pattern.empty()) {
+            return Method::Bayer;
+        }else if(fmt.format == "GRAY16LE" && fmt.channel_bit_depth < 16) {
+            return Method::Gray16;
+        }
+    }
+    return Method::None;
+#endif
+}
+
+void GlPixelConverter::SetBayerPattern(const std::string& pattern)
+{
+    if(!pattern.empty() && pattern != "RGGB" && pattern != "BGGR" && pattern != "GRBG" && pattern != "GBRG") {
+        throw std::invalid_argument("GlPixelConverter: Unknown bayer pattern '" + pattern + "'.");
+    }
+    bayer_pattern = pattern;
+}
+
+const std::string& GlPixelConverter::BayerPattern() const
+{
+    return bayer_pattern;
+}
+
+void GlPixelConverter::SetOffsetScale(float offset, float scale)
+{
+    this->offset = offset;
+    this->scale = scale;
+}
+
+GlSlProgram& GlPixelConverter::Program(Method method)
+{
+    std::unique_ptr<GlSlProgram>& prog = programs[method];
+    if(!prog) {
+        prog.reset(new GlSlProgram());
+        prog->AddShader(GlSlAnnotatedShader, pixel_convert_shader, {{"METHOD", std::to_string((int)method)}});
+        prog->Link();
+    }
+    return *prog;
+}
+
+void GlPixelConverter::Convert(const Image<unsigned char>& img, const PixelFormat& fmt, GlTexture& out)
+{
+#ifdef HAVE_GLES
+    PANGOLIN_UNUSED(img);
+    PANGOLIN_UNUSED(fmt);
+    PANGOLIN_UNUSED(out);
+    throw std::runtime_error("GlPixelConverter: Not supported on GLES.");
+#else
+    const Method method = MethodForFormat(fmt);
+    PANGO_ASSERT(method != Method::None);
+
+    // Dimensions and format to upload the unmodified bytes with
+    GLsizei raw_w = (GLsizei)img.w;
+    GLsizei raw_h = (GLsizei)img.h;
+    GLint raw_internal = GL_LUMINANCE8;
+    GLenum raw_format = GL_LUMINANCE;
+    GLenum raw_type = GL_UNSIGNED_BYTE;
+    size_t raw_texel_bytes = 1;
+    size_t raw_pitch = img.pitch;
+    float gain = 1.0f;
+
+    switch(method) {
+    case Method::YUYV:
+    case Method::UYVY:
+        raw_w = (GLsizei)img.w / 2;
+        raw_internal = GL_RGBA8;
+        raw_format = GL_RGBA;
+        raw_texel_bytes = 4;
+        break;
+    case Method::NV12:
+        // Stream pitch covers 12 bits per pixel; planes are stored at the luma stride.
+        raw_h = (GLsizei)(img.h + img.h / 2);
+        raw_pitch = (img.pitch * 8) / fmt.bpp;
+        break;
+    case Method::Packed10:
+    case Method::Packed12:
+        raw_w = (GLsizei)((img.w * fmt.bpp) / 8);
+        break;
+    case Method::Bayer:
+    case Method::Gray16:
+        if(fmt.bpp == 16) {
+            raw_internal = GL_LUMINANCE16;
+            raw_type = GL_UNSIGNED_SHORT;
+            raw_texel_bytes = 2;
+            gain = 65535.0f / ((1 << fmt.channel_bit_depth) - 1);
+        }
+        break;
+    case Method::None:
+        break;
+    }
+
+    PANGO_ASSERT(raw_pitch % raw_texel_bytes == 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(raw_pitch / raw_texel_bytes));
+    if(!raw.tid || raw.width != raw_w || raw.height != raw_h || raw.internal_format != raw_internal) {
+        raw.Reinitialise(raw_w, raw_h, raw_internal, false, 0, raw_format, raw_type, img.ptr);
+    }else{
+        raw.Upload(img.ptr, raw_format, raw_type);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    if(!out.tid || out.width != (GLint)img.w || out.height != (GLint)img.h || out.internal_format != GL_RGBA8) {
+        out.Reinitialise((GLsizei)img.w, (GLsizei)img.h, GL_RGBA8, true, 0, GL_RGBA, GL_UNSIGNED_BYTE);
+    }
+    if(out.tid != fbo_tex) {
+        fbo.Reinitialise();
+        fbo.attachments = 0;
+        fbo.AttachColour(out);
+        fbo_tex = out.tid;
+    }
+    if(!vao) {
+        vao.reset(new GlVertexArrayObject());
+    }
+
+    GLint prev_fbo = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+    glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    fbo.Bind();
+    glViewport(0, 0, (GLsizei)img.w, (GLsizei)img.h);
+
+    GlSlProgram& prog = Program(method);
+    prog.SaveBind();
+    prog.SetUniform("u_raw", 0);
+    prog.SetUniform("u_offset", offset);
+    prog.SetUniform("u_scale", scale);
+    if(method == Method::NV12 || method == Method::Bayer) {
+        prog.SetUniform("u_size", (int)img.w, (int)img.h);
+    }
+    if(method == Method::Bayer || method == Method::Gray16) {
+        prog.SetUniform("u_gain", gain);
+    }
+    if(method == Method::Bayer) {
+        // Position of red pixel in the 2x2 tile
+        const int rx = (bayer_pattern == "GRBG" || bayer_pattern == "BGGR") ? 1 : 0;
+        const int ry = (bayer_pattern == "GBRG" || bayer_pattern == "BGGR") ? 1 : 0;
+        prog.SetUniform("u_red", rx, ry);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    raw.Bind();
+    vao->Bind();
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    vao->Unbind();
+    raw.Unbind();
+    prog.Unbind();
+
+    fbo.Unbind();
+    if(prev_fbo) {
+        glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+    }
+    glPopAttrib();
+    CheckGlDieOnError();
+#endif
+}
+
+}
@@ -0,0 +1,305 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2011 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pangolin/gl/glpixelunpackring.h>
+#include <pangolin/gl/glinclude.h>
+#include <pangolin/utils/assert.h>
+
+#include <algorithm>
+
+namespace pangolin
+{
+
+namespace
+{
+
+bool HaveBufferStorage()
+{
+#ifdef HAVE_GLES
+    return false;
+#else
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    glGetError(); // Ignore error from legacy contexts which don't know these enums
+    if(major > 4 || (major == 4 && minor >= 4)) {
+        return true;
+    }
+#  ifdef HAVE_EPOXY
+    return epoxy_has_gl_extension("GL_ARB_buffer_storage");
+#  elif defined(HAVE_GLEW)
+    return GLEW_ARB_buffer_storage;
+#  else
+    return false;
+#  endif
+#endif
+}
+
+}
+
+GlPixelUnpackRing::GlPixelUnpackRing(size_t num_slots)
+    : slots(std::max<size_t>(num_slots,2)), buffer_bytes(0), requested_bytes(0),
+      next_seq(0), uploading(-1), supported(-1), total_latency_ms(0.0)
+{
+}
+
+GlPixelUnpackRing::~GlPixelUnpackRing()
+{
+    Free();
+}
+
+unsigned char* GlPixelUnpackRing::BeginWrite(size_t size_bytes, int& slot)
+{
+    std::lock_guard<std::mutex> l(lock);
+
+    if(supported == 0) {
+        return nullptr;
+    }
+
+    if(size_bytes > buffer_bytes) {
+        // Ask the GL thread to (re)allocate on its next BeginUpload()
+        requested_bytes = std::max(requested_bytes, size_bytes);
+        return nullptr;
+    }
+
+    // Prefer a free buffer, otherwise recycle the oldest frame still waiting to be uploaded
+    int oldest_ready = -1;
+    for(size_t i=0; i < slots.size(); ++i) {
+        if(slots[i].state == SlotState::Free) {
+            slot = (int)i;
+            slots[i].state = SlotState::Writing;
+            return slots[i].ptr;
+        }else if(slots[i].state == SlotState::Ready) {
+            if(oldest_ready < 0 || slots[i].seq < slots[oldest_ready].seq) {
+                oldest_ready = (int)i;
+            }
+        }
+    }
+
+    if(oldest_ready >= 0) {
+        ++stats.frames_dropped;
+        slot = oldest_ready;
+        slots[slot].state = SlotState::Writing;
+        return slots[slot].ptr;
+    }
+
+    return nullptr;
+}
+
+void GlPixelUnpackRing::EndWrite(int slot, const Frame& frame)
+{
+    std::lock_guard<std::mutex> l(lock);
+    Slot& s = slots[slot];
+    PANGO_ASSERT(s.state == SlotState::Writing);
+    s.frame = frame;
+    s.seq = next_seq++;
+    s.written = std::chrono::steady_clock::now();
+    s.state = SlotState::Ready;
+}
+
+void GlPixelUnpackRing::CancelWrite(int slot)
+{
+    std::lock_guard<std::mutex> l(lock);
+    PANGO_ASSERT(slots[slot].state == SlotState::Writing);
+    slots[slot].state = SlotState::Free;
+}
+
+void GlPixelUnpackRing::DiscardReady()
+{
+    std::lock_guard<std::mutex> l(lock);
+    for(Slot& s : slots) {
+        if(s.state == SlotState::Ready) {
+            s.state = SlotState::Free;
+            ++stats.frames_dropped;
+        }
+    }
+}
+
+bool GlPixelUnpackRing::BeginUpload(Frame& frame)
+{
+#ifdef HAVE_GLES
+    PANGOLIN_UNUSED(frame);
+    supported = 0;
+    return false;
+#else
+    std::lock_guard<std::mutex> l(lock);
+    PANGO_ASSERT(uploading < 0);
+
+    if(supported < 0) {
+        supported = HaveBufferStorage() ? 1 : 0;
+    }
+    if(!supported) {
+        return false;
+    }
+
+    RetireCompleted(false);
+
+    if(requested_bytes > buffer_bytes) {
+        const bool writer_active = std::any_of(slots.begin(), slots.end(), [](const Slot& s){
+            return s.state == SlotState::Writing;
+        });
+        if(!writer_active) {
+            Reallocate(requested_bytes);
+        }
+    }
+
+    // Find the newest complete frame and discard any older ones
+    int newest = -1;
+    for(size_t i=0; i < slots.size(); ++i) {
+        if(slots[i].state == SlotState::Ready) {
+            if(newest < 0 || slots[i].seq > slots[newest].seq) {
+                if(newest >= 0) {
+                    slots[newest].state = SlotState::Free;
+                    ++stats.frames_dropped;
+                }
+                newest = (int)i;
+            }else{
+                slots[i].state = SlotState::Free;
+                ++stats.frames_dropped;
+            }
+        }
+    }
+
+    if(newest < 0) {
+        return false;
+    }
+
+    Slot& s = slots[newest];
+    frame = s.frame;
+    uploading = newest;
+
+    const double latency_ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - s.written).count();
+    ++stats.frames_uploaded;
+    stats.bytes_uploaded += s.frame.pitch * s.frame.h;
+    total_latency_ms += latency_ms;
+    stats.mean_latency_ms = total_latency_ms / stats.frames_uploaded;
+    stats.max_latency_ms = std::max(stats.max_latency_ms, latency_ms);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.pbo);
+    return true;
+#endif
+}
+
+void GlPixelUnpackRing::EndUpload()
+{
+#ifndef HAVE_GLES
+    std::lock_guard<std::mutex> l(lock);
+    PANGO_ASSERT(uploading >= 0);
+    Slot& s = slots[uploading];
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    s.state = SlotState::InFlight;
+    uploading = -1;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#endif
+}
+
+void GlPixelUnpackRing::Free()
+{
+#ifndef HAVE_GLES
+    std::lock_guard<std::mutex> l(lock);
+    if(buffer_bytes) {
+        Reallocate(0);
+    }
+#endif
+}
+
+GlPixelUnpackRing::Stats GlPixelUnpackRing::GetStats() const
+{
+    std::lock_guard<std::mutex> l(lock);
+    return stats;
+}
+
+void GlPixelUnpackRing::ResetStats()
+{
+    std::lock_guard<std::mutex> l(lock);
+    stats = Stats();
+    total_latency_ms = 0.0;
+}
+
+void GlPixelUnpackRing::Reallocate(size_t size_bytes)
+{
+#ifndef HAVE_GLES
+    // Wait for any transfers still reading from the old buffers
+    RetireCompleted(true);
+
+    for(Slot& s : slots) {
+        PANGO_ASSERT(s.state != SlotState::Writing);
+        if(s.state == SlotState::Ready) {
+            ++stats.frames_dropped;
+        }
+        if(s.pbo) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glDeleteBuffers(1, &s.pbo);
+        }
+        s = Slot();
+    }
+    buffer_bytes = 0;
+
+    if(size_bytes) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        for(Slot& s : slots) {
+            glGenBuffers(1, &s.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.pbo);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size_bytes, nullptr, flags);
+            s.ptr = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size_bytes, flags);
+            PANGO_ASSERT(s.ptr);
+        }
+        buffer_bytes = size_bytes;
+    }
+    requested_bytes = 0;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    CheckGlDieOnError();
+#else
+    PANGOLIN_UNUSED(size_bytes);
+#endif
+}
+
+void GlPixelUnpackRing::RetireCompleted(bool block)
+{
+#ifndef HAVE_GLES
+    for(Slot& s : slots) {
+        if(s.state == SlotState::InFlight) {
+            const GLenum status = glClientWaitSync(
+                s.fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                block ? GL_TIMEOUT_IGNORED : 0
+            );
+            if(status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED || status == GL_WAIT_FAILED) {
+                glDeleteSync(s.fence);
+                s.fence = 0;
+                s.state = SlotState::Free;
+            }
+        }
+    }
+#else
+    PANGOLIN_UNUSED(block);
+#endif
+}
+
+}
@@ -27,12 +27,130 @@
 
 #include <pangolin/gl/gltexturecache.h>
 
+#include <algorithm>
+#include <tuple>
+
 namespace pangolin
 {
-    
+
+namespace
+{
+
+// Smallest power of two >= size, or size itself if that would exceed the
+// maximum texture dimension
+GLsizei SizeClass(GLsizei size, GLint max_size)
+{
+    GLsizei c = 16;
+    while(c < size) c *= 2;
+    return (max_size > 0 && c > max_size) ? std::max<GLsizei>(size, max_size) : c;
+}
+
+}
+
+bool TextureCache::Key::operator<(const Key& o) const
+{
+    return std::tie(internal_format, glformat, gltype, w, h) <
+           std::tie(o.internal_format, o.glformat, o.gltype, o.w, o.h);
+}
+
 TextureCache& TextureCache::I() {
     static TextureCache instance;
     return instance;
 }
 
-}
\ No newline at end of file
+TextureCache::TextureCache()
+    : default_sampling_linear(true), budget_bytes(256*1024*1024),
+      bytes_resident(0), use_counter(0), frame(0), max_texture_size(0)
+{
+}
+
+GlTexture& TextureCache::GlTex(GLsizei w, GLsizei h, GLint internal_format, GLint glformat, GLenum gltype)
+{
+    std::lock_guard<std::mutex> l(lock);
+
+    if(!max_texture_size) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    }
+
+    const Key key = {
+        internal_format, glformat, gltype,
+        SizeClass(w, max_texture_size), SizeClass(h, max_texture_size)
+    };
+
+    auto it = texture_map.find(key);
+    if(it == texture_map.end()) {
+        ++current.misses;
+        const size_t bytes = (size_t)key.w * key.h * GlFormatChannels(glformat) * GlDataTypeBytes(gltype);
+        EvictToBudget(bytes);
+
+        Entry entry;
+        entry.tex.reset(new GlTexture(key.w, key.h, internal_format, default_sampling_linear, 0, glformat, gltype));
+        entry.bytes = bytes;
+        it = texture_map.emplace(key, std::move(entry)).first;
+        bytes_resident += bytes;
+        current.bytes_allocated += bytes;
+    }else{
+        ++current.hits;
+    }
+
+    it->second.last_use = ++use_counter;
+    it->second.last_frame = frame;
+    return *it->second.tex;
+}
+
+void TextureCache::NextFrame()
+{
+    std::lock_guard<std::mutex> l(lock);
+    ++frame;
+    EvictToBudget(0);
+    current.textures_resident = texture_map.size();
+    current.bytes_resident = bytes_resident;
+    last_frame = current;
+    current = Stats();
+}
+
+void TextureCache::SetBudgetBytes(size_t bytes)
+{
+    std::lock_guard<std::mutex> l(lock);
+    budget_bytes = bytes;
+}
+
+size_t TextureCache::BudgetBytes() const
+{
+    std::lock_guard<std::mutex> l(lock);
+    return budget_bytes;
+}
+
+TextureCache::Stats TextureCache::FrameStats() const
+{
+    std::lock_guard<std::mutex> l(lock);
+    return last_frame;
+}
+
+void TextureCache::Clear()
+{
+    std::lock_guard<std::mutex> l(lock);
+    texture_map.clear();
+    bytes_resident = 0;
+}
+
+void TextureCache::EvictToBudget(size_t incoming_bytes)
+{
+    while(bytes_resident + incoming_bytes > budget_bytes) {
+        auto lru = texture_map.end();
+        for(auto it = texture_map.begin(); it != texture_map.end(); ++it) {
+            if(it->second.last_frame != frame && (lru == texture_map.end() || it->second.last_use < lru->second.last_use)) {
+                lru = it;
+            }
+        }
+        if(lru == texture_map.end()) {
+            // Everything left is in use this frame
+            break;
+        }
+        bytes_resident -= lru->second.bytes;
+        texture_map.erase(lru);
+        ++current.evictions;
+    }
+}
+
+}
@@ -26,6 +26,7 @@
 #pragma once
 
 #include <fstream>
+#include <vector>
 
 #include <pangolin/platform.h>
 
@@ -39,21 +40,21 @@ class PANGOLIN_EXPORT PacketStream: public std::ifstream
 {
 public:
     PacketStream()
-        : _is_pipe(false)
+        : _is_pipe(false), _in_chunk(false)
     {
         cclear();
     }
 
     PacketStream(const std::string& filename)
         : Base(filename.c_str(), std::ios::in | std::ios::binary),
-          _is_pipe(IsPipe(filename))
+          _is_pipe(IsPipe(filename)), _in_chunk(false)
     {
         cclear();
     }
 
     bool seekable() const
     {
-        return is_open() && !_is_pipe;
+        return is_open() && (!_is_pipe || _in_chunk);
     }
 
     void open(const std::string& filename)
@@ -65,10 +66,26 @@ public:
 
     void close()
     {
+        leaveChunk();
         cclear();
         if (Base::is_open()) Base::close();
     }
 
+    // Read from data, the decompressed contents of a chunk, instead of the
+    // file until leaveChunk(). Positions are then offsets within data.
+    void enterChunk(std::vector<char>&& data);
+
+    // Continue reading the file from after the chunk
+    void leaveChunk();
+
+    bool inChunk() const
+    {
+        return _in_chunk;
+    }
+
+    // True once everything in the current chunk has been read
+    bool chunkExhausted();
+
     void seekg(std::streampos target);
 
     void seekg(std::streamoff off, std::ios_base::seekdir way);
@@ -96,8 +113,27 @@ public:
 private:
     using Base = std::ifstream;
 
+    // Read only buffer over a chunk which supports seeking within it
+    class ChunkBuffer : public std::streambuf
+    {
+    public:
+        void assign(std::vector<char>&& data);
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir way, std::ios_base::openmode which) override;
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+    private:
+        std::vector<char> _data;
+    };
+
     bool _is_pipe;
     PangoTagType _tag;
+    ChunkBuffer _chunk;
+    bool _in_chunk;
+
+    // Blocks searched by syncToTag(), allocated on first use
+    std::vector<unsigned char> _sync_block;
 
     // Amount of frame data left to read. Tracks our position within a data block.
 
@@ -107,5 +143,27 @@ private:
     }
 };
 
+// Decode a varint as written by writeCompressedUnsignedInt() from the buffer
+// at p, advancing p. Returns false if it runs past end.
+inline bool readCompressedUnsignedInt(const unsigned char*& p, const unsigned char* end, uint64_t& n)
+{
+    n = 0;
+    for(int shift = 0; p < end && shift < 64; shift += 7) {
+        const uint64_t b = *p++;
+        n |= (b & 0x7F) << shift;
+        if(!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Decode a zigzag encoded signed varint
+inline bool readCompressedSignedInt(const unsigned char*& p, const unsigned char* end, int64_t& n)
+{
+    uint64_t z;
+    if(!readCompressedUnsignedInt(p, end, z)) return false;
+    n = static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+    return true;
+}
+
 
 }
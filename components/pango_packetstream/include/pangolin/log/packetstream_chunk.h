@@ -0,0 +1,68 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <pangolin/platform.h>
+
+namespace pangolin
+{
+
+// Compression applied to the packets grouped in a TAG_PANGO_CHUNK block
+enum class PacketChunkCodec : uint8_t
+{
+    None = 0,
+    LZ4  = 1,
+    Zstd = 2
+};
+
+// Fixed size part of a chunk: the tag, uint8 codec, uint32 CRC32C of the
+// table and payload, then the uint64 sizes of the table, the stored payload
+// and the payload once decompressed.
+const size_t PACKET_CHUNK_HEADER_BYTES = 3 + 1 + 4 + 3*8;
+
+// True if Pangolin was built with support for codec
+PANGOLIN_EXPORT
+bool PacketChunkCodecAvailable(PacketChunkCodec codec);
+
+// CRC32C (Castagnoli) of size bytes at data, continuing from crc
+PANGOLIN_EXPORT
+uint32_t Crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+// Compress raw_size bytes from raw into out. Returns false if codec is not
+// available or the data does not get smaller.
+PANGOLIN_EXPORT
+bool CompressChunk(PacketChunkCodec codec, int level, const char* raw, size_t raw_size, std::string& out);
+
+// Decompress size bytes from data into exactly raw_size bytes at raw.
+// Returns false if the data is not valid for codec.
+PANGOLIN_EXPORT
+bool DecompressChunk(PacketChunkCodec codec, const char* data, size_t size, char* raw, size_t raw_size);
+
+}
@@ -0,0 +1,71 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <pangolin/log/packetstream_reader.h>
+#include <pangolin/log/packetstream_writer.h>
+
+namespace pangolin
+{
+
+// Packets of an indexed stream to copy with CopyPackets() or SplitPackets()
+struct PANGOLIN_EXPORT PacketStreamSelection
+{
+    // Sources to copy, numbered in this order in the output. All if empty.
+    std::vector<PacketStreamSourceId> sources;
+
+    // Capture times to copy, [begin_us, end_us)
+    int64_t begin_us = std::numeric_limits<int64_t>::min();
+    int64_t end_us = std::numeric_limits<int64_t>::max();
+
+    // Limit the capture times to those of packets [begin, end) of src
+    void SetFrames(const PacketStreamReader& reader, PacketStreamSourceId src, size_t begin, size_t end);
+};
+
+// Copy the selected packets of reader into writer, adding their sources to
+// it first. Packet data and metadata are copied as they are, without
+// decoding, so the cost is that of reading and writing the bytes. Returns
+// the number of packets copied. Throws std::runtime_error if the stream ends
+// before every packet in its index has been copied.
+PANGOLIN_EXPORT
+size_t CopyPackets(PacketStreamReader& reader, PacketStreamWriter& writer, const PacketStreamSelection& selection = PacketStreamSelection());
+
+// Copy the selected packets into consecutive files named filename(n) for the
+// n'th, each starting segment_us of capture time after the last. Packets
+// arriving after a later segment has begun are kept in that segment. Returns
+// the number of files written.
+PANGOLIN_EXPORT
+size_t SplitPackets(
+    PacketStreamReader& reader, int64_t segment_us, const std::function<std::string(size_t)>& filename,
+    const PacketStreamSelection& selection = PacketStreamSelection()
+);
+
+}
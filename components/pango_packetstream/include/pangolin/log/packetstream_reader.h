@@ -49,6 +49,12 @@ public:
 
     void Open(const std::string& filename);
 
+    // Open another handle on the file already opened by other, sharing a copy
+    // of its sources and index but reading from an independent position. Such
+    // a cursor is intended to follow one source: NextFrame(src) seeks over
+    // packets of other sources using the index instead of reading them.
+    void Open(const PacketStreamReader& other);
+
     void Close();
 
     const std::vector<PacketStreamSource>&
@@ -76,6 +82,12 @@ public:
 
     void FixFileIndex();
 
+    // Number of chunks skipped because their checksum or contents were bad
+    size_t CorruptChunks() const
+    {
+        return _corrupt_chunks;
+    }
+
 private:
     bool GoodToRead();
 
@@ -85,8 +97,23 @@ private:
 
     void ParseNewSource();
 
+    // Legacy JSON index following TAG_PANGO_STATS
     bool ParseIndex();
 
+    // Binary index following TAG_PANGO_INDEX, see writeSourceIndex()
+    bool ParseBinaryIndex();
+
+    // Skip a TAG_PANGO_INDEX or TAG_PANGO_CHECKPOINT block
+    void SkipIndexBlock();
+
+    // Recover the index from the chain of checkpoints ending nearest the end
+    // of the file. Returns the position following the last checkpoint, or -1.
+    std::streamoff RecoverCheckpoints();
+
+    // Append packets from begin to the end of the file to the index, scanning
+    // sections of large files on separate threads.
+    void ScanPackets(std::streamoff begin);
+
     void RebuildIndex();
 
     void AppendIndex();
@@ -95,19 +122,33 @@ private:
 
     void SkipSync();
 
-    void ReSync() {
-        _stream.syncToTag();
-    }
+    // Skip to the next item, checking that candidate packets parse
+    void ReSync();
+
+    // Verify and decompress the chunk at the current position, then read
+    // its contents from offset. Returns false, having skipped the chunk, if
+    // it is corrupt.
+    bool EnterChunk(int64_t offset);
+
+    void LeaveChunk();
+
+    // Seek forward to the next indexed packet of src, if it is ahead
+    void SkipToNext(PacketStreamSourceId src);
 
     std::string _filename;
     std::vector<PacketStreamSource> _sources;
     SyncTime::TimePoint packet_stream_start;
+    std::streampos _packets_begin;
 
     PacketStream _stream;
-    std::recursive_mutex _mutex;
+    mutable std::recursive_mutex _mutex;
 
     bool _is_pipe;
     int _pipe_fd;
+    bool _index_checkpoints;
+    size_t _corrupt_chunks;
+    std::streamoff _chunk_pos;
+    bool _is_cursor;
 };
 
 
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
 #include <pangolin/platform.h>
 #include <pangolin/utils/picojson.h>
 
@@ -8,12 +11,70 @@ namespace pangolin {
 
 using PacketStreamSourceId = size_t;
 
+// Keys and value types of the binary frame metadata declared by a
+// TAG_SRC_SCHEMA block, see PacketStreamWriter::SetBinaryMeta().
+struct PacketMetaSchema
+{
+    std::vector<std::string> keys;
+    // Per key, one of 'i' (int64), 'f' (double), 'b' (bool), 's' (string)
+    // or 'j' (any other json, stored serialized)
+    std::string types;
+    // Integers are stored as the difference from their value when declared
+    std::vector<int64_t> bases;
+};
+
 struct PANGOLIN_EXPORT PacketStreamSource
 {
     struct PacketInfo
     {
         std::streampos pos;
         int64_t capture_time;
+        // Offset of the packet within the chunk at pos, or -1 if not chunked
+        int64_t chunk_offset = -1;
+    };
+
+    // Packet index whose entries are shared between copies, such as the
+    // cursors of a PacketStreamReader, until one of them is modified.
+    class PacketIndex
+    {
+    public:
+        using const_iterator = std::vector<PacketInfo>::const_iterator;
+
+        PacketIndex() = default;
+
+        PacketIndex(std::vector<PacketInfo>&& entries)
+            : _entries(std::make_shared<const std::vector<PacketInfo>>(std::move(entries)))
+        {
+        }
+
+        size_t size() const { return Entries().size(); }
+        bool empty() const { return Entries().empty(); }
+        const PacketInfo& operator[](size_t i) const { return Entries()[i]; }
+        const PacketInfo& back() const { return Entries().back(); }
+        const_iterator begin() const { return Entries().begin(); }
+        const_iterator end() const { return Entries().end(); }
+
+        void push_back(const PacketInfo& info) { Mutable().push_back(info); }
+        void pop_back() { Mutable().pop_back(); }
+        void clear() { _entries.reset(); }
+
+    private:
+        const std::vector<PacketInfo>& Entries() const
+        {
+            static const std::vector<PacketInfo> none;
+            return _entries ? *_entries : none;
+        }
+
+        // Entries which only this index refers to, copied if shared
+        std::vector<PacketInfo>& Mutable()
+        {
+            if(!_entries || _entries.use_count() > 1) {
+                _entries = std::make_shared<const std::vector<PacketInfo>>(Entries());
+            }
+            return const_cast<std::vector<PacketInfo>&>(*_entries);
+        }
+
+        std::shared_ptr<const std::vector<PacketInfo>> _entries;
     };
 
     PacketStreamSource()
@@ -54,10 +115,13 @@ struct PANGOLIN_EXPORT PacketStreamSource
     int64_t         data_size_bytes;
 
     // Index keyed by packet_id
-    std::vector<PacketInfo> index;
+    PacketIndex index;
 
     // Based on current position in stream
     size_t          next_packet_id;
+
+    // Binary metadata schemas read so far, keyed by their stream position
+    std::map<int64_t, PacketMetaSchema> meta_schemas;
 };
 
 }
@@ -23,14 +23,24 @@ const static std::string pss_pkt_format_written = "format_written";
 
 const unsigned int TAG_LENGTH = 3;
 
+// Version of the binary index blocks following TAG_PANGO_INDEX and
+// TAG_PANGO_CHECKPOINT. Version 2 adds the offset of each packet within its
+// chunk and is only written for streams holding chunks.
+const uint32_t PANGO_INDEX_VERSION = 2;
+
 #define PANGO_TAG(a,b,c) ( (c<<16) | (b<<8) | a)
 const PangoTagType TAG_PANGO_HDR    = PANGO_TAG('L', 'I', 'N');
 const PangoTagType TAG_PANGO_MAGIC  = PANGO_TAG('P', 'A', 'N');
 const PangoTagType TAG_PANGO_SYNC   = PANGO_TAG('S', 'Y', 'N');
 const PangoTagType TAG_PANGO_STATS  = PANGO_TAG('S', 'T', 'A');
 const PangoTagType TAG_PANGO_FOOTER = PANGO_TAG('F', 'T', 'R');
+const PangoTagType TAG_PANGO_INDEX  = PANGO_TAG('I', 'D', 'X');
+const PangoTagType TAG_PANGO_CHECKPOINT = PANGO_TAG('C', 'H', 'K');
+const PangoTagType TAG_PANGO_CHUNK  = PANGO_TAG('C', 'N', 'K');
 const PangoTagType TAG_ADD_SOURCE   = PANGO_TAG('S', 'R', 'C');
 const PangoTagType TAG_SRC_JSON     = PANGO_TAG('J', 'S', 'N');
+const PangoTagType TAG_SRC_SCHEMA   = PANGO_TAG('S', 'C', 'M');
+const PangoTagType TAG_SRC_META     = PANGO_TAG('B', 'M', 'T');
 const PangoTagType TAG_SRC_PACKET   = PANGO_TAG('P', 'K', 'T');
 const PangoTagType TAG_END          = PANGO_TAG('E', 'N', 'D');
 #undef PANGO_TAG
@@ -25,12 +25,23 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <ostream>
+#include <sstream>
+#include <thread>
 
 #include <pangolin/log/packetstream.h>
+#include <pangolin/log/packetstream_chunk.h>
 #include <pangolin/log/packetstream_source.h>
 #include <pangolin/utils/file_utils.h>
+#include <pangolin/utils/log.h>
 #include <pangolin/utils/threadedfilebuf.h>
+#include <pangolin/utils/timer.h>
 
 namespace pangolin
 {
@@ -39,21 +50,31 @@ class PANGOLIN_EXPORT PacketStreamWriter
 {
 public:
     PacketStreamWriter()
-        : _stream(&_buffer), _indexable(false), _open(false), _bytes_written(0)
+        : _stream(&_buffer), _indexable(false), _open(false), _bytes_written(0),
+          _checkpoint_packets(0), _checkpoint_us(0), _header_checkpoints(false),
+          _last_checkpoint_pos(-1), _last_checkpoint_us(Time_us(TimeNow())), _packets_since_checkpoint(0),
+          _binary_meta(false)
     {
         _stream.exceptions(std::ostream::badbit);
     }
 
     PacketStreamWriter(const std::string& filename, size_t buffer_size  = 100*1024*1024)
         : _buffer(pangolin::PathExpand(filename), buffer_size), _stream(&_buffer),
-          _indexable(!IsPipe(filename)), _open(_stream.good()), _bytes_written(0)
+          _indexable(!IsPipe(filename)), _open(_stream.good()), _bytes_written(0),
+          _checkpoint_packets(0), _checkpoint_us(0), _header_checkpoints(false),
+          _last_checkpoint_pos(-1), _last_checkpoint_us(Time_us(TimeNow())), _packets_since_checkpoint(0),
+          _binary_meta(false)
     {
         _stream.exceptions(std::ostream::badbit);
         WriteHeader();
     }
 
     ~PacketStreamWriter() {
-        Close();
+        try {
+            Close();
+        } catch (const std::exception& e) {
+            pango_print_error("PacketStreamWriter: %s\n", e.what());
+        }
     }
 
     void Open(const std::string& filename, size_t buffer_size = 100 * 1024 * 1024)
@@ -63,24 +84,46 @@ public:
         _open = _stream.good();
         _bytes_written = 0;
         _indexable = !IsPipe(filename);
+        _last_checkpoint_pos = -1;
+        _last_checkpoint_us = Time_us(TimeNow());
+        _packets_since_checkpoint = 0;
+        _checkpointed.clear();
+        _meta_schemas.clear();
         WriteHeader();
+        if (_chunk_bytes) {
+            StartCompressors();
+        }
+        if (_staging_requested) {
+            StartStaging();
+        }
     }
 
+    // Rethrows any error from writing staged packets, once the stream is closed.
     void Close()
     {
+        StopStaging();
+        std::exception_ptr error;
+        std::swap(error, _sequencer_error);
         if (_open)
         {
+            FlushChunks();
             if (_indexable) {
                 WriteEnd();
             }
             _buffer.close();
             _open = false;
         }
+        StopCompressors();
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
 
     // Does not write footer or index.
     void ForceClose()
     {
+        StopStaging();
+        DiscardChunks();
         if (_open)
         {
         _buffer.force_close();
@@ -102,13 +145,76 @@ public:
     );
 
     // For stream read/write synchronization. Note that this is NOT the same as
-    // time synchronization on playback of iPacketStreams.
+    // time synchronization on playback of iPacketStreams. Rethrows any error
+    // from writing staged packets.
     void WriteSync();
 
     // Writes the end of the stream data, including the index. Does NOT close
-    // the underlying ostream.
+    // the underlying ostream. Rethrows any error from writing staged packets.
     void WriteEnd();
 
+    // Index checkpoints hold the index entries since the previous checkpoint
+    // and its position, so that a reader can recover the index of a stream
+    // which was never closed from its last few megabytes. One is written
+    // after every_packets packets or every_us microseconds, whichever comes
+    // first. Zero disables that trigger. Off by default, since older readers
+    // cannot open streams with checkpoints, and default_checkpoint_packets /
+    // default_checkpoint_us are suggested values. The stream header records
+    // whether checkpoints follow, so enable them before Open().
+    void SetIndexCheckpointInterval(size_t every_packets, int64_t every_us);
+
+    // Write an index checkpoint now
+    void WriteCheckpoint();
+
+    // Group consecutive packets into chunks of about chunk_bytes, each
+    // compressed with codec on one of num_threads threads (or inline if zero)
+    // and protected by a CRC32C which readers verify. The index then refers to
+    // packets by chunk and offset. Codecs unavailable in this build fall back
+    // to uncompressed, checksummed chunks. Zero chunk_bytes, the default,
+    // writes packets directly. Streams with chunks cannot be read by earlier
+    // versions of Pangolin, which don't know the chunk tag.
+    void SetChunking(size_t chunk_bytes, PacketChunkCodec codec = PacketChunkCodec::LZ4, int level = 0, size_t num_threads = 2);
+
+    // Write object metadata in binary, declaring its keys and value types in
+    // a schema once per source and whenever they change. Readers present it
+    // as picojson as before. Off by default so that older readers can open
+    // the stream.
+    void SetBinaryMeta(bool enable);
+
+    enum class PacketOrder
+    {
+        Arrival,   // Order of the WriteSourcePacket() calls
+        Timestamp  // Receive time, amongst the packets staged at once
+    };
+
+    // When enabled, WriteSourcePacket() copies each packet into a staging
+    // queue for its source and returns, and a sequencer thread interleaves
+    // the queues into the stream in order. Threads writing different sources
+    // then only wait on their own queue exceeding max_staged_bytes, never on
+    // each other. Must not be called concurrently with WriteSourcePacket().
+    void SetStaging(bool enable, PacketOrder order = PacketOrder::Arrival, size_t max_staged_bytes = 64*1024*1024);
+
+    // Wait until all staged packets have been written to the stream. Rethrows
+    // any error from writing them.
+    void Flush();
+
+    struct Stats
+    {
+        size_t packets_submitted = 0;
+        // Time spent within WriteSourcePacket(), including any wait for space
+        int64_t total_submit_us = 0;
+        int64_t max_submit_us = 0;
+        // Number of packets which waited for their staging queue to drain
+        size_t packets_blocked = 0;
+    };
+
+    Stats GetStats() const;
+
+    void ResetStats();
+
+    static constexpr size_t default_checkpoint_packets = 10000;
+    static constexpr int64_t default_checkpoint_us = 10000000;
+
     const std::vector<PacketStreamSource>& Sources() const {
         return _sources;
     }
@@ -118,9 +224,68 @@ public:
     }
 
 private:
+    struct StagedPacket
+    {
+        uint64_t ticket;
+        int64_t receive_time_us;
+        std::vector<char> data;
+        picojson::value meta;
+    };
+
+    struct Staging
+    {
+        int64_t data_size_bytes = 0;
+        std::mutex lock;
+        std::condition_variable space;
+        std::deque<StagedPacket> queue;
+        size_t bytes = 0;
+    };
+
+    using StagingList = std::vector<std::shared_ptr<Staging>>;
+
+    struct Chunk
+    {
+        PacketChunkCodec codec;
+        int level;
+        // Serialized items, then the payload as stored once done
+        std::string data;
+        size_t raw_size = 0;
+        // Source and index entry of each packet, relative to the chunk
+        std::vector<std::pair<PacketStreamSourceId, PacketStreamSource::PacketInfo>> packets;
+        std::string table;
+        uint32_t checksum = 0;
+        bool done = false;
+    };
+
+    void WritePacket(
+        PacketStreamSourceId src, const char* source, int64_t receive_time_us,
+        size_t sourcelen, const picojson::value& meta
+    );
+    bool StagePacket(
+        PacketStreamSourceId src, const char* source, int64_t receive_time_us,
+        size_t sourcelen, const picojson::value& meta
+    );
+    void StartStaging();
+    void StopStaging();
+    void WaitForStaged();
+    void SequencerLoop();
+
+    void SealChunk();
+    void WriteChunks(bool all);
+    void FlushChunks();
+    void DiscardChunks();
+    void StartCompressors();
+    void StopCompressors();
+    void CompressorLoop();
+    static void EncodeChunk(Chunk& chunk);
+
+    void CountCheckpointPackets(size_t num_packets);
+    void WriteCheckpointBlock();
+
     void WriteHeader();
     void Write(const PacketStreamSource&);
     void WriteMeta(PacketStreamSourceId src, const picojson::value& data);
+    void WriteBinaryMeta(PacketStreamSourceId src, const picojson::object& data);
 
     threadedfilebuf _buffer;
     std::ostream _stream;
@@ -129,6 +294,62 @@ private:
     std::vector<PacketStreamSource> _sources;
     size_t _bytes_written;
     std::recursive_mutex _lock;
+
+    size_t _checkpoint_packets;
+    int64_t _checkpoint_us;
+    // Whether the header of the open stream announced checkpoints
+    bool _header_checkpoints;
+    int64_t _last_checkpoint_pos;
+    int64_t _last_checkpoint_us;
+    size_t _packets_since_checkpoint;
+    // Per source, the number of index entries already written to a checkpoint
+    std::vector<size_t> _checkpointed;
+
+    bool _binary_meta;
+    // Per source, the position and layout of the current metadata schema
+    std::vector<std::pair<int64_t, PacketMetaSchema>> _meta_schemas;
+
+    // Per source staging queues, replaced as a whole when sources are added
+    // so that producers can read the list without a lock.
+    std::shared_ptr<const StagingList> _staging = std::make_shared<StagingList>();
+    bool _staging_requested = false;
+    std::atomic<bool> _staging_enabled{false};
+    PacketOrder _order = PacketOrder::Arrival;
+    size_t _max_staged_bytes = 0;
+
+    std::thread _sequencer;
+    std::mutex _sequencer_lock;
+    std::condition_variable _sequencer_cv;
+    std::condition_variable _flushed_cv;
+    // Packets staged and packets written, the latter guarded by _sequencer_lock
+    std::atomic<uint64_t> _tickets{0};
+    uint64_t _written = 0;
+    std::atomic<bool> _sequencer_waiting{false};
+    bool _stop_sequencer = false;
+    std::exception_ptr _sequencer_error;
+
+    std::atomic<size_t> _packets_submitted{0};
+    std::atomic<int64_t> _total_submit_us{0};
+    std::atomic<int64_t> _max_submit_us{0};
+    std::atomic<size_t> _packets_blocked{0};
+
+    size_t _chunk_bytes = 0;
+    PacketChunkCodec _chunk_codec = PacketChunkCodec::None;
+    int _chunk_level = 0;
+    size_t _chunk_threads = 0;
+    // Items are serialized here whilst a chunk is open
+    std::stringbuf _chunk_buffer;
+    bool _chunk_open = false;
+    std::vector<std::pair<PacketStreamSourceId, PacketStreamSource::PacketInfo>> _chunk_packets;
+    // Sealed chunks in stream order awaiting compression or writing
+    std::deque<std::shared_ptr<Chunk>> _chunks;
+
+    std::vector<std::thread> _compressors;
+    std::mutex _compress_lock;
+    std::condition_variable _compress_cv;
+    std::condition_variable _compressed_cv;
+    std::deque<std::shared_ptr<Chunk>> _compress_queue;
+    bool _stop_compressors = false;
 };
 
 inline void writeCompressedUnsignedInt(std::ostream& writer, size_t n)
@@ -170,4 +391,14 @@ inline picojson::value SourceStats(const std::vector<PacketStreamSource>& srcs)
     return stat;
 }
 
+// Writes TAG_PANGO_INDEX followed by the binary index of srcs: the uint32
+// index version, the uint64 size of the remaining block and then the
+// number of sources. Each source holds its packet count followed by the
+// zigzag varint differences in stream position and capture time from the
+// previous packet, so that large indices stay compact and can be decoded from
+// a single read. Version 2 follows each packet with its varint chunk offset
+// plus one, zero for packets outside of chunks.
+PANGOLIN_EXPORT
+void writeSourceIndex(std::ostream& writer, const std::vector<PacketStreamSource>& srcs);
+
 }
@@ -33,6 +33,23 @@ public:
         }
     }
 
+    // Return a reader with its own file handle and read position, sharing the
+    // sources and index parsed by Open(filename). Readers following different
+    // sources of one file then proceed in parallel instead of serialising on
+    // and seeking one stream. Pipes cannot be reopened, so all readers of a
+    // pipe share the instance from Open(filename).
+    std::shared_ptr<PacketStreamReader> OpenCursor(const std::string& filename)
+    {
+        auto psr = Open(filename);
+        if(IsPipe(SanitizePath(PathExpand(filename)))) {
+            return psr;
+        }
+
+        auto cursor = std::make_shared<PacketStreamReader>();
+        cursor->Open(*psr);
+        return cursor;
+    }
+
     // Should only be called if there's no playbacks
     // in flight
     void Clear() {
@@ -1,5 +1,8 @@
 #include <pangolin/log/packet.h>
 
+#include <cstring>
+#include <iterator>
+
 namespace pangolin {
 
 
@@ -36,17 +39,124 @@ int Packet::BytesRemaining() const
     }
 }
 
+static void ParseMetaSchema(PacketStream& s, std::vector<PacketStreamSource>& srcs)
+{
+    const int64_t pos = static_cast<std::streamoff>(s.tellg());
+    s.readTag(TAG_SRC_SCHEMA);
+    const size_t src = s.readUINT();
+    PANGO_ENSURE(src < srcs.size(), "Metadata schema for unknown source. Stream may be corrupt.");
+
+    picojson::value json;
+    picojson::parse(json, s);
+
+    PacketMetaSchema schema;
+    for (const auto& key : json["keys"].get<picojson::array>())
+        schema.keys.push_back(key.get<std::string>());
+    for (const auto& type : json["types"].get<picojson::array>())
+        schema.types.push_back(type.get<std::string>().at(0));
+    for (const auto& base : json["bases"].get<picojson::array>())
+        schema.bases.push_back(base.get<int64_t>());
+    PANGO_ENSURE(schema.keys.size() == schema.types.size() && schema.keys.size() == schema.bases.size());
+
+    srcs[src].meta_schemas[pos] = std::move(schema);
+}
+
+// Read binary metadata into an equivalent picojson object. Returns its source.
+static size_t ParseBinaryMeta(PacketStream& s, std::vector<PacketStreamSource>& srcs, picojson::value& meta)
+{
+    const int64_t pos = static_cast<std::streamoff>(s.tellg());
+    s.readTag(TAG_SRC_META);
+    const size_t src = s.readUINT();
+    const int64_t schema_pos = pos - static_cast<int64_t>(s.readUINT());
+    const size_t values_size = s.readUINT();
+    PANGO_ENSURE(s.good() && src < srcs.size(), "Binary metadata for unknown source. Stream may be corrupt.");
+
+    std::string values(values_size, '\0');
+    PANGO_ENSURE(s.read(&values[0], values_size) == values_size);
+
+    auto& schemas = srcs[src].meta_schemas;
+    auto schema = schemas.find(schema_pos);
+    if (schema == schemas.end()) {
+        if (s.seekable()) {
+            // We have seeked past the schema, so go back and read it.
+            const std::streampos resume = s.tellg();
+            s.seekg(schema_pos);
+            ParseMetaSchema(s, srcs);
+            s.seekg(resume);
+            schema = schemas.find(schema_pos);
+        } else if (!schemas.empty()) {
+            // Pipes have no positions but are read in order, so the latest
+            // schema read is the current one.
+            schema = std::prev(schemas.end());
+        }
+    }
+    PANGO_ENSURE(schema != schemas.end(), "Binary metadata schema not found. Stream may be corrupt.");
+
+    const PacketMetaSchema& sch = schema->second;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(values.data());
+    const unsigned char* end = p + values.size();
+
+    meta = picojson::value(picojson::object());
+    picojson::object& obj = meta.get<picojson::object>();
+    for (size_t i = 0; i < sch.keys.size(); ++i) {
+        picojson::value& v = obj[sch.keys[i]];
+        switch (sch.types[i]) {
+        case 'i': {
+            int64_t d;
+            PANGO_ENSURE(readCompressedSignedInt(p, end, d));
+            v = picojson::value(sch.bases[i] + d);
+            break;
+        }
+        case 'f': {
+            double d;
+            PANGO_ENSURE(end - p >= std::ptrdiff_t(sizeof(d)));
+            std::memcpy(&d, p, sizeof(d));
+            p += sizeof(d);
+            v = picojson::value(d);
+            break;
+        }
+        case 'b':
+            PANGO_ENSURE(p < end);
+            v = picojson::value(*p++ != 0);
+            break;
+        default: {
+            uint64_t len;
+            PANGO_ENSURE(readCompressedUnsignedInt(p, end, len) && len <= uint64_t(end - p));
+            std::string str(reinterpret_cast<const char*>(p), len);
+            p += len;
+            if (sch.types[i] == 's') {
+                v = picojson::value(std::move(str));
+            } else {
+                picojson::parse(v, str);
+            }
+            break;
+        }
+        }
+    }
+
+    return src;
+}
+
 void Packet::ParsePacketHeader(PacketStream& s, std::vector<PacketStreamSource>& srcs)
 {
     size_t json_src = -1;
 
     frame_streampos = s.tellg();
+    if (s.peekTag() == TAG_SRC_SCHEMA)
+    {
+        ParseMetaSchema(s, srcs);
+    }
+
     if (s.peekTag() == TAG_SRC_JSON)
     {
         s.readTag(TAG_SRC_JSON);
         json_src = s.readUINT();
         picojson::parse(meta, s);
     }
+    else if (s.peekTag() == TAG_SRC_META)
+    {
+        json_src = ParseBinaryMeta(s, srcs, meta);
+    }
 
     s.readTag(TAG_SRC_PACKET);
     time = s.readTimestamp();
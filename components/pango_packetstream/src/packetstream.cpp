@@ -1,5 +1,11 @@
 #include <pangolin/log/packetstream.h>
+#include <array>
 #include <stdexcept>
+#include <vector>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
 
 namespace pangolin {
 
@@ -102,45 +108,156 @@ void PacketStream::seekg(std::streamoff off, std::ios_base::seekdir way)
     }
 }
 
+void PacketStream::ChunkBuffer::assign(std::vector<char>&& data)
+{
+    _data = std::move(data);
+    setg(_data.data(), _data.data(), _data.data() + _data.size());
+}
+
+PacketStream::ChunkBuffer::pos_type PacketStream::ChunkBuffer::seekoff(off_type off, std::ios_base::seekdir way, std::ios_base::openmode which)
+{
+    if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+
+    off_type target = off;
+    if (way == std::ios_base::cur) target += gptr() - eback();
+    else if (way == std::ios_base::end) target += egptr() - eback();
+    if (target < 0 || target > egptr() - eback()) return pos_type(off_type(-1));
+
+    setg(eback(), eback() + target, egptr());
+    return pos_type(target);
+}
+
+PacketStream::ChunkBuffer::pos_type PacketStream::ChunkBuffer::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+void PacketStream::enterChunk(std::vector<char>&& data)
+{
+    cclear();
+    _chunk.assign(std::move(data));
+    std::ios::rdbuf(&_chunk);
+    _in_chunk = true;
+}
+
+void PacketStream::leaveChunk()
+{
+    if (_in_chunk) {
+        // The file was read up to the end of the chunk before entering it
+        cclear();
+        std::ios::rdbuf(Base::rdbuf());
+        _chunk.assign(std::vector<char>());
+        _in_chunk = false;
+    }
+}
+
+bool PacketStream::chunkExhausted()
+{
+    return _in_chunk && (!good() || (!_tag && _chunk.in_avail() <= 0));
+}
+
+// All tags are three upper case letters, which syncToTag() relies upon
+static const PangoTagType valid_tags[] = {
+    TAG_PANGO_SYNC, TAG_ADD_SOURCE, TAG_SRC_JSON, TAG_SRC_SCHEMA, TAG_SRC_META,
+    TAG_SRC_PACKET, TAG_PANGO_STATS, TAG_PANGO_INDEX, TAG_PANGO_CHECKPOINT, TAG_PANGO_CHUNK,
+    TAG_PANGO_FOOTER, TAG_END, TAG_PANGO_HDR, TAG_PANGO_MAGIC
+};
+
 static bool valid(PangoTagType t)
 {
-    switch (t)
-    {
-    case TAG_PANGO_SYNC:
-        case TAG_ADD_SOURCE:
-        case TAG_SRC_JSON:
-        case TAG_SRC_PACKET:
-        case TAG_PANGO_STATS:
-        case TAG_PANGO_FOOTER:
-        case TAG_END:
-        case TAG_PANGO_HDR:
-        case TAG_PANGO_MAGIC:
-        return true;
-    default:
-        return false;
+    for (PangoTagType v : valid_tags) {
+        if (t == v) return true;
     }
+    return false;
 }
 
-PangoTagType PacketStream::syncToTag() //scan through chars one by one until the last three look like a tag
+// True for bytes which begin a valid tag, to reject most positions with one lookup
+static const std::array<bool,256>& tagStarts()
 {
-    peekTag();
-    char * buffer = reinterpret_cast<char*>(&_tag);
+    static const std::array<bool,256> starts = [](){
+        std::array<bool,256> s{};
+        for (PangoTagType v : valid_tags) s[v & 0xff] = true;
+        return s;
+    }();
+    return starts;
+}
 
-    buffer[3] = 0;
+PangoTagType PacketStream::syncToTag() //scan forward from the byte after the current tag until three bytes look like a tag
+{
+    peekTag();
+    const std::streamoff tag_pos = tellg();
+    const auto& starts = tagStarts();
 
-    do
+    if (seekable() && tag_pos >= 0)
     {
-        buffer[0] = buffer[1];
-        buffer[1] = buffer[2];
-        buffer[2] = get();
-    }
-    while (good() && !valid(_tag));
+        // Search large blocks, overlapping each by the length of a tag
+        const std::streamoff block_size = 1 << 20;
+        std::vector<unsigned char>& block = _sync_block;
+        block.resize(block_size);
+        std::streamoff block_pos = tag_pos + 1;
 
-    if (!good())
-        _tag = TAG_END;
+        while (true)
+        {
+            Base::clear();
+            Base::seekg(block_pos);
+            Base::read(reinterpret_cast<char*>(block.data()), block_size);
+            const std::streamoff n = gcount();
 
-    return _tag;
+            for (std::streamoff i = 0; i + std::streamoff(TAG_LENGTH) <= n; ++i)
+            {
+#ifdef __SSE2__
+                // Every tag is three upper case letters, so skip to the next
+                // letter sixteen bytes at a time.
+                if (i + 16 <= n) {
+                    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.data() + i));
+                    const __m128i letters = _mm_and_si128(
+                        _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1))
+                    );
+                    const int mask = _mm_movemask_epi8(letters);
+                    if (!mask) {
+                        i += 15;
+                        continue;
+                    }
+                    i += __builtin_ctz(mask);
+                    if (i + std::streamoff(TAG_LENGTH) > n) break;
+                }
+#endif
+                if (!starts[block[i]]) continue;
+                const PangoTagType t = block[i] | (block[i+1] << 8) | (block[i+2] << 16);
+                if (valid(t))
+                {
+                    Base::clear();
+                    Base::seekg(block_pos + i + TAG_LENGTH);
+                    _tag = t;
+                    return _tag;
+                }
+            }
+
+            if (n < block_size) break;
+            block_pos += n - (TAG_LENGTH - 1);
+        }
+
+        _tag = TAG_END;
+        return _tag;
+    }
 
+    // Pipes can't be rewound, so slide a window over the stream buffer
+    std::streambuf* sb = std::ios::rdbuf();
+    PangoTagType t = _tag;
+    while (true)
+    {
+        const int c = sb->sbumpc();
+        if (c == std::char_traits<char>::eof()) {
+            setstate(std::ios::eofbit | std::ios::failbit);
+            _tag = TAG_END;
+            return _tag;
+        }
+        t = (t >> 8) | (PangoTagType(c) << 16);
+        if (starts[t & 0xff] && valid(t)) {
+            _tag = t;
+            return _tag;
+        }
+    }
 }
 
 }
@@ -0,0 +1,179 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pangolin/log/packetstream_chunk.h>
+
+#include <cstring>
+#include <limits>
+
+#ifdef __SSE4_2__
+#  include <nmmintrin.h>
+#endif
+
+#ifdef HAVE_LZ4
+#  include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#endif
+
+namespace pangolin
+{
+
+bool PacketChunkCodecAvailable(PacketChunkCodec codec)
+{
+    switch (codec) {
+    case PacketChunkCodec::None:
+        return true;
+#ifdef HAVE_LZ4
+    case PacketChunkCodec::LZ4:
+        return true;
+#endif
+#ifdef HAVE_ZSTD
+    case PacketChunkCodec::Zstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+#ifndef __SSE4_2__
+// Tables for processing eight bytes per step ("slicing by 8")
+struct Crc32cTables
+{
+    Crc32cTables()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) {
+                t[s][i] = (t[s-1][i] >> 8) ^ t[0][t[s-1][i] & 0xff];
+            }
+        }
+    }
+
+    uint32_t t[8][256];
+};
+#endif
+
+uint32_t Crc32c(const void* data, size_t size, uint32_t crc)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+
+#ifdef __SSE4_2__
+    uint64_t c = crc;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = static_cast<uint32_t>(c);
+    for (; size; --size) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+#else
+    static const Crc32cTables tables;
+    const auto& t = tables.t;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, sizeof(lo));
+        std::memcpy(&hi, p + 4, sizeof(hi));
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    }
+    for (; size; --size) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    }
+#endif
+
+    return ~crc;
+}
+
+bool CompressChunk(PacketChunkCodec codec, int level, const char* raw, size_t raw_size, std::string& out)
+{
+    PANGOLIN_UNUSED(level);
+    PANGOLIN_UNUSED(raw);
+
+    switch (codec) {
+#ifdef HAVE_LZ4
+    case PacketChunkCodec::LZ4: {
+        if (raw_size > size_t(LZ4_MAX_INPUT_SIZE)) return false;
+        out.resize(LZ4_compressBound(int(raw_size)));
+        // level is the acceleration factor, where larger is faster
+        const int n = LZ4_compress_fast(raw, &out[0], int(raw_size), int(out.size()), level);
+        if (n <= 0 || size_t(n) >= raw_size) return false;
+        out.resize(n);
+        return true;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case PacketChunkCodec::Zstd: {
+        out.resize(ZSTD_compressBound(raw_size));
+        const size_t n = ZSTD_compress(&out[0], out.size(), raw, raw_size, level);
+        if (ZSTD_isError(n) || n >= raw_size) return false;
+        out.resize(n);
+        return true;
+    }
+#endif
+    default:
+        PANGOLIN_UNUSED(raw_size);
+        PANGOLIN_UNUSED(out);
+        return false;
+    }
+}
+
+bool DecompressChunk(PacketChunkCodec codec, const char* data, size_t size, char* raw, size_t raw_size)
+{
+    switch (codec) {
+    case PacketChunkCodec::None:
+        if (size != raw_size) return false;
+        std::memcpy(raw, data, size);
+        return true;
+#ifdef HAVE_LZ4
+    case PacketChunkCodec::LZ4:
+        if (size > size_t(std::numeric_limits<int>::max()) || raw_size > size_t(std::numeric_limits<int>::max())) return false;
+        return LZ4_decompress_safe(data, raw, int(size), int(raw_size)) == int(raw_size);
+#endif
+#ifdef HAVE_ZSTD
+    case PacketChunkCodec::Zstd: {
+        const size_t n = ZSTD_decompress(raw, raw_size, data, size);
+        return !ZSTD_isError(n) && n == raw_size;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+}
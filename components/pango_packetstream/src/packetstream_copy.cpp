@@ -0,0 +1,207 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pangolin/log/packetstream_copy.h>
+#include <pangolin/utils/format_string.h>
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+namespace pangolin
+{
+
+void PacketStreamSelection::SetFrames(const PacketStreamReader& reader, PacketStreamSourceId src, size_t begin, size_t end)
+{
+    if(src >= reader.Sources().size())
+        throw std::runtime_error("PacketStreamSelection: unknown source.");
+
+    const auto& index = reader.Sources()[src].index;
+    if(begin < index.size()) {
+        begin_us = std::max(begin_us, index[begin].capture_time);
+    }else{
+        end_us = begin_us;
+    }
+    if(end < index.size()) {
+        end_us = std::min(end_us, index[end].capture_time);
+    }
+}
+
+// Description of src without its index or read state
+static PacketStreamSource describeSource(const PacketStreamSource& src)
+{
+    PacketStreamSource desc;
+    desc.driver = src.driver;
+    desc.uri = src.uri;
+    desc.info = src.info;
+    desc.version = src.version;
+    desc.data_alignment_bytes = src.data_alignment_bytes;
+    desc.data_definitions = src.data_definitions;
+    desc.data_size_bytes = src.data_size_bytes;
+    return desc;
+}
+
+static std::vector<PacketStreamSourceId> selectedSources(const PacketStreamReader& reader, const PacketStreamSelection& selection)
+{
+    std::vector<PacketStreamSourceId> sources = selection.sources;
+    if(sources.empty()) {
+        for(size_t i=0; i < reader.Sources().size(); ++i) sources.push_back(i);
+    }
+    for(PacketStreamSourceId src : sources) {
+        if(src >= reader.Sources().size())
+            throw std::runtime_error("PacketStreamSelection: unknown source.");
+    }
+    return sources;
+}
+
+// Next packet of a stream whose index promised remaining packets, copied of
+// which have been read
+static Packet nextFrame(PacketStreamReader& reader, size_t copied, size_t remaining)
+{
+    try {
+        return reader.NextFrame();
+    }catch(const std::runtime_error&) {
+        throw std::runtime_error(FormatString("CopyPackets: stream ended after % of % packets.", copied, remaining));
+    }
+}
+
+// Read the selected packets in stream order, passing each to write. Uses the
+// index to seek straight to the first packet and to stop after the last.
+// Throws if the stream holds fewer packets than its index promised.
+static size_t copySelected(
+    PacketStreamReader& reader, const PacketStreamSelection& selection,
+    const std::vector<PacketStreamSourceId>& sources,
+    const std::function<void(size_t out_src, Packet& packet, const std::vector<char>& data)>& write)
+{
+    const size_t unselected = static_cast<size_t>(-1);
+    std::vector<size_t> out_ids(reader.Sources().size(), unselected);
+    for(size_t i=0; i < sources.size(); ++i) {
+        out_ids[sources[i]] = i;
+    }
+
+    auto selected = [&](int64_t time) {
+        return selection.begin_us <= time && time < selection.end_us;
+    };
+
+    auto before = [](const PacketStreamSource::PacketInfo& a, const PacketStreamSource::PacketInfo& b) {
+        return a.pos < b.pos || (a.pos == b.pos && a.chunk_offset < b.chunk_offset);
+    };
+
+    // Count the packets to copy and find the earliest in the stream
+    size_t remaining = 0;
+    PacketStreamSourceId first_src = 0;
+    size_t first_frame = unselected;
+    for(PacketStreamSourceId src : sources) {
+        const auto& index = reader.Sources()[src].index;
+        size_t src_first = unselected;
+        for(size_t f=0; f < index.size(); ++f) {
+            if(!selected(index[f].capture_time)) continue;
+            ++remaining;
+            if(src_first == unselected) src_first = f;
+        }
+        if( src_first != unselected && (first_frame == unselected ||
+            before(index[src_first], reader.Sources()[first_src].index[first_frame])) )
+        {
+            first_src = src;
+            first_frame = src_first;
+        }
+    }
+
+    if(!remaining) {
+        return 0;
+    }
+
+    reader.Seek(first_src, first_frame);
+
+    size_t copied = 0;
+    std::vector<char> data;
+    while(copied < remaining) {
+        Packet packet = nextFrame(reader, copied, remaining);
+        if(packet.src >= out_ids.size() || out_ids[packet.src] == unselected || !selected(packet.time)) {
+            continue;
+        }
+
+        data.resize(packet.size);
+        if(packet.Stream().read(data.data(), data.size()) != data.size()) {
+            throw std::runtime_error(FormatString("CopyPackets: packet % of source % is truncated.", packet.sequence_num, packet.src));
+        }
+        write(out_ids[packet.src], packet, data);
+        ++copied;
+    }
+
+    return copied;
+}
+
+size_t CopyPackets(PacketStreamReader& reader, PacketStreamWriter& writer, const PacketStreamSelection& selection)
+{
+    const std::vector<PacketStreamSourceId> sources = selectedSources(reader, selection);
+
+    const PacketStreamSourceId first_id = writer.Sources().size();
+    for(PacketStreamSourceId src : sources) {
+        writer.AddSource(describeSource(reader.Sources()[src]));
+    }
+
+    return copySelected(reader, selection, sources,
+        [&](size_t out_src, Packet& packet, const std::vector<char>& data) {
+            writer.WriteSourcePacket(first_id + out_src, data.data(), packet.time, data.size(), packet.meta);
+        }
+    );
+}
+
+size_t SplitPackets(
+    PacketStreamReader& reader, int64_t segment_us, const std::function<std::string(size_t)>& filename,
+    const PacketStreamSelection& selection)
+{
+    if(segment_us <= 0)
+        throw std::runtime_error("SplitPackets: segment length must be positive.");
+
+    const std::vector<PacketStreamSourceId> sources = selectedSources(reader, selection);
+
+    std::unique_ptr<PacketStreamWriter> writer;
+    size_t num_segments = 0;
+    int64_t segment_end = 0;
+
+    copySelected(reader, selection, sources,
+        [&](size_t out_src, Packet& packet, const std::vector<char>& data) {
+            if(!writer || packet.time >= segment_end) {
+                // Segments are aligned to the first packet, skipping any gaps
+                const int64_t segment_begin = writer ?
+                    segment_end + (packet.time - segment_end) / segment_us * segment_us : packet.time;
+                segment_end = segment_begin + segment_us;
+
+                writer.reset();
+                writer.reset(new PacketStreamWriter(filename(num_segments++)));
+                for(PacketStreamSourceId src : sources) {
+                    writer->AddSource(describeSource(reader.Sources()[src]));
+                }
+            }
+            writer->WriteSourcePacket(out_src, data.data(), packet.time, data.size(), packet.meta);
+        }
+    );
+
+    return num_segments;
+}
+
+}
@@ -23,6 +23,7 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <pangolin/log/packetstream_chunk.h>
 #include <pangolin/log/packetstream_reader.h>
 #include <pangolin/log/packetstream_writer.h>
 
@@ -35,6 +36,8 @@ using std::ios_base;
 using std::streampos;
 using std::streamoff;
 
+#include <algorithm>
+#include <cstring>
 #include <thread>
 
 #ifndef _WIN_
@@ -45,12 +48,12 @@ namespace pangolin
 {
 
 PacketStreamReader::PacketStreamReader()
-    : _pipe_fd(-1)
+    : _pipe_fd(-1), _index_checkpoints(false), _corrupt_chunks(0), _chunk_pos(-1), _is_cursor(false)
 {
 }
 
 PacketStreamReader::PacketStreamReader(const std::string& filename)
-    : _pipe_fd(-1)
+    : _pipe_fd(-1), _index_checkpoints(false), _corrupt_chunks(0), _chunk_pos(-1), _is_cursor(false)
 {
     Open(filename);
 }
@@ -90,17 +93,49 @@ void PacketStreamReader::Open(const std::string& filename)
     while (_stream.peekTag() == TAG_ADD_SOURCE) {
         ParseNewSource();
     }
+    _packets_begin = _is_pipe ? std::streampos(0) : _stream.tellg();
 
     if(!SetupIndex()) {
         FixFileIndex();
     }
 }
 
+void PacketStreamReader::Open(const PacketStreamReader& other)
+{
+    std::lock_guard<std::recursive_mutex> lg(_mutex);
+    std::lock_guard<std::recursive_mutex> lg_other(other._mutex);
+
+    if(other._is_pipe || !other._stream.is_open())
+        throw runtime_error("Cursors can only be opened on seekable files.");
+
+    Close();
+
+    _filename = other._filename;
+    _is_pipe = false;
+    _stream.open(_filename);
+    if (!_stream.is_open())
+        throw runtime_error("Cannot open stream from " + _filename);
+
+    _sources = other._sources;
+    for(PacketStreamSource& src : _sources) {
+        src.next_packet_id = 0;
+        src.meta_schemas.clear();
+    }
+    packet_stream_start = other.packet_stream_start;
+    _packets_begin = other._packets_begin;
+    _index_checkpoints = other._index_checkpoints;
+    _is_cursor = true;
+
+    _stream.seekg(_packets_begin);
+}
+
 void PacketStreamReader::Close() {
     std::lock_guard<std::recursive_mutex> lg(_mutex);
 
     _stream.close();
     _sources.clear();
+    _chunk_pos = -1;
+    _is_cursor = false;
 
 #ifndef _WIN_
     if (_pipe_fd != -1) {
@@ -119,25 +154,20 @@ void PacketStreamReader::ParseHeader()
     // File timestamp
     const int64_t start_us = json_header["time_us"].get<int64_t>();
     packet_stream_start = SyncTime::TimePoint() + std::chrono::microseconds(start_us);
+    _index_checkpoints = json_header.contains("index_checkpoints");
 
     _stream.get(); // consume newline
 }
 
-void PacketStreamReader::ParseNewSource()
+static void AddSource(std::vector<PacketStreamSource>& sources, const picojson::value& json)
 {
-    _stream.readTag(TAG_ADD_SOURCE);
-    picojson::value json;
-    picojson::parse(json, _stream);
-    _stream.get(); // consume newline
-
-
     const size_t src_id = json[pss_src_id].get<int64_t>();
 
-    if(_sources.size() <= src_id) {
-        _sources.resize(src_id+1);
+    if(sources.size() <= src_id) {
+        sources.resize(src_id+1);
     }
 
-    PacketStreamSource& pss = _sources[src_id];
+    PacketStreamSource& pss = sources[src_id];
     pss.id = src_id;
     pss.driver = json[pss_src_driver].get<string>();
     pss.uri = json[pss_src_uri].get<string>();
@@ -148,6 +178,16 @@ void PacketStreamReader::ParseNewSource()
     pss.data_size_bytes = json[pss_src_packet][pss_pkt_size_bytes].get<int64_t>();
 }
 
+void PacketStreamReader::ParseNewSource()
+{
+    _stream.readTag(TAG_ADD_SOURCE);
+    picojson::value json;
+    picojson::parse(json, _stream);
+    _stream.get(); // consume newline
+
+    AddSource(_sources, json);
+}
+
 bool PacketStreamReader::SetupIndex()
 {
     bool index_good = false;
@@ -163,7 +203,9 @@ bool PacketStreamReader::SetupIndex()
         {
             //parsing the footer returns the index position
             _stream.seekg(ParseFooter());
-            if (_stream.peekTag() == TAG_PANGO_STATS) {
+            if (_stream.peekTag() == TAG_PANGO_INDEX) {
+                index_good = ParseBinaryIndex();
+            }else if (_stream.peekTag() == TAG_PANGO_STATS) {
                 // Read the pre-build index from the file
                 index_good = ParseIndex();
             }
@@ -209,17 +251,604 @@ bool PacketStreamReader::ParseIndex()
         // Populate index
         for(size_t i=0; i < _sources.size(); ++i) {
             PANGO_ENSURE(json_index[i].size() == json_times[i].size());
-            _sources[i].index.resize(json_index[i].size());
+            std::vector<PacketStreamSource::PacketInfo> index(json_index[i].size());
             for(size_t f=0; f < json_index[i].size(); ++f) {
-                _sources[i].index[f].pos = json_index[i][f].get<int64_t>();
-                _sources[i].index[f].capture_time = json_times[i][f].get<int64_t>();
+                index[f].pos = json_index[i][f].get<int64_t>();
+                index[f].capture_time = json_times[i][f].get<int64_t>();
             }
+            _sources[i].index = std::move(index);
         }
     }
 
     return index_good;
 }
 
+// Decode a packet count and the packet differences written by appendIndexSegment()
+static bool readIndexSegment(const unsigned char*& p, const unsigned char* end, uint32_t version, std::vector<PacketStreamSource::PacketInfo>& index)
+{
+    // Each packet takes at least a byte per field, which bounds any counts we trust.
+    const size_t min_packet_bytes = version >= 2 ? 3 : 2;
+    uint64_t num_packets;
+    if(!readCompressedUnsignedInt(p, end, num_packets) || num_packets > size_t(end - p) / min_packet_bytes) {
+        return false;
+    }
+
+    const size_t first = index.size();
+    index.resize(first + num_packets);
+
+    int64_t pos = 0;
+    int64_t time = 0;
+    for(size_t i = first; i < index.size(); ++i) {
+        int64_t dpos, dtime;
+        if(!readCompressedSignedInt(p, end, dpos) || !readCompressedSignedInt(p, end, dtime)) {
+            return false;
+        }
+        pos += dpos;
+        time += dtime;
+        index[i].pos = pos;
+        index[i].capture_time = time;
+        if(version >= 2) {
+            uint64_t offset;
+            if(!readCompressedUnsignedInt(p, end, offset)) {
+                return false;
+            }
+            index[i].chunk_offset = int64_t(offset) - 1;
+        }
+    }
+    return true;
+}
+
+bool PacketStreamReader::ParseBinaryIndex()
+{
+    _stream.readTag(TAG_PANGO_INDEX);
+
+    uint32_t version = 0;
+    uint64_t block_size = 0;
+    if( _stream.read(reinterpret_cast<char*>(&version), sizeof(version)) != sizeof(version) ||
+        _stream.read(reinterpret_cast<char*>(&block_size), sizeof(block_size)) != sizeof(block_size) )
+    {
+        return false;
+    }
+
+    if(version < 1 || version > PANGO_INDEX_VERSION) {
+        pango_print_warn("Unsupported index version %u in '%s'.\n", version, _filename.c_str());
+        return false;
+    }
+
+    // Reject a block larger than the rest of the file before allocating for it
+    const std::streamoff block_begin = _stream.tellg();
+    _stream.seekg(0, ios_base::end);
+    const std::streamoff file_size = _stream.tellg();
+    _stream.seekg(block_begin);
+    if(block_begin < 0 || file_size < block_begin || block_size > uint64_t(file_size - block_begin)) {
+        return false;
+    }
+
+    // Read the whole block at once and decode it in memory
+    std::vector<unsigned char> block;
+    try {
+        block.resize(block_size);
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+    if(_stream.read(reinterpret_cast<char*>(block.data()), block.size()) != block.size()) {
+        return false;
+    }
+
+    const unsigned char* p = block.data();
+    const unsigned char* end = p + block.size();
+
+    uint64_t num_sources;
+    if(!readCompressedUnsignedInt(p, end, num_sources) || num_sources < _sources.size() || num_sources > block.size()) {
+        return false;
+    }
+
+    std::vector<std::vector<PacketStreamSource::PacketInfo>> index(num_sources);
+    for(auto& src_index : index) {
+        if(!readIndexSegment(p, end, version, src_index)) {
+            return false;
+        }
+    }
+
+    if(p != end) {
+        return false;
+    }
+
+    _sources.resize(num_sources);
+    for(size_t i=0; i < _sources.size(); ++i) {
+        _sources[i].index = std::move(index[i]);
+    }
+
+    return true;
+}
+
+void PacketStreamReader::SkipIndexBlock()
+{
+    _stream.readTag();
+
+    uint32_t version = 0;
+    uint64_t block_size = 0;
+    _stream.read(reinterpret_cast<char*>(&version), sizeof(version));
+    _stream.read(reinterpret_cast<char*>(&block_size), sizeof(block_size));
+    _stream.skip(block_size);
+}
+
+namespace
+{
+
+const std::streamoff index_block_header_bytes = TAG_LENGTH + sizeof(uint32_t) + sizeof(uint64_t);
+
+struct IndexCheckpoint
+{
+    std::streamoff pos;
+    std::streamoff end;
+    int64_t prev;
+    // Per source, the id of the first packet and the packets which follow
+    std::vector<size_t> first;
+    std::vector<std::vector<PacketStreamSource::PacketInfo>> index;
+};
+
+// Sequence of stream items parsed from one section of a file
+struct PacketScan
+{
+    PacketScan() : start(-1), end(-1), complete(false) {}
+
+    // Position of the first item parsed and of the first item not parsed
+    std::streamoff start;
+    std::streamoff end;
+    // Stopped on reaching the end of the section, not an unreadable item
+    bool complete;
+    std::vector<std::pair<PacketStreamSourceId, PacketStreamSource::PacketInfo>> packets;
+    std::vector<picojson::value> sources;
+};
+
+// Fields following TAG_PANGO_CHUNK, see PacketStreamWriter::WriteChunks()
+struct ChunkHeader
+{
+    PacketChunkCodec codec;
+    uint32_t checksum;
+    uint64_t table_size;
+    uint64_t data_size;
+    uint64_t raw_size;
+};
+
+}
+
+static bool readChunkHeader(PacketStream& s, ChunkHeader& h)
+{
+    uint8_t codec = 0;
+    s.read(reinterpret_cast<char*>(&codec), sizeof(codec));
+    s.read(reinterpret_cast<char*>(&h.checksum), sizeof(h.checksum));
+    s.read(reinterpret_cast<char*>(&h.table_size), sizeof(h.table_size));
+    s.read(reinterpret_cast<char*>(&h.data_size), sizeof(h.data_size));
+    s.read(reinterpret_cast<char*>(&h.raw_size), sizeof(h.raw_size));
+    h.codec = static_cast<PacketChunkCodec>(codec);
+    return s.good() && codec <= uint8_t(PacketChunkCodec::Zstd);
+}
+
+// Decode the source, time and offset of each packet in a chunk at pos
+static bool readChunkTable(
+    const std::vector<char>& table, size_t num_sources, uint64_t raw_size, std::streamoff pos,
+    std::vector<std::pair<PacketStreamSourceId, PacketStreamSource::PacketInfo>>& packets)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(table.data());
+    const unsigned char* end = p + table.size();
+
+    uint64_t num_packets;
+    if(!readCompressedUnsignedInt(p, end, num_packets) || num_packets > table.size()) {
+        return false;
+    }
+
+    std::vector<std::pair<PacketStreamSourceId, PacketStreamSource::PacketInfo>> chunk_packets(num_packets);
+    int64_t time = 0;
+    uint64_t offset = 0;
+    for(auto& packet : chunk_packets) {
+        uint64_t src, doffset;
+        int64_t dtime;
+        if( !readCompressedUnsignedInt(p, end, src) || !readCompressedSignedInt(p, end, dtime) ||
+            !readCompressedUnsignedInt(p, end, doffset) || src >= num_sources || doffset >= raw_size - offset )
+        {
+            return false;
+        }
+        time += dtime;
+        offset += doffset;
+        packet = {src, {pos, time, int64_t(offset)}};
+    }
+
+    if(p != end) {
+        return false;
+    }
+    packets.insert(packets.end(), chunk_packets.begin(), chunk_packets.end());
+    return true;
+}
+
+// Read and decode the checkpoint block written by PacketStreamWriter::WriteCheckpoint() at pos
+static bool readCheckpoint(std::istream& in, std::streamoff pos, std::streamoff file_size, IndexCheckpoint& cp)
+{
+    if(pos < 0 || pos + index_block_header_bytes > file_size) {
+        return false;
+    }
+
+    char header[index_block_header_bytes];
+    in.clear();
+    in.seekg(pos);
+    if(!in.read(header, index_block_header_bytes)) {
+        return false;
+    }
+
+    PangoTagType tag = 0;
+    uint32_t version;
+    uint64_t block_size;
+    std::memcpy(&tag, header, TAG_LENGTH);
+    std::memcpy(&version, header + TAG_LENGTH, sizeof(version));
+    std::memcpy(&block_size, header + TAG_LENGTH + sizeof(version), sizeof(block_size));
+
+    if( tag != TAG_PANGO_CHECKPOINT || version < 1 || version > PANGO_INDEX_VERSION ||
+        block_size < sizeof(cp.prev) || block_size > uint64_t(file_size - pos - index_block_header_bytes) )
+    {
+        return false;
+    }
+
+    std::vector<unsigned char> block(block_size);
+    if(!in.read(reinterpret_cast<char*>(block.data()), block.size())) {
+        return false;
+    }
+
+    const unsigned char* p = block.data();
+    const unsigned char* end = p + block.size();
+
+    std::memcpy(&cp.prev, p, sizeof(cp.prev));
+    p += sizeof(cp.prev);
+    if(cp.prev < -1 || cp.prev >= pos) {
+        return false;
+    }
+
+    uint64_t num_sources;
+    if(!readCompressedUnsignedInt(p, end, num_sources) || num_sources > block.size()) {
+        return false;
+    }
+
+    cp.first.resize(num_sources);
+    cp.index.assign(num_sources, {});
+    for(size_t i=0; i < num_sources; ++i) {
+        uint64_t first;
+        if(!readCompressedUnsignedInt(p, end, first) || !readIndexSegment(p, end, version, cp.index[i])) {
+            return false;
+        }
+        cp.first[i] = first;
+    }
+
+    cp.pos = pos;
+    cp.end = pos + index_block_header_bytes + block_size;
+    return p == end;
+}
+
+// Search backwards from the end of the file for the last valid checkpoint
+static bool findLastCheckpoint(std::istream& in, std::streamoff file_size, IndexCheckpoint& cp)
+{
+    const std::streamoff chunk_size = 1 << 20;
+    std::vector<char> buffer(chunk_size + TAG_LENGTH - 1);
+    const PangoTagType tag = TAG_PANGO_CHECKPOINT;
+
+    for(std::streamoff chunk_end = file_size; chunk_end > 0; ) {
+        // Overlap the following chunk so that tags spanning the boundary are found
+        const std::streamoff chunk_begin = std::max<std::streamoff>(0, chunk_end - chunk_size);
+        const std::streamoff n = std::min<std::streamoff>(file_size, chunk_end + TAG_LENGTH - 1) - chunk_begin;
+        in.clear();
+        in.seekg(chunk_begin);
+        if(!in.read(buffer.data(), n)) {
+            return false;
+        }
+
+        for(std::streamoff i = chunk_end - chunk_begin - 1; i >= 0; --i) {
+            if( i + std::streamoff(TAG_LENGTH) <= n && !std::memcmp(buffer.data() + i, &tag, TAG_LENGTH) &&
+                readCheckpoint(in, chunk_begin + i, file_size, cp) )
+            {
+                return true;
+            }
+        }
+        chunk_end = chunk_begin;
+    }
+    return false;
+}
+
+// Copy of sources holding only what is needed to parse their packets
+static std::vector<PacketStreamSource> packetLayouts(const std::vector<PacketStreamSource>& sources)
+{
+    std::vector<PacketStreamSource> layouts(sources.size());
+    for(size_t i=0; i < sources.size(); ++i) {
+        layouts[i].id = sources[i].id;
+        layouts[i].data_size_bytes = sources[i].data_size_bytes;
+    }
+    return layouts;
+}
+
+// Parse stream items from pos until reaching limit or an item which can't be
+// read, such as a packet truncated by the end of the file.
+static void scanItems(
+    PacketStream& s, std::vector<PacketStreamSource>& sources,
+    std::streamoff pos, std::streamoff limit, std::streamoff file_size, PacketScan& scan)
+{
+    scan.start = pos;
+    s.clear();
+    s.seekg(pos);
+
+    try {
+        while(pos < limit) {
+            const PangoTagType tag = s.peekTag();
+            if(tag == TAG_PANGO_SYNC) {
+                s.readTag();
+            }else if(tag == TAG_ADD_SOURCE) {
+                s.readTag();
+                picojson::value json;
+                if(!picojson::parse(json, s).empty()) break;
+                s.get(); // consume newline
+                AddSource(sources, json);
+                scan.sources.push_back(json);
+            }else if(tag == TAG_SRC_SCHEMA || tag == TAG_SRC_JSON || tag == TAG_SRC_META || tag == TAG_SRC_PACKET) {
+                // Packets may be preceded by a metadata schema, then metadata
+                if(tag == TAG_SRC_SCHEMA) {
+                    s.readTag();
+                    s.readUINT();
+                    picojson::value schema;
+                    if(!picojson::parse(schema, s).empty()) break;
+                }
+                size_t json_src = -1;
+                if(s.peekTag() == TAG_SRC_JSON) {
+                    s.readTag();
+                    json_src = s.readUINT();
+                    picojson::value meta;
+                    if(!picojson::parse(meta, s).empty()) break;
+                }else if(s.peekTag() == TAG_SRC_META) {
+                    s.readTag();
+                    json_src = s.readUINT();
+                    s.readUINT();
+                    const size_t values_size = s.readUINT();
+                    const std::streamoff values_begin = s.tellg();
+                    if(!s.good() || values_size > size_t(file_size - values_begin)) break;
+                    s.seekg(values_begin + std::streamoff(values_size));
+                }
+                if(s.readTag() != TAG_SRC_PACKET) break;
+                const int64_t time = s.readTimestamp();
+                const size_t src = s.readUINT();
+                if(!s.good() || src >= sources.size() || (json_src != size_t(-1) && json_src != src)) break;
+                size_t size = sources[src].data_size_bytes;
+                if(!size) size = s.readUINT();
+                const std::streamoff data_begin = s.tellg();
+                if(!s.good() || size > size_t(file_size - data_begin)) break;
+                s.seekg(data_begin + std::streamoff(size));
+                scan.packets.push_back({src, {pos, time}});
+            }else if(tag == TAG_PANGO_CHUNK) {
+                // Packets are listed ahead of the compressed data
+                s.readTag();
+                ChunkHeader h;
+                if(!readChunkHeader(s, h)) break;
+                const std::streamoff table_begin = s.tellg();
+                const uint64_t remaining = uint64_t(file_size - table_begin);
+                if(h.table_size > remaining || h.data_size > remaining - h.table_size) break;
+                std::vector<char> table(h.table_size);
+                if(s.read(table.data(), table.size()) != table.size()) break;
+                if(!readChunkTable(table, sources.size(), h.raw_size, pos, scan.packets)) break;
+                s.seekg(table_begin + std::streamoff(h.table_size + h.data_size));
+            }else if(tag == TAG_PANGO_INDEX || tag == TAG_PANGO_CHECKPOINT) {
+                s.readTag();
+                uint32_t version;
+                uint64_t block_size;
+                s.read(reinterpret_cast<char*>(&version), sizeof(version));
+                s.read(reinterpret_cast<char*>(&block_size), sizeof(block_size));
+                const std::streamoff block_begin = s.tellg();
+                if(!s.good() || block_size > uint64_t(file_size - block_begin)) break;
+                s.seekg(block_begin + std::streamoff(block_size));
+            }else{
+                break;
+            }
+
+            if(!s.good()) break;
+            pos = s.tellg();
+        }
+    }catch(...) {
+    }
+
+    scan.end = pos;
+    scan.complete = pos >= limit;
+}
+
+// Scan the section [begin,limit) of filename from its first position which
+// parses as a run of stream items.
+static void syncAndScanItems(
+    const std::string& filename, const std::vector<PacketStreamSource>& sources,
+    std::streamoff begin, std::streamoff limit, std::streamoff file_size, PacketScan& scan)
+{
+    // Without a sync point, only accept runs long enough to be unlikely by chance
+    const size_t min_run = 4;
+    const PangoTagType tags[] = {TAG_SRC_PACKET, TAG_SRC_JSON, TAG_SRC_SCHEMA, TAG_SRC_META, TAG_ADD_SOURCE, TAG_PANGO_CHUNK};
+
+    PacketStream s(filename);
+    std::vector<char> buffer(1 << 16);
+
+    for(std::streamoff chunk = begin; chunk < limit; chunk += buffer.size() - (TAG_LENGTH - 1)) {
+        s.clear();
+        s.seekg(chunk);
+        const std::streamoff n = s.read(buffer.data(), std::min<std::streamoff>(buffer.size(), file_size - chunk));
+
+        for(std::streamoff i = 0; i + std::streamoff(TAG_LENGTH) <= n && chunk + i < limit; ++i) {
+            for(PangoTagType tag : tags) {
+                if(!std::memcmp(buffer.data() + i, &tag, TAG_LENGTH)) {
+                    std::vector<PacketStreamSource> trial_sources = sources;
+                    PacketScan trial;
+                    scanItems(s, trial_sources, chunk + i, limit, file_size, trial);
+                    if(trial.complete || trial.packets.size() + trial.sources.size() >= min_run) {
+                        scan = std::move(trial);
+                        return;
+                    }
+                }
+            }
+        }
+        if(n < std::streamoff(buffer.size())) break;
+    }
+}
+
+void PacketStreamReader::ReSync()
+{
+    if(!_stream.seekable()) {
+        _stream.syncToTag();
+        return;
+    }
+
+    const std::streamoff start = _stream.tellg();
+    _stream.seekg(0, ios_base::end);
+    const std::streamoff file_size = _stream.tellg();
+    _stream.seekg(start);
+    _stream.peekTag();
+
+    // Tag bytes occur by chance within packet data, so only stop on packets
+    // and sources which parse in full.
+    while(_stream.syncToTag() != TAG_END) {
+        const PangoTagType tag = _stream.peekTag();
+        if( tag != TAG_SRC_PACKET && tag != TAG_SRC_JSON && tag != TAG_SRC_SCHEMA &&
+            tag != TAG_SRC_META && tag != TAG_ADD_SOURCE && tag != TAG_PANGO_CHUNK )
+        {
+            return;
+        }
+
+        const std::streamoff pos = _stream.tellg();
+        std::vector<PacketStreamSource> layouts = packetLayouts(_sources);
+        PacketScan item;
+        scanItems(_stream, layouts, pos, pos + 1, file_size, item);
+
+        _stream.clear();
+        _stream.seekg(pos);
+        _stream.peekTag();
+        if(item.complete) {
+            return;
+        }
+    }
+}
+
+std::streamoff PacketStreamReader::RecoverCheckpoints()
+{
+    std::ifstream in(_filename, ios::in | ios::binary);
+    in.seekg(0, ios::end);
+    const std::streamoff file_size = in.tellg();
+
+    // Follow the chain of checkpoints back from the newest
+    std::vector<IndexCheckpoint> chain(1);
+    if(!in.good() || !findLastCheckpoint(in, file_size, chain.back())) {
+        return -1;
+    }
+    while(chain.back().prev >= 0) {
+        IndexCheckpoint cp;
+        if(!readCheckpoint(in, chain.back().prev, file_size, cp)) {
+            pango_print_warn("Index checkpoint chain in '%s' is broken.\n", _filename.c_str());
+            return -1;
+        }
+        chain.push_back(std::move(cp));
+    }
+
+    // Sources added after the first packets aren't known until they are scanned
+    if(chain.front().index.size() > _sources.size()) {
+        return -1;
+    }
+
+    std::vector<std::vector<PacketStreamSource::PacketInfo>> index(_sources.size());
+    for(auto cp = chain.rbegin(); cp != chain.rend(); ++cp) {
+        for(size_t i=0; i < cp->index.size(); ++i) {
+            if(cp->first[i] != index[i].size()) {
+                return -1;
+            }
+            index[i].insert(index[i].end(), cp->index[i].begin(), cp->index[i].end());
+        }
+    }
+
+    for(size_t i=0; i < _sources.size(); ++i) {
+        _sources[i].index = std::move(index[i]);
+    }
+
+    return chain.front().end;
+}
+
+void PacketStreamReader::ScanPackets(std::streamoff begin)
+{
+    std::streamoff file_size;
+    {
+        std::ifstream in(_filename, ios::in | ios::binary);
+        in.seekg(0, ios::end);
+        file_size = in.tellg();
+        if(!in.good() || file_size <= begin) return;
+    }
+
+    // Split large files into sections which are scanned concurrently. All
+    // but the first must find their own starting point, which is checked
+    // against where the previous section ended when they are joined.
+    const std::streamoff min_section_bytes = 64 << 20;
+    const size_t num_sections = std::max<size_t>(1, std::min<size_t>(
+        std::thread::hardware_concurrency(), (file_size - begin) / min_section_bytes
+    ));
+
+    std::vector<std::streamoff> limits(num_sections);
+    for(size_t i=0; i < num_sections; ++i) {
+        limits[i] = (i+1 == num_sections) ? file_size : begin + (file_size - begin) / std::streamoff(num_sections) * std::streamoff(i+1);
+    }
+
+    std::vector<PacketScan> scans(num_sections);
+    {
+        const std::vector<PacketStreamSource> layouts = packetLayouts(_sources);
+        std::vector<std::thread> threads;
+        for(size_t i=1; i < num_sections; ++i) {
+            threads.emplace_back([&,i](){
+                syncAndScanItems(_filename, layouts, limits[i-1], limits[i], file_size, scans[i]);
+            });
+        }
+        std::vector<PacketStreamSource> sources = layouts;
+        scanItems(_stream, sources, begin, limits[0], file_size, scans[0]);
+        for(auto& t : threads) t.join();
+    }
+
+    // Where the sections joined so far stopped, and whether that was at the
+    // end of a section rather than on an unreadable item.
+    std::streamoff resume = begin;
+    bool resume_complete = true;
+
+    for(size_t i=0; i < num_sections; ++i) {
+        if(i > 0 && scans[i].start != resume) {
+            // The previous section's last item spans into this one, this
+            // section synchronised on something which wasn't an item, or
+            // the previous section stopped early and items between there and
+            // this section's start were skipped. Rescan serially from where
+            // the previous section stopped.
+            PacketScan rescan;
+            if(resume >= limits[i]) {
+                rescan.start = rescan.end = resume;
+                rescan.complete = true;
+            }else{
+                std::vector<PacketStreamSource> sources = packetLayouts(_sources);
+                if(resume_complete) {
+                    scanItems(_stream, sources, resume, limits[i], file_size, rescan);
+                }else{
+                    syncAndScanItems(_filename, sources, resume, limits[i], file_size, rescan);
+                }
+            }
+            scans[i] = std::move(rescan);
+        }
+
+        for(const picojson::value& json : scans[i].sources) {
+            AddSource(_sources, json);
+        }
+        for(const auto& packet : scans[i].packets) {
+            _sources[packet.first].index.push_back(packet.second);
+        }
+
+        if(scans[i].end >= 0) {
+            resume = scans[i].end;
+            resume_complete = scans[i].complete;
+        }else{
+            // Nothing in this section could be read
+            resume = limits[i];
+            resume_complete = false;
+        }
+    }
+}
+
 bool PacketStreamReader::GoodToRead()
 {
     if(!_stream.good()) {
@@ -252,12 +881,105 @@ bool PacketStreamReader::GoodToRead()
 
 }
 
+bool PacketStreamReader::EnterChunk(int64_t offset)
+{
+    const std::streamoff pos = _stream.tellg();
+    _stream.readTag(TAG_PANGO_CHUNK);
+
+    ChunkHeader h;
+    std::vector<char> table, data, raw;
+    bool readable = readChunkHeader(_stream, h);
+    if(readable) {
+        try {
+            table.resize(h.table_size);
+            data.resize(h.data_size);
+        } catch (const std::bad_alloc&) {
+            readable = false;
+        }
+    }
+    readable = readable &&
+        _stream.read(table.data(), table.size()) == table.size() &&
+        _stream.read(data.data(), data.size()) == data.size();
+
+    if(!readable) {
+        // The header itself is damaged, so look for the next item
+        pango_print_warn("Unreadable chunk at %lld in '%s'. Resyncing.\n", (long long)pos, _filename.c_str());
+        ++_corrupt_chunks;
+        if(_stream.seekable()) {
+            _stream.clear();
+            _stream.seekg(pos);
+            ReSync();
+        }
+        return false;
+    }
+
+    bool intact = Crc32c(data.data(), data.size(), Crc32c(table.data(), table.size())) == h.checksum;
+    if(intact) {
+        try {
+            raw.resize(h.raw_size);
+        } catch (const std::bad_alloc&) {
+            intact = false;
+        }
+        intact = intact && DecompressChunk(h.codec, data.data(), data.size(), raw.data(), raw.size());
+    }
+
+    if(!intact) {
+        pango_print_warn("Chunk at %lld in '%s' is corrupt, skipping its packets.\n", (long long)pos, _filename.c_str());
+        ++_corrupt_chunks;
+        // Keep sequence numbers in step with the index, or failing that with
+        // the chunk's own table of packets, which may be the corrupt part.
+        std::vector<std::pair<PacketStreamSourceId, PacketStreamSource::PacketInfo>> packets;
+        readChunkTable(table, _sources.size(), h.raw_size, pos, packets);
+        for(PacketStreamSource& src : _sources) {
+            if(!src.index.empty()) {
+                while(src.next_packet_id < src.index.size() && src.index[src.next_packet_id].pos == pos) {
+                    ++src.next_packet_id;
+                }
+            }else{
+                for(const auto& packet : packets) {
+                    if(packet.first == src.id && packet.second.chunk_offset >= offset) ++src.next_packet_id;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Metadata schemas are declared per chunk at positions within it
+    for(PacketStreamSource& src : _sources) {
+        src.meta_schemas.clear();
+    }
+    _stream.enterChunk(std::move(raw));
+    _chunk_pos = pos;
+    if(offset > 0) {
+        _stream.seekg(offset);
+    }
+    return true;
+}
+
+void PacketStreamReader::LeaveChunk()
+{
+    if(_stream.inChunk()) {
+        _stream.leaveChunk();
+        _chunk_pos = -1;
+        for(PacketStreamSource& src : _sources) {
+            src.meta_schemas.clear();
+        }
+    }
+}
+
 Packet PacketStreamReader::NextFrame()
 {
     std::unique_lock<std::recursive_mutex> lock(_mutex);
 
-    while (GoodToRead())
+    while (true)
     {
+        if (_stream.chunkExhausted()) {
+            LeaveChunk();
+        }
+        if (!GoodToRead()) {
+            break;
+        }
+
         const PangoTagType t = _stream.peekTag();
 
         switch (t)
@@ -269,11 +991,21 @@ Packet PacketStreamReader::NextFrame()
             ParseNewSource();
             break;
         case TAG_SRC_JSON: //frames are sometimes preceded by metadata, but metadata must ALWAYS be followed by a frame from the same source.
+        case TAG_SRC_SCHEMA:
+        case TAG_SRC_META:
         case TAG_SRC_PACKET:
             return Packet(_stream, std::move(lock), _sources);
         case TAG_PANGO_STATS:
             ParseIndex();
             break;
+        case TAG_PANGO_INDEX:
+        case TAG_PANGO_CHECKPOINT:
+            // Already loaded by SetupIndex() when the stream is seekable
+            SkipIndexBlock();
+            break;
+        case TAG_PANGO_CHUNK:
+            EnterChunk(0);
+            break;
         case TAG_PANGO_FOOTER: //end of frames
         case TAG_END:
             throw std::runtime_error("PacketStreamReader: end of stream");
@@ -296,6 +1028,10 @@ Packet PacketStreamReader::NextFrame()
 
 Packet PacketStreamReader::NextFrame(PacketStreamSourceId src)
 {
+    if(_is_cursor) {
+        SkipToNext(src);
+    }
+
     while (1)
     {
         // This will throw if nothing is left.
@@ -322,18 +1058,16 @@ void PacketStreamReader::RebuildIndex()
             s.next_packet_id = 0;
         }
 
-        // Read through entire file, updating index
-        try{
-            while (1)
-            {
-                // This will throw if we've run out of frames
-                auto fi = NextFrame();
-                PacketStreamSource& s = _sources[fi.src];
-                PANGO_ENSURE(s.index.size() == fi.sequence_num);
-                s.index.push_back({fi.frame_streampos, fi.time});
+        // Start from the last index checkpoint if there is one, otherwise
+        // read through the entire file.
+        std::streamoff scan_from = _index_checkpoints ? RecoverCheckpoints() : -1;
+        if(scan_from < 0) {
+            for(PacketStreamSource& s : _sources) {
+                s.index.clear();
             }
-        }catch(...){
+            scan_from = pos;
         }
+        ScanPackets(scan_from);
 
         // Reset Packet id's
         for(PacketStreamSource& s : _sources) {
@@ -356,8 +1090,7 @@ void PacketStreamReader::AppendIndex()
         if(of.is_open()) {
             pango_print_warn("Appending new index to '%s'.\n", _filename.c_str());
             uint64_t indexpos = (uint64_t)of.tellp();
-            writeTag(of, TAG_PANGO_STATS);
-            SourceStats(_sources).serialize(std::ostream_iterator<char>(of), false);
+            writeSourceIndex(of, _sources);
             writeTag(of, TAG_PANGO_FOOTER);
             of.write(reinterpret_cast<char*>(&indexpos), sizeof(uint64_t));
         }
@@ -373,6 +1106,28 @@ void PacketStreamReader::FixFileIndex()
     }
 }
 
+void PacketStreamReader::SkipToNext(PacketStreamSourceId src)
+{
+    lock_guard<decltype(_mutex)> lg(_mutex);
+
+    if(src >= _sources.size()) return;
+    const PacketStreamSource& source = _sources[src];
+    if(source.next_packet_id >= source.index.size()) return;
+
+    // Only ever move forwards, so that anything we skip would otherwise
+    // have been read and discarded.
+    const PacketStreamSource::PacketInfo& info = source.index[source.next_packet_id];
+    if(info.pos <= 0) {
+        return;
+    }else if(_stream.inChunk() && info.pos == _chunk_pos) {
+        if(info.chunk_offset > static_cast<std::streamoff>(_stream.tellg())) {
+            _stream.seekg(info.chunk_offset);
+        }
+    }else if(_stream.inChunk() ? info.pos > _chunk_pos : info.pos > static_cast<std::streamoff>(_stream.tellg())) {
+        Seek(src, source.next_packet_id);
+    }
+}
+
 size_t PacketStreamReader::Seek(PacketStreamSourceId src, size_t framenum)
 {
     lock_guard<decltype(_mutex)> lg(_mutex);
@@ -382,10 +1137,15 @@ size_t PacketStreamReader::Seek(PacketStreamSourceId src, size_t framenum)
     PacketStreamSource& source = _sources[src];
     PANGO_ASSERT(framenum < source.index.size());
 
-    if(source.index[framenum].pos > 0) {
+    const PacketStreamSource::PacketInfo& info = source.index[framenum];
+    if(info.pos > 0) {
+        LeaveChunk();
         _stream.clear();
-        _stream.seekg(source.index[framenum].pos);
+        _stream.seekg(info.pos);
         source.next_packet_id = framenum;
+        if(info.chunk_offset >= 0) {
+            EnterChunk(info.chunk_offset);
+        }
     }
     return source.next_packet_id;
 }
@@ -27,6 +27,8 @@
 #include <pangolin/utils/file_utils.h>
 #include <pangolin/utils/timer.h>
 
+#include <algorithm>
+
 using std::ios;
 using std::lock_guard;
 
@@ -37,6 +39,80 @@ using std::lock_guard;
 namespace pangolin
 {
 
+static inline void appendCompressedUnsignedInt(std::string& buffer, uint64_t n)
+{
+    while (n >= 0x80)
+    {
+        buffer.push_back(static_cast<char>(0x80 | (n & 0x7F)));
+        n >>= 7;
+    }
+    buffer.push_back(static_cast<char>(n));
+}
+
+static inline void appendCompressedSignedInt(std::string& buffer, int64_t n)
+{
+    // zigzag encode so that small negative values stay small
+    appendCompressedUnsignedInt(buffer, (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63));
+}
+
+using IndexIterator = std::vector<PacketStreamSource::PacketInfo>::const_iterator;
+
+// Version 1 unless some packet is within a chunk
+static uint32_t indexVersion(IndexIterator begin, IndexIterator end)
+{
+    for(auto frame = begin; frame != end; ++frame) {
+        if(frame->chunk_offset >= 0) return 2;
+    }
+    return 1;
+}
+
+// Packet count followed by position and time differences from the previous packet
+static void appendIndexSegment(std::string& block, IndexIterator begin, IndexIterator end, uint32_t version)
+{
+    appendCompressedUnsignedInt(block, end - begin);
+    int64_t last_pos = 0;
+    int64_t last_time = 0;
+    for(auto frame = begin; frame != end; ++frame) {
+        const int64_t pos = static_cast<std::streamoff>(frame->pos);
+        appendCompressedSignedInt(block, pos - last_pos);
+        appendCompressedSignedInt(block, frame->capture_time - last_time);
+        if(version >= 2) {
+            appendCompressedUnsignedInt(block, frame->chunk_offset + 1);
+        }
+        last_pos = pos;
+        last_time = frame->capture_time;
+    }
+}
+
+static void writeIndexBlock(std::ostream& writer, PangoTagType tag, uint32_t version, const std::string& block)
+{
+    const uint64_t block_size = block.size();
+    writeTag(writer, tag);
+    writer.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    writer.write(reinterpret_cast<const char*>(&block_size), sizeof(block_size));
+    writer.write(block.data(), block.size());
+}
+
+void writeSourceIndex(std::ostream& writer, const std::vector<PacketStreamSource>& srcs)
+{
+    size_t num_packets = 0;
+    uint32_t version = 1;
+    for(const auto& src : srcs) {
+        num_packets += src.index.size();
+        version = std::max(version, indexVersion(src.index.begin(), src.index.end()));
+    }
+
+    std::string block;
+    block.reserve(16 + 6 * num_packets);
+
+    appendCompressedUnsignedInt(block, srcs.size());
+    for(const auto& src : srcs) {
+        appendIndexSegment(block, src.index.begin(), src.index.end(), version);
+    }
+
+    writeIndexBlock(writer, TAG_PANGO_INDEX, version, block);
+}
+
 static inline const std::string CurrentTimeStr()
 {
     time_t time_now = time(0);
@@ -55,6 +131,10 @@ void PacketStreamWriter::WriteHeader()
     pango["time_us"] = Time_us(TimeNow());
     pango["date_created"] = CurrentTimeStr();
     pango["endian"] = "little_endian";
+    _header_checkpoints = _indexable && (_checkpoint_packets || _checkpoint_us);
+    if (_header_checkpoints) {
+        pango["index_checkpoints"] = true;
+    }
 
     writeTag(_stream, TAG_PANGO_HDR);
     pango.serialize(std::ostream_iterator<char>(_stream), true);
@@ -95,25 +175,176 @@ PacketStreamSourceId PacketStreamWriter::AddSource(const PacketStreamSource& sou
     _sources.push_back(source);
     _sources.back().id = r;
 
+    // Sources are written outside of chunks so that scanning can find them
+    if (_chunk_open)
+        SealChunk();
+
     if (_open) //we might be a pipe, in which case we may not be open
         Write(_sources.back());
 
+    // Replace the staging list so that producers holding the old one are unaffected
+    auto staging = std::make_shared<StagingList>(*std::atomic_load(&_staging));
+    staging->push_back(std::make_shared<Staging>());
+    staging->back()->data_size_bytes = source.data_size_bytes;
+    std::atomic_store(&_staging, std::shared_ptr<const StagingList>(std::move(staging)));
+
     return _sources.back().id;
 }
 
 void PacketStreamWriter::WriteMeta(PacketStreamSourceId src, const picojson::value& data)
 {
     SCOPED_LOCK;
+    if (_binary_meta && data.is<picojson::object>()) {
+        WriteBinaryMeta(src, data.get<picojson::object>());
+        return;
+    }
+
     writeTag(_stream, TAG_SRC_JSON);
     writeCompressedUnsignedInt(_stream, src);
-    data.serialize(std::ostream_iterator<char>(_stream), false);
+    const std::string json = data.serialize();
+    _stream.write(json.data(), json.size());
+}
+
+static char metaType(const picojson::value& v)
+{
+    if (v.is<bool>()) return 'b';
+    if (v.is<int64_t>()) return 'i';
+    if (v.is<double>()) return 'f';
+    if (v.is<std::string>()) return 's';
+    return 'j';
+}
+
+void PacketStreamWriter::WriteBinaryMeta(PacketStreamSourceId src, const picojson::object& data)
+{
+    SCOPED_LOCK;
+    if (_meta_schemas.size() <= src) {
+        _meta_schemas.resize(src + 1, {-1, PacketMetaSchema()});
+    }
+    auto& current = _meta_schemas[src];
+
+    // Declare a new schema when the keys or their types change
+    bool matches = current.first >= 0 && current.second.keys.size() == data.size();
+    if (matches) {
+        size_t i = 0;
+        for (const auto& kv : data) {
+            if (kv.first != current.second.keys[i] || metaType(kv.second) != current.second.types[i]) {
+                matches = false;
+                break;
+            }
+            ++i;
+        }
+    }
+
+    if (!matches) {
+        PacketMetaSchema schema;
+        picojson::value json;
+        json["keys"] = picojson::array();
+        json["types"] = picojson::array();
+        json["bases"] = picojson::array();
+        for (const auto& kv : data) {
+            const char type = metaType(kv.second);
+            const int64_t base = type == 'i' ? kv.second.get<int64_t>() : 0;
+            schema.keys.push_back(kv.first);
+            schema.types.push_back(type);
+            schema.bases.push_back(base);
+            json["keys"].push_back(kv.first);
+            json["types"].push_back(std::string(1, type));
+            json["bases"].push_back(base);
+        }
+
+        current = {static_cast<std::streamoff>(_stream.tellp()), std::move(schema)};
+        writeTag(_stream, TAG_SRC_SCHEMA);
+        writeCompressedUnsignedInt(_stream, src);
+        const std::string serialized = json.serialize();
+        _stream.write(serialized.data(), serialized.size());
+    }
+
+    const PacketMetaSchema& schema = current.second;
+    std::string values;
+    size_t i = 0;
+    for (const auto& kv : data) {
+        switch (schema.types[i]) {
+        case 'i':
+            appendCompressedSignedInt(values, kv.second.get<int64_t>() - schema.bases[i]);
+            break;
+        case 'f': {
+            const double v = kv.second.get<double>();
+            values.append(reinterpret_cast<const char*>(&v), sizeof(v));
+            break;
+        }
+        case 'b':
+            values.push_back(kv.second.get<bool>() ? 1 : 0);
+            break;
+        case 's':
+            appendCompressedUnsignedInt(values, kv.second.get<std::string>().size());
+            values.append(kv.second.get<std::string>());
+            break;
+        default: {
+            const std::string json = kv.second.serialize();
+            appendCompressedUnsignedInt(values, json.size());
+            values.append(json);
+            break;
+        }
+        }
+        ++i;
+    }
+
+    // Source, distance back to the schema and size of the values which follow
+    const int64_t pos = static_cast<std::streamoff>(_stream.tellp());
+    std::string block;
+    appendCompressedUnsignedInt(block, src);
+    appendCompressedUnsignedInt(block, pos - current.first);
+    appendCompressedUnsignedInt(block, values.size());
+    block.append(values);
+
+    writeTag(_stream, TAG_SRC_META);
+    _stream.write(block.data(), block.size());
+}
+
+void PacketStreamWriter::SetBinaryMeta(bool enable)
+{
+    SCOPED_LOCK;
+    _binary_meta = enable;
 }
 
 void PacketStreamWriter::WriteSourcePacket(PacketStreamSourceId src, const char* source, const int64_t receive_time_us, size_t sourcelen, const picojson::value& meta)
 {
+    const basetime start = TimeNow();
+    bool blocked = false;
 
+    if (_staging_enabled) {
+        blocked = StagePacket(src, source, receive_time_us, sourcelen, meta);
+    } else {
+        WritePacket(src, source, receive_time_us, sourcelen, meta);
+    }
+
+    const int64_t submit_us = TimeDiff_us(start, TimeNow());
+    _packets_submitted++;
+    _total_submit_us += submit_us;
+    if (blocked) _packets_blocked++;
+    int64_t max_us = _max_submit_us.load();
+    while (submit_us > max_us && !_max_submit_us.compare_exchange_weak(max_us, submit_us)) {}
+}
+
+void PacketStreamWriter::WritePacket(PacketStreamSourceId src, const char* source, const int64_t receive_time_us, size_t sourcelen, const picojson::value& meta)
+{
     SCOPED_LOCK;
-    _sources[src].index.push_back({_stream.tellp(), receive_time_us});
+    if (_sources[src].data_size_bytes && sourcelen != static_cast<size_t>(_sources[src].data_size_bytes))
+        throw std::runtime_error("oPacketStream::writePacket --> Tried to write a fixed-size packet with bad size.");
+
+    if (_chunk_bytes && !_chunk_open) {
+        // Serialize into the chunk instead of the file. Each chunk declares
+        // its own metadata schemas so that it can be read alone.
+        _stream.rdbuf(&_chunk_buffer);
+        _meta_schemas.clear();
+        _chunk_open = true;
+    }
+
+    if (_chunk_open) {
+        _chunk_packets.push_back({src, {_stream.tellp(), receive_time_us}});
+    } else {
+        _sources[src].index.push_back({_stream.tellp(), receive_time_us});
+    }
 
     if (!meta.is<picojson::null>())
         WriteMeta(src, meta);
@@ -122,33 +353,460 @@ void PacketStreamWriter::WriteSourcePacket(PacketStreamSourceId src, const char*
     writeTimestamp(_stream, receive_time_us);
     writeCompressedUnsignedInt(_stream, src);
 
-    if (_sources[src].data_size_bytes) {
-        if (sourcelen != static_cast<size_t>(_sources[src].data_size_bytes))
-            throw std::runtime_error("oPacketStream::writePacket --> Tried to write a fixed-size packet with bad size.");
-    } else {
+    if (!_sources[src].data_size_bytes) {
         writeCompressedUnsignedInt(_stream, sourcelen);
     }
 
     _stream.write(source, sourcelen);
     _bytes_written += sourcelen;
+
+    if (_chunk_open) {
+        if (size_t(_stream.tellp()) >= _chunk_bytes) {
+            SealChunk();
+        }
+    } else {
+        CountCheckpointPackets(1);
+    }
+}
+
+void PacketStreamWriter::CountCheckpointPackets(size_t num_packets)
+{
+    if (_indexable && (_checkpoint_packets || _checkpoint_us)) {
+        _packets_since_checkpoint += num_packets;
+        const int64_t now_us = Time_us(TimeNow());
+        if ( (_checkpoint_packets && _packets_since_checkpoint >= _checkpoint_packets) ||
+             (_checkpoint_us && now_us - _last_checkpoint_us >= _checkpoint_us) )
+        {
+            WriteCheckpointBlock();
+            _last_checkpoint_us = now_us;
+        }
+    }
+}
+
+void PacketStreamWriter::SetChunking(size_t chunk_bytes, PacketChunkCodec codec, int level, size_t num_threads)
+{
+    SCOPED_LOCK;
+    FlushChunks();
+    StopCompressors();
+
+    if (!PacketChunkCodecAvailable(codec)) {
+        pango_print_warn("PacketStreamWriter: chunk codec %d unavailable in this build, chunks will not be compressed.\n", int(codec));
+        codec = PacketChunkCodec::None;
+    }
+
+    _chunk_bytes = chunk_bytes;
+    _chunk_codec = codec;
+    _chunk_level = level;
+    _chunk_threads = codec == PacketChunkCodec::None ? 0 : num_threads;
+
+    if (_chunk_bytes && _open) {
+        StartCompressors();
+    }
+}
+
+void PacketStreamWriter::EncodeChunk(Chunk& chunk)
+{
+    // Source, capture time and offset of each packet within the raw chunk,
+    // so that the index can be rebuilt without decompressing.
+    appendCompressedUnsignedInt(chunk.table, chunk.packets.size());
+    int64_t last_time = 0;
+    int64_t last_offset = 0;
+    for (const auto& packet : chunk.packets) {
+        appendCompressedUnsignedInt(chunk.table, packet.first);
+        appendCompressedSignedInt(chunk.table, packet.second.capture_time - last_time);
+        appendCompressedUnsignedInt(chunk.table, static_cast<std::streamoff>(packet.second.pos) - last_offset);
+        last_time = packet.second.capture_time;
+        last_offset = static_cast<std::streamoff>(packet.second.pos);
+    }
+
+    chunk.raw_size = chunk.data.size();
+    std::string compressed;
+    if (chunk.codec != PacketChunkCodec::None &&
+        CompressChunk(chunk.codec, chunk.level, chunk.data.data(), chunk.data.size(), compressed))
+    {
+        chunk.data.swap(compressed);
+    } else {
+        chunk.codec = PacketChunkCodec::None;
+    }
+
+    chunk.checksum = Crc32c(chunk.data.data(), chunk.data.size(), Crc32c(chunk.table.data(), chunk.table.size()));
+}
+
+void PacketStreamWriter::SealChunk()
+{
+    auto chunk = std::make_shared<Chunk>();
+    chunk->codec = _chunk_codec;
+    chunk->level = _chunk_level;
+    chunk->data = _chunk_buffer.str();
+    chunk->packets.swap(_chunk_packets);
+
+    _chunk_buffer.str(std::string());
+    _stream.rdbuf(&_buffer);
+    _meta_schemas.clear();
+    _chunk_open = false;
+
+    if (_compressors.empty()) {
+        EncodeChunk(*chunk);
+        chunk->done = true;
+        _chunks.push_back(chunk);
+    } else {
+        {
+            std::lock_guard<std::mutex> l(_compress_lock);
+            _chunks.push_back(chunk);
+            _compress_queue.push_back(chunk);
+        }
+        _compress_cv.notify_one();
+    }
+
+    WriteChunks(false);
+}
+
+void PacketStreamWriter::WriteChunks(bool all)
+{
+    while (!_chunks.empty()) {
+        std::shared_ptr<Chunk> chunk = _chunks.front();
+        {
+            std::unique_lock<std::mutex> l(_compress_lock);
+            if (!chunk->done) {
+                // Keep every compressor busy, only waiting once they fall behind
+                if (!all && _chunks.size() <= 2 * _compressors.size()) break;
+                _compressed_cv.wait(l, [&](){ return chunk->done; });
+            }
+        }
+        _chunks.pop_front();
+
+        const uint64_t table_size = chunk->table.size();
+        const uint64_t data_size = chunk->data.size();
+        const uint64_t raw_size = chunk->raw_size;
+        const uint8_t codec = static_cast<uint8_t>(chunk->codec);
+
+        const std::streampos pos = _stream.tellp();
+        for (const auto& packet : chunk->packets) {
+            _sources[packet.first].index.push_back({pos, packet.second.capture_time, static_cast<std::streamoff>(packet.second.pos)});
+        }
+
+        writeTag(_stream, TAG_PANGO_CHUNK);
+        _stream.write(reinterpret_cast<const char*>(&codec), sizeof(codec));
+        _stream.write(reinterpret_cast<const char*>(&chunk->checksum), sizeof(chunk->checksum));
+        _stream.write(reinterpret_cast<const char*>(&table_size), sizeof(table_size));
+        _stream.write(reinterpret_cast<const char*>(&data_size), sizeof(data_size));
+        _stream.write(reinterpret_cast<const char*>(&raw_size), sizeof(raw_size));
+        _stream.write(chunk->table.data(), chunk->table.size());
+        _stream.write(chunk->data.data(), chunk->data.size());
+
+        CountCheckpointPackets(chunk->packets.size());
+    }
+}
+
+void PacketStreamWriter::FlushChunks()
+{
+    SCOPED_LOCK;
+    if (_chunk_open) {
+        SealChunk();
+    }
+    WriteChunks(true);
+}
+
+void PacketStreamWriter::DiscardChunks()
+{
+    SCOPED_LOCK;
+    if (_chunk_open) {
+        _chunk_buffer.str(std::string());
+        _stream.rdbuf(&_buffer);
+        _chunk_packets.clear();
+        _chunk_open = false;
+    }
+    {
+        std::lock_guard<std::mutex> l(_compress_lock);
+        _compress_queue.clear();
+    }
+    // Chunks being compressed are still referenced by their compressor
+    _chunks.clear();
+}
+
+void PacketStreamWriter::CompressorLoop()
+{
+    while (true) {
+        std::shared_ptr<Chunk> chunk;
+        {
+            std::unique_lock<std::mutex> l(_compress_lock);
+            _compress_cv.wait(l, [&](){ return !_compress_queue.empty() || _stop_compressors; });
+            if (_compress_queue.empty()) break;
+            chunk = _compress_queue.front();
+            _compress_queue.pop_front();
+        }
+
+        EncodeChunk(*chunk);
+
+        {
+            std::lock_guard<std::mutex> l(_compress_lock);
+            chunk->done = true;
+        }
+        _compressed_cv.notify_all();
+    }
+}
+
+void PacketStreamWriter::StartCompressors()
+{
+    if (_compressors.empty()) {
+        _stop_compressors = false;
+        for (size_t i = 0; i < _chunk_threads; ++i) {
+            _compressors.emplace_back(&PacketStreamWriter::CompressorLoop, this);
+        }
+    }
+}
+
+void PacketStreamWriter::StopCompressors()
+{
+    if (!_compressors.empty()) {
+        {
+            std::lock_guard<std::mutex> l(_compress_lock);
+            _stop_compressors = true;
+        }
+        _compress_cv.notify_all();
+        for (auto& t : _compressors) t.join();
+        _compressors.clear();
+    }
+}
+
+bool PacketStreamWriter::StagePacket(PacketStreamSourceId src, const char* source, const int64_t receive_time_us, size_t sourcelen, const picojson::value& meta)
+{
+    const auto staging = std::atomic_load(&_staging);
+    if (src >= staging->size())
+        throw std::runtime_error("PacketStreamWriter: packet for unknown source.");
+
+    Staging& s = *(*staging)[src];
+    if (s.data_size_bytes && sourcelen != static_cast<size_t>(s.data_size_bytes))
+        throw std::runtime_error("oPacketStream::writePacket --> Tried to write a fixed-size packet with bad size.");
+
+    // Copy outside of the lock
+    StagedPacket packet{0, receive_time_us, std::vector<char>(source, source + sourcelen), meta};
+
+    bool blocked = false;
+    {
+        std::unique_lock<std::mutex> l(s.lock);
+        if (s.bytes && s.bytes + sourcelen > _max_staged_bytes) {
+            blocked = true;
+            s.space.wait(l, [&](){ return !s.bytes || s.bytes + sourcelen <= _max_staged_bytes; });
+        }
+        packet.ticket = _tickets++;
+        s.bytes += sourcelen;
+        s.queue.push_back(std::move(packet));
+    }
+
+    // The sequencer only waits once it has seen every ticket written, so we
+    // need only wake it if it is already waiting.
+    if (_sequencer_waiting) {
+        std::lock_guard<std::mutex> l(_sequencer_lock);
+        _sequencer_cv.notify_one();
+    }
+
+    return blocked;
+}
+
+void PacketStreamWriter::SequencerLoop()
+{
+    std::vector<std::deque<StagedPacket>> batches;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> l(_sequencer_lock);
+            _sequencer_waiting = true;
+            _sequencer_cv.wait(l, [&](){ return _tickets != _written || _stop_sequencer; });
+            _sequencer_waiting = false;
+            if (_tickets == _written) break;
+        }
+
+        // Take everything staged so far from each source
+        const auto staging = std::atomic_load(&_staging);
+        batches.resize(staging->size());
+        size_t num_packets = 0;
+        for (size_t i = 0; i < staging->size(); ++i) {
+            Staging& s = *(*staging)[i];
+            {
+                std::lock_guard<std::mutex> l(s.lock);
+                batches[i].swap(s.queue);
+                s.bytes = 0;
+            }
+            s.space.notify_all();
+            num_packets += batches[i].size();
+        }
+
+        if (!num_packets) {
+            // A producer has taken a ticket but not yet queued its packet
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Interleave the sources, each of which is already in order
+        {
+            SCOPED_LOCK;
+            while (true) {
+                size_t next = batches.size();
+                for (size_t i = 0; i < batches.size(); ++i) {
+                    if (batches[i].empty()) continue;
+                    if (next == batches.size() || (_order == PacketOrder::Timestamp ?
+                            batches[i].front().receive_time_us < batches[next].front().receive_time_us :
+                            batches[i].front().ticket < batches[next].front().ticket))
+                    {
+                        next = i;
+                    }
+                }
+                if (next == batches.size()) break;
+
+                const StagedPacket& packet = batches[next].front();
+                try {
+                    WritePacket(next, packet.data.data(), packet.receive_time_us, packet.data.size(), packet.meta);
+                } catch (...) {
+                    std::lock_guard<std::mutex> l(_sequencer_lock);
+                    if (!_sequencer_error) _sequencer_error = std::current_exception();
+                }
+                batches[next].pop_front();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> l(_sequencer_lock);
+            _written += num_packets;
+        }
+        _flushed_cv.notify_all();
+    }
+}
+
+void PacketStreamWriter::StartStaging()
+{
+    if (!_sequencer.joinable()) {
+        _stop_sequencer = false;
+        _sequencer = std::thread(&PacketStreamWriter::SequencerLoop, this);
+        _staging_enabled = true;
+    }
+}
+
+void PacketStreamWriter::StopStaging()
+{
+    if (_sequencer.joinable()) {
+        _staging_enabled = false;
+        {
+            std::lock_guard<std::mutex> l(_sequencer_lock);
+            _stop_sequencer = true;
+        }
+        _sequencer_cv.notify_one();
+        _sequencer.join();
+    }
+}
+
+void PacketStreamWriter::SetStaging(bool enable, PacketOrder order, size_t max_staged_bytes)
+{
+    StopStaging();
+    _order = order;
+    _max_staged_bytes = max_staged_bytes;
+    _staging_requested = enable;
+    if (enable) {
+        StartStaging();
+    }
+}
+
+void PacketStreamWriter::WaitForStaged()
+{
+    std::unique_lock<std::mutex> l(_sequencer_lock);
+    _flushed_cv.wait(l, [&](){ return _tickets == _written; });
+}
+
+void PacketStreamWriter::Flush()
+{
+    WaitForStaged();
+    std::lock_guard<std::mutex> l(_sequencer_lock);
+    if (_sequencer_error) {
+        std::exception_ptr error = _sequencer_error;
+        _sequencer_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+PacketStreamWriter::Stats PacketStreamWriter::GetStats() const
+{
+    Stats stats;
+    stats.packets_submitted = _packets_submitted;
+    stats.total_submit_us = _total_submit_us;
+    stats.max_submit_us = _max_submit_us;
+    stats.packets_blocked = _packets_blocked;
+    return stats;
+}
+
+void PacketStreamWriter::ResetStats()
+{
+    _packets_submitted = 0;
+    _total_submit_us = 0;
+    _max_submit_us = 0;
+    _packets_blocked = 0;
+}
+
+void PacketStreamWriter::SetIndexCheckpointInterval(size_t every_packets, int64_t every_us)
+{
+    SCOPED_LOCK;
+    if (_open && _indexable && !_header_checkpoints && (every_packets || every_us)) {
+        throw std::runtime_error("PacketStreamWriter: index checkpoints must be enabled before the stream is opened");
+    }
+    _checkpoint_packets = every_packets;
+    _checkpoint_us = every_us;
+}
+
+void PacketStreamWriter::WriteCheckpoint()
+{
+    SCOPED_LOCK;
+    FlushChunks();
+    WriteCheckpointBlock();
+}
+
+void PacketStreamWriter::WriteCheckpointBlock()
+{
+    if (!_indexable)
+        return;
+
+    const int64_t pos = static_cast<std::streamoff>(_stream.tellp());
+
+    // Position of the previous checkpoint, then for each source the id of the
+    // first packet covered followed by the packets since the last checkpoint.
+    std::string block;
+    block.append(reinterpret_cast<const char*>(&_last_checkpoint_pos), sizeof(_last_checkpoint_pos));
+    appendCompressedUnsignedInt(block, _sources.size());
+    _checkpointed.resize(_sources.size(), 0);
+    uint32_t version = 1;
+    for(size_t i=0; i < _sources.size(); ++i) {
+        const auto& index = _sources[i].index;
+        version = std::max(version, indexVersion(index.begin() + _checkpointed[i], index.end()));
+    }
+    for(size_t i=0; i < _sources.size(); ++i) {
+        const auto& index = _sources[i].index;
+        appendCompressedUnsignedInt(block, _checkpointed[i]);
+        appendIndexSegment(block, index.begin() + _checkpointed[i], index.end(), version);
+        _checkpointed[i] = index.size();
+    }
+
+    writeIndexBlock(_stream, TAG_PANGO_CHECKPOINT, version, block);
+    _last_checkpoint_pos = pos;
+    _packets_since_checkpoint = 0;
 }
 
 void PacketStreamWriter::WriteSync()
 {
+    Flush();
     SCOPED_LOCK;
+    FlushChunks();
     for (unsigned i = 0; i < 10; ++i)
     writeTag(_stream, TAG_PANGO_SYNC);
 }
 
 void PacketStreamWriter::WriteEnd()
 {
+    Flush();
     SCOPED_LOCK;
+    FlushChunks();
     if (!_indexable)
         return;
 
     auto indexpos = _stream.tellp();
-    writeTag(_stream, TAG_PANGO_STATS);
-    SourceStats(_sources).serialize(std::ostream_iterator<char>(_stream), false);
+    writeSourceIndex(_stream, _sources);
     writeTag(_stream, TAG_PANGO_FOOTER);
     _stream.write(reinterpret_cast<char*>(&indexpos), sizeof(uint64_t));
 }
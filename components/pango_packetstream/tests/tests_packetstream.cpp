@@ -0,0 +1,596 @@
+#define CATCH_CONFIG_MAIN
+#if __has_include(<catch2/catch.hpp>)
+#include <catch2/catch.hpp>
+#else
+#include <catch2/catch_test_macros.hpp>
+#endif
+
+#include <pangolin/log/packetstream_copy.h>
+#include <pangolin/log/packetstream_reader.h>
+#include <pangolin/log/packetstream_writer.h>
+#include <pangolin/log/playback_session.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+TEST_CASE( "Packet stream index round trips in binary and legacy form" )
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_index.pango";
+    std::filesystem::remove(file);
+
+    std::vector<pangolin::PacketStreamSource> written;
+    {
+        pangolin::PacketStreamWriter writer(file.string());
+        for(int s=0; s < 2; ++s) {
+            pangolin::PacketStreamSource src;
+            src.driver = "test";
+            writer.AddSource(src);
+        }
+        const std::string data(100, 'x');
+        for(int64_t i=0; i < 1000; ++i) {
+            // Non monotonic times on source 1 exercise negative deltas
+            const size_t src = i % 3 == 0;
+            const int64_t time_us = src ? 5000000 - 7*i : 1000000 + 33333*i;
+            writer.WriteSourcePacket(src, data.data(), time_us, 1 + i % data.size());
+        }
+        writer.Close();
+        written = writer.Sources();
+    }
+
+    auto require_index = [&](){
+        pangolin::PacketStreamReader reader(file.string());
+        REQUIRE(reader.Sources().size() == written.size());
+        for(size_t s=0; s < written.size(); ++s) {
+            const auto& a = written[s].index;
+            const auto& b = reader.Sources()[s].index;
+            REQUIRE(a.size() == b.size());
+            for(size_t i=0; i < a.size(); ++i) {
+                REQUIRE(a[i].pos == b[i].pos);
+                REQUIRE(a[i].capture_time == b[i].capture_time);
+            }
+        }
+        reader.Seek(1, 10);
+        REQUIRE(reader.NextFrame().time == written[1].index[10].capture_time);
+    };
+
+    require_index();
+
+    uint64_t indexpos = 0;
+    auto read_indexpos = [&](){
+        std::ifstream in(file, std::ios::binary);
+        in.seekg(-(std::streamoff)sizeof(indexpos), std::ios::end);
+        in.read(reinterpret_cast<char*>(&indexpos), sizeof(indexpos));
+    };
+
+    // An index block claiming more bytes than the file holds is rebuilt from
+    // the packets rather than allocated for
+    read_indexpos();
+    {
+        const uint64_t block_size = uint64_t(1) << 40;
+        std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(indexpos + pangolin::TAG_LENGTH + sizeof(uint32_t));
+        f.write(reinterpret_cast<const char*>(&block_size), sizeof(block_size));
+    }
+    require_index();
+
+    // Replace the binary index with the JSON index written by older versions
+    read_indexpos();
+    std::filesystem::resize_file(file, indexpos);
+    {
+        std::ofstream of(file, std::ios::app | std::ios::binary);
+        pangolin::writeTag(of, pangolin::TAG_PANGO_STATS);
+        pangolin::SourceStats(written).serialize(std::ostream_iterator<char>(of), false);
+        pangolin::writeTag(of, pangolin::TAG_PANGO_FOOTER);
+        of.write(reinterpret_cast<char*>(&indexpos), sizeof(indexpos));
+    }
+    const auto legacy_size = std::filesystem::file_size(file);
+
+    require_index();
+
+    // The legacy index was used as is, not rebuilt and appended to
+    REQUIRE(std::filesystem::file_size(file) == legacy_size);
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Packet stream index is recovered from truncated recordings" )
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_truncated.pango";
+
+    for(size_t checkpoint_packets : {size_t(0), size_t(64)}) {
+        std::filesystem::remove(file);
+
+        std::vector<pangolin::PacketStreamSource> written;
+        {
+            pangolin::PacketStreamWriter writer;
+            writer.SetIndexCheckpointInterval(checkpoint_packets, 0);
+            writer.SetBinaryMeta(checkpoint_packets != 0);
+            writer.Open(file.string());
+            for(int s=0; s < 2; ++s) {
+                pangolin::PacketStreamSource src;
+                src.driver = "test";
+                src.data_size_bytes = s ? 16 : 0;
+                writer.AddSource(src);
+            }
+            const std::string data(300, 'P');
+            for(int64_t i=0; i < 1000; ++i) {
+                const size_t src = i % 4 == 0;
+                picojson::value meta;
+                if(i % 5 == 0) meta["i"] = i;
+                writer.WriteSourcePacket(src, data.data(), 1000*i, src ? 16 : 1 + i % data.size(), meta);
+            }
+            writer.Close();
+            written = writer.Sources();
+        }
+
+        // Only a writer which enabled checkpoints announces them
+        {
+            std::ifstream in(file, std::ios::binary);
+            std::string header(256, '\0');
+            in.read(&header[0], header.size());
+            REQUIRE((header.find("index_checkpoints") != std::string::npos) == (checkpoint_packets != 0));
+        }
+
+        // Simulate a crash part way through writing the final packet
+        uint64_t indexpos = 0;
+        {
+            std::ifstream in(file, std::ios::binary);
+            in.seekg(-(std::streamoff)sizeof(indexpos), std::ios::end);
+            in.read(reinterpret_cast<char*>(&indexpos), sizeof(indexpos));
+        }
+        std::filesystem::resize_file(file, indexpos - 10);
+        REQUIRE(written[0].index.back().pos > written[1].index.back().pos);
+        written[0].index.pop_back();
+
+        for(int reopen=0; reopen < 2; ++reopen) {
+            // The first open rebuilds and appends the index, the second reads it
+            pangolin::PacketStreamReader reader(file.string());
+            REQUIRE(reader.Sources().size() == written.size());
+            for(size_t s=0; s < written.size(); ++s) {
+                const auto& a = written[s].index;
+                const auto& b = reader.Sources()[s].index;
+                REQUIRE(a.size() == b.size());
+                for(size_t i=0; i < a.size(); ++i) {
+                    REQUIRE(a[i].pos == b[i].pos);
+                    REQUIRE(a[i].capture_time == b[i].capture_time);
+                }
+            }
+        }
+    }
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Binary packet metadata reads back as json" )
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_meta.pango";
+    std::filesystem::remove(file);
+
+    const size_t num_packets = 200;
+    std::vector<picojson::value> metas;
+    for(size_t i=0; i < num_packets; ++i) {
+        picojson::value meta;
+        meta["host_reception_time_us"] = picojson::value(int64_t(1600000000000000 + 1000*i));
+        meta["exposure"] = picojson::value(0.01 * i);
+        meta["valid"] = picojson::value(i % 3 == 0);
+        // Change the keys and types part way through
+        if(i >= 120) meta["name"] = picojson::value("frame" + std::to_string(i));
+        if(i >= 150) meta["exposure"] = picojson::value(int64_t(-(int64_t)i));
+        meta["nested"]["values"] = picojson::value(picojson::array{picojson::value(int64_t(i)), picojson::value("x")});
+        metas.push_back(meta);
+    }
+
+    {
+        pangolin::PacketStreamWriter writer(file.string());
+        writer.SetBinaryMeta(true);
+        pangolin::PacketStreamSource src;
+        src.driver = "test";
+        writer.AddSource(src);
+        const std::string data(8, 'd');
+        for(size_t i=0; i < num_packets; ++i) {
+            writer.WriteSourcePacket(0, data.data(), 1000*i, data.size(), metas[i]);
+        }
+    }
+
+    pangolin::PacketStreamReader reader(file.string());
+    REQUIRE(reader.Sources()[0].index.size() == num_packets);
+    for(size_t i=0; i < num_packets; ++i) {
+        REQUIRE(reader.NextFrame().meta == metas[i]);
+    }
+
+    // Seeking needs the schema of the target packet, which may not have been read
+    pangolin::PacketStreamReader seeker(file.string());
+    for(size_t i : {size_t(199), size_t(130), size_t(5), size_t(121), size_t(160)}) {
+        seeker.Seek(0, i);
+        REQUIRE(seeker.NextFrame().meta == metas[i]);
+    }
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Staged packet stream writer interleaves concurrent sources" )
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_staged.pango";
+    std::filesystem::remove(file);
+
+    const size_t num_sources = 3;
+    const size_t num_packets = 300;
+    auto packet_size = [](size_t src, size_t i) { return src == 0 ? 16 : 1000 + 37*i; };
+
+    {
+        pangolin::PacketStreamWriter writer(file.string());
+        writer.SetStaging(true, pangolin::PacketStreamWriter::PacketOrder::Arrival, 20000);
+        for(size_t s=0; s < num_sources; ++s) {
+            pangolin::PacketStreamSource src;
+            src.driver = "test";
+            writer.AddSource(src);
+        }
+
+        std::vector<std::thread> producers;
+        for(size_t s=0; s < num_sources; ++s) {
+            producers.emplace_back([&,s](){
+                for(size_t i=0; i < num_packets; ++i) {
+                    const std::string data(packet_size(s, i), char('a' + (i+s) % 26));
+                    picojson::value meta;
+                    meta["i"] = picojson::value(int64_t(i));
+                    writer.WriteSourcePacket(s, data.data(), int64_t(i), data.size(), meta);
+                }
+            });
+        }
+        for(auto& t : producers) t.join();
+        writer.Flush();
+
+        REQUIRE(writer.GetStats().packets_submitted == num_sources * num_packets);
+    }
+
+    pangolin::PacketStreamReader reader(file.string());
+    std::vector<size_t> next(num_sources, 0);
+    for(size_t n=0; n < num_sources * num_packets; ++n) {
+        auto packet = reader.NextFrame();
+        const size_t i = next[packet.src]++;
+        REQUIRE(packet.meta["i"].get<int64_t>() == int64_t(i));
+        REQUIRE(packet.time == int64_t(i));
+        REQUIRE(packet.size == packet_size(packet.src, i));
+        std::string data(packet.size, '\0');
+        packet.Stream().read(&data[0], data.size());
+        REQUIRE(data == std::string(packet.size, char('a' + (i+packet.src) % 26)));
+    }
+    for(size_t s=0; s < num_sources; ++s) {
+        REQUIRE(reader.Sources()[s].index.size() == num_packets);
+    }
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Packet stream reader resynchronises past corrupt packets" )
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_corrupt.pango";
+    std::filesystem::remove(file);
+
+    const int64_t num_packets = 50;
+    const int64_t corrupt = 20;
+    std::vector<pangolin::PacketStreamSource> written;
+    {
+        pangolin::PacketStreamWriter writer(file.string());
+        pangolin::PacketStreamSource src;
+        src.driver = "test";
+        writer.AddSource(src);
+        // Packet data which contains tags, but not valid packets
+        std::string data;
+        while(data.size() < 200) data += "PKT\x01\x02JSNSRC";
+        for(int64_t i=0; i < num_packets; ++i) {
+            writer.WriteSourcePacket(0, data.data(), i, data.size());
+        }
+        writer.Close();
+        written = writer.Sources();
+    }
+
+    {
+        std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(written[0].index[corrupt].pos);
+        f.write("XXX", 3);
+    }
+
+    pangolin::PacketStreamReader reader(file.string());
+    std::vector<int64_t> times;
+    try {
+        while(true) times.push_back(reader.NextFrame().time);
+    }catch(const std::runtime_error&) {
+    }
+
+    REQUIRE(times.size() == num_packets - 1);
+    for(int64_t i=0, t=0; i < num_packets; ++i) {
+        if(i != corrupt) REQUIRE(times[t++] == i);
+    }
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Chunked packet streams round trip and detect corruption" )
+{
+    REQUIRE(pangolin::Crc32c("123456789", 9) == 0xE3069283u);
+
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_chunks.pango";
+    std::filesystem::remove(file);
+
+    const size_t num_packets = 300;
+    auto packet_data = [](size_t i) { return std::string(100 + i % 50, char('a' + i % 26)); };
+
+    std::vector<pangolin::PacketStreamSource> written;
+    {
+        pangolin::PacketStreamWriter writer(file.string());
+        writer.SetBinaryMeta(true);
+        writer.SetChunking(4096, pangolin::PacketChunkCodec::LZ4, 0, 2);
+        for(int s=0; s < 2; ++s) {
+            pangolin::PacketStreamSource src;
+            src.driver = "test";
+            writer.AddSource(src);
+        }
+        for(size_t i=0; i < num_packets; ++i) {
+            picojson::value meta;
+            meta["frame"] = picojson::value(int64_t(i));
+            const std::string data = packet_data(i);
+            writer.WriteSourcePacket(i % 2, data.data(), 1000*i, data.size(), meta);
+        }
+        writer.Close();
+        written = writer.Sources();
+    }
+
+    auto check = [&](pangolin::Packet&& packet) {
+        const size_t i = packet.meta["frame"].get<int64_t>();
+        REQUIRE(packet.src == i % 2);
+        REQUIRE(packet.time == int64_t(1000*i));
+        REQUIRE(packet.sequence_num == i / 2);
+        std::string data(packet.size, '\0');
+        packet.Stream().read(&data[0], data.size());
+        REQUIRE(data == packet_data(i));
+        return i;
+    };
+
+    {
+        pangolin::PacketStreamReader reader(file.string());
+        REQUIRE(reader.Sources()[0].index.size() == num_packets / 2);
+        REQUIRE(reader.Sources()[0].index.back().chunk_offset >= 0);
+        for(size_t i=0; i < num_packets; ++i) {
+            REQUIRE(check(reader.NextFrame()) == i);
+        }
+        for(size_t frame : {size_t(149), size_t(3), size_t(77), size_t(78)}) {
+            reader.Seek(1, frame);
+            REQUIRE(check(reader.NextFrame()) == 2*frame + 1);
+        }
+        REQUIRE(reader.CorruptChunks() == 0);
+    }
+
+    // Truncated recordings are indexed from the chunks which remain
+    {
+        const std::filesystem::path truncated = std::filesystem::temp_directory_path() / "pangolin_test_chunks_truncated.pango";
+        std::filesystem::copy_file(file, truncated, std::filesystem::copy_options::overwrite_existing);
+        const std::streamoff cut = written[0].index[100].pos;
+        std::filesystem::resize_file(truncated, cut + 20);
+        size_t expected = 0;
+        for(const auto& entry : written[0].index) expected += entry.pos < cut;
+
+        pangolin::PacketStreamReader reader(truncated.string());
+        REQUIRE(reader.Sources()[0].index.size() == expected);
+        std::filesystem::remove(truncated);
+    }
+
+    // Flip a byte within a chunk which holds packets from both sources
+    const std::streamoff corrupt_pos = written[0].index[50].pos;
+    {
+        std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekg(corrupt_pos + std::streamoff(pangolin::PACKET_CHUNK_HEADER_BYTES) + 40);
+        const char c = char(f.get() ^ 0x10);
+        f.seekp(corrupt_pos + std::streamoff(pangolin::PACKET_CHUNK_HEADER_BYTES) + 40);
+        f.put(c);
+    }
+
+    pangolin::PacketStreamReader reader(file.string());
+    size_t num_read = 0;
+    try {
+        while(true) {
+            pangolin::Packet packet = reader.NextFrame();
+            REQUIRE(packet.Stream().inChunk());
+            const size_t i = check(std::move(packet));
+            REQUIRE(written[i % 2].index[i / 2].pos != corrupt_pos);
+            ++num_read;
+        }
+    }catch(const std::runtime_error&) {
+    }
+
+    size_t num_lost = 0;
+    for(const auto& src : written) {
+        for(const auto& entry : src.index) num_lost += entry.pos == corrupt_pos;
+    }
+    REQUIRE(reader.CorruptChunks() == 1);
+    REQUIRE(num_lost > 0);
+    REQUIRE(num_read == num_packets - num_lost);
+
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Packet streams are trimmed and split without decoding" )
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::filesystem::path file = dir / "pangolin_test_copy.pango";
+    const std::filesystem::path trimmed = dir / "pangolin_test_copy_trimmed.pango";
+    auto segment = [&](size_t n) { return (dir / ("pangolin_test_copy_" + std::to_string(n) + ".pango")).string(); };
+
+    // Three sources at different rates over ten seconds
+    const int64_t duration_us = 10000000;
+    const int64_t periods_us[] = {10000, 25000, 100000};
+    {
+        pangolin::PacketStreamWriter writer(file.string());
+        for(int s=0; s < 3; ++s) {
+            pangolin::PacketStreamSource src;
+            src.driver = "test" + std::to_string(s);
+            src.data_size_bytes = s == 2 ? 0 : 16;
+            writer.AddSource(src);
+        }
+        for(int64_t t=0; t < duration_us; t += 5000) {
+            for(int s=0; s < 3; ++s) {
+                if(t % periods_us[s]) continue;
+                picojson::value meta;
+                meta["t"] = picojson::value(t);
+                const std::string data(s == 2 ? 1 + t / 100000 : 16, char('0' + s));
+                writer.WriteSourcePacket(s, data.data(), t, data.size(), meta);
+            }
+        }
+    }
+
+    pangolin::PacketStreamReader reader(file.string());
+
+    // Sources 2 and 0, from 2.5s to 4s
+    {
+        pangolin::PacketStreamSelection selection;
+        selection.sources = {2, 0};
+        selection.begin_us = 2500000;
+        selection.end_us = 4000000;
+
+        size_t copied;
+        {
+            pangolin::PacketStreamWriter writer(trimmed.string());
+            copied = pangolin::CopyPackets(reader, writer, selection);
+        }
+        REQUIRE(copied == 15 + 150);
+
+        pangolin::PacketStreamReader out(trimmed.string());
+        REQUIRE(out.Sources().size() == 2);
+        REQUIRE(out.Sources()[0].driver == "test2");
+        REQUIRE(out.Sources()[1].driver == "test0");
+        REQUIRE(out.Sources()[0].index.size() == 15);
+        REQUIRE(out.Sources()[1].index.size() == 150);
+        for(size_t i=0; i < copied; ++i) {
+            pangolin::Packet packet = out.NextFrame();
+            REQUIRE(packet.time >= selection.begin_us);
+            REQUIRE(packet.time < selection.end_us);
+            REQUIRE(packet.meta["t"].get<int64_t>() == packet.time);
+            std::string data(packet.size, '\0');
+            packet.Stream().read(&data[0], data.size());
+            const int s = packet.src == 0 ? 2 : 0;
+            REQUIRE(data == std::string(s == 2 ? 1 + packet.time / 100000 : 16, char('0' + s)));
+        }
+    }
+
+    // Frames 100 to 200 of source 1
+    {
+        pangolin::PacketStreamSelection selection;
+        selection.sources = {1};
+        selection.SetFrames(reader, 1, 100, 200);
+        {
+            pangolin::PacketStreamWriter writer(trimmed.string());
+            REQUIRE(pangolin::CopyPackets(reader, writer, selection) == 100);
+        }
+        pangolin::PacketStreamReader out(trimmed.string());
+        REQUIRE(out.NextFrame().time == 100 * periods_us[1]);
+    }
+
+    // Three second segments
+    {
+        const size_t num_segments = pangolin::SplitPackets(reader, 3000000, segment);
+        REQUIRE(num_segments == 4);
+        size_t total = 0;
+        for(size_t n=0; n < num_segments; ++n) {
+            pangolin::PacketStreamReader out(segment(n));
+            REQUIRE(out.Sources().size() == 3);
+            for(const auto& src : out.Sources()) {
+                total += src.index.size();
+                for(const auto& entry : src.index) {
+                    REQUIRE(entry.capture_time / 3000000 == int64_t(n));
+                }
+            }
+            std::filesystem::remove(segment(n));
+        }
+        REQUIRE(total == 1000 + 400 + 100);
+    }
+
+    // A stream holding fewer packets than its index is an error, not a short copy
+    {
+        const std::string garbage(64, 'X');
+        std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(reader.Sources()[0].index[500].pos);
+        f.write(garbage.data(), garbage.size());
+    }
+    {
+        pangolin::PacketStreamReader corrupt(file.string());
+        pangolin::PacketStreamWriter writer(trimmed.string());
+        REQUIRE_THROWS_AS(pangolin::CopyPackets(corrupt, writer), std::runtime_error);
+    }
+
+    std::filesystem::remove(trimmed);
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Playback cursors read sources of one file in parallel" )
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_cursors.pango";
+
+    for(bool chunked : {false, true}) {
+        const size_t num_sources = 3;
+        const size_t num_packets = 300;
+        {
+            pangolin::PacketStreamWriter writer(file.string());
+            if(chunked) writer.SetChunking(4096, pangolin::PacketChunkCodec::None);
+            for(size_t s=0; s < num_sources; ++s) {
+                pangolin::PacketStreamSource src;
+                src.driver = "test" + std::to_string(s);
+                writer.AddSource(src);
+            }
+            for(size_t i=0; i < num_packets; ++i) {
+                for(size_t s=0; s < num_sources; ++s) {
+                    picojson::value meta;
+                    meta["i"] = picojson::value(int64_t(i));
+                    const std::string data(1 + (i + s) % 64, char('a' + s));
+                    writer.WriteSourcePacket(s, data.data(), int64_t(i * 1000 + s), data.size(), meta);
+                }
+            }
+        }
+
+        auto session = std::make_shared<pangolin::PlaybackSession>();
+        std::vector<std::shared_ptr<pangolin::PacketStreamReader>> cursors;
+        for(size_t s=0; s < num_sources; ++s) {
+            cursors.push_back(session->OpenCursor(file.string()));
+        }
+        REQUIRE(cursors[0] != cursors[1]);
+        REQUIRE(cursors[0] != session->Open(file.string()));
+
+        // Cursors share the index parsed by the session's reader
+        const auto& shared_index = session->Open(file.string())->Sources()[0].index;
+        REQUIRE(shared_index.size() == num_packets);
+        for(const auto& cursor : cursors) {
+            REQUIRE(&cursor->Sources()[0].index[0] == &shared_index[0]);
+        }
+
+        // Each thread follows its own source; none may block another
+        std::vector<size_t> good(num_sources, 0);
+        std::vector<std::thread> threads;
+        for(size_t s=0; s < num_sources; ++s) {
+            threads.emplace_back([&, s]() {
+                for(size_t i=0; i < num_packets; ++i) {
+                    pangolin::Packet packet = cursors[s]->NextFrame(s);
+                    std::string data(packet.size, '\0');
+                    packet.Stream().read(&data[0], data.size());
+                    if( packet.src == s && packet.sequence_num == i && packet.time == int64_t(i * 1000 + s) &&
+                        packet.meta["i"].get<int64_t>() == int64_t(i) &&
+                        data == std::string(1 + (i + s) % 64, char('a' + s)) ) {
+                        ++good[s];
+                    }
+                }
+            });
+        }
+        for(auto& t : threads) t.join();
+        for(size_t s=0; s < num_sources; ++s) {
+            REQUIRE(good[s] == num_packets);
+        }
+
+        // Seeking one cursor leaves the others where they were
+        cursors[1]->Seek(1, 10);
+        REQUIRE(cursors[1]->NextFrame(1).sequence_num == 10);
+        REQUIRE(cursors[0]->Sources()[0].next_packet_id == num_packets);
+    }
+
+    std::filesystem::remove(file);
+}
@@ -11,6 +11,8 @@
 #include <pangolin/handler/handler_image.h>
 #include <pangolin/var/var.h>
 
+#include <chrono>
+
 
 namespace pangolin
 {
@@ -99,6 +101,8 @@ void VideoViewer::Run()
     glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     pangolin::Var<int> frame("ui.frame");
+    pangolin::Var<double> upload_MBps("ui.upload_MBps", 0.0);
+    pangolin::Var<double> upload_latency_ms("ui.upload_latency_ms", 0.0);
     pangolin::Slider frame_slider("frame", frame.Ref() );
 
     if(video_playback && TotalFrames() < std::numeric_limits<int>::max())
@@ -156,8 +160,20 @@ void VideoViewer::Run()
         } );
     }
 
+    // Print texture streaming throughput / latency
+    pangolin::RegisterKeyPressCallback('u', [&](){
+        pango_print_info("Texture upload: %.1f MB/s, %.2f ms mean latency\n", (double)upload_MBps, (double)upload_latency_ms);
+        for(size_t v=0; v < stream_views.size(); ++v) {
+            const GlPixelUnpackRing::Stats stats = stream_views[v].GetUploadStats();
+            pango_print_info("  Stream %zu: %zu uploaded, %zu dropped, %.2f ms max latency\n",
+                v, stats.frames_uploaded, stats.frames_dropped, stats.max_latency_ms);
+        }
+    } );
+
     video.Start();
 
+    auto upload_stats_start = std::chrono::steady_clock::now();
+
     // Stream and display video
     while(should_run && !pangolin::ShouldQuit())
     {
@@ -185,12 +201,29 @@ void VideoViewer::Run()
                 if((frame-1) % draw_nth_frame == 0) {
                     for(unsigned int i=0; i<images.size(); ++i)
                         if(stream_views[i].IsShown()) {
-                            stream_views[i].SetImage(images[i], pangolin::GlPixFormat(video.Streams()[i].PixFormat() ));
+                            stream_views[i].SetImage(images[i], video.Streams()[i].PixFormat());
                         }
                 }
             }
         }
 
+        // Update streaming statistics about once per second
+        const auto now = std::chrono::steady_clock::now();
+        const double upload_stats_s = std::chrono::duration<double>(now - upload_stats_start).count();
+        if(upload_stats_s >= 1.0) {
+            size_t bytes = 0;
+            double latency_ms = 0.0;
+            for(auto& sv : stream_views) {
+                const GlPixelUnpackRing::Stats stats = sv.GetUploadStats();
+                bytes += stats.bytes_uploaded;
+                latency_ms = std::max(latency_ms, stats.mean_latency_ms);
+                sv.ResetUploadStats();
+            }
+            upload_MBps = bytes / (1024.0 * 1024.0 * upload_stats_s);
+            upload_latency_ms = latency_ms;
+            upload_stats_start = now;
+        }
+
         // leave in pixel orthographic for slider to render.
         pangolin::DisplayBase().ActivatePixelOrthographic();
         pangolin::FinishFrame();
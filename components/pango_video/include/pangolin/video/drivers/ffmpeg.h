@@ -31,13 +31,25 @@
 #include <pangolin/video/iostream_operators.h>
 #include <pangolin/video/drivers/ffmpeg_common.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 namespace pangolin
 {
 
+// decode_threads and thread_type ("frame", "slice" or "frame,slice") configure
+// the decoder's own threading. Decoding is single threaded by default, since
+// frame threading delays output by a frame per thread; 0 lets ffmpeg choose. If
+// decode_ahead is non-zero, a dedicated thread decodes up to that many frames
+// ahead of GrabNext(). Conversion to the output format is split into bands of
+// rows across convert_threads, which persist for the lifetime of the video.
 class PANGOLIN_EXPORT FfmpegVideo : public VideoInterface, public VideoPlaybackInterface
 {
 public:
-    FfmpegVideo(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false, int user_video_stream = -1, ImageDim size = ImageDim(0,0));
+    FfmpegVideo(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false, int user_video_stream = -1, ImageDim size = ImageDim(0,0),
+                int decode_threads = 1, const std::string thread_type = "frame,slice", size_t decode_ahead = 0, size_t convert_threads = 1);
     ~FfmpegVideo();
     
     //! Implement VideoInput::Start()
@@ -64,11 +76,26 @@ public:
     size_t Seek(size_t frameid) override;
 
 protected:
-    void InitUrl(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false , int user_video_stream = -1, ImageDim size= ImageDim(0,0));
+    void InitUrl(const std::string filename, const std::string fmtout = "RGB24", const std::string codec_hint = "", bool dump_info = false , int user_video_stream = -1, ImageDim size= ImageDim(0,0),
+                 int decode_threads = 1, const std::string thread_type = "frame,slice", size_t convert_threads = 1);
+
+    // Decode the next frame in sequence into frame. Returns false at the end of the stream.
+    bool DecodeFrame(AVFrame* frame);
+
+    // Convert frame to fmtout, written packed into image
+    void ConvertFrame(const AVFrame* frame, unsigned char* image);
+
+    void DecodeLoop();
+    void StartDecodeThread();
+    void StopDecodeThread();
+
+    // Convert band b of each frame handed over by ConvertFrame()
+    void ConvertLoop(size_t b);
+    void StartConvertThreads();
+    void StopConvertThreads();
     
     std::vector<StreamInfo> streams;
     
-    SwsContext      *img_convert_ctx;
     AVFormatContext *pFormatCtx;
     int             videoStream;
     int64_t         numFrames;
@@ -77,11 +104,46 @@ protected:
     const AVCodec         *pAudCodec;
     AVCodecContext *pCodecContext;
     AVFrame         *pFrame;
-    AVFrame         *pFrameOut;
     AVPacket        *packet;
     int             numBytesOut;
     AVPixelFormat     fmtout;
     int64_t next_frame;
+    int64_t next_decode_frame;
+    bool decoder_drained;
+
+    // One conversion context per band of rows
+    struct ConvertBand
+    {
+        SwsContext* ctx;
+        int y;
+        int h;
+    };
+    std::vector<ConvertBand> convert_bands;
+
+    // Convert the rows of one band of frame into image
+    void ConvertBandRows(const ConvertBand& band, const AVFrame* frame, unsigned char* image);
+
+    // Workers for all but the first band, which ConvertFrame() converts itself.
+    // Each generation is one frame, complete when convert_pending reaches 0.
+    std::vector<std::thread> convert_workers;
+    std::mutex convert_lock;
+    std::condition_variable convert_cond;
+    std::condition_variable convert_done_cond;
+    const AVFrame* convert_frame;
+    unsigned char* convert_image;
+    size_t convert_generation;
+    size_t convert_pending;
+    bool quit_convert;
+
+    // Decode ahead queue of frames, recycled through free_frames
+    size_t decode_ahead;
+    std::thread decode_thread;
+    std::mutex decode_lock;
+    std::condition_variable decode_cond;
+    std::deque<AVFrame*> decoded_frames;
+    std::vector<AVFrame*> free_frames;
+    bool decode_eof;
+    bool quit_decode;
 };
 
 }
@@ -30,6 +30,12 @@
 #include <pangolin/video/video_output_interface.h>
 #include <pangolin/video/drivers/ffmpeg_common.h>
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
 namespace pangolin
 {
 
@@ -40,12 +46,30 @@ typedef AVCodecID CodecID;
 // Forward declaration
 class FfmpegVideoOutputStream;
 
+// By default frames are encoded within WriteStreams() by a single threaded
+// codec. If queue_size is non-zero, each stream is instead converted and
+// encoded on its own thread from a queue of up to queue_size frames. When a
+// queue is full, WriteStreams() either blocks until the encoder catches up or,
+// if drop_frames, discards the frame for all streams and returns -1. Dropped
+// frames are also counted in GetStats(). encoder_threads (0 lets the codec
+// choose) and preset (e.g. "ultrafast") are passed to the codec.
 class PANGOLIN_EXPORT FfmpegVideoOutput
     : public VideoOutputInterface
 {
     friend class FfmpegVideoOutputStream;
 public:
-    FfmpegVideoOutput( const std::string& filename, int base_frame_rate, int bit_rate, bool flip = false);
+    struct Stats
+    {
+        size_t frames_queued = 0;
+        size_t frames_dropped = 0;
+        // Number of times WriteStreams() waited for a full queue, and for how long
+        size_t frames_blocked = 0;
+        int64_t blocked_us = 0;
+        size_t max_queue_depth = 0;
+    };
+
+    FfmpegVideoOutput( const std::string& filename, int base_frame_rate, int bit_rate, bool flip = false,
+                       int encoder_threads = 1, const std::string& preset = "", size_t queue_size = 0, bool drop_frames = false);
     ~FfmpegVideoOutput();
 
     const std::vector<StreamInfo>& Streams() const override;
@@ -56,6 +80,8 @@ public:
 
     bool IsPipe() const override;
 
+    Stats GetStats() const;
+
 protected:
     void Initialise(std::string filename);
     void StartStream();
@@ -73,20 +99,52 @@ protected:
     int bit_rate;
     bool is_pipe;
     bool flip;
+
+    int encoder_threads;
+    std::string preset;
+    size_t queue_size;
+    bool drop_frames;
+
+    // Serialises writes of packets from each stream's encoder
+    std::mutex write_lock;
+    mutable std::mutex stats_lock;
+    Stats stats;
 };
 
 class FfmpegVideoOutputStream
 {
 public:
-    FfmpegVideoOutputStream(FfmpegVideoOutput& recorder, CodecID codec_id, uint64_t frame_rate, int bit_rate, const StreamInfo& input_info, bool flip );
+    FfmpegVideoOutputStream(FfmpegVideoOutput& recorder, CodecID codec_id, uint64_t frame_rate, int bit_rate, const StreamInfo& input_info, bool flip,
+                            int encoder_threads = 1, const std::string& preset = "", size_t queue_size = 0);
     ~FfmpegVideoOutputStream();
 
     const StreamInfo& GetStreamInfo() const;
 
+    // Queue img to be encoded, blocking whilst the queue is full, or encode it
+    // immediately if the stream has no queue.
     void WriteImage(const uint8_t* img, int w, int h);
+
+    // True if WriteImage() would not block
+    bool CanQueue();
+
+    size_t QueueDepth();
+
+    // Wait for queued frames to be encoded and stop the encoder thread, if any
+    void Finish();
+
     void Flush();
 
 protected:
+    struct QueuedFrame
+    {
+        AVFrame* frame;
+        int w;
+        int h;
+    };
+
+    AVFrame* AllocSourceFrame();
+    void EncodeImage(AVFrame* src_frame, int w, int h);
+    void EncodeLoop();
     void WriteAvPacket(AVPacket* pkt);
     void WriteFrame(AVFrame* frame);
     double BaseFrameTime();
@@ -101,11 +159,21 @@ protected:
     // These pointers are owned by class
     AVStream* stream;
     SwsContext *sws_ctx;
-    AVFrame* src_frame;
     AVFrame* frame;
     AVCodecContext* codec_context;
 
     bool flip;
+    int64_t next_pts;
+
+    // Source frames waiting to be encoded, recycled through free_frames
+    std::vector<AVFrame*> src_frames;
+    std::vector<AVFrame*> free_frames;
+    std::deque<QueuedFrame> queue;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::thread encode_thread;
+    bool quit;
+    std::exception_ptr encode_error;
 };
 
 }
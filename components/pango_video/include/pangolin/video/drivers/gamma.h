@@ -27,21 +27,36 @@
 
 #pragma once
 
-#include <pangolin/pangolin.h>
-#include <pangolin/video/video.h>
-#include <set>
+#include <pangolin/video/video_interface.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
 
 namespace pangolin
 {
 
-// Video class that applies gamma to its video input
+// Video class that applies gamma, or any other tone curve, to its video input.
+// Each curve is evaluated once for every possible input value into a per-stream
+// lookup table, so frames are mapped by table lookup alone. Supports integer
+// formats with 8 or 16 bits per channel as well as packed GRAY10 and GRAY12.
+// Rows are split into bands which are processed on num_threads threads, kept
+// for the lifetime of the video.
 class PANGOLIN_EXPORT GammaVideo :
     public VideoInterface,
     public VideoFilterInterface,
     public BufferAwareVideoInterface
 {
 public:
-    GammaVideo(std::unique_ptr<VideoInterface>& videoin, const std::map<size_t, float> &stream_gammas);
+    // Maps normalised intensity in [0,1] to [0,1]
+    typedef std::function<float(float)> ToneCurve;
+
+    GammaVideo(std::unique_ptr<VideoInterface>& videoin, const std::map<size_t, float> &stream_gammas, size_t num_threads = 1);
+
+    GammaVideo(std::unique_ptr<VideoInterface>& videoin, const std::map<size_t, ToneCurve> &stream_curves, size_t num_threads = 1);
+
     ~GammaVideo();
 
     //! Implement VideoInput::Start()
@@ -69,8 +84,43 @@ public:
 
     bool DropNFrames(uint32_t n);
 
+    //! Tone curve through the normalised control points (x,y), linearly
+    //! interpolated. x must be increasing.
+    static ToneCurve PiecewiseLinearCurve(const std::vector<std::pair<float,float>>& points);
+
+    //! Set the number of significant bits of input data in stream, which
+    //! defaults to the channel bit depth of its pixel format. Input values
+    //! above this range map to the top of the curve.
+    void SetSignificantBits(size_t stream, unsigned int bits);
+
 protected:
+    // Lookup table for a stream, empty for streams which are copied unchanged
+    struct StreamLut
+    {
+        ToneCurve curve;
+        unsigned int bits = 0;
+        std::vector<uint8_t> lut8;
+        std::vector<uint16_t> lut16;
+    };
+
+    // Rows [y0,y1) of a stream
+    struct Band
+    {
+        size_t stream;
+        size_t y0;
+        size_t y1;
+    };
+
+    void Init(const std::map<size_t, ToneCurve>& stream_curves);
+    void BuildLut(size_t stream);
     void Process(uint8_t* image, const uint8_t* buffer);
+    void ProcessRows(size_t stream, Image<uint8_t>& img_out, const Image<uint8_t>& img_in, size_t y0, size_t y1);
+
+    // Process bands of the current frame until none are left. Called with
+    // work_lock held by l.
+    void ProcessBands(std::unique_lock<std::mutex>& l);
+    void WorkerLoop();
+    void StopWorkers();
 
     std::unique_ptr<VideoInterface> src;
     std::vector<VideoInterface*> videoin;
@@ -78,8 +128,21 @@ protected:
     std::vector<StreamInfo> streams;
     size_t size_bytes;
     std::unique_ptr<uint8_t[]> buffer;
-    const std::map<size_t, float> stream_gammas;
-    std::set<std::string> formats_supported;
+    std::vector<StreamLut> luts;
+    size_t num_threads;
+
+    // Bands of the frame being processed, taken in turn by the workers and
+    // the thread calling Process()
+    std::vector<Band> bands;
+    uint8_t* bands_out;
+    const uint8_t* bands_in;
+    size_t next_band;
+    size_t bands_done;
+    bool quit_workers;
+    std::vector<std::thread> workers;
+    std::mutex work_lock;
+    std::condition_variable work_cond;
+    std::condition_variable done_cond;
 };
 
 }
@@ -30,7 +30,12 @@
 #include <pangolin/video/video_interface.h>
 #include <pangolin/image/image_io.h>
 
+#include <condition_variable>
 #include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace pangolin
@@ -56,6 +61,12 @@ public:
 
     ~ImagesVideo();
 
+    // Decode up to frames ahead of the current position using num_threads
+    // workers (0 for one per core, up to frames). Lookahead is further limited
+    // to max_bytes of decoded images if non-zero. frames = 0 decodes
+    // synchronously within GrabNext().
+    void Prefetch(size_t frames, size_t num_threads = 0, size_t max_bytes = 0);
+
     ///////////////////////////////////
     // Implement VideoInterface
     
@@ -89,8 +100,18 @@ public:
     
 protected:
     typedef std::vector<TypedImage> Frame;
+
+    struct PrefetchSlot
+    {
+        enum class State { Loading, Ready };
+        State state;
+        // Distinguishes a slot from a previous one for the same frame discarded by Seek()
+        size_t ticket;
+        Frame frame;
+        std::exception_ptr error;
+    };
     
-    const std::string& Filename(size_t frameNum, size_t channelNum) {
+    const std::string& Filename(size_t frameNum, size_t channelNum) const {
         return filenames[channelNum][frameNum];
     }
     
@@ -98,7 +119,11 @@ protected:
 
     void PopulateFilenamesFromJson(const std::string& filename);
 
-    bool LoadFrame(size_t i);
+    bool LoadFrame(size_t i, Frame& frame) const;
+
+    void PrefetchLoop();
+
+    void StopPrefetch();
 
     void ConfigureStreamSizes();
     
@@ -109,7 +134,16 @@ protected:
     size_t num_channels;
     size_t next_frame_id;
     std::vector<std::vector<std::string> > filenames;
-    std::vector<Frame> loaded;
+
+    // Decoded frames, or frames being decoded, from next_frame_id onwards
+    std::map<size_t, PrefetchSlot> loaded;
+    size_t prefetch_frames;
+    size_t next_ticket;
+    bool quit_prefetch;
+    std::vector<std::thread> prefetch_threads;
+    std::mutex prefetch_lock;
+    std::condition_variable prefetch_cond;
+    std::condition_variable frame_ready_cond;
 
     bool unknowns_are_raw;
     PixelFormat raw_fmt;
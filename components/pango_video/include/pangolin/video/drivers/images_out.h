@@ -31,13 +31,25 @@
 #include <pangolin/video/video_output_interface.h>
 #include <pangolin/log/packetstream_writer.h>
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 namespace pangolin
 {
 
+// Encodes and writes images on a pool of num_threads workers (0 for one per
+// core). WriteStreams() blocks whilst max_queued_frames frames are waiting to
+// be written (0 for twice the number of workers). Frames are added to the json
+// index in order as soon as they have been written.
 class PANGOLIN_EXPORT ImagesVideoOutput : public VideoOutputInterface
 {
 public:
-    ImagesVideoOutput(const std::string& image_folder, const std::string& json_file_out, const std::string &image_file_extension);
+    ImagesVideoOutput(const std::string& image_folder, const std::string& json_file_out, const std::string &image_file_extension, size_t num_threads = 0, size_t max_queued_frames = 0);
     ~ImagesVideoOutput();
 
     const std::vector<StreamInfo>& Streams() const override;
@@ -45,16 +57,45 @@ public:
     int WriteStreams(const unsigned char* data, const picojson::value& frame_properties) override;
     bool IsPipe() const override;
 
+    // Block until all queued frames have been written
+    void Flush();
+
 protected:
+    struct Job
+    {
+        size_t image_index;
+        std::unique_ptr<unsigned char[]> data;
+        picojson::value frame_properties;
+    };
+
+    void WriteLoop();
+
+    void WriteJsonHeader();
+
     std::vector<StreamInfo> streams;
+    size_t size_bytes;
     std::string input_uri;
     picojson::value device_properties;
-    picojson::value json_frames;
 
     size_t image_index;
     std::string image_folder;
     std::string image_file_extension;
     std::ofstream file;
+    bool json_header_written;
+
+    size_t max_queued_frames;
+    std::vector<std::thread> write_threads;
+    std::mutex lock;
+    std::condition_variable cond;
+    bool quit_write_threads;
+    std::deque<Job> queue;
+    size_t frames_in_flight;
+    std::vector<std::unique_ptr<unsigned char[]>> free_buffers;
+
+    // Index entries of written frames, waiting for earlier frames to complete
+    std::map<size_t, picojson::value> json_pending;
+    size_t json_next_index;
+    std::exception_ptr write_error;
 };
 
 }
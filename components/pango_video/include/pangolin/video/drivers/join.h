@@ -29,14 +29,35 @@
 
 #include <pangolin/video/video_interface.h>
 
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 namespace pangolin
 {
 
 class PANGOLIN_EXPORT JoinVideo
-    : public VideoInterface, public VideoFilterInterface
+    : public VideoInterface, public VideoFilterInterface, public VideoPropertiesInterface
 {
 public:
-    JoinVideo(std::vector<std::unique_ptr<VideoInterface>> &src, const bool verbose);
+    struct Stats
+    {
+        // Number of joined frame sets returned from GrabNext / GrabNewest
+        size_t sets_delivered = 0;
+        // Per source: frames received, frames discarded because the source
+        // buffer was full, and frames discarded without a match in time.
+        std::vector<size_t> frames_received;
+        std::vector<size_t> frames_dropped;
+        std::vector<size_t> frames_unmatched;
+        // Largest capture time spread of a delivered set
+        int64_t max_set_span_us = 0;
+    };
+
+    // If threaded, each source is grabbed continuously by its own thread into
+    // num_buffers frames of buffering, and sets are matched by capture time as
+    // frames arrive. Otherwise sources are polled from GrabNext().
+    JoinVideo(std::vector<std::unique_ptr<VideoInterface>> &src, const bool verbose, const bool threaded = false, const size_t num_buffers = 4);
 
     ~JoinVideo();
 
@@ -62,9 +83,49 @@ public:
 
     std::vector<VideoInterface*>& InputStreams();
 
+    const picojson::value& DeviceProperties() const;
+
+    const picojson::value& FrameProperties() const;
+
+    // Statistics are only gathered in threaded mode
+    Stats GetStats() const;
+
 protected:
+    struct BufferedFrame
+    {
+        size_t buffer;
+        int64_t capture_us;
+        picojson::value frame_properties;
+    };
+
+    struct Source
+    {
+        std::vector<std::unique_ptr<unsigned char[]>> buffers;
+        std::vector<size_t> free_buffers;
+        // Frames in arrival (and so capture time) order
+        std::deque<BufferedFrame> frames;
+        std::thread thread;
+        bool grab_failed = false;
+    };
+
     int64_t GetAdjustedCaptureTime(size_t src_index);
 
+    bool GrabNextPolled( unsigned char* image, bool wait );
+    bool GrabNextThreaded( unsigned char* image, bool wait, bool newest );
+
+    // Grab thread for source s
+    void GrabLoop(size_t s);
+
+    // Discard frames which can no longer be part of a set. Returns true if the
+    // oldest remaining frame of each source form a set. Requires lock.
+    bool MatchSet();
+
+    // Release the oldest frame of each source, copying it to image if not null. Requires lock.
+    void PopSet(unsigned char* image);
+
+    void StartThreads();
+    void StopThreads();
+
     std::vector<std::unique_ptr<VideoInterface>> storage;
     std::vector<VideoInterface*> src;
     std::vector<bool> frame_seen;
@@ -74,6 +135,16 @@ protected:
     int64_t sync_tolerance_us;
     int64_t transfer_bandwidth_bytes_per_us;
     bool verbose;
+
+    bool threaded;
+    std::vector<Source> sources;
+    bool quit_grab_threads;
+    mutable std::mutex lock;
+    std::condition_variable cond;
+    Stats stats;
+
+    mutable picojson::value device_properties;
+    mutable picojson::value frame_properties;
 };
 
 
@@ -33,6 +33,10 @@
 #include <pangolin/log/playback_session.h>
 #include <pangolin/utils/signal_slot.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace pangolin
 {
 
@@ -40,6 +44,22 @@ class PANGOLIN_EXPORT PangoVideo
     : public VideoInterface, public VideoPropertiesInterface, public VideoPlaybackInterface
 {
 public:
+    struct Stats
+    {
+        size_t frames = 0;
+        // Time GrabNext() spent reading (and decoding) packets, in total and
+        // the longest for one frame
+        int64_t read_us = 0;
+        int64_t max_read_us = 0;
+        // Frames whose read took longer than 10ms, and the time spent on them
+        size_t frames_stalled = 0;
+        int64_t stalled_us = 0;
+        // Reads hinted to the OS by readahead, one per packet or chunk, and
+        // the bytes of file they span
+        size_t packets_advised = 0;
+        size_t bytes_advised = 0;
+    };
+
     PangoVideo(const std::string& filename, std::shared_ptr<PlaybackSession> playback_session);
     ~PangoVideo();
 
@@ -77,9 +97,20 @@ public:
 
     std::string GetSourceUri();
 
+    // Ask the OS to start reading the packets needed over the next horizon_us
+    // of playback, at the rate frames are being grabbed, whilst the current
+    // frame is processed. At most max_bytes of the file are requested ahead.
+    void Readahead(int64_t horizon_us, size_t max_bytes);
+
+    void StopReadahead();
+
+    Stats GetStats() const;
+
 private:
     void HandlePipeClosed();
 
+    void ReadaheadLoop();
+
 protected:
     int FindPacketStreamSource();
     void SetupStreams(const PacketStreamSource& src);
@@ -100,6 +131,24 @@ protected:
     std::string _source_uri;
 
     sigslot::scoped_connection session_seek;
+
+    // File extent (position, length) of each packet of the source, in index
+    // order. Packets of one chunk share the extent of the whole chunk.
+    std::vector<std::pair<int64_t,int64_t>> _readahead_extents;
+    // Bytes spanned by the extents of packets [0,i), counting each once
+    std::vector<int64_t> _readahead_bytes;
+    int64_t _readahead_us;
+    size_t _readahead_max_bytes;
+    size_t _next_frame_id;
+    size_t _readahead_advised_id;
+    double _readahead_frames_per_s;
+    basetime _last_grab;
+    int _readahead_fd;
+    bool _readahead_quit;
+    std::thread _readahead_thread;
+    mutable std::mutex _readahead_lock;
+    std::condition_variable _readahead_cond;
+    Stats _stats;
 };
 
 }
@@ -39,7 +39,7 @@ namespace pangolin
 class PANGOLIN_EXPORT PangoVideoOutput : public VideoOutputInterface
 {
 public:
-    PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris);
+    PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris, bool binary_meta = false, bool index_checkpoints = false);
     ~PangoVideoOutput();
 
     const std::vector<StreamInfo>& Streams() const override;
@@ -47,6 +47,9 @@ public:
     int WriteStreams(const unsigned char* data, const picojson::value& frame_properties) override;
     bool IsPipe() const override;
 
+    // See PacketStreamWriter::SetChunking()
+    void SetChunking(size_t chunk_bytes, PacketChunkCodec codec, int level = 0);
+
 protected:
 //    void WriteHeader();
 
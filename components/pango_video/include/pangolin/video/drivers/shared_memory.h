@@ -4,18 +4,70 @@
 #include <pangolin/utils/posix/condition_variable.h>
 #include <pangolin/utils/posix/shared_memory_buffer.h>
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
 namespace pangolin
 {
 
-class SharedMemoryVideo : public VideoInterface
+// Layout of a shared memory ring written by SharedMemoryVideoOutput. The
+// header is followed by num_slots slots of slot_bytes, each holding one frame.
+// Frame n is written to slot n % num_slots. slot_seq[s] is 2n+1 whilst frame n
+// is being written to slot s and 2n+2 once it is complete, so readers can
+// detect a slot being overwritten whilst they copy from it.
+struct SharedMemoryRingHeader
+{
+  static constexpr uint64_t kMagic = 0x474e5252474e4150ull; // "PANGRRNG"
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint32_t kMaxSlots = 64;
+  static constexpr uint32_t kMaxStreams = 8;
+
+  struct Stream
+  {
+    char fmt[16];
+    uint32_t w;
+    uint32_t h;
+    uint64_t pitch;
+    uint64_t offset;
+  };
+
+  // Written last by the writer, once the rest of the header is valid
+  std::atomic<uint64_t> magic;
+  uint32_t version;
+  uint32_t num_slots;
+  uint64_t frame_bytes;
+  uint64_t slot_bytes;
+  uint64_t data_offset;
+  uint32_t num_streams;
+  std::atomic<uint32_t> closed;
+  Stream streams[kMaxStreams];
+
+  // Number of frames published so far
+  alignas(64) std::atomic<uint64_t> published;
+  alignas(64) std::atomic<uint64_t> slot_seq[kMaxSlots];
+  int64_t slot_time_us[kMaxSlots];
+
+  static size_t TotalBytes(size_t frame_bytes, size_t num_slots);
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory ring requires lock free 64 bit atomics");
+
+// Reads frames from posix shared memory. Either a single frame buffer guarded
+// by a file lock and optional condition variable, or a ring of frames written
+// by SharedMemoryVideoOutput. Each reader of a ring keeps its own position so
+// that any number of processes can consume the same frames. A reader which
+// falls more than the ring size behind skips forward, counting dropped frames.
+class SharedMemoryVideo : public VideoInterface, public VideoPropertiesInterface
 {
 public:
   SharedMemoryVideo(size_t w, size_t h, std::string pix_fmt,
     const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory,
     const std::shared_ptr<ConditionVariableInterface>& buffer_full);
+
+  // Read from the ring in shared_memory, which must have been initialised
+  SharedMemoryVideo(const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory,
+    const std::shared_ptr<ConditionVariableInterface>& frame_ready);
   ~SharedMemoryVideo();
 
   size_t SizeBytes() const;
@@ -25,12 +77,36 @@ public:
   bool GrabNext(unsigned char *image, bool wait);
   bool GrabNewest(unsigned char *image, bool wait);
 
+  const picojson::value& DeviceProperties() const override;
+  const picojson::value& FrameProperties() const override;
+  VideoFrameProperties TypedFrameProperties() const override;
+
+  // Frames this reader missed because the writer overtook it
+  uint64_t FramesDropped() const;
+
+  // True if shared_memory begins with an initialised ring header
+  static bool IsRing(const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory);
+
 private:
+  bool _ReadRing(unsigned char *image, bool wait, bool newest);
+  bool _ReadSlot(uint64_t frame, unsigned char *image);
+  void _WaitForFrame();
+
   PixelFormat _fmt;
   size_t _frame_size;
   std::vector<StreamInfo> _streams;
   std::shared_ptr<SharedMemoryBufferInterface> _shared_memory;
   std::shared_ptr<ConditionVariableInterface> _buffer_full;
+
+  SharedMemoryRingHeader* _ring;
+  uint64_t _next_frame;
+  uint64_t _dropped;
+  picojson::value _device_properties;
+  VideoFrameProperties _frame_properties;
+
+  // Built from _frame_properties when first asked for after a frame
+  mutable picojson::value _frame_properties_json;
+  mutable bool _frame_properties_dirty;
 };
 
 }
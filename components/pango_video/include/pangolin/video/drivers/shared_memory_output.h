@@ -0,0 +1,46 @@
+#pragma once
+
+#include <pangolin/video/video_output_interface.h>
+#include <pangolin/video/drivers/shared_memory.h>
+
+#include <memory>
+#include <vector>
+
+namespace pangolin
+{
+
+// Publishes frames to a ring of num_slots frames in posix shared memory, named
+// name, which any number of SharedMemoryVideo readers can consume (shmem://name).
+// The writer never waits for readers; a reader falling more than num_slots
+// frames behind drops frames. Use AcquireFrame() / PublishFrame() to write
+// straight into shared memory without an extra copy.
+class SharedMemoryVideoOutput : public VideoOutputInterface
+{
+public:
+  SharedMemoryVideoOutput(const std::string& name, size_t num_slots = 4);
+  ~SharedMemoryVideoOutput();
+
+  const std::vector<StreamInfo>& Streams() const override;
+  void SetStreams(const std::vector<StreamInfo>& streams, const std::string& uri, const picojson::value& properties) override;
+  int WriteStreams(const unsigned char* data, const picojson::value& frame_properties) override;
+  bool IsPipe() const override;
+
+  // Slot for the next frame, laid out according to Streams(). Readers will
+  // not use its contents until PublishFrame() is called.
+  unsigned char* AcquireFrame();
+
+  // Make the acquired frame visible to readers. capture_time_us defaults to now.
+  int PublishFrame(int64_t capture_time_us = -1);
+
+private:
+  std::string _name;
+  size_t _num_slots;
+  std::vector<StreamInfo> _streams;
+  std::shared_ptr<SharedMemoryBufferInterface> _shared_memory;
+  std::shared_ptr<ConditionVariableInterface> _frame_ready;
+  SharedMemoryRingHeader* _ring;
+  uint64_t _frame;
+  bool _acquired;
+};
+
+}
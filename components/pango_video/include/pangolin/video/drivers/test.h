@@ -28,15 +28,25 @@
 #pragma once
 
 #include <pangolin/video/video_interface.h>
+#include <pangolin/utils/timer.h>
 
 namespace pangolin
 {
 
 // Video class that outputs test video signal.
-class PANGOLIN_EXPORT TestVideo : public VideoInterface
+//
+// Patterns are deterministic: "noise" is generated from seed and the frame
+// index, whilst "gradient", "checker" and "bar" scroll horizontally across a
+// pre-rendered image so that each frame costs little more than a memcpy.
+// Single channel formats can be rendered as a bayer mosaic of the colour
+// pattern. If fps is non-zero, frames are delivered at that rate and capture
+// times are spaced exactly 1/fps apart.
+class PANGOLIN_EXPORT TestVideo : public VideoInterface, public VideoPropertiesInterface
 {
 public:
-    TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt);
+    TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt,
+              const std::string& pattern = "noise", double fps = 0.0,
+              uint64_t seed = 0, const std::string& bayer = "");
     ~TestVideo();
     
     //! Implement VideoInput::Start()
@@ -56,10 +66,44 @@ public:
     
     //! Implement VideoInput::GrabNewest()
     bool GrabNewest( unsigned char* image, bool wait = true ) override;
+
+    //! Implement VideoPropertiesInterface
+    const picojson::value& DeviceProperties() const override;
+
+    const picojson::value& FrameProperties() const override;
+
+    VideoFrameProperties TypedFrameProperties() const override;
     
 protected:
+    void RenderPattern();
+
+    void FillFrame(unsigned char* image);
+
     std::vector<StreamInfo> streams;
     size_t size_bytes;
+
+    std::string pattern;
+    std::string bayer;
+    uint64_t seed;
+
+    // Pre-rendered image period_px wider than the stream, scrolled by
+    // step_px per frame. Empty for noise.
+    std::vector<unsigned char> rendered;
+    size_t rendered_pitch;
+    size_t period_px;
+    size_t step_px;
+
+    size_t frame_index;
+    basetime::duration frame_period;
+    basetime start_time;
+    bool started;
+
+    picojson::value device_properties;
+    VideoFrameProperties frame_properties;
+
+    // Built from frame_properties when first asked for after a frame
+    mutable picojson::value frame_properties_json;
+    mutable bool frame_properties_dirty;
 };
 
 }
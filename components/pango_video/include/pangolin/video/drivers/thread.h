@@ -65,6 +65,8 @@ public:
 
     const picojson::value& FrameProperties() const;
 
+    VideoFrameProperties TypedFrameProperties() const;
+
     uint32_t AvailableFrames() const;
 
     bool DropNFrames(uint32_t n);
@@ -90,7 +92,7 @@ protected:
 
         bool return_status;
         std::unique_ptr<unsigned char[]> buffer;
-        picojson::value frame_properties;
+        VideoFrameProperties frame_properties;
     };
 
     std::unique_ptr<VideoInterface> src;
@@ -105,7 +107,11 @@ protected:
     std::string thread_name;
 
     mutable picojson::value device_properties;
-    picojson::value frame_properties;
+    VideoFrameProperties frame_properties;
+
+    // Built from frame_properties when first asked for after a frame
+    mutable picojson::value frame_properties_json;
+    mutable bool frame_properties_dirty;
 };
 
 }
@@ -29,6 +29,10 @@
 
 #include <pangolin/video/video_interface.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace pangolin
 {
 
@@ -39,13 +43,15 @@ enum class TransformOptions
 };
 
 // Video class that transforms its video input using the specified method.
+// Output rows are split into bands which are transformed on num_threads threads,
+// kept for the lifetime of the video.
 class PANGOLIN_EXPORT TransformVideo :
     public VideoInterface,
     public VideoFilterInterface,
     public BufferAwareVideoInterface
 {
 public:
-    TransformVideo(std::unique_ptr<VideoInterface>& videoin, const std::vector<TransformOptions>& flips);
+    TransformVideo(std::unique_ptr<VideoInterface>& videoin, const std::vector<TransformOptions>& flips, size_t num_threads = 1);
     ~TransformVideo();
 
     //! Implement VideoInput::Start()
@@ -74,14 +80,42 @@ public:
     bool DropNFrames(uint32_t n);
 
 protected:
+    // Output rows [y0,y1) of a stream
+    struct Band
+    {
+        size_t stream;
+        size_t y0;
+        size_t y1;
+    };
+
     void Process(unsigned char* image, const unsigned char* buffer);
 
+    // Transform bands of the current frame until none are left. Called with
+    // work_lock held by l.
+    void ProcessBands(std::unique_lock<std::mutex>& l);
+    void WorkerLoop();
+    void StopWorkers();
+
     std::unique_ptr<VideoInterface> videoin;
     std::vector<VideoInterface*> inputs;
     std::vector<StreamInfo> streams;
     std::vector<TransformOptions> flips;
     size_t size_bytes;
     unsigned char* buffer;
+    size_t num_threads;
+
+    // Bands of the frame being transformed, taken in turn by the workers and
+    // the thread calling Process()
+    std::vector<Band> bands;
+    unsigned char* bands_out;
+    const unsigned char* bands_in;
+    size_t next_band;
+    size_t bands_done;
+    bool quit_workers;
+    std::vector<std::thread> workers;
+    std::mutex work_lock;
+    std::condition_variable work_cond;
+    std::condition_variable done_cond;
 
     picojson::value device_properties;
     picojson::value frame_properties;
@@ -0,0 +1,111 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <pangolin/utils/picojson.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace pangolin {
+
+//! Properties of a captured frame, equivalent to a flat JSON object.
+//! The common numeric properties are held in fixed slots and anything
+//! else in a shared overflow object, so that copies cost little more than
+//! a memcpy. The JSON form is only built when asked for. Like a json object,
+//! an instance must not be changed whilst other threads read it.
+class PANGOLIN_EXPORT VideoFrameProperties
+{
+public:
+    //! Properties with a fixed slot, named as the PANGO_* keys
+    enum Field : uint8_t
+    {
+        HostReceptionTimeUs = 0,
+        CaptureTimeUs,
+        EstimatedCenterCaptureTimeUs,
+        JoinOffsetUs,
+        ExposureUs,
+        AnalogGain,
+        AnalogBlackLevel,
+        Gamma,
+        SensorTemperatureC,
+        FrameCounter,
+        FrameIndex,
+        Sequence,
+        NumFields
+    };
+
+    //! JSON key of field
+    static const char* Key(Field field);
+
+    VideoFrameProperties();
+
+    //! Adapt JSON properties. The json is kept whole and shared between
+    //! copies, so adapting costs one copy.
+    explicit VideoFrameProperties(const picojson::value& json);
+
+    //! True if field is set, or is a number in the adapted json
+    bool Has(Field field) const;
+
+    //! Value of field, converted if it was set as the other numeric type
+    int64_t GetInt(Field field, int64_t default_val = 0) const;
+
+    double GetDouble(Field field, double default_val = 0.0) const;
+
+    void Set(Field field, int64_t val);
+
+    void Set(Field field, double val);
+
+    //! Set any property, taking a fixed slot if key names a number
+    void Set(const std::string& key, const picojson::value& val);
+
+    void Clear();
+
+    //! Equivalent JSON object, built on each call. Drivers implementing
+    //! FrameProperties() build their copy there, once per frame asked for.
+    picojson::value Json() const;
+
+private:
+    union Value
+    {
+        int64_t i;
+        double d;
+    };
+
+    // Numeric value of field from the overflow, or null
+    const picojson::value* OverflowNumber(Field field) const;
+
+    Value values[NumFields];
+    uint16_t present;
+    uint16_t is_double;
+
+    // Properties without a slot, or adapted json. Slots take precedence.
+    // Shared between copies until one changes.
+    std::shared_ptr<const picojson::value> overflow;
+};
+
+}
@@ -128,6 +128,22 @@ picojson::value GetVideoFrameProperties(VideoInterface* video)
     return picojson::value();
 }
 
+// As GetVideoFrameProperties(), but avoiding JSON where the video or the
+// single video it filters provides VideoFrameProperties
+inline
+VideoFrameProperties GetTypedVideoFrameProperties(VideoInterface* video)
+{
+    VideoPropertiesInterface* pi = dynamic_cast<VideoPropertiesInterface*>(video);
+    VideoFilterInterface* fi = dynamic_cast<VideoFilterInterface*>(video);
+
+    if(pi) {
+        return pi->TypedFrameProperties();
+    }else if(fi && fi->InputStreams().size() == 1) {
+        return GetTypedVideoFrameProperties(fi->InputStreams()[0]);
+    }
+    return VideoFrameProperties(GetVideoFrameProperties(video));
+}
+
 inline
 picojson::value GetVideoDeviceProperties(VideoInterface* video)
 {
@@ -28,6 +28,7 @@
 #pragma once
 
 #include <pangolin/utils/picojson.h>
+#include <pangolin/video/frame_properties.h>
 #include <pangolin/video/stream_info.h>
 
 #include <memory>
@@ -114,6 +115,13 @@ struct PANGOLIN_EXPORT VideoPropertiesInterface
 
     //! Access JSON properties of most recently captured frame
     virtual const picojson::value& FrameProperties() const = 0;
+
+    //! Properties of most recently captured frame without going through
+    //! JSON, for drivers which store them as VideoFrameProperties
+    virtual VideoFrameProperties TypedFrameProperties() const
+    {
+        return VideoFrameProperties(FrameProperties());
+    }
 };
 
 enum UvcRequestCode {
@@ -44,6 +44,10 @@ struct PANGOLIN_EXPORT VideoOutputInterface
 
     virtual void SetStreams(const std::vector<StreamInfo>& streams, const std::string& uri ="", const picojson::value& properties = picojson::value() ) = 0;
 
+    //! Record the frame held in data, laid out as described by Streams().
+    //! Returns a non-negative, implementation defined value (such as the frame
+    //! number) on success, or -1 if the frame was intentionally not recorded,
+    //! for instance because the destination dropped it to keep up.
     virtual int WriteStreams(const unsigned char* data, const picojson::value& frame_properties = picojson::value() ) = 0;
 
     virtual bool IsPipe() const = 0;
@@ -31,6 +31,7 @@
 #  pragma GCC diagnostic ignored "-Wdeprecated-declarations"
 #endif
 
+#include <algorithm>
 #include <array>
 #include <pangolin/factory/factory_registry.h>
 #include <pangolin/video/iostream_operators.h>
@@ -74,13 +75,38 @@ int pango_sws_scale_frame(struct SwsContext *c, AVFrame *dst, const AVFrame *src
     );
 }
 
-FfmpegVideo::FfmpegVideo(const std::string filename, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size)
-    :pFormatCtx(nullptr), pCodecContext(nullptr)
+// Pointers to the planes of an image starting at row y
+template<typename TIn, typename TOut>
+void OffsetPlanes(const AVPixFmtDescriptor* desc, TIn* const in[4], const int linesize[4], int y, TOut* out[4])
 {
-    InitUrl(PathExpand(filename), strfmtout, codec_hint, dump_info, user_video_stream, size);
+    for(int p=0; p < 4; ++p) {
+        // Second and third planes hold (possibly subsampled) chroma, or the palette.
+        const bool palette = (desc->flags & AV_PIX_FMT_FLAG_PAL) && p == 1;
+        const int shift = (p == 1 || p == 2) ? desc->log2_chroma_h : 0;
+        out[p] = (in[p] && !palette) ? in[p] + (ptrdiff_t)(y >> shift) * linesize[p] : in[p];
+    }
+}
+
+FfmpegVideo::FfmpegVideo(const std::string filename, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size,
+                         int decode_threads, const std::string thread_type, size_t decode_ahead, size_t convert_threads)
+    :pFormatCtx(nullptr), pCodecContext(nullptr),
+     convert_frame(nullptr), convert_image(nullptr), convert_generation(0), convert_pending(0), quit_convert(false),
+     decode_ahead(decode_ahead), decode_eof(false), quit_decode(true)
+{
+    InitUrl(PathExpand(filename), strfmtout, codec_hint, dump_info, user_video_stream, size, decode_threads, thread_type, convert_threads);
+
+    for(size_t i=0; i < decode_ahead; ++i) {
+        AVFrame* frame = av_frame_alloc();
+        if(!frame)
+            throw VideoException("Couldn't allocate frames");
+        free_frames.push_back(frame);
+    }
+    StartConvertThreads();
+    StartDecodeThread();
 }
 
-void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size)
+void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, const std::string codec_hint, bool dump_info, int user_video_stream, ImageDim size,
+                          int decode_threads, const std::string thread_type, size_t convert_threads)
 {
     if( url.find('*') != url.npos )
         throw VideoException("Wildcards not supported. Please use ffmpegs printf style formatting for image sequences. e.g. img-000000%04d.ppm");
@@ -206,6 +232,8 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
     }
 
     next_frame = 0;
+    next_decode_frame = 0;
+    decoder_drained = false;
 
     // Find the decoder for the video stream
     pVidCodec = pCodec;
@@ -214,8 +242,7 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
 
     // Allocate video frames
     pFrame = av_frame_alloc();
-    pFrameOut = av_frame_alloc();
-    if(!pFrame || !pFrameOut)
+    if(!pFrame)
         throw VideoException("Couldn't allocate frames");
 
     fmtout = FfmpegFmtFromString(strfmtout);
@@ -229,6 +256,13 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
     if (avcodec_parameters_to_context(pCodecContext, pCodecParameters) < 0)
         throw VideoException("failed to copy codec params to codec context");
 
+    // Let the codec decode across several threads. Only the threading
+    // types the codec supports will be used.
+    pCodecContext->thread_count = decode_threads;
+    pCodecContext->thread_type = 0;
+    if(thread_type.find("frame") != std::string::npos) pCodecContext->thread_type |= FF_THREAD_FRAME;
+    if(thread_type.find("slice") != std::string::npos) pCodecContext->thread_type |= FF_THREAD_SLICE;
+
     if (avcodec_open2(pCodecContext, pCodec, NULL) < 0)
         throw VideoException("failed to open codec through avcodec_open2");
 
@@ -237,20 +271,34 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
     const int w = pCodecContext->width;
     const int h = pCodecContext->height;
 
-    pFrameOut->width = w;
-    pFrameOut->height = h;
-    pFrameOut->format = fmtout;
-    if(av_frame_get_buffer(pFrameOut, 0) != 0) {
-        throw VideoException("");
+    // Split conversion into bands of rows, each with its own context. Bands
+    // start on rows which are whole in every plane of both formats.
+    const AVPixFmtDescriptor* desc_in = av_pix_fmt_desc_get(pCodecContext->pix_fmt);
+    const AVPixFmtDescriptor* desc_out = av_pix_fmt_desc_get(fmtout);
+    if(!desc_in || !desc_out) {
+        throw VideoException("Unknown pixel format for conversion");
+    }
+    if(convert_threads == 0) {
+        convert_threads = std::max(1u, std::thread::hardware_concurrency());
     }
+    const int align = 1 << std::max(desc_in->log2_chroma_h, desc_out->log2_chroma_h);
+    const bool can_split = !(desc_in->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM));
+    const int num_bands = can_split ? (int)std::max<size_t>(1, std::min<size_t>(convert_threads, h / (16*align))) : 1;
+    const int band_h = ((h / num_bands + align - 1) / align) * align;
 
     // Allocate SWS for converting pixel formats
-    img_convert_ctx = sws_getContext(w, h,
-                                     pCodecContext->pix_fmt,
-                                     w, h, fmtout, SWS_FAST_BILINEAR,
-                                     NULL, NULL, NULL);
-    if(!img_convert_ctx) {
-        throw VideoException("Cannot initialize the conversion context");
+    for(int y = 0; y < h; y += band_h) {
+        ConvertBand band;
+        band.y = y;
+        band.h = std::min(band_h, h - y);
+        band.ctx = sws_getContext(w, band.h,
+                                  pCodecContext->pix_fmt,
+                                  w, band.h, fmtout, SWS_FAST_BILINEAR,
+                                  NULL, NULL, NULL);
+        if(!band.ctx) {
+            throw VideoException("Cannot initialize the conversion context");
+        }
+        convert_bands.push_back(band);
     }
 
     // Populate stream info for users to query
@@ -268,12 +316,18 @@ void FfmpegVideo::InitUrl(const std::string url, const std::string strfmtout, co
 
 FfmpegVideo::~FfmpegVideo()
 {
-    av_free(pFrameOut);
+    StopDecodeThread();
+    StopConvertThreads();
+    for(AVFrame* frame : decoded_frames) free_frames.push_back(frame);
+    for(AVFrame* frame : free_frames) av_frame_free(&frame);
+
     av_free(pFrame);
 
     avcodec_close(pCodecContext);
     avformat_close_input(&pFormatCtx);
-    sws_freeContext(img_convert_ctx);
+    for(ConvertBand& band : convert_bands) {
+        sws_freeContext(band.ctx);
+    }
 }
 
 const std::vector<StreamInfo>& FfmpegVideo::Streams() const
@@ -294,44 +348,230 @@ void FfmpegVideo::Stop()
 {
 }
 
-bool FfmpegVideo::GrabNext(unsigned char* image, bool /*wait*/)
+bool FfmpegVideo::DecodeFrame(AVFrame* frame)
 {
     auto vid_stream = pFormatCtx->streams[videoStream];
 
     while(true)
     {
-        const int rx_res = avcodec_receive_frame(pCodecContext, pFrame);
+        const int rx_res = avcodec_receive_frame(pCodecContext, frame);
         if(rx_res == 0) {
-            const int expected_pts = vid_stream->start_time + next_frame * ptsPerFrame;
-            if(ptsPerFrame > 0 && expected_pts > pFrame->pts) {
+            const int64_t expected_pts = vid_stream->start_time + next_decode_frame * ptsPerFrame;
+            if(ptsPerFrame > 0 && expected_pts > frame->pts) {
                 // We dont have the right frame, probably from seek to keyframe.
                 continue;
             }
-            pango_sws_scale_frame(img_convert_ctx, pFrameOut, pFrame);
-            av_image_copy_to_buffer(image, numBytesOut, pFrameOut->data, pFrameOut->linesize, fmtout, pFrameOut->width, pFrameOut->height, 1);
-            next_frame++;
+            next_decode_frame++;
             return true;
+        }else if(rx_res == AVERROR_EOF || decoder_drained) {
+            return false;
         }else{
             while(true) {
                 const int read_res = av_read_frame(pFormatCtx, packet);
                 if(read_res == 0) {
+                    int send_res = -1;
                     if(packet->stream_index==videoStream) {
-                        if(avcodec_send_packet(pCodecContext, packet) == 0) {
-                            break; // have frame for codex
-                        }
+                        send_res = avcodec_send_packet(pCodecContext, packet);
                     }
                     av_packet_unref(packet);
+                    if(send_res == 0) {
+                        break; // have frame for codex
+                    }
                 }else{
-                    // No more packets for codec
-                    return false;
+                    // No more packets. Drain frames the decoder still holds,
+                    // which with frame threading can be several.
+                    avcodec_send_packet(pCodecContext, nullptr);
+                    decoder_drained = true;
+                    break;
                 }
             }
         }
     }
 }
 
+void FfmpegVideo::ConvertBandRows(const ConvertBand& band, const AVFrame* frame, unsigned char* image)
+{
+    uint8_t* dst_data[4];
+    int dst_linesize[4];
+    av_image_fill_arrays(dst_data, dst_linesize, image, fmtout, frame->width, frame->height, 1);
+
+    const uint8_t* src[4];
+    uint8_t* dst[4];
+    OffsetPlanes(av_pix_fmt_desc_get((AVPixelFormat)frame->format), frame->data, frame->linesize, band.y, src);
+    OffsetPlanes(av_pix_fmt_desc_get(fmtout), dst_data, dst_linesize, band.y, dst);
+    sws_scale(band.ctx, src, frame->linesize, 0, band.h, dst, dst_linesize);
+}
+
+void FfmpegVideo::ConvertFrame(const AVFrame* frame, unsigned char* image)
+{
+    if(convert_workers.empty()) {
+        for(const ConvertBand& band : convert_bands) {
+            ConvertBandRows(band, frame, image);
+        }
+        return;
+    }
+
+    // Hand the frame to the band workers and convert the first band here
+    {
+        std::lock_guard<std::mutex> l(convert_lock);
+        convert_frame = frame;
+        convert_image = image;
+        convert_pending = convert_workers.size();
+        ++convert_generation;
+    }
+    convert_cond.notify_all();
+
+    ConvertBandRows(convert_bands[0], frame, image);
+
+    std::unique_lock<std::mutex> l(convert_lock);
+    convert_done_cond.wait(l, [&]{ return convert_pending == 0; });
+}
+
+void FfmpegVideo::ConvertLoop(size_t b)
+{
+    size_t generation = 0;
+
+    std::unique_lock<std::mutex> l(convert_lock);
+    while(true) {
+        convert_cond.wait(l, [&]{ return quit_convert || convert_generation != generation; });
+        if(quit_convert) break;
+        generation = convert_generation;
+        const AVFrame* frame = convert_frame;
+        unsigned char* image = convert_image;
+
+        l.unlock();
+        ConvertBandRows(convert_bands[b], frame, image);
+        l.lock();
+
+        if(--convert_pending == 0) {
+            convert_done_cond.notify_one();
+        }
+    }
+}
+
+void FfmpegVideo::StartConvertThreads()
+{
+    try {
+        for(size_t b=1; b < convert_bands.size(); ++b) {
+            convert_workers.emplace_back(&FfmpegVideo::ConvertLoop, this, b);
+        }
+    }catch(...) {
+        StopConvertThreads();
+        throw;
+    }
+}
+
+void FfmpegVideo::StopConvertThreads()
+{
+    {
+        std::lock_guard<std::mutex> l(convert_lock);
+        quit_convert = true;
+    }
+    convert_cond.notify_all();
+    for(std::thread& t : convert_workers) {
+        t.join();
+    }
+    convert_workers.clear();
+}
+
+void FfmpegVideo::DecodeLoop()
+{
+    std::unique_lock<std::mutex> l(decode_lock);
+
+    while(!quit_decode && !decode_eof) {
+        if(free_frames.empty()) {
+            decode_cond.wait(l);
+            continue;
+        }
+        AVFrame* frame = free_frames.back();
+        free_frames.pop_back();
+
+        l.unlock();
+        const bool success = DecodeFrame(frame);
+        l.lock();
+
+        if(success) {
+            decoded_frames.push_back(frame);
+        }else{
+            free_frames.push_back(frame);
+            decode_eof = true;
+        }
+        decode_cond.notify_all();
+    }
+}
+
+void FfmpegVideo::StartDecodeThread()
+{
+    if(decode_ahead && quit_decode) {
+        quit_decode = false;
+        decode_eof = false;
+        decode_thread = std::thread(&FfmpegVideo::DecodeLoop, this);
+    }
+}
+
+void FfmpegVideo::StopDecodeThread()
+{
+    {
+        std::lock_guard<std::mutex> l(decode_lock);
+        quit_decode = true;
+    }
+    decode_cond.notify_all();
+    if(decode_thread.joinable()) {
+        decode_thread.join();
+    }
+}
+
+bool FfmpegVideo::GrabNext(unsigned char* image, bool wait)
+{
+    if(!decode_ahead) {
+        if(!DecodeFrame(pFrame)) {
+            return false;
+        }
+        ConvertFrame(pFrame, image);
+        next_frame++;
+        return true;
+    }
+
+    AVFrame* frame = nullptr;
+    {
+        std::unique_lock<std::mutex> l(decode_lock);
+        while(decoded_frames.empty()) {
+            if(decode_eof || quit_decode || !wait) {
+                return false;
+            }
+            decode_cond.wait(l);
+        }
+        frame = decoded_frames.front();
+        decoded_frames.pop_front();
+    }
+
+    // Convert outside of the lock whilst the next frames decode
+    ConvertFrame(frame, image);
+    av_frame_unref(frame);
+    next_frame++;
+
+    {
+        std::lock_guard<std::mutex> l(decode_lock);
+        free_frames.push_back(frame);
+    }
+    decode_cond.notify_all();
+    return true;
+}
+
 bool FfmpegVideo::GrabNewest(unsigned char *image, bool wait)
 {
+    if(decode_ahead) {
+        // Skip to the last frame already decoded
+        std::lock_guard<std::mutex> l(decode_lock);
+        while(decoded_frames.size() > 1) {
+            AVFrame* frame = decoded_frames.front();
+            decoded_frames.pop_front();
+            av_frame_unref(frame);
+            free_frames.push_back(frame);
+            next_frame++;
+        }
+    }
+    decode_cond.notify_all();
     return GrabNext(image,wait);
 }
 
@@ -348,16 +588,32 @@ size_t FfmpegVideo::GetTotalFrames() const
 size_t FfmpegVideo::Seek(size_t frameid)
 {
     if(ptsPerFrame && frameid != next_frame) {
+        // The decode thread reads from the format context, so it must be
+        // stopped whilst we seek.
+        StopDecodeThread();
+
         const int64_t pts = ptsPerFrame*frameid;
         const int res = avformat_seek_file(pFormatCtx, videoStream, 0, pts, pts, 0);
-        avcodec_flush_buffers(pCodecContext);
 
         if(res >= 0) {
+            // Discard frames decoded ahead from the old position
+            for(AVFrame* frame : decoded_frames) {
+                av_frame_unref(frame);
+                free_frames.push_back(frame);
+            }
+            decoded_frames.clear();
+            avcodec_flush_buffers(pCodecContext);
+            decoder_drained = false;
+
             // success - next frame to read will be frameid, so 'current frame' is one before that.
             next_frame = frameid;
+            next_decode_frame = frameid;
         }else{
+            // Carry on from where we were, keeping any frames decoded ahead
             pango_print_info("error whilst seeking. %u, %s\n", (unsigned)frameid, ffmpeg_error_string(res).data());
         }
+
+        StartDecodeThread();
     }
 
     return next_frame;
@@ -383,6 +639,10 @@ PANGOLIN_REGISTER_FACTORY(FfmpegVideo)
                 {"codec_hint","","Apply a hint to FFMPEG on codec. Examples include {MJPEG,video4linux,...}"},
                 {"size","","Request a particular size output from FFMPEG"},
                 {"verbose","0","Output FFMPEG instantiation information."},
+                {"threads","1","Number of threads the codec decodes with, 0 to let FFMPEG choose."},
+                {"thread_type","frame,slice","Codec threading to allow: frame, slice or frame,slice."},
+                {"decode_ahead","0","Number of frames to decode ahead of GrabNext on a separate thread, 0 to decode within GrabNext."},
+                {"convert_threads","1","Number of threads converting to the output format, each converting a band of rows. 0 for one per core."},
             }};
         }
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
@@ -409,7 +669,12 @@ PANGOLIN_REGISTER_FACTORY(FfmpegVideo)
             ToUpper(codec_hint);
             const int video_stream = uri.Get<int>("stream",0);
             const ImageDim size = uri.Get<ImageDim>("size",ImageDim(0,0));
-            return std::unique_ptr<VideoInterface>( new FfmpegVideo(uri.url.c_str(), outfmt, codec_hint, verbose, video_stream) );
+            const int decode_threads = uri.Get<int>("threads",1);
+            const std::string thread_type = uri.Get<std::string>("thread_type","frame,slice");
+            const size_t decode_ahead = uri.Get<size_t>("decode_ahead",0);
+            const size_t convert_threads = uri.Get<size_t>("convert_threads",1);
+            return std::unique_ptr<VideoInterface>( new FfmpegVideo(uri.url.c_str(), outfmt, codec_hint, verbose, video_stream, size,
+                decode_threads, thread_type, decode_ahead, convert_threads) );
         }
     };
 
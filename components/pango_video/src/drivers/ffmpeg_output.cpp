@@ -6,13 +6,16 @@
 
 #include <pangolin/video/drivers/ffmpeg_output.h>
 #include <pangolin/factory/factory_registry.h>
+#include <pangolin/utils/timer.h>
+
+#include <algorithm>
 
 namespace pangolin {
 
 // Defined in ffmpeg.cpp
 int pango_sws_scale_frame(struct SwsContext *c, AVFrame *dst, const AVFrame *src);
 
-AVCodecContext* CreateVideoCodecContext(AVCodecID codec_id, uint64_t frame_rate, int bit_rate, AVPixelFormat EncoderFormat, int width, int height)
+AVCodecContext* CreateVideoCodecContext(AVCodecID codec_id, uint64_t frame_rate, int bit_rate, AVPixelFormat EncoderFormat, int width, int height, int encoder_threads = 1, const std::string& preset = "")
 {
     const AVCodec* codec = avcodec_find_encoder(codec_id);
     if (!(codec))
@@ -35,8 +38,21 @@ AVCodecContext* CreateVideoCodecContext(AVCodecID codec_id, uint64_t frame_rate,
     codec_context->max_b_frames  = 1;
     codec_context->pix_fmt       = EncoderFormat;
 
+    // 0 lets the codec choose based on the number of cores
+    codec_context->thread_count  = encoder_threads;
+    codec_context->thread_type   = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+    AVDictionary* opts = nullptr;
+    if(!preset.empty()) {
+        av_dict_set(&opts, "preset", preset.c_str(), 0);
+    }
+
     /* open the codec */
-    int ret = avcodec_open2(codec_context, nullptr, nullptr);
+    int ret = avcodec_open2(codec_context, nullptr, &opts);
+    if(av_dict_get(opts, "preset", nullptr, 0)) {
+        pango_print_warn("ffmpeg: encoder '%s' does not support presets, ignoring preset=%s.\n", codec->name, preset.c_str());
+    }
+    av_dict_free(&opts);
     if (ret < 0)  throw VideoException("Could not open video codec");
 
     return codec_context;
@@ -93,6 +109,7 @@ void FfmpegVideoOutputStream::WriteFrame(AVFrame* frame)
 
        if (pkt->size) {
            int64_t pts = pkt->pts;
+           std::lock_guard<std::mutex> l(recorder.write_lock);
            int ret = av_interleaved_write_frame(recorder.oc, pkt);
            if (ret < 0) throw VideoException("Error writing video frame");
            if(pkt->pts != (int64_t)AV_NOPTS_VALUE) last_pts = pts;
@@ -102,15 +119,8 @@ void FfmpegVideoOutputStream::WriteFrame(AVFrame* frame)
      return;
 }
 
-void FfmpegVideoOutputStream::WriteImage(const uint8_t* img, int w, int h)
+void FfmpegVideoOutputStream::EncodeImage(AVFrame* src_frame, int w, int h)
 {
-    static int64_t pts = 0;
-
-    av_frame_make_writable(src_frame);
-    memcpy(src_frame->buf[0]->data, img, src_frame->buf[0]->size);
-
-    recorder.StartStream();
-
     AVFrame* frame_to_write = nullptr;
 
     if (codec_context->pix_fmt != input_format || codec_context->width != w || codec_context->height != h) {
@@ -130,9 +140,111 @@ void FfmpegVideoOutputStream::WriteImage(const uint8_t* img, int w, int h)
     }
 
     if(frame_to_write) {
-        frame_to_write->pts = pts;
+        frame_to_write->pts = next_pts;
         WriteFrame(frame_to_write);
-        ++pts;
+        ++next_pts;
+    }
+}
+
+void FfmpegVideoOutputStream::EncodeLoop()
+{
+    std::unique_lock<std::mutex> l(lock);
+    while(true) {
+        cond.wait(l, [this](){ return quit || !queue.empty(); });
+        if(queue.empty()) break;
+
+        QueuedFrame qf = queue.front();
+        l.unlock();
+        try {
+            EncodeImage(qf.frame, qf.w, qf.h);
+        }catch(...) {
+            l.lock();
+            if(!encode_error) encode_error = std::current_exception();
+            l.unlock();
+        }
+        l.lock();
+
+        // Only release the frame now so that the queue bounds frames in flight
+        queue.pop_front();
+        free_frames.push_back(qf.frame);
+        cond.notify_all();
+    }
+}
+
+bool FfmpegVideoOutputStream::CanQueue()
+{
+    std::lock_guard<std::mutex> l(lock);
+    return !free_frames.empty();
+}
+
+size_t FfmpegVideoOutputStream::QueueDepth()
+{
+    std::lock_guard<std::mutex> l(lock);
+    return queue.size();
+}
+
+void FfmpegVideoOutputStream::WriteImage(const uint8_t* img, int w, int h)
+{
+    const bool queued = encode_thread.joinable();
+
+    AVFrame* src_frame = src_frames[0];
+    if(queued) {
+        std::unique_lock<std::mutex> l(lock);
+        cond.wait(l, [this](){ return !free_frames.empty() || encode_error; });
+        if(encode_error) {
+            std::exception_ptr e = encode_error;
+            encode_error = nullptr;
+            std::rethrow_exception(e);
+        }
+        src_frame = free_frames.back();
+        free_frames.pop_back();
+    }
+
+    // The encoder may still reference a frame it has been sent, in which case
+    // this gives src_frame a new buffer.
+    av_frame_make_writable(src_frame);
+
+    uint8_t* img_data[4];
+    int img_linesize[4];
+    av_image_fill_arrays(img_data, img_linesize, img, input_format, w, h, 1);
+    if(flip) {
+        // Point to the last row of each plane and walk backwards
+        for(int i=0; i<4; ++i) {
+            if(img_data[i]) {
+                const int plane_h = (i == 0 || i == 3) ? h : AV_CEIL_RSHIFT(h, av_pix_fmt_desc_get(input_format)->log2_chroma_h);
+                img_data[i] += (plane_h-1) * img_linesize[i];
+                img_linesize[i] *= -1;
+            }
+        }
+    }
+    av_image_copy(src_frame->data, src_frame->linesize, (const uint8_t**)img_data, img_linesize, input_format, w, h);
+
+    if(!queued) {
+        EncodeImage(src_frame, w, h);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> l(lock);
+        queue.push_back({src_frame, w, h});
+    }
+    cond.notify_all();
+}
+
+void FfmpegVideoOutputStream::Finish()
+{
+    if(encode_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            quit = true;
+        }
+        cond.notify_all();
+        encode_thread.join();
+    }
+
+    if(encode_error) {
+        pango_print_error("ffmpeg: error whilst encoding stream.\n");
+        encode_error = nullptr;
     }
 }
 
@@ -146,6 +258,19 @@ const StreamInfo& FfmpegVideoOutputStream::GetStreamInfo() const
     return input_info;
 }
 
+AVFrame* FfmpegVideoOutputStream::AllocSourceFrame()
+{
+    AVFrame* f = av_frame_alloc();
+    f->format = input_format;
+    f->width = input_info.Width();
+    f->height = input_info.Height();
+    if(av_frame_get_buffer(f,0)) {
+        av_frame_free(&f);
+        throw VideoException("Could not allocate picture");
+    }
+    return f;
+}
+
 double FfmpegVideoOutputStream::BaseFrameTime()
 {
     return (double)codec_context->time_base.num / (double)codec_context->time_base.den;
@@ -153,14 +278,16 @@ double FfmpegVideoOutputStream::BaseFrameTime()
 
 FfmpegVideoOutputStream::FfmpegVideoOutputStream(
     FfmpegVideoOutput& recorder, CodecID codec_id, uint64_t frame_rate,
-    int bit_rate, const StreamInfo& input_info, bool flip_image
+    int bit_rate, const StreamInfo& input_info, bool flip_image,
+    int encoder_threads, const std::string& preset, size_t queue_size
 )
     : recorder(recorder), input_info(input_info),
       input_format(FfmpegFmtFromString(input_info.PixFormat())),
       output_format( FfmpegFmtFromString("YUV420P") ),
-      last_pts(-1), sws_ctx(NULL), frame(NULL), flip(flip_image)
+      last_pts(-1), sws_ctx(NULL), frame(NULL), flip(flip_image),
+      next_pts(0), quit(false)
 {
-    codec_context = CreateVideoCodecContext(codec_id, frame_rate, bit_rate, output_format, input_info.Width(), input_info.Height());
+    codec_context = CreateVideoCodecContext(codec_id, frame_rate, bit_rate, output_format, input_info.Width(), input_info.Height(), encoder_threads, preset);
     stream = CreateStream(recorder.oc, codec_context);
 
     // Allocate frame
@@ -172,42 +299,37 @@ FfmpegVideoOutputStream::FfmpegVideoOutputStream(
         throw VideoException("Could not allocate picture");
     }
 
-    src_frame = av_frame_alloc();
-    src_frame->format = input_format;
-    src_frame->width = input_info.Width();
-    src_frame->height = input_info.Height();
-    if(av_frame_get_buffer(src_frame,0)) {
-        throw VideoException("Could not allocate picture");
+    for(size_t i=0; i < std::max<size_t>(queue_size,1); ++i) {
+        src_frames.push_back(AllocSourceFrame());
     }
+    free_frames = src_frames;
 
-    if(flip) {
-        // setup data pointer to end of memory, and negate line sizes.
-        for(int i=0; i<4; ++i) {
-            if(src_frame->data[i]) {
-                src_frame->data[i] += (src_frame->height-1) * src_frame->linesize[i];
-            }
-            if(src_frame->linesize[i]) {
-                src_frame->linesize[i] *= -1;
-            }
-        }
+    if(queue_size > 0) {
+        encode_thread = std::thread(&FfmpegVideoOutputStream::EncodeLoop, this);
     }
 }
 
 FfmpegVideoOutputStream::~FfmpegVideoOutputStream()
 {
+    Finish();
     Flush();
 
     if(sws_ctx) {
         sws_freeContext(sws_ctx);
     }
 
+    for(AVFrame* f : src_frames) {
+        av_frame_free(&f);
+    }
     av_free(frame);
     avcodec_close(codec_context);
 }
 
-FfmpegVideoOutput::FfmpegVideoOutput(const std::string& filename, int base_frame_rate, int bit_rate, bool flip_image)
+FfmpegVideoOutput::FfmpegVideoOutput(const std::string& filename, int base_frame_rate, int bit_rate, bool flip_image,
+                                     int encoder_threads, const std::string& preset, size_t queue_size, bool drop_frames)
     : filename(filename), started(false), oc(NULL),
-      frame_count(0), base_frame_rate(base_frame_rate), bit_rate(bit_rate), is_pipe(pangolin::IsPipe(filename)), flip(flip_image)
+      frame_count(0), base_frame_rate(base_frame_rate), bit_rate(bit_rate), is_pipe(pangolin::IsPipe(filename)), flip(flip_image),
+      encoder_threads(encoder_threads), preset(preset), queue_size(queue_size), drop_frames(drop_frames)
 {
     Initialise(filename);
 }
@@ -254,11 +376,22 @@ void FfmpegVideoOutput::StartStream()
 
 void FfmpegVideoOutput::Close()
 {
+    // Streams continue encoding in parallel whilst we wait on each in turn
+    for(FfmpegVideoOutputStream* s : streams) {
+        s->Finish();
+    }
+
+    // Deleting the stream flushes its encoder
     for(std::vector<FfmpegVideoOutputStream*>::iterator i = streams.begin(); i!=streams.end(); ++i)
     {
-        (*i)->Flush();
         delete *i;
     }
+    streams.clear();
+
+    const Stats s = GetStats();
+    if(s.frames_dropped) {
+        pango_print_warn("ffmpeg: dropped %zu of %zu frames whilst encoding '%s'.\n", s.frames_dropped, s.frames_queued + s.frames_dropped, filename.c_str());
+    }
 
     av_write_trailer(oc);
 
@@ -279,7 +412,8 @@ void FfmpegVideoOutput::SetStreams(const std::vector<StreamInfo>& str, const std
     for(std::vector<StreamInfo>::const_iterator i = str.begin(); i!= str.end(); ++i)
     {
         streams.push_back( new FfmpegVideoOutputStream(
-            *this, oc->oformat->video_codec, base_frame_rate, bit_rate, *i, flip
+            *this, oc->oformat->video_codec, base_frame_rate, bit_rate, *i, flip,
+            encoder_threads, preset, queue_size
         ) );
     }
 
@@ -290,15 +424,50 @@ void FfmpegVideoOutput::SetStreams(const std::vector<StreamInfo>& str, const std
 
 int FfmpegVideoOutput::WriteStreams(const unsigned char* data, const picojson::value& /*frame_properties*/)
 {
+    bool full = false;
+    size_t depth = 0;
+    for(FfmpegVideoOutputStream* s : streams) {
+        full |= !s->CanQueue();
+        depth = std::max(depth, s->QueueDepth());
+    }
+
+    if(full && drop_frames) {
+        // Drop the frame from every stream so that they remain in step
+        std::lock_guard<std::mutex> l(stats_lock);
+        ++stats.frames_dropped;
+        return -1;
+    }
+
+    // The header must be written before any stream's encoder produces packets
+    StartStream();
+
+    const basetime start = TimeNow();
     for(std::vector<FfmpegVideoOutputStream*>::iterator i = streams.begin(); i!= streams.end(); ++i)
     {
         FfmpegVideoOutputStream& s = **i;
         Image<unsigned char> img = s.GetStreamInfo().StreamImage(data);
         s.WriteImage(img.ptr, img.w, img.h);
     }
+
+    {
+        std::lock_guard<std::mutex> l(stats_lock);
+        ++stats.frames_queued;
+        stats.max_queue_depth = std::max(stats.max_queue_depth, depth + ((full || !queue_size) ? 0 : 1));
+        if(full) {
+            ++stats.frames_blocked;
+            stats.blocked_us += TimeDiff_us(start, TimeNow());
+        }
+    }
+
     return frame_count++;
 }
 
+FfmpegVideoOutput::Stats FfmpegVideoOutput::GetStats() const
+{
+    std::lock_guard<std::mutex> l(stats_lock);
+    return stats;
+}
+
 PANGOLIN_REGISTER_FACTORY(FfmpegVideoOutput)
 {
     struct FfmpegVideoFactory final : public TypedFactoryInterface<VideoOutputInterface> {
@@ -317,12 +486,20 @@ PANGOLIN_REGISTER_FACTORY(FfmpegVideoOutput)
                 {"bps","20000*1024","desired bitrate (hint)"},
                 {"flip","0","Flip the output vertically before recording"},
                 {"unique_filename","","Automatically append a unique number instead of overwriting files"},
+                {"threads","1","Encoder threads per stream (0 lets the codec decide)"},
+                {"preset","","Encoder preset, e.g. ultrafast, fast, medium for libx264 / libx265"},
+                {"queue","0","Frames buffered per stream whilst waiting to be encoded on a separate thread, 0 to encode within WriteStreams"},
+                {"drop","0","Drop frames when the encoder falls behind instead of blocking"},
             }};
         }
         std::unique_ptr<VideoOutputInterface> Open(const Uri& uri) override {
             const int desired_frame_rate = uri.Get("fps", 60);
             const int desired_bit_rate = uri.Get("bps", 20000*1024);
             const bool flip = uri.Get("flip", false);
+            const int encoder_threads = uri.Get("threads", 1);
+            const std::string preset = uri.Get<std::string>("preset", "");
+            const size_t queue_size = uri.Get<size_t>("queue", 0);
+            const bool drop_frames = uri.Get("drop", false);
             std::string filename = uri.url;
 
             if(uri.Contains("unique_filename")) {
@@ -330,7 +507,7 @@ PANGOLIN_REGISTER_FACTORY(FfmpegVideoOutput)
             }
 
             return std::unique_ptr<VideoOutputInterface>(
-                new FfmpegVideoOutput(filename, desired_frame_rate, desired_bit_rate, flip)
+                new FfmpegVideoOutput(filename, desired_frame_rate, desired_bit_rate, flip, encoder_threads, preset, queue_size, drop_frames)
             );
         }
     };
@@ -28,51 +28,269 @@
 #include <pangolin/video/drivers/gamma.h>
 #include <pangolin/factory/factory_registry.h>
 #include <pangolin/video/iostream_operators.h>
-#include <pangolin/utils/avx_math.h>
+#include <pangolin/video/video.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <thread>
 
 namespace pangolin
 {
 
+namespace
+{
+
+bool IsPacked(const PixelFormat& fmt)
+{
+    return fmt.format == "GRAY10" || fmt.format == "GRAY12";
+}
+
+// Bits of the integer type holding each channel, or 0 if the format can't be
+// mapped through a table.
+unsigned int LutContainerBits(const PixelFormat& fmt)
+{
+    if(IsPacked(fmt)) {
+        return fmt.channel_bits[0];
+    }
+    if(fmt.planar || fmt.channels == 0 || fmt.format.back() == 'F') {
+        return 0;
+    }
+    for(unsigned int c=1; c < fmt.channels; ++c) {
+        if(fmt.channel_bits[c] != fmt.channel_bits[0]) return 0;
+    }
+    const unsigned int bits = fmt.channel_bits[0];
+    return (bits == 8 || bits == 16) ? bits : 0;
+}
+
+template<typename T>
+void ApplyLut(Image<uint8_t>& out, const Image<uint8_t>& in, const T* lut, size_t values_per_row, size_t y0, size_t y1)
+{
+    for(size_t r = y0; r < y1; ++r)
+    {
+        const T* pin = (const T*)in.RowPtr(r);
+        T* pout = (T*)out.RowPtr(r);
+        size_t i = 0;
+
+        // Independent loads let the lookups overlap
+        for(; i + 4 <= values_per_row; i += 4) {
+            const T a = lut[pin[i+0]];
+            const T b = lut[pin[i+1]];
+            const T c = lut[pin[i+2]];
+            const T d = lut[pin[i+3]];
+            pout[i+0] = a;
+            pout[i+1] = b;
+            pout[i+2] = c;
+            pout[i+3] = d;
+        }
+        for(; i < values_per_row; ++i) {
+            pout[i] = lut[pin[i]];
+        }
+    }
+}
+
+// Four 10 bit values packed into 5 bytes, as read by UnpackVideo
+void ApplyLutPacked10(Image<uint8_t>& out, const Image<uint8_t>& in, const uint16_t* lut, size_t width, size_t y0, size_t y1)
+{
+    for(size_t r = y0; r < y1; ++r)
+    {
+        const uint8_t* pin = in.RowPtr(r);
+        uint8_t* pout = out.RowPtr(r);
+        const uint8_t* pin_end = pin + (width * 10 + 7) / 8;
+        while(pin < pin_end) {
+            // The last group of a row may be partial
+            const size_t n = std::min<size_t>(5, pin_end - pin);
+            uint64_t val = 0;
+            std::memcpy(&val, pin, n);
+            uint64_t res = lut[val & 0x3FF];
+            res |= uint64_t(lut[(val >> 10) & 0x3FF]) << 10;
+            res |= uint64_t(lut[(val >> 20) & 0x3FF]) << 20;
+            res |= uint64_t(lut[(val >> 30) & 0x3FF]) << 30;
+            std::memcpy(pout, &res, n);
+            pin += n;
+            pout += n;
+        }
+    }
+}
+
+// Two 12 bit values packed into 3 bytes, as read by UnpackVideo
+void ApplyLutPacked12(Image<uint8_t>& out, const Image<uint8_t>& in, const uint16_t* lut, size_t width, size_t y0, size_t y1)
+{
+    for(size_t r = y0; r < y1; ++r)
+    {
+        const uint8_t* pin = in.RowPtr(r);
+        uint8_t* pout = out.RowPtr(r);
+        const uint8_t* pin_end = pin + (width * 12 + 7) / 8;
+        while(pin < pin_end) {
+            // The last group of a row may be partial
+            const size_t n = std::min<size_t>(3, pin_end - pin);
+            uint32_t val = 0;
+            std::memcpy(&val, pin, n);
+            const uint32_t res = uint32_t(lut[val & 0xFFF]) | (uint32_t(lut[(val >> 12) & 0xFFF]) << 12);
+            std::memcpy(pout, &res, n);
+            pin += n;
+            pout += n;
+        }
+    }
+}
+
+}
+
+GammaVideo::GammaVideo(std::unique_ptr<VideoInterface>& src_, const std::map<size_t, float> &stream_gammas, size_t num_threads)
+    : src(std::move(src_)), size_bytes(0), num_threads(num_threads),
+      bands_out(nullptr), bands_in(nullptr), next_band(0), bands_done(0), quit_workers(false)
+{
+    std::map<size_t, ToneCurve> curves;
+    for(const auto& sg : stream_gammas) {
+        const float gamma = sg.second;
+        if(gamma != 0.0f && gamma != 1.0f) {
+            curves[sg.first] = [gamma](float x){ return std::pow(x, gamma); };
+        }
+    }
+    Init(curves);
+}
+
+GammaVideo::GammaVideo(std::unique_ptr<VideoInterface>& src_, const std::map<size_t, ToneCurve> &stream_curves, size_t num_threads)
+    : src(std::move(src_)), size_bytes(0), num_threads(num_threads),
+      bands_out(nullptr), bands_in(nullptr), next_band(0), bands_done(0), quit_workers(false)
+{
+    Init(stream_curves);
+}
 
-GammaVideo::GammaVideo(std::unique_ptr<VideoInterface>& src_, const std::map<size_t, float> &stream_gammas)
-    : src(std::move(src_)), size_bytes(0), stream_gammas(stream_gammas)
+void GammaVideo::Init(const std::map<size_t, ToneCurve>& stream_curves)
 {
     if(!src.get()) {
         throw VideoException("GammaVideo: VideoInterface in must not be null");
     }
 
-    videoin.push_back(src.get());
+    if(num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
 
-    formats_supported.insert("GRAY8");
-    formats_supported.insert("GRAY16LE");
-    formats_supported.insert("RGB24");
-    formats_supported.insert("BGR24");
-    formats_supported.insert("RGB48");
-    formats_supported.insert("BGR48");
-    formats_supported.insert("RGBA32");
-    formats_supported.insert("BGRA32");
-    formats_supported.insert("RGBA64");
-    formats_supported.insert("BGRA64");
+    videoin.push_back(src.get());
 
+    luts.resize(src->Streams().size());
     for(size_t s = 0; s < src->Streams().size(); s++)
     {
-        auto i = stream_gammas.find(s);
+        streams.push_back(src->Streams()[s]);
+        size_bytes += streams.back().SizeBytes();
 
-        if(i != stream_gammas.end() && i->second != 0.0f && i->second != 1.0f &&
-           formats_supported.count(src->Streams()[s].PixFormat().format) == 0)
+        auto i = stream_curves.find(s);
+        if(i != stream_curves.end() && i->second)
         {
-            throw VideoException("GammaVideo: Stream format not supported");
+            const PixelFormat& fmt = streams.back().PixFormat();
+            if(!LutContainerBits(fmt)) {
+                throw VideoException("GammaVideo: Stream format not supported", fmt.format);
+            }
+            luts[s].curve = i->second;
+            luts[s].bits = std::min(fmt.channel_bit_depth, LutContainerBits(fmt));
+            BuildLut(s);
         }
-
-        streams.push_back(src->Streams()[s]);
-        size_bytes += streams.back().SizeBytes();
     }
 
     buffer.reset(new uint8_t[src->SizeBytes()]);
+
+    try {
+        for(size_t i=1; i < num_threads; ++i) {
+            workers.emplace_back(&GammaVideo::WorkerLoop, this);
+        }
+    }catch(...) {
+        StopWorkers();
+        throw;
+    }
 }
 
 GammaVideo::~GammaVideo()
 {
+    StopWorkers();
+}
+
+void GammaVideo::WorkerLoop()
+{
+    std::unique_lock<std::mutex> l(work_lock);
+    while(!quit_workers) {
+        if(next_band < bands.size()) {
+            ProcessBands(l);
+        }else{
+            work_cond.wait(l);
+        }
+    }
+}
+
+void GammaVideo::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> l(work_lock);
+        quit_workers = true;
+    }
+    work_cond.notify_all();
+    for(std::thread& t : workers) {
+        t.join();
+    }
+    workers.clear();
+}
+
+void GammaVideo::BuildLut(size_t stream)
+{
+    StreamLut& l = luts[stream];
+    const unsigned int container_bits = LutContainerBits(streams[stream].PixFormat());
+    const size_t entries = size_t(1) << container_bits;
+    const float in_max = float((1u << l.bits) - 1);
+    const float out_max = float((1u << container_bits) - 1);
+
+    std::vector<uint16_t> lut(entries);
+    for(size_t v = 0; v < entries; ++v) {
+        const float x = std::min(float(v) / in_max, 1.0f);
+        const float y = std::max(0.0f, std::min(l.curve(x), 1.0f));
+        // Output keeps the range of the input data
+        lut[v] = uint16_t(std::min(y * in_max + 0.5f, out_max));
+    }
+
+    if(container_bits == 8) {
+        l.lut8.assign(lut.begin(), lut.end());
+        l.lut16.clear();
+    }else{
+        l.lut16 = std::move(lut);
+        l.lut8.clear();
+    }
+}
+
+void GammaVideo::SetSignificantBits(size_t stream, unsigned int bits)
+{
+    if(stream >= luts.size()) {
+        throw VideoException("GammaVideo: Stream index out of range");
+    }
+    const unsigned int container_bits = LutContainerBits(streams[stream].PixFormat());
+    if(bits == 0 || (container_bits && bits > container_bits)) {
+        throw VideoException("GammaVideo: Invalid number of significant bits");
+    }
+    luts[stream].bits = bits;
+    if(luts[stream].curve) {
+        BuildLut(stream);
+    }
+}
+
+GammaVideo::ToneCurve GammaVideo::PiecewiseLinearCurve(const std::vector<std::pair<float,float>>& points)
+{
+    if(points.empty()) {
+        throw VideoException("GammaVideo: Tone curve must have at least one point");
+    }
+    for(size_t i=1; i < points.size(); ++i) {
+        if(points[i].first <= points[i-1].first) {
+            throw VideoException("GammaVideo: Tone curve points must be increasing in x");
+        }
+    }
+
+    return [points](float x) {
+        if(x <= points.front().first) return points.front().second;
+        if(x >= points.back().first) return points.back().second;
+        auto hi = std::upper_bound(points.begin(), points.end(), x,
+            [](float v, const std::pair<float,float>& p){ return v < p.first; });
+        auto lo = hi - 1;
+        const float t = (x - lo->first) / (hi->first - lo->first);
+        return lo->second + t * (hi->second - lo->second);
+    };
 }
 
 //! Implement VideoInput::Start()
@@ -99,177 +317,77 @@ const std::vector<StreamInfo>& GammaVideo::Streams() const
     return streams;
 }
 
-template <typename T>
-void ApplyGamma(Image<uint8_t>& out,
-                       const Image<uint8_t>& in,
-                       const float gamma,
-                       const float channel_max_value);
-
-#ifdef __AVX2__
-template <>
-void ApplyGamma<uint8_t>(Image<uint8_t>& out,
-                         const Image<uint8_t>& in,
-                         const float gamma,
-                         const float channel_max_value)
+void GammaVideo::ProcessRows(size_t s, Image<uint8_t>& img_out, const Image<uint8_t>& img_in, size_t y0, size_t y1)
 {
-    //Special shuffling constants for bytes across lanes
-    const __m256i K0 = _mm256_setr_epi8(
-        0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u,
-        0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u);
-
-    const __m256i K1 = _mm256_setr_epi8(
-        0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u, 0xF0u,
-        0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u, 0x70u);
-
-    const __m256i shuffle = _mm256_setr_epi8(0, 4, 8, 12, 16, 20, 24, 28, 2, 9, 10, 11, 3, 13, 14, 15, 4,
-        17, 18, 19, 5, 21, 22, 23, 6, 25, 26, 27, 7, 29, 30, 31);
-
-    for(size_t r = 0; r < out.h; ++r)
-    {
-        uint8_t* pout = out.ptr + r * out.pitch;
-        uint8_t* pin = in.ptr + r * in.pitch;
-        const uint8_t* pin_end = in.ptr + (r + 1) * in.pitch;
-        const uint32_t numElems = in.pitch / sizeof(uint8_t);
-
-        constexpr int vecElems = 8;
-
-        const int numVecs = (numElems / vecElems) * vecElems;
-
-        //Processing eight at a time (max number of floats per vector)
-        for(int vec = 0; vec < numVecs; vec += vecElems, pin += vecElems, pout += vecElems)
-        {
-            //Convert bytes to floats
-            const __m256 floatVals = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_cvtsi64_si128(*(uint64_t*)pin)));
-
-            //Apply gamma and prepare for truncation (rounding) to integer
-            const __m256 gammaValues = _mm256_add_ps(_mm256_mul_ps(pow256_ps(_mm256_div_ps(floatVals, _mm256_set1_ps(channel_max_value)), _mm256_set1_ps(gamma)), _mm256_set1_ps(channel_max_value)), _mm256_set1_ps(0.5f));
-
-            //Clamp and convert to integer
-            __m256i gammaValuesI = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvtps_epi32(gammaValues), _mm256_set1_epi32(0)), _mm256_set1_epi32(255));
-
-            //Unshuffle bytes to end of vector
-            gammaValuesI = _mm256_or_si256(_mm256_shuffle_epi8(gammaValuesI, _mm256_add_epi8(shuffle, K0)),
-                                           _mm256_shuffle_epi8(_mm256_permute4x64_epi64(gammaValuesI, 0x4E), _mm256_add_epi8(shuffle, K1)));
-
-            //Copy result out
-            *(uint64_t*)pout = _mm_cvtsi128_si64(_mm256_castsi256_si128(gammaValuesI));
-        }
-
-        //Remainder loose ends
-        while(pin != pin_end) {
-            *(pout++) = uint8_t(std::pow(float(*(pin++)) / channel_max_value, gamma) * channel_max_value + 0.5f);
+    const StreamLut& l = luts[s];
+    const PixelFormat& fmt = Streams()[s].PixFormat();
+
+    if(!l.curve) {
+        //straight copy
+        const size_t row_bytes = (fmt.bpp * img_in.w + 7) / 8;
+        for(size_t y=y0; y < y1; ++y) {
+            std::memcpy(img_out.RowPtr(y), img_in.RowPtr(y), row_bytes);
         }
+    }else if(fmt.format == "GRAY10") {
+        ApplyLutPacked10(img_out, img_in, l.lut16.data(), img_in.w, y0, y1);
+    }else if(fmt.format == "GRAY12") {
+        ApplyLutPacked12(img_out, img_in, l.lut16.data(), img_in.w, y0, y1);
+    }else if(!l.lut8.empty()) {
+        ApplyLut<uint8_t>(img_out, img_in, l.lut8.data(), img_in.w * fmt.channels, y0, y1);
+    }else{
+        ApplyLut<uint16_t>(img_out, img_in, l.lut16.data(), img_in.w * fmt.channels, y0, y1);
     }
 }
 
-template <>
-void ApplyGamma<uint16_t>(Image<uint8_t>& out,
-                          const Image<uint8_t>& in,
-                          const float gamma,
-                          const float channel_max_value)
+void GammaVideo::ProcessBands(std::unique_lock<std::mutex>& l)
 {
-    for(size_t r = 0; r < out.h; ++r)
-    {
-        uint16_t* pout = (uint16_t*)(out.ptr + r * out.pitch);
-        uint16_t* pin = (uint16_t*)(in.ptr + r * in.pitch);
-        const uint16_t* pin_end = (uint16_t*)(in.ptr + (r + 1) * in.pitch);
-        const uint32_t numElems = in.pitch / sizeof(uint16_t);
-
-        constexpr int vecElems = 8;
+    while(next_band < bands.size()) {
+        const Band band = bands[next_band++];
+        l.unlock();
 
-        const int numVecs = (numElems / vecElems) * vecElems;
+        Image<uint8_t> img_out = Streams()[band.stream].StreamImage(bands_out);
+        const Image<uint8_t> img_in = videoin[0]->Streams()[band.stream].StreamImage(bands_in);
+        ProcessRows(band.stream, img_out, img_in, band.y0, band.y1);
 
-        //Processing eight at a time (max number of floats per vector)
-        for(int vec = 0; vec < numVecs; vec += vecElems, pin += vecElems, pout += vecElems)
-        {
-            //Convert shorts to floats
-            const __m256 floatVals = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)pin)));
-
-            //Apply gamma and prepare for truncation (rounding) to integer
-            const __m256 gammaValues = _mm256_add_ps(_mm256_mul_ps(pow256_ps(_mm256_div_ps(floatVals, _mm256_set1_ps(channel_max_value)), _mm256_set1_ps(gamma)), _mm256_set1_ps(channel_max_value)), _mm256_set1_ps(0.5f));
-
-            //Clamp and convert to integer
-            __m256i gammaValuesI = _mm256_min_epi32(_mm256_max_epi32(_mm256_cvtps_epi32(gammaValues), _mm256_set1_epi32(0)), _mm256_set1_epi32(65535));
-
-            //Unshuffle shorts to end of vector
-            gammaValuesI = _mm256_packs_epi32(gammaValuesI, _mm256_setzero_si256());
-            gammaValuesI = _mm256_permute4x64_epi64(gammaValuesI, 0xD8);
-
-            // Copy result out
-            *(__m128i*)pout = _mm256_castsi256_si128(gammaValuesI);
-        }
-
-        //Remainder loose ends
-        while(pin != pin_end) {
-            *(pout++) = uint16_t(std::pow(float(*(pin++)) / channel_max_value, gamma) * channel_max_value + 0.5f);
+        l.lock();
+        if(++bands_done == bands.size()) {
+            done_cond.notify_all();
         }
     }
 }
-#else
-template <typename T>
-void ApplyGamma(Image<uint8_t>& out,
-                const Image<uint8_t>& in,
-                const float gamma,
-                const float channel_max_value)
-{
-    for(size_t r = 0; r < out.h; ++r)
-    {
-        T* pout = (T*)(out.ptr + r*out.pitch);
-        T* pin = (T*)(in.ptr + r*in.pitch);
-        const T* pin_end = (T*)(in.ptr + (r+1)*in.pitch);
-        while(pin != pin_end) {
-            *(pout++) = T(std::pow(float(*(pin++)) / channel_max_value, gamma) * channel_max_value + 0.5f);
-        }
-    }
-}
-#endif
 
 void GammaVideo::Process(uint8_t* buffer_out, const uint8_t* buffer_in)
 {
-    for(size_t s=0; s<streams.size(); ++s) {
-        Image<uint8_t> img_out = Streams()[s].StreamImage(buffer_out);
-        const Image<uint8_t> img_in  = videoin[0]->Streams()[s].StreamImage(buffer_in);
-        const size_t bytes_per_pixel = Streams()[s].PixFormat().bpp / 8;
-
-        auto i = stream_gammas.find(s);
+    std::vector<Band> frame_bands;
 
-        if(i != stream_gammas.end() && i->second != 0.0f && i->second != 1.0f)
-        {
-            const float gamma = i->second;
+    for(size_t s=0; s<streams.size(); ++s) {
+        const StreamInfo& si_out = Streams()[s];
+        const StreamInfo& si_in = videoin[0]->Streams()[s];
 
-            if(Streams()[s].PixFormat().format == "GRAY8" ||
-               Streams()[s].PixFormat().format == "RGB24" ||
-               Streams()[s].PixFormat().format == "BGR24" ||
-               Streams()[s].PixFormat().format == "RGBA32" ||
-               Streams()[s].PixFormat().format == "BGRA32")
-            {
-                ApplyGamma<uint8_t>(img_out, img_in, gamma, std::pow(2, Streams()[s].PixFormat().channel_bit_depth) - 1);
-            }
-            else if(Streams()[s].PixFormat().format == "GRAY16LE" ||
-                    Streams()[s].PixFormat().format == "RGB48" ||
-                    Streams()[s].PixFormat().format == "BGR48" ||
-                    Streams()[s].PixFormat().format == "RGBA64" ||
-                    Streams()[s].PixFormat().format == "BGRA64")
-            {
-                ApplyGamma<uint16_t>(img_out, img_in, gamma, std::pow(2, Streams()[s].PixFormat().channel_bit_depth) - 1);
-            }
-            else
-            {
-                throw VideoException("GammaVideo: Stream format not supported");
-            }
+        if( si_out.Width() != si_in.Width() || si_out.Height() != si_in.Height() ) {
+            throw std::runtime_error("GammaVideo: Incompatible image sizes");
         }
-        else
-        {
-            //straight copy
-            if( img_out.w != img_in.w || img_out.h != img_in.h ) {
-                throw std::runtime_error("GammaVideo: Incompatible image sizes");
-            }
 
-            for(size_t y=0; y < img_out.h; ++y) {
-                std::memcpy(img_out.RowPtr((int)y), img_in.RowPtr((int)y), bytes_per_pixel * img_in.w);
-            }
+        // Keep bands large enough to amortise handing them to a worker
+        const size_t h = si_in.Height();
+        const size_t num_bands = std::max<size_t>(1, std::min(num_threads, h / 64));
+        const size_t band_h = (h + num_bands - 1) / num_bands;
+
+        for(size_t y = 0; y < h; y += band_h) {
+            frame_bands.push_back(Band{s, y, std::min(y + band_h, h)});
         }
     }
+
+    std::unique_lock<std::mutex> l(work_lock);
+    bands.swap(frame_bands);
+    bands_out = buffer_out;
+    bands_in = buffer_in;
+    next_band = 0;
+    bands_done = 0;
+    work_cond.notify_all();
+
+    ProcessBands(l);
+    done_cond.wait(l, [this]{ return bands_done == bands.size(); });
 }
 
 //! Implement VideoInput::GrabNext()
@@ -330,46 +448,76 @@ bool GammaVideo::DropNFrames(uint32_t n)
 PANGOLIN_REGISTER_FACTORY(GammaVideo)
 {
     struct GammaVideoFactory final : public TypedFactoryInterface<VideoInterface> {
-        GammaVideoFactory()
+        std::map<std::string,Precedence> Schemes() const override
+        {
+            return {{"gamma",10}};
+        }
+        const char* Description() const override
+        {
+            return "Video Filter: gamma correct or tone map pixel values using lookup tables.";
+        }
+        ParamSet Params() const override
         {
-            param_set_ = {{
-                {"gamma\\d+","1.0","gammaK, where 1 <= K <= N where N is the number of streams"}
+            return {{
+                {"gamma\\d+","1.0","gammaN, N:[1,streams]. Output = input^gamma, normalised to the range of the data."},
+                {"curve\\d+","","curveN, N:[1,streams]. Piecewise linear tone curve as normalised points x0:y0;x1:y1;... overriding gammaN."},
+                {"bits\\d+","","bitsN, N:[1,streams]. Significant bits of input data, defaulting to the pixel format bit depth."},
+                {"threads","1","Number of threads, each processing a band of rows. 0 for one per core."},
             }};
         }
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
+            ParamReader reader(Params(), uri);
 
-            ParamReader reader(param_set_, uri);
-            // Gamma for each stream
-            std::map<size_t, float> stream_gammas;
+            std::map<size_t, GammaVideo::ToneCurve> stream_curves;
+            std::map<size_t, unsigned int> stream_bits;
             for(size_t i=0; i<100; ++i)
             {
                 const std::string gamma_key = pangolin::FormatString("gamma%",i+1);
+                const std::string curve_key = pangolin::FormatString("curve%",i+1);
+                const std::string bits_key = pangolin::FormatString("bits%",i+1);
 
-                if(uri.Contains(gamma_key))
+                if(reader.Contains(curve_key))
                 {
-                    stream_gammas[i] = reader.Get<float>(gamma_key, 1.0f);
+                    std::vector<std::pair<float,float>> points;
+                    std::istringstream iss(reader.Get<std::string>(curve_key));
+                    std::string point;
+                    while(std::getline(iss, point, ';')) {
+                        float x, y;
+                        char sep;
+                        std::istringstream ps(point);
+                        if(!(ps >> x >> sep >> y) || sep != ':') {
+                            throw VideoException("GammaVideo: Unable to parse tone curve point", point);
+                        }
+                        points.emplace_back(x, y);
+                    }
+                    stream_curves[i] = GammaVideo::PiecewiseLinearCurve(points);
+                }
+                else if(reader.Contains(gamma_key))
+                {
+                    const float gamma = reader.Get<float>(gamma_key);
+                    if(gamma != 0.0f && gamma != 1.0f) {
+                        stream_curves[i] = [gamma](float x){ return std::pow(x, gamma); };
+                    }
                 }
-            }
 
-            std::unique_ptr<VideoInterface> subvid = pangolin::OpenVideo(uri.url);
+                if(reader.Contains(bits_key))
+                {
+                    stream_bits[i] = reader.Get<unsigned int>(bits_key);
+                }
+            }
 
-            return std::unique_ptr<VideoInterface> (new GammaVideo(subvid, stream_gammas));
-        }
-        FactoryUseInfo Help( const std::string& scheme ) const override {
-            return FactoryUseInfo(scheme, "Gamma corrects a set of video streams", param_set_);
-        }
+            const size_t num_threads = reader.Get<size_t>("threads");
 
-        bool ValidateUri( const std::string& scheme, const Uri& uri, std::unordered_set<std::string>& unrecognized_params) const override {
-            return ValidateUriAgainstParamSet(scheme, param_set_, uri, unrecognized_params );
+            std::unique_ptr<VideoInterface> subvid = pangolin::OpenVideo(uri.url);
+            std::unique_ptr<GammaVideo> video(new GammaVideo(subvid, stream_curves, num_threads));
+            for(const auto& sb : stream_bits) {
+                video->SetSignificantBits(sb.first, sb.second);
+            }
+            return video;
         }
-
-        bool IsValidated( const std::string& ) const override {return true;}
-
-        ParamSet param_set_;
     };
 
-    auto factory = std::make_shared<GammaVideoFactory>();
-    FactoryRegistry::I()->RegisterFactory<VideoInterface>(factory, 10, "gamma");
+    return FactoryRegistry::I()->RegisterFactory<VideoInterface>(std::make_shared<GammaVideoFactory>());
 }
 
 }
@@ -30,16 +30,17 @@
 #include <pangolin/video/drivers/images.h>
 #include <pangolin/video/iostream_operators.h>
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 
 namespace pangolin
 {
 
-bool ImagesVideo::LoadFrame(size_t i)
+bool ImagesVideo::LoadFrame(size_t i, Frame& frame) const
 {
     if( i < num_files) {
-        Frame& frame = loaded[i];
+        frame.clear();
         for(size_t c=0; c< num_channels; ++c) {
             const std::string& filename = Filename(i,c);
             const ImageFileType file_type = FileType(filename);
@@ -57,6 +58,87 @@ bool ImagesVideo::LoadFrame(size_t i)
     return false;
 }
 
+void ImagesVideo::PrefetchLoop()
+{
+    std::unique_lock<std::mutex> l(prefetch_lock);
+
+    while(!quit_prefetch) {
+        // Find the earliest frame in the lookahead window not already claimed
+        size_t i = next_frame_id;
+        const size_t end = std::min(num_files, next_frame_id + prefetch_frames);
+        while(i < end && loaded.count(i)) ++i;
+
+        if(i >= end) {
+            prefetch_cond.wait(l);
+            continue;
+        }
+
+        const size_t ticket = next_ticket++;
+        loaded[i] = PrefetchSlot{PrefetchSlot::State::Loading, ticket, Frame(), nullptr};
+
+        Frame frame;
+        std::exception_ptr error;
+        l.unlock();
+        try {
+            LoadFrame(i, frame);
+        }catch(...) {
+            error = std::current_exception();
+        }
+        l.lock();
+
+        // Slot may have been discarded by Seek() whilst we were decoding
+        auto it = loaded.find(i);
+        if(it != loaded.end() && it->second.ticket == ticket) {
+            it->second.frame = std::move(frame);
+            it->second.error = error;
+            it->second.state = PrefetchSlot::State::Ready;
+            frame_ready_cond.notify_all();
+        }
+    }
+}
+
+void ImagesVideo::Prefetch(size_t frames, size_t num_threads, size_t max_bytes)
+{
+    StopPrefetch();
+
+    if(max_bytes && size_bytes) {
+        frames = std::min(frames, std::max<size_t>(1, max_bytes / size_bytes));
+    }
+    if(num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_threads = std::min(num_threads, frames);
+
+    prefetch_frames = frames;
+    quit_prefetch = false;
+    for(size_t t=0; t < num_threads; ++t) {
+        prefetch_threads.emplace_back(&ImagesVideo::PrefetchLoop, this);
+    }
+}
+
+void ImagesVideo::StopPrefetch()
+{
+    {
+        std::lock_guard<std::mutex> l(prefetch_lock);
+        quit_prefetch = true;
+    }
+    prefetch_cond.notify_all();
+    for(std::thread& t : prefetch_threads) {
+        t.join();
+    }
+    prefetch_threads.clear();
+
+    // Drop frames still marked as loading by the stopped workers
+    for(auto it = loaded.begin(); it != loaded.end(); ) {
+        if(it->second.state == PrefetchSlot::State::Loading) {
+            it = loaded.erase(it);
+        }else{
+            ++it;
+        }
+    }
+    prefetch_frames = 0;
+}
+
 void ImagesVideo::PopulateFilenamesFromJson(const std::string& filename)
 {
     std::ifstream ifs( PathExpand(filename));
@@ -85,7 +167,6 @@ void ImagesVideo::PopulateFilenamesFromJson(const std::string& filename)
                 filenames[c][i] = (path.size() && path[0] == '/') ? path : (folder + path);
             }
         }
-        loaded.resize(num_files);
     }else{
         throw VideoException(err);
     }
@@ -126,16 +207,13 @@ void ImagesVideo::PopulateFilenames(const std::string& wildcard_path)
             throw VideoException("No files found for wildcard '" + channel_wildcard + "'");
         }
     }
-
-    // Resize empty frames vector to hold future images.
-    loaded.resize(num_files);
 }
 
 void ImagesVideo::ConfigureStreamSizes()
 {
     size_bytes = 0;
     for(size_t c=0; c < num_channels; ++c) {
-        const TypedImage& img = loaded[0][c];
+        const TypedImage& img = loaded[0].frame[c];
         const StreamInfo stream_info(img.fmt, img.w, img.h, img.pitch, (unsigned char*)(size_bytes));
         streams.push_back(stream_info);
         size_bytes += img.h*img.pitch;
@@ -144,17 +222,18 @@ void ImagesVideo::ConfigureStreamSizes()
 
 ImagesVideo::ImagesVideo(const std::string& wildcard_path)
     : num_files(-1), num_channels(0), next_frame_id(0),
+      prefetch_frames(0), next_ticket(1), quit_prefetch(true),
       unknowns_are_raw(false)
 {
     // Work out which files to sequence
     PopulateFilenames(wildcard_path);
 
     // Load first image in order to determine stream sizes etc
-    LoadFrame(next_frame_id);
+    PrefetchSlot& first = loaded[next_frame_id];
+    first = PrefetchSlot{PrefetchSlot::State::Ready, 0, Frame(), nullptr};
+    LoadFrame(next_frame_id, first.frame);
 
     ConfigureStreamSizes();
-
-    // TODO: Queue frames in another thread.
 }
 
 ImagesVideo::ImagesVideo(
@@ -164,6 +243,7 @@ ImagesVideo::ImagesVideo(
     size_t raw_pitch, size_t raw_offset,
     size_t raw_planes
 ) : num_files(-1), num_channels(0), next_frame_id(0),
+    prefetch_frames(0), next_ticket(1), quit_prefetch(true),
     unknowns_are_raw(true), raw_fmt(raw_fmt),
     raw_width(raw_width), raw_height(raw_height),
     raw_planes(raw_planes), raw_pitch(raw_pitch),
@@ -173,15 +253,16 @@ ImagesVideo::ImagesVideo(
     PopulateFilenames(wildcard_path);
 
     // Load first image in order to determine stream sizes etc
-    LoadFrame(next_frame_id);
+    PrefetchSlot& first = loaded[next_frame_id];
+    first = PrefetchSlot{PrefetchSlot::State::Ready, 0, Frame(), nullptr};
+    LoadFrame(next_frame_id, first.frame);
 
     ConfigureStreamSizes();
-
-    // TODO: Queue frames in another thread.
 }
 
 ImagesVideo::~ImagesVideo()
 {
+    StopPrefetch();
 }
 
 //! Implement VideoInput::Start()
@@ -209,31 +290,58 @@ const std::vector<StreamInfo>& ImagesVideo::Streams() const
 }
 
 //! Implement VideoInput::GrabNext()
-bool ImagesVideo::GrabNext( unsigned char* image, bool /*wait*/ )
+bool ImagesVideo::GrabNext( unsigned char* image, bool wait )
 {
-    if(next_frame_id < loaded.size()) {
-        Frame& frame = loaded[next_frame_id];
+    if(next_frame_id >= num_files) {
+        return false;
+    }
 
-        if(frame.size() != num_channels) {
-            LoadFrame(next_frame_id);
+    Frame frame;
+    {
+        std::unique_lock<std::mutex> l(prefetch_lock);
+        auto it = loaded.find(next_frame_id);
+
+        if(prefetch_frames) {
+            // Wait for the workers to reach this frame
+            prefetch_cond.notify_all();
+            while(it == loaded.end() || it->second.state != PrefetchSlot::State::Ready) {
+                if(!wait) {
+                    return false;
+                }
+                frame_ready_cond.wait(l);
+                it = loaded.find(next_frame_id);
+            }
         }
 
-        for(size_t c=0; c < num_channels; ++c){
-            TypedImage& img = frame[c];
-            if(!img.ptr || img.w != streams[c].Width() || img.h != streams[c].Height() ) {
-                return false;
+        if(it != loaded.end()) {
+            if(it->second.error) {
+                std::exception_ptr error = it->second.error;
+                loaded.erase(it);
+                std::rethrow_exception(error);
             }
-            const StreamInfo& si = streams[c];
-            std::memcpy(image + (size_t)si.Offset(), img.ptr, si.SizeBytes());
-            img.Deallocate();
+            frame = std::move(it->second.frame);
+            loaded.erase(it);
         }
-        frame.clear();
 
         next_frame_id++;
-        return true;
     }
+    // Lookahead window has moved on
+    prefetch_cond.notify_all();
 
-    return false;
+    if(frame.size() != num_channels) {
+        LoadFrame(next_frame_id-1, frame);
+    }
+
+    for(size_t c=0; c < num_channels; ++c){
+        TypedImage& img = frame[c];
+        if(!img.ptr || img.w != streams[c].Width() || img.h != streams[c].Height() ) {
+            return false;
+        }
+        const StreamInfo& si = streams[c];
+        std::memcpy(image + (size_t)si.Offset(), img.ptr, si.SizeBytes());
+    }
+
+    return true;
 }
 
 //! Implement VideoInput::GrabNewest()
@@ -254,7 +362,22 @@ size_t ImagesVideo::GetTotalFrames() const
 
 size_t ImagesVideo::Seek(size_t frameid)
 {
-    next_frame_id = std::max(size_t(0), std::min(frameid, num_files));
+    {
+        std::lock_guard<std::mutex> l(prefetch_lock);
+        next_frame_id = std::max(size_t(0), std::min(frameid, num_files));
+
+        // Discard work outside of the new lookahead window. Frames still being
+        // decoded are ignored by their worker when finished.
+        const size_t end = next_frame_id + std::max<size_t>(prefetch_frames, 1);
+        for(auto it = loaded.begin(); it != loaded.end(); ) {
+            if(it->first < next_frame_id || it->first >= end) {
+                it = loaded.erase(it);
+            }else{
+                ++it;
+            }
+        }
+    }
+    prefetch_cond.notify_all();
     return next_frame_id;
 }
 
@@ -295,7 +418,10 @@ PANGOLIN_REGISTER_FACTORY(ImagesVideo)
                 {"size","640x480","RAW files only. Image size, required if fmt is specified"},
                 {"pitch","0","RAW files only. Specify distance from the start of one row to the next in bytes. If not specified, assumed image is packed."},
                 {"offset","0","Offset from the start of the file in bytes where the image starts"},
-                {"planes","1","Number of channel planes (outer array channels) for raw image. fmt should be the format of an element in the individual plane."}
+                {"planes","1","Number of channel planes (outer array channels) for raw image. fmt should be the format of an element in the individual plane."},
+                {"prefetch","4","Number of frames to decode ahead of playback in the background. 0 to decode within GrabNext."},
+                {"threads","0","Number of threads used for prefetching, 0 for one per core (up to prefetch)."},
+                {"prefetch_mb","512","Upper bound on the memory used by prefetched frames in megabytes. 0 for no limit."}
             }};
         }
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
@@ -303,6 +429,11 @@ PANGOLIN_REGISTER_FACTORY(ImagesVideo)
 
             const bool raw = reader.Contains("fmt");
             const std::string path = PathExpand(uri.url);
+            const size_t prefetch = reader.Get<size_t>("prefetch");
+            const size_t threads = reader.Get<size_t>("threads");
+            const size_t prefetch_bytes = reader.Get<size_t>("prefetch_mb") * 1024 * 1024;
+
+            std::unique_ptr<ImagesVideo> video;
 
             if(raw) {
                 const std::string sfmt = reader.Get<std::string>("fmt");
@@ -311,12 +442,17 @@ PANGOLIN_REGISTER_FACTORY(ImagesVideo)
                 const size_t image_pitch = reader.Get<int>("pitch");
                 const size_t image_offset = reader.Get<int>("offset");
                 const size_t image_planes = reader.Get<int>("planes");
-                return std::unique_ptr<VideoInterface>( new ImagesVideo(
+                video.reset( new ImagesVideo(
                     path, fmt, dim.x, dim.y, image_pitch, image_offset, image_planes
                 ));
             }else{
-                return std::unique_ptr<VideoInterface>( new ImagesVideo(path) );
+                video.reset( new ImagesVideo(path) );
+            }
+
+            if(prefetch) {
+                video->Prefetch(prefetch, threads, prefetch_bytes);
             }
+            return std::unique_ptr<VideoInterface>(std::move(video));
         }
     };
 
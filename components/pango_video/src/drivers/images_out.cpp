@@ -31,11 +31,15 @@
 #include <pangolin/utils/file_utils.h>
 #include <pangolin/video/drivers/images_out.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace pangolin {
 
-ImagesVideoOutput::ImagesVideoOutput(const std::string& image_folder, const std::string& json_file_out, const std::string& image_file_extension)
-    : json_frames(picojson::array_type,true),
-      image_index(0), image_folder( PathExpand(image_folder) + "/" ), image_file_extension(image_file_extension)
+ImagesVideoOutput::ImagesVideoOutput(const std::string& image_folder, const std::string& json_file_out, const std::string& image_file_extension, size_t num_threads, size_t max_queued_frames)
+    : size_bytes(0), image_index(0), image_folder( PathExpand(image_folder) + "/" ), image_file_extension(image_file_extension),
+      json_header_written(false), max_queued_frames(max_queued_frames), quit_write_threads(false),
+      frames_in_flight(0), json_next_index(0)
 {
     if(!json_file_out.empty()) {
         file.open(json_file_out);
@@ -43,21 +47,42 @@ ImagesVideoOutput::ImagesVideoOutput(const std::string& image_folder, const std:
             throw std::runtime_error("Unable to open json file for writing, " + json_file_out + ". Make sure output folder already exists.");
         }
     }
+
+    if(num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if(this->max_queued_frames == 0) {
+        this->max_queued_frames = 2 * num_threads;
+    }
+    for(size_t t=0; t < num_threads; ++t) {
+        write_threads.emplace_back(&ImagesVideoOutput::WriteLoop, this);
+    }
 }
 
 ImagesVideoOutput::~ImagesVideoOutput()
 {
+    {
+        std::unique_lock<std::mutex> l(lock);
+        cond.wait(l, [this](){ return frames_in_flight == 0; });
+        quit_write_threads = true;
+    }
+    cond.notify_all();
+    for(std::thread& t : write_threads) {
+        t.join();
+    }
+
+    if(write_error) {
+        try {
+            std::rethrow_exception(write_error);
+        }catch(const std::exception& e) {
+            pango_print_error("ImagesVideoOutput: %s\n", e.what());
+        }
+    }
+
     if(file.is_open())
     {
-        const std::string video_uri = "images://" + image_folder + "archive.json";
-        picojson::value json_file;
-        json_file["device_properties"] = device_properties;
-        json_file["frames"] = json_frames;
-        json_file["input_uri"] = input_uri;
-        json_file["video_uri"] = video_uri;
-
-        // Serialize json to file.
-        file << json_file.serialize(true);
+        WriteJsonHeader();
+        file << "\n]}\n";
     }
 }
 
@@ -68,34 +93,135 @@ const std::vector<StreamInfo>& ImagesVideoOutput::Streams() const
 
 void ImagesVideoOutput::SetStreams(const std::vector<StreamInfo>& streams, const std::string& uri, const picojson::value& device_properties)
 {
+    std::lock_guard<std::mutex> l(lock);
     this->streams = streams;
     this->input_uri = uri;
     this->device_properties = device_properties;
+
+    size_bytes = 0;
+    for(const StreamInfo& si : streams) {
+        size_bytes = std::max(size_bytes, (size_t)si.Offset() + si.SizeBytes());
+    }
+    free_buffers.clear();
+
+    WriteJsonHeader();
+}
+
+void ImagesVideoOutput::WriteJsonHeader()
+{
+    if(file.is_open() && !json_header_written) {
+        // Frames are appended to the index as they are written and the document
+        // closed on destruction.
+        const std::string video_uri = "images://" + image_folder + "archive.json";
+        file << "{\"device_properties\":" << device_properties.serialize()
+             << ",\"input_uri\":" << picojson::value(input_uri).serialize()
+             << ",\"video_uri\":" << picojson::value(video_uri).serialize()
+             << ",\"frames\":[";
+        json_header_written = true;
+    }
 }
 
 int ImagesVideoOutput::WriteStreams(const unsigned char* data, const picojson::value& frame_properties)
 {
-    picojson::value json_filenames(picojson::array_type, true);
-
-    // Write each stream image to file.
-    for(size_t s=0; s < streams.size(); ++s) {
-        const pangolin::StreamInfo& si = streams[s];
-        const std::string filename = pangolin::FormatString("image_%%%_%.%",std::setfill('0'),std::setw(10),image_index, s, image_file_extension);
-        json_filenames.push_back(filename);
-        const Image<unsigned char> img = si.StreamImage(data);
-        pangolin::SaveImage(img, si.PixFormat(), image_folder + filename);
+    std::unique_ptr<unsigned char[]> buffer;
+    {
+        std::unique_lock<std::mutex> l(lock);
+        if(write_error) {
+            std::rethrow_exception(write_error);
+        }
+
+        // Apply back pressure to the caller if the writers can't keep up
+        cond.wait(l, [this](){ return frames_in_flight < max_queued_frames || write_error; });
+        if(write_error) {
+            std::rethrow_exception(write_error);
+        }
+
+        ++frames_in_flight;
+        if(!free_buffers.empty()) {
+            buffer = std::move(free_buffers.back());
+            free_buffers.pop_back();
+        }
     }
 
-    // Add frame_properties to json file.
-    picojson::value json_frame;
-    json_frame["frame_properties"] = frame_properties;
-    json_frame["stream_files"] = json_filenames;
-    json_frames.push_back(json_frame);
+    if(!buffer) {
+        buffer.reset(new unsigned char[size_bytes]);
+    }
+    std::memcpy(buffer.get(), data, size_bytes);
+
+    {
+        std::lock_guard<std::mutex> l(lock);
+        queue.push_back(Job{image_index, std::move(buffer), frame_properties});
+    }
+    cond.notify_all();
 
     ++image_index;
     return 0;
 }
 
+void ImagesVideoOutput::WriteLoop()
+{
+    std::unique_lock<std::mutex> l(lock);
+
+    while(true) {
+        cond.wait(l, [this](){ return quit_write_threads || !queue.empty(); });
+        if(queue.empty()) {
+            break;
+        }
+
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        const std::vector<StreamInfo> job_streams = streams;
+        l.unlock();
+
+        // Write each stream image to file.
+        picojson::value json_filenames(picojson::array_type, true);
+        std::exception_ptr error;
+        try {
+            for(size_t s=0; s < job_streams.size(); ++s) {
+                const pangolin::StreamInfo& si = job_streams[s];
+                const std::string filename = pangolin::FormatString("image_%%%_%.%",std::setfill('0'),std::setw(10),job.image_index, s, image_file_extension);
+                json_filenames.push_back(filename);
+                const Image<unsigned char> img = si.StreamImage(job.data.get());
+                pangolin::SaveImage(img, si.PixFormat(), image_folder + filename);
+            }
+        }catch(...) {
+            error = std::current_exception();
+        }
+
+        // Add frame_properties to json file.
+        picojson::value json_frame;
+        json_frame["frame_properties"] = job.frame_properties;
+        json_frame["stream_files"] = json_filenames;
+
+        l.lock();
+        if(error && !write_error) {
+            write_error = error;
+        }
+        free_buffers.push_back(std::move(job.data));
+        json_pending[job.image_index] = std::move(json_frame);
+
+        // Append any frames now complete up to the first still being written
+        for(auto it = json_pending.begin(); it != json_pending.end() && it->first == json_next_index; it = json_pending.erase(it)) {
+            if(file.is_open()) {
+                WriteJsonHeader();
+                file << (json_next_index ? ",\n" : "\n") << it->second.serialize();
+            }
+            ++json_next_index;
+            --frames_in_flight;
+        }
+        if(file.is_open()) {
+            file.flush();
+        }
+        cond.notify_all();
+    }
+}
+
+void ImagesVideoOutput::Flush()
+{
+    std::unique_lock<std::mutex> l(lock);
+    cond.wait(l, [this](){ return frames_in_flight == 0; });
+}
+
 bool ImagesVideoOutput::IsPipe() const
 {
     return false;
@@ -115,7 +241,9 @@ PANGOLIN_REGISTER_FACTORY(ImagesVideoOutput)
         ParamSet Params() const override
         {
             return {{
-                {"fmt","png","Output image format. Possible values are all Pangolin image formats e.g.: png,jpg,jpeg,ppm,pgm,pxm,pdm,zstd,lzf,p12b,exr,pango"}
+                {"fmt","png","Output image format. Possible values are all Pangolin image formats e.g.: png,jpg,jpeg,ppm,pgm,pxm,pdm,zstd,lzf,p12b,exr,pango"},
+                {"threads","0","Number of threads encoding and writing images, 0 for one per core."},
+                {"queue","0","Maximum number of frames waiting to be written before WriteStreams blocks, 0 for twice the number of threads."}
             }};
         }
         std::unique_ptr<VideoOutputInterface> Open(const Uri& uri) override {
@@ -124,13 +252,15 @@ PANGOLIN_REGISTER_FACTORY(ImagesVideoOutput)
             const std::string images_folder = PathExpand(uri.url);
             const std::string json_filename = images_folder + "/archive.json";
             const std::string image_extension = reader.Get<std::string>("fmt");
+            const size_t num_threads = reader.Get<size_t>("threads");
+            const size_t max_queued_frames = reader.Get<size_t>("queue");
 
             if(FileExists(json_filename)) {
                 throw std::runtime_error("Dataset already exists in directory.");
             }
 
             return std::unique_ptr<VideoOutputInterface>(
-                new ImagesVideoOutput(images_folder, json_filename, image_extension)
+                new ImagesVideoOutput(images_folder, json_filename, image_extension, num_threads, max_queued_frames)
             );
         }
     };
@@ -25,6 +25,8 @@
  * OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <thread>
 #include <pangolin/factory/factory_registry.h>
 #include <pangolin/video/drivers/join.h>
@@ -57,8 +59,52 @@
 
 namespace pangolin
 {
-JoinVideo::JoinVideo(std::vector<std::unique_ptr<VideoInterface>>& src_, const bool verbose)
-    : storage(std::move(src_)), size_bytes(0), sync_tolerance_us(0), verbose(verbose)
+
+// Arbitrary length of time larger than any reasonble period/exposure.
+constexpr size_t total_sleep_threshold_us = 200000;
+constexpr size_t grab_fail_thread_sleep_us = 1000;
+
+// Combine per source properties in the same way as GetVideoFrameProperties()
+// does for filters without properties of their own.
+static picojson::value JoinStreamProperties(const std::vector<picojson::value>& props)
+{
+    if(props.size() == 1)
+    {
+        return props[0];
+    }
+
+    picojson::value streams;
+    for(const picojson::value& dev_props : props)
+    {
+        if(dev_props.contains("streams"))
+        {
+            const picojson::value& dev_streams = dev_props["streams"];
+            for(size_t j = 0; j < dev_streams.size(); ++j)
+            {
+                streams.push_back(dev_streams[j]);
+            }
+        }
+        else
+        {
+            streams.push_back(dev_props);
+        }
+    }
+
+    if(streams.size() > 1)
+    {
+        picojson::value json = streams[0];
+        json["streams"] = streams;
+        return json;
+    }
+    else
+    {
+        return streams[0];
+    }
+}
+
+JoinVideo::JoinVideo(std::vector<std::unique_ptr<VideoInterface>>& src_, const bool verbose, const bool threaded, const size_t num_buffers)
+    : storage(std::move(src_)), size_bytes(0), sync_tolerance_us(0), verbose(verbose),
+      threaded(threaded), quit_grab_threads(true)
 {
     for(auto& p : storage)
     {
@@ -66,6 +112,22 @@ JoinVideo::JoinVideo(std::vector<std::unique_ptr<VideoInterface>>& src_, const b
         frame_seen.push_back(false);
     }
 
+    if(threaded)
+    {
+        sources.resize(src.size());
+        for(size_t s = 0; s < src.size(); ++s)
+        {
+            for(size_t b = 0; b < std::max<size_t>(num_buffers, 2); ++b)
+            {
+                sources[s].buffers.emplace_back(new unsigned char[src[s]->SizeBytes()]);
+                sources[s].free_buffers.push_back(b);
+            }
+        }
+        stats.frames_received.resize(src.size(), 0);
+        stats.frames_dropped.resize(src.size(), 0);
+        stats.frames_unmatched.resize(src.size(), 0);
+    }
+
     // Add individual streams
     for(size_t s = 0; s < src.size(); ++s)
     {
@@ -83,6 +145,7 @@ JoinVideo::JoinVideo(std::vector<std::unique_ptr<VideoInterface>>& src_, const b
 
 JoinVideo::~JoinVideo()
 {
+    StopThreads();
     for(size_t s = 0; s < src.size(); ++s)
     {
         src[s]->Stop();
@@ -105,10 +168,15 @@ void JoinVideo::Start()
     {
         src[s]->Start();
     }
+    if(threaded)
+    {
+        StartThreads();
+    }
 }
 
 void JoinVideo::Stop()
 {
+    StopThreads();
     for(size_t s = 0; s < src.size(); ++s)
     {
         src[s]->Stop();
@@ -219,6 +287,11 @@ int64_t JoinVideo::GetAdjustedCaptureTime(size_t src_index)
 }
 
 bool JoinVideo::GrabNext(unsigned char* image, bool wait)
+{
+    return threaded ? GrabNextThreaded(image, wait, false) : GrabNextPolled(image, wait);
+}
+
+bool JoinVideo::GrabNextPolled(unsigned char* image, bool wait)
 {
     std::vector<size_t> offsets(src.size(), 0);
     std::vector<int64_t> capture_us(src.size(), 0);
@@ -228,8 +301,6 @@ bool JoinVideo::GrabNext(unsigned char* image, bool wait)
 
     constexpr size_t loop_sleep_us = 500;
     size_t total_sleep_us = 0;
-    // Arbitrary length of time larger than any reasonble period/exposure.
-    const size_t total_sleep_threshold_us = 200000;
     size_t unfilled_images = src.size();
 
     while (true)
@@ -365,6 +436,11 @@ bool AllInterfacesAreBufferAware(std::vector<VideoInterface*>& src)
 
 bool JoinVideo::GrabNewest(unsigned char* image, bool wait)
 {
+    if(threaded)
+    {
+        return GrabNextThreaded(image, wait, true);
+    }
+
     // TODO: Tidy to correspond to GrabNext()
     TSTART()
     DBGPRINT("Entering GrabNewest:");
@@ -519,6 +595,289 @@ std::vector<VideoInterface*>& JoinVideo::InputStreams()
     return src;
 }
 
+const picojson::value& JoinVideo::DeviceProperties() const
+{
+    std::vector<picojson::value> props;
+    for(size_t s = 0; s < src.size(); ++s)
+    {
+        props.push_back(GetVideoDeviceProperties(src[s]));
+    }
+    device_properties = JoinStreamProperties(props);
+    return device_properties;
+}
+
+const picojson::value& JoinVideo::FrameProperties() const
+{
+    if(!threaded)
+    {
+        // Sources hold the properties of the frames we last grabbed from them
+        std::vector<picojson::value> props;
+        for(size_t s = 0; s < src.size(); ++s)
+        {
+            props.push_back(GetVideoFrameProperties(src[s]));
+        }
+        frame_properties = JoinStreamProperties(props);
+    }
+    return frame_properties;
+}
+
+JoinVideo::Stats JoinVideo::GetStats() const
+{
+    std::lock_guard<std::mutex> l(lock);
+    return stats;
+}
+
+void JoinVideo::StartThreads()
+{
+    if(!quit_grab_threads)
+    {
+        return;
+    }
+    quit_grab_threads = false;
+    for(size_t s = 0; s < sources.size(); ++s)
+    {
+        sources[s].thread = std::thread(&JoinVideo::GrabLoop, this, s);
+    }
+}
+
+void JoinVideo::StopThreads()
+{
+    {
+        std::lock_guard<std::mutex> l(lock);
+        quit_grab_threads = true;
+    }
+    cond.notify_all();
+    for(Source& source : sources)
+    {
+        if(source.thread.joinable())
+        {
+            source.thread.join();
+        }
+    }
+}
+
+void JoinVideo::GrabLoop(size_t s)
+{
+    Source& source = sources[s];
+
+    while(true)
+    {
+        size_t b;
+        {
+            std::lock_guard<std::mutex> l(lock);
+            if(quit_grab_threads)
+            {
+                break;
+            }
+            if(source.free_buffers.empty())
+            {
+                // Consumer isn't keeping up, recycle the oldest frame
+                b = source.frames.front().buffer;
+                source.frames.pop_front();
+                ++stats.frames_dropped[s];
+            }
+            else
+            {
+                b = source.free_buffers.back();
+                source.free_buffers.pop_back();
+            }
+        }
+
+        // Blocking grab outside of the lock so that sources proceed independently
+        BufferedFrame frame = {b, 0, picojson::value()};
+        bool success = false;
+        try
+        {
+            success = src[s]->GrabNext(source.buffers[b].get(), true);
+            if(success)
+            {
+                frame.capture_us = (sync_tolerance_us > 0) ? GetAdjustedCaptureTime(s) : 0;
+                frame.frame_properties = GetVideoFrameProperties(src[s]);
+            }
+        }
+        catch(const std::exception& e)
+        {
+            // User doesn't have the opportunity to catch exceptions here.
+            pango_print_warn("JoinVideo: Stream %zu caught exception (%s)\n", s, e.what());
+            success = false;
+        }
+
+        {
+            std::lock_guard<std::mutex> l(lock);
+            if(success)
+            {
+                source.frames.push_back(std::move(frame));
+                frame_seen[s] = true;
+                ++stats.frames_received[s];
+            }
+            else
+            {
+                source.free_buffers.push_back(b);
+            }
+            source.grab_failed = !success;
+        }
+        cond.notify_all();
+
+        if(!success)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(grab_fail_thread_sleep_us));
+        }
+    }
+}
+
+bool JoinVideo::MatchSet()
+{
+    while(true)
+    {
+        int64_t newest = std::numeric_limits<int64_t>::min();
+        for(const Source& source : sources)
+        {
+            if(source.frames.empty())
+            {
+                return false;
+            }
+            newest = std::max(newest, source.frames.front().capture_us);
+        }
+
+        if(sync_tolerance_us <= 0)
+        {
+            return true;
+        }
+
+        // Frames older than the tolerance from the newest oldest frame can't be
+        // matched by any source, now or later.
+        bool discarded = false;
+        for(size_t s = 0; s < sources.size(); ++s)
+        {
+            Source& source = sources[s];
+            while(!source.frames.empty() && source.frames.front().capture_us < newest - sync_tolerance_us)
+            {
+                source.free_buffers.push_back(source.frames.front().buffer);
+                source.frames.pop_front();
+                ++stats.frames_unmatched[s];
+                discarded = true;
+            }
+        }
+
+        if(!discarded)
+        {
+            // All oldest frames lie within [newest - tolerance, newest]
+            return true;
+        }
+
+        if(verbose)
+        {
+            pango_print_warn("JoinVideo: Discarded frames older than %ld us before %ld us\n", (long)sync_tolerance_us, (long)newest);
+        }
+    }
+}
+
+void JoinVideo::PopSet(unsigned char* image)
+{
+    std::vector<picojson::value> props;
+    int64_t oldest = std::numeric_limits<int64_t>::max();
+    int64_t newest = std::numeric_limits<int64_t>::min();
+    size_t offset = 0;
+
+    for(size_t s = 0; s < sources.size(); ++s)
+    {
+        Source& source = sources[s];
+        BufferedFrame& frame = source.frames.front();
+        if(image)
+        {
+            std::memcpy(image + offset, source.buffers[frame.buffer].get(), src[s]->SizeBytes());
+            props.push_back(std::move(frame.frame_properties));
+        }
+        else
+        {
+            ++stats.frames_dropped[s];
+        }
+        oldest = std::min(oldest, frame.capture_us);
+        newest = std::max(newest, frame.capture_us);
+        source.free_buffers.push_back(frame.buffer);
+        source.frames.pop_front();
+        offset += src[s]->SizeBytes();
+    }
+
+    if(image)
+    {
+        frame_properties = JoinStreamProperties(props);
+        stats.max_set_span_us = std::max(stats.max_set_span_us, newest - oldest);
+        ++stats.sets_delivered;
+    }
+}
+
+bool JoinVideo::GrabNextThreaded(unsigned char* image, bool wait, bool newest)
+{
+    StartThreads();
+
+    std::unique_lock<std::mutex> l(lock);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(total_sleep_threshold_us);
+
+    while(!MatchSet())
+    {
+        // A source which can't grab and has nothing buffered is waiting on data or has finished.
+        const bool source_failed = std::any_of(sources.begin(), sources.end(), [](const Source& source) {
+            return source.grab_failed && source.frames.empty();
+        });
+        if(!wait || source_failed)
+        {
+            return false;
+        }
+
+        if(sync_tolerance_us == 0)
+        {
+            cond.wait(l);
+        }
+        else if(cond.wait_until(l, deadline) == std::cv_status::timeout && !MatchSet())
+        {
+            // We've waited long enough. Report on which cameras were not responding.
+            pango_print_warn(
+                "JoinVideo: Not all frames were delivered within the threshold of %zuus. Cameras not reporting:\n",
+                total_sleep_threshold_us);
+            for(size_t blocked = 0; blocked < sources.size(); ++blocked)
+            {
+                if(sources[blocked].frames.empty())
+                {
+                    pango_print_warn("           Stream %zu%s\n",
+                                     blocked,
+                                     frame_seen[blocked] ? "" : " [never reported]");
+                }
+            }
+            return false;
+        }
+    }
+
+    if(newest)
+    {
+        // Skip sets while the following frames of every source are known to form one too
+        while(true)
+        {
+            int64_t oldest_next = std::numeric_limits<int64_t>::max();
+            int64_t newest_next = std::numeric_limits<int64_t>::min();
+            bool have_next = true;
+            for(const Source& source : sources)
+            {
+                if(source.frames.size() < 2)
+                {
+                    have_next = false;
+                    break;
+                }
+                oldest_next = std::min(oldest_next, source.frames[1].capture_us);
+                newest_next = std::max(newest_next, source.frames[1].capture_us);
+            }
+            if(!have_next || (sync_tolerance_us > 0 && newest_next - oldest_next > sync_tolerance_us))
+            {
+                break;
+            }
+            PopSet(nullptr);
+        }
+    }
+
+    PopSet(image);
+    return true;
+}
+
 std::vector<std::string> SplitBrackets(const std::string src, char open = '{', char close = '}')
 {
     std::vector<std::string> splits;
@@ -568,6 +927,8 @@ PANGOLIN_REGISTER_FACTORY(JoinVideo)
             return {{
                 {"sync_tolerance_us", "0", "The maximum timestamp difference (in microsecs) between images that are considered to be in sync for joining"},
                 {"transfer_bandwidth_gbps","0", "Bandwidth used to compute exposure end time from reception time for sync logic"},
+                {"threaded","false", "Grab each source from its own thread and match frames by capture time as they arrive"},
+                {"buffers","4", "Number of frames buffered per source when threaded"},
                 {"Verbose","false","For verbose error/warning messages"}
             }};
         }
@@ -583,6 +944,8 @@ PANGOLIN_REGISTER_FACTORY(JoinVideo)
             // Bandwidth used to compute exposure end time from reception time for sync logic
             const double transfer_bandwidth_gbps = reader.Get<double>("transfer_bandwidth_gbps");
             const bool verbose = reader.Get<bool>("Verbose");
+            const bool threaded = reader.Get<bool>("threaded");
+            const size_t num_buffers = reader.Get<size_t>("buffers");
             if(uris.size() == 0)
             {
                 throw VideoException("No VideoSources found in join URL.",
@@ -595,7 +958,7 @@ PANGOLIN_REGISTER_FACTORY(JoinVideo)
                 src.push_back(pangolin::OpenVideo(uris[i]));
             }
 
-            JoinVideo* video_raw = new JoinVideo(src, verbose);
+            JoinVideo* video_raw = new JoinVideo(src, verbose, threaded, num_buffers);
 
             if(sync_tol_us > 0)
             {
@@ -29,23 +29,55 @@
 #include <pangolin/log/playback_session.h>
 #include <pangolin/utils/file_extension.h>
 #include <pangolin/utils/file_utils.h>
+#include <pangolin/utils/log.h>
 #include <pangolin/utils/signal_slot.h>
 #include <pangolin/video/drivers/pango.h>
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <functional>
 
+#ifndef _WIN_
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
 namespace pangolin
 {
 
 const std::string pango_video_type = "raw_video";
 
+// Reads of a frame taking longer than this count as stalls
+const int64_t stall_threshold_us = 10000;
+
+#ifndef _WIN_
+static void AdviseWillNeed(int fd, int64_t pos, int64_t len)
+{
+#if defined(_LINUX_)
+    posix_fadvise(fd, pos, len, POSIX_FADV_WILLNEED);
+#elif defined(_OSX_)
+    radvisory ra;
+    ra.ra_offset = pos;
+    ra.ra_count = int(std::min<int64_t>(len, INT_MAX));
+    fcntl(fd, F_RDADVISE, &ra);
+#else
+    PANGOLIN_UNUSED(fd);
+    PANGOLIN_UNUSED(pos);
+    PANGOLIN_UNUSED(len);
+#endif
+}
+#endif
+
 PangoVideo::PangoVideo(const std::string& filename, std::shared_ptr<PlaybackSession> playback_session)
     : _filename(filename),
       _playback_session(playback_session),
-      _reader(_playback_session->Open(filename)),
+      _reader(_playback_session->OpenCursor(filename)),
       _event_promise(_playback_session->Time()),
       _src_id(FindPacketStreamSource()),
-      _source(nullptr)
+      _source(nullptr),
+      _readahead_us(0), _readahead_max_bytes(0), _next_frame_id(0), _readahead_advised_id(0),
+      _readahead_frames_per_s(0.0), _readahead_fd(-1), _readahead_quit(true)
 {
     PANGO_ENSURE(_src_id != -1, "No appropriate video streams found in log.");
 
@@ -57,6 +89,12 @@ PangoVideo::PangoVideo(const std::string& filename, std::shared_ptr<PlaybackSess
         [&](SyncTime::TimePoint t){
             _event_promise.Cancel();
             _reader->Seek(_src_id, t);
+            {
+                std::lock_guard<std::mutex> l(_readahead_lock);
+                _next_frame_id = _source->next_packet_id;
+                _readahead_advised_id = _next_frame_id;
+            }
+            _readahead_cond.notify_all();
             _event_promise.WaitAndRenew(_source->NextPacketTime());
         }
     );
@@ -66,6 +104,7 @@ PangoVideo::PangoVideo(const std::string& filename, std::shared_ptr<PlaybackSess
 
 PangoVideo::~PangoVideo()
 {
+    StopReadahead();
 }
 
 size_t PangoVideo::SizeBytes() const
@@ -92,6 +131,7 @@ bool PangoVideo::GrabNext(unsigned char* image, bool /*wait*/)
 {
     try
     {
+        const basetime start = TimeNow();
         Packet fi = _reader->NextFrame(_src_id);
         _frame_properties = fi.meta;
 
@@ -118,6 +158,30 @@ bool PangoVideo::GrabNext(unsigned char* image, bool /*wait*/)
             }
         }
 
+        const basetime done = TimeNow();
+        {
+            std::lock_guard<std::mutex> l(_readahead_lock);
+            const int64_t read_us = TimeDiff_us(start, done);
+            ++_stats.frames;
+            _stats.read_us += read_us;
+            _stats.max_read_us = std::max(_stats.max_read_us, read_us);
+            if(read_us > stall_threshold_us) {
+                ++_stats.frames_stalled;
+                _stats.stalled_us += read_us;
+            }
+
+            // Follow the rate frames are consumed to size the readahead
+            if(_stats.frames > 1) {
+                const double dt = TimeDiff_us(_last_grab, done) * 1e-6;
+                if(dt > 0.0) {
+                    _readahead_frames_per_s = _readahead_frames_per_s > 0.0 ? 0.8 * _readahead_frames_per_s + 0.2 / dt : 1.0 / dt;
+                }
+            }
+            _last_grab = done;
+            _next_frame_id = fi.sequence_num + 1;
+        }
+        _readahead_cond.notify_all();
+
         _event_promise.WaitAndRenew(_source->NextPacketTime());
         return true;
     }
@@ -143,18 +207,137 @@ size_t PangoVideo::GetTotalFrames() const
     return _source->index.size();
 }
 
-size_t PangoVideo::Seek(size_t next_frame_id)
+size_t PangoVideo::Seek(size_t frameid)
 {
     // Get time for seek
-    if(next_frame_id < _source->index.size()) {
-        const int64_t capture_time = _source->index[next_frame_id].capture_time;
+    if(frameid < _source->index.size()) {
+        const int64_t capture_time = _source->index[frameid].capture_time;
         _playback_session->Time().Seek(SyncTime::TimePoint(std::chrono::microseconds(capture_time)));
-        return next_frame_id;
+        return frameid;
     }else{
         return _source->next_packet_id;
     }
 }
 
+void PangoVideo::Readahead(int64_t horizon_us, size_t max_bytes)
+{
+    StopReadahead();
+
+#ifndef _WIN_
+    if(horizon_us <= 0 || max_bytes == 0 || IsPipe(_filename)) {
+        return;
+    }
+
+    _readahead_fd = open(_filename.c_str(), O_RDONLY);
+    if(_readahead_fd < 0) {
+        pango_print_warn("Unable to open '%s' for readahead.\n", _filename.c_str());
+        return;
+    }
+    const int64_t file_size = lseek(_readahead_fd, 0, SEEK_END);
+
+    // Each packet extends to the start of the next packet or chunk of any
+    // source. Snapshot these so that the loop needn't touch the reader.
+    std::vector<int64_t> starts;
+    for(const auto& src : _reader->Sources()) {
+        for(const auto& info : src.index) {
+            if(info.pos > 0) starts.push_back(info.pos);
+        }
+    }
+    std::sort(starts.begin(), starts.end());
+    starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+    std::lock_guard<std::mutex> l(_readahead_lock);
+    _readahead_extents.clear();
+    _readahead_bytes.assign(1, 0);
+    for(const auto& info : _source->index) {
+        int64_t pos = 0, len = 0;
+        if(info.pos > 0) {
+            const auto next = std::upper_bound(starts.begin(), starts.end(), info.pos);
+            pos = info.pos;
+            len = std::max<int64_t>(0, (next == starts.end() ? file_size : *next) - pos);
+        }
+        const bool repeat = !_readahead_extents.empty() && _readahead_extents.back().first == pos;
+        _readahead_bytes.push_back(_readahead_bytes.back() + (repeat ? 0 : len));
+        _readahead_extents.emplace_back(pos, len);
+    }
+
+    _readahead_us = horizon_us;
+    _readahead_max_bytes = max_bytes;
+    _next_frame_id = _source->next_packet_id;
+    _readahead_advised_id = _next_frame_id;
+    _readahead_quit = false;
+    _readahead_thread = std::thread(&PangoVideo::ReadaheadLoop, this);
+#else
+    PANGOLIN_UNUSED(horizon_us);
+    PANGOLIN_UNUSED(max_bytes);
+#endif
+}
+
+void PangoVideo::StopReadahead()
+{
+    {
+        std::lock_guard<std::mutex> l(_readahead_lock);
+        _readahead_quit = true;
+    }
+    _readahead_cond.notify_all();
+    if(_readahead_thread.joinable()) {
+        _readahead_thread.join();
+    }
+#ifndef _WIN_
+    if(_readahead_fd >= 0) {
+        close(_readahead_fd);
+        _readahead_fd = -1;
+    }
+#endif
+}
+
+void PangoVideo::ReadaheadLoop()
+{
+#ifndef _WIN_
+    std::unique_lock<std::mutex> l(_readahead_lock);
+    const size_t num_frames = _readahead_extents.size();
+    int64_t advised_pos = -1;
+
+    while(!_readahead_quit) {
+        // Frames expected to be grabbed over the horizon, but at least the
+        // next two, and no more than max_bytes of file.
+        const size_t window = std::max<size_t>(2, size_t(std::ceil(_readahead_frames_per_s * _readahead_us * 1e-6)));
+        const size_t begin = std::min(_next_frame_id, num_frames);
+        size_t end = std::min(num_frames, begin + window);
+        const int64_t limit = _readahead_bytes[begin] + int64_t(_readahead_max_bytes);
+        end = std::min<size_t>(end, std::max<size_t>(begin + 1,
+            std::upper_bound(_readahead_bytes.begin() + begin + 1, _readahead_bytes.begin() + end + 1, limit) - _readahead_bytes.begin() - 1
+        ));
+
+        _readahead_advised_id = std::max(_readahead_advised_id, begin);
+        if(_readahead_advised_id >= end) {
+            _readahead_cond.wait(l);
+            continue;
+        }
+
+        const std::pair<int64_t,int64_t> extent = _readahead_extents[_readahead_advised_id++];
+        if(extent.second <= 0 || extent.first == advised_pos) {
+            // Packets of a chunk already requested
+            continue;
+        }
+        advised_pos = extent.first;
+
+        l.unlock();
+        AdviseWillNeed(_readahead_fd, extent.first, extent.second);
+        l.lock();
+
+        ++_stats.packets_advised;
+        _stats.bytes_advised += extent.second;
+    }
+#endif
+}
+
+PangoVideo::Stats PangoVideo::GetStats() const
+{
+    std::lock_guard<std::mutex> l(_readahead_lock);
+    return _stats;
+}
+
 std::string PangoVideo::GetSourceUri()
 {
     return _source_uri;
@@ -234,7 +417,9 @@ PANGOLIN_REGISTER_FACTORY(PangoVideo)
         ParamSet Params() const override
         {
             return {{
-                {"OrderedPlayback","false","Whether the playback respects the order of every data as they were recorded. Important for simulated playback."}
+                {"OrderedPlayback","false","Whether the playback respects the order of every data as they were recorded. Important for simulated playback."},
+                {"readahead_ms","500","Playback time of packets to ask the OS to read ahead of GrabNext(). 0 to disable."},
+                {"readahead_mb","64","Upper bound on the file data requested ahead of playback in megabytes."}
             }};
         }
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
@@ -243,7 +428,9 @@ PANGOLIN_REGISTER_FACTORY(PangoVideo)
             ParamReader reader(Params(),uri);
 
             if( !uri.scheme.compare("pango") || FileType(uri.url) == ImageFileTypePango ) {
-                return std::unique_ptr<VideoInterface>(new PangoVideo(path.c_str(), PlaybackSession::ChooseFromParams(reader)));
+                std::unique_ptr<PangoVideo> video(new PangoVideo(path.c_str(), PlaybackSession::ChooseFromParams(reader)));
+                video->Readahead(reader.Get<int64_t>("readahead_ms") * 1000, reader.Get<size_t>("readahead_mb") * 1024 * 1024);
+                return video;
             }
             return std::unique_ptr<VideoInterface>();
         }
@@ -51,7 +51,7 @@ void SigPipeHandler(int sig)
     SigState::I().sig_callbacks.at(sig).value = true;
 }
 
-PangoVideoOutput::PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris)
+PangoVideoOutput::PangoVideoOutput(const std::string& filename, size_t buffer_size_bytes, const std::map<size_t, std::string> &stream_encoder_uris, bool binary_meta, bool index_checkpoints)
     : filename(filename),
       packetstream_buffer_size_bytes(buffer_size_bytes),
       packetstreamsrcid(-1),
@@ -60,6 +60,11 @@ PangoVideoOutput::PangoVideoOutput(const std::string& filename, size_t buffer_si
       fixed_size(true),
       stream_encoder_uris(stream_encoder_uris)
 {
+    packetstream.SetBinaryMeta(binary_meta);
+    if(index_checkpoints) {
+        packetstream.SetIndexCheckpointInterval(PacketStreamWriter::default_checkpoint_packets, PacketStreamWriter::default_checkpoint_us);
+    }
+
     if(!is_pipe)
     {
         packetstream.Open(filename, packetstream_buffer_size_bytes);
@@ -81,6 +86,11 @@ const std::vector<StreamInfo>& PangoVideoOutput::Streams() const
     return streams;
 }
 
+void PangoVideoOutput::SetChunking(size_t chunk_bytes, PacketChunkCodec codec, int level)
+{
+    packetstream.SetChunking(chunk_bytes, codec, level);
+}
+
 bool PangoVideoOutput::IsPipe() const
 {
     return is_pipe;
@@ -278,7 +288,12 @@ PANGOLIN_REGISTER_FACTORY(PangoVideoOutput)
             return {{
                 {"buffer_size_mb","100","Buffer size in MB"},
                 {"unique_filename","","This is flag to create a unique file name in the case of file already exists."},
-                {"encoder(\\d+)?"," ","encoder or encoderN, 1 <= N <= 100. The default values of encoderN are set to encoder"}
+                {"encoder(\\d+)?"," ","encoder or encoderN, 1 <= N <= 100. The default values of encoderN are set to encoder"},
+                {"binary_meta","0","Write frame properties in a compact binary form. Requires a reader from this version or later."},
+                {"checkpoints","0","Periodically write the index so far, letting readers quickly recover the index of a recording which was never closed. Requires a reader from this version or later."},
+                {"chunk_kb","0","Group frames into checksummed chunks of about this many KB, 0 to disable. Requires a reader from this version or later."},
+                {"chunk_codec","lz4","Compression for chunks: none, lz4 or zstd."},
+                {"chunk_level","0","Codec specific level: acceleration for lz4, compression level for zstd."}
             }};
         }
         std::unique_ptr<VideoOutputInterface> Open(const Uri& uri) override {
@@ -307,9 +322,23 @@ PANGOLIN_REGISTER_FACTORY(PangoVideoOutput)
                 stream_encoder_uris[i] = reader.Get<std::string>(encoder_key, default_encoder);
             }
 
-            return std::unique_ptr<VideoOutputInterface>(
-                new PangoVideoOutput(filename, buffer_size_bytes, stream_encoder_uris)
-            );
+            auto output = std::make_unique<PangoVideoOutput>(filename, buffer_size_bytes, stream_encoder_uris, reader.Get<bool>("binary_meta"), reader.Get<bool>("checkpoints"));
+
+            const size_t chunk_bytes = reader.Get<size_t>("chunk_kb") * 1024;
+            if(chunk_bytes) {
+                const std::string codec = reader.Get<std::string>("chunk_codec");
+                PacketChunkCodec chunk_codec = PacketChunkCodec::None;
+                if(codec == "lz4") {
+                    chunk_codec = PacketChunkCodec::LZ4;
+                }else if(codec == "zstd") {
+                    chunk_codec = PacketChunkCodec::Zstd;
+                }else if(codec != "none") {
+                    throw VideoException("Unknown chunk_codec '" + codec + "'");
+                }
+                output->SetChunking(chunk_bytes, chunk_codec, reader.Get<int>("chunk_level"));
+            }
+
+            return output;
         }
     };
 
@@ -0,0 +1,154 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Copyright (c) 2013 Steven Lovegrove
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <pangolin/video/drivers/profile.h>
+#include <pangolin/factory/factory_registry.h>
+#include <pangolin/video/iostream_operators.h>
+#include <pangolin/video/video.h>
+#include <pangolin/utils/timer.h>
+
+namespace pangolin
+{
+
+ProfileVideo::ProfileVideo(std::unique_ptr<VideoInterface>& src_, const std::string& stage_name)
+    : src(std::move(src_)), stage_name(stage_name)
+{
+    videoin.push_back(src.get());
+}
+
+ProfileVideo::~ProfileVideo()
+{
+}
+
+size_t ProfileVideo::SizeBytes() const
+{
+    return videoin[0]->SizeBytes();
+}
+
+const std::vector<StreamInfo>& ProfileVideo::Streams() const
+{
+    return videoin[0]->Streams();
+}
+
+void ProfileVideo::Start()
+{
+    videoin[0]->Start();
+}
+
+void ProfileVideo::Stop()
+{
+    videoin[0]->Stop();
+}
+
+void ProfileVideo::RecordFrame(int64_t grab_us)
+{
+    frame_properties = GetVideoFrameProperties(videoin[0]);
+    if(!frame_properties.is<picojson::object>()) {
+        frame_properties = picojson::value(picojson::object_type, true);
+    }
+
+    picojson::value stage;
+    stage["stage"] = picojson::value(stage_name);
+    stage["grab_us"] = picojson::value(grab_us);
+    stage["bytes"] = picojson::value((int64_t)SizeBytes());
+
+    if(!frame_properties.contains("profile")) {
+        frame_properties["profile"] = picojson::value(picojson::array_type, true);
+    }
+    frame_properties["profile"].push_back(stage);
+}
+
+bool ProfileVideo::GrabNext( unsigned char* image, bool wait )
+{
+    const basetime start = TimeNow();
+    const bool success = videoin[0]->GrabNext(image, wait);
+    if(success) {
+        RecordFrame(TimeDiff_us(start, TimeNow()));
+    }
+    return success;
+}
+
+bool ProfileVideo::GrabNewest( unsigned char* image, bool wait )
+{
+    const basetime start = TimeNow();
+    const bool success = videoin[0]->GrabNewest(image, wait);
+    if(success) {
+        RecordFrame(TimeDiff_us(start, TimeNow()));
+    }
+    return success;
+}
+
+std::vector<VideoInterface*>& ProfileVideo::InputStreams()
+{
+    return videoin;
+}
+
+const picojson::value& ProfileVideo::DeviceProperties() const
+{
+    device_properties = GetVideoDeviceProperties(videoin[0]);
+    return device_properties;
+}
+
+const picojson::value& ProfileVideo::FrameProperties() const
+{
+    return frame_properties;
+}
+
+PANGOLIN_REGISTER_FACTORY(ProfileVideo)
+{
+    struct ProfileVideoFactory final : public TypedFactoryInterface<VideoInterface> {
+        std::map<std::string,Precedence> Schemes() const override
+        {
+            return {{"profile",10}};
+        }
+        const char* Description() const override
+        {
+            return "Records the time taken to grab each frame from the wrapped video in the frame properties.";
+        }
+        ParamSet Params() const override
+        {
+            return {{
+                {"name","","Name of the profiled stage. Defaults to the scheme of the wrapped video."}
+            }};
+        }
+        std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
+            ParamReader reader(Params(),uri);
+            std::string name = reader.Get<std::string>("name");
+            if(name.empty()) {
+                name = ParseUri(uri.url).scheme;
+            }
+
+            std::unique_ptr<VideoInterface> subvid = pangolin::OpenVideo(uri.url);
+            return std::unique_ptr<VideoInterface>( new ProfileVideo(subvid, name) );
+        }
+    };
+
+    return FactoryRegistry::I()->RegisterFactory<VideoInterface>(std::make_shared<ProfileVideoFactory>());
+}
+
+}
@@ -1,25 +1,98 @@
 #include <pangolin/factory/factory_registry.h>
 #include <pangolin/video/drivers/shared_memory.h>
 #include <pangolin/video/iostream_operators.h>
+#include <pangolin/utils/timer.h>
+
+#include <cstring>
+#include <thread>
 
 using namespace std;
 
 namespace pangolin
 {
 
+size_t SharedMemoryRingHeader::TotalBytes(size_t frame_bytes, size_t num_slots)
+{
+  const size_t header_bytes = (sizeof(SharedMemoryRingHeader) + 63) & ~size_t(63);
+  const size_t slot_bytes = (frame_bytes + 63) & ~size_t(63);
+  return header_bytes + num_slots * slot_bytes;
+}
+
 SharedMemoryVideo::SharedMemoryVideo(size_t w, size_t h, std::string pix_fmt,
     const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory,
     const std::shared_ptr<ConditionVariableInterface>& buffer_full) :
     _fmt(PixelFormatFromString(pix_fmt)),
     _frame_size(w*h*_fmt.bpp/8),
     _shared_memory(shared_memory),
-    _buffer_full(buffer_full)
+    _buffer_full(buffer_full),
+    _ring(nullptr),
+    _next_frame(0),
+    _dropped(0),
+    _frame_properties_dirty(false)
 {
     const size_t pitch = w * _fmt.bpp/8;
     const StreamInfo stream(_fmt, w, h, pitch, 0);
     _streams.push_back(stream);
 }
 
+SharedMemoryVideo::SharedMemoryVideo(
+    const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory,
+    const std::shared_ptr<ConditionVariableInterface>& frame_ready) :
+    _frame_size(0),
+    _shared_memory(shared_memory),
+    _buffer_full(frame_ready),
+    _ring(nullptr),
+    _next_frame(0),
+    _dropped(0),
+    _frame_properties_dirty(false)
+{
+    if(!IsRing(shared_memory)) {
+        throw VideoException("SharedMemoryVideo: shared memory does not contain a frame ring", shared_memory->name());
+    }
+
+    _ring = reinterpret_cast<SharedMemoryRingHeader*>(shared_memory->ptr());
+    if(_ring->version != SharedMemoryRingHeader::kVersion) {
+        throw VideoException("SharedMemoryVideo: unsupported ring version");
+    }
+
+    // The header comes from another process, so check it describes memory we
+    // have actually mapped before trusting any slot or stream within it.
+    const size_t mapped_bytes = shared_memory->size();
+    if(_ring->num_slots == 0 || _ring->num_slots > SharedMemoryRingHeader::kMaxSlots ||
+       _ring->num_streams > SharedMemoryRingHeader::kMaxStreams) {
+        throw VideoException("SharedMemoryVideo: ring header has invalid slot or stream count", shared_memory->name());
+    }
+    if(_ring->frame_bytes > mapped_bytes || _ring->slot_bytes < _ring->frame_bytes ||
+       _ring->data_offset < sizeof(SharedMemoryRingHeader) ||
+       mapped_bytes < SharedMemoryRingHeader::TotalBytes(_ring->frame_bytes, _ring->num_slots) ||
+       _ring->data_offset > mapped_bytes ||
+       (mapped_bytes - _ring->data_offset) / _ring->num_slots < _ring->slot_bytes) {
+        throw VideoException("SharedMemoryVideo: ring does not fit within the shared memory", shared_memory->name());
+    }
+
+    _frame_size = _ring->frame_bytes;
+    for(uint32_t i=0; i < _ring->num_streams; ++i) {
+        const SharedMemoryRingHeader::Stream& s = _ring->streams[i];
+        const std::string fmt(s.fmt, strnlen(s.fmt, sizeof(s.fmt)));
+        const StreamInfo si(PixelFormatFromString(fmt), s.w, s.h, s.pitch, (unsigned char*)0 + s.offset);
+        if(s.h > 0) {
+            // h-1 rows of pitch bytes followed by the last row must fit in the frame
+            const size_t avail = (s.offset <= _frame_size) ? _frame_size - s.offset : 0;
+            if(s.offset > _frame_size || si.RowBytes() > avail ||
+               (s.pitch > 0 && (s.h - 1) > (avail - si.RowBytes()) / s.pitch)) {
+                throw VideoException("SharedMemoryVideo: ring stream lies outside of the frame", shared_memory->name());
+            }
+        }
+        _streams.push_back(si);
+    }
+    _fmt = _streams.empty() ? PixelFormat() : _streams[0].PixFormat();
+
+    // Start with the next frame to be published
+    _next_frame = _ring->published.load(std::memory_order_acquire);
+
+    _device_properties["ring_slots"] = (int64_t)_ring->num_slots;
+}
+
 SharedMemoryVideo::~SharedMemoryVideo()
 {
 }
@@ -42,8 +115,97 @@ const std::vector<StreamInfo>& SharedMemoryVideo::Streams() const
     return _streams;
 }
 
+bool SharedMemoryVideo::IsRing(const std::shared_ptr<SharedMemoryBufferInterface>& shared_memory)
+{
+    if(shared_memory->size() < sizeof(SharedMemoryRingHeader)) {
+        return false;
+    }
+    const SharedMemoryRingHeader* ring = reinterpret_cast<const SharedMemoryRingHeader*>(shared_memory->ptr());
+    return ring && ring->magic.load(std::memory_order_acquire) == SharedMemoryRingHeader::kMagic;
+}
+
+bool SharedMemoryVideo::_ReadSlot(uint64_t frame, unsigned char* image)
+{
+    const size_t slot = frame % _ring->num_slots;
+    const uint64_t expected = 2*frame + 2;
+    if(_ring->slot_seq[slot].load(std::memory_order_acquire) != expected) {
+        return false;
+    }
+
+    const unsigned char* data = _shared_memory->ptr() + _ring->data_offset + slot * _ring->slot_bytes;
+    memcpy(image, data, _frame_size);
+    const int64_t time_us = _ring->slot_time_us[slot];
+
+    // Valid only if the writer didn't start reusing the slot during the copy
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(_ring->slot_seq[slot].load(std::memory_order_relaxed) != expected) {
+        return false;
+    }
+
+    _frame_properties.Clear();
+    _frame_properties.Set(VideoFrameProperties::CaptureTimeUs, time_us);
+    _frame_properties.Set(VideoFrameProperties::HostReceptionTimeUs, Time_us(TimeNow()));
+    _frame_properties.Set(VideoFrameProperties::Sequence, (int64_t)frame);
+    _frame_properties_dirty = true;
+    return true;
+}
+
+void SharedMemoryVideo::_WaitForFrame()
+{
+    if(_buffer_full) {
+        // Timeout guards against missing a broadcast made just before waiting
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 10000000;
+        if(ts.tv_nsec >= 1000000000) {
+            ts.tv_sec += 1;
+            ts.tv_nsec -= 1000000000;
+        }
+        _buffer_full->wait(ts);
+    }else{
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool SharedMemoryVideo::_ReadRing(unsigned char* image, bool wait, bool newest)
+{
+    while(true) {
+        const uint64_t published = _ring->published.load(std::memory_order_acquire);
+
+        if(newest && published > 0 && _next_frame + 1 < published) {
+            _next_frame = published - 1;
+        }
+
+        if(_next_frame < published) {
+            if(published - _next_frame > _ring->num_slots) {
+                // Older frames have already been overwritten
+                const uint64_t oldest = published - _ring->num_slots;
+                _dropped += oldest - _next_frame;
+                _next_frame = oldest;
+            }
+            if(_ReadSlot(_next_frame, image)) {
+                ++_next_frame;
+                return true;
+            }
+            // Overwritten whilst reading
+            ++_dropped;
+            ++_next_frame;
+            continue;
+        }
+
+        if(_ring->closed.load(std::memory_order_acquire) || !wait) {
+            return false;
+        }
+        _WaitForFrame();
+    }
+}
+
 bool SharedMemoryVideo::GrabNext(unsigned char* image, bool wait)
 {
+    if(_ring) {
+        return _ReadRing(image, wait, false);
+    }
+
     // If a condition variable exists, try waiting on it.
     if(_buffer_full) {
         timespec ts;
@@ -66,9 +228,36 @@ bool SharedMemoryVideo::GrabNext(unsigned char* image, bool wait)
 
 bool SharedMemoryVideo::GrabNewest(unsigned char* image, bool wait)
 {
+    if(_ring) {
+        return _ReadRing(image, wait, true);
+    }
     return GrabNext(image,wait);
 }
 
+const picojson::value& SharedMemoryVideo::DeviceProperties() const
+{
+    return _device_properties;
+}
+
+const picojson::value& SharedMemoryVideo::FrameProperties() const
+{
+    if(_frame_properties_dirty) {
+        _frame_properties_json = _frame_properties.Json();
+        _frame_properties_dirty = false;
+    }
+    return _frame_properties_json;
+}
+
+VideoFrameProperties SharedMemoryVideo::TypedFrameProperties() const
+{
+    return _frame_properties;
+}
+
+uint64_t SharedMemoryVideo::FramesDropped() const
+{
+    return _dropped;
+}
+
 PANGOLIN_REGISTER_FACTORY(SharedMemoryVideo)
 {
     struct SharedMemoryVideoFactory final : public TypedFactoryInterface<VideoInterface> {
@@ -78,13 +267,13 @@ PANGOLIN_REGISTER_FACTORY(SharedMemoryVideo)
         }
         const char* Description() const override
         {
-            return "Stream from posix shared memory";
+            return "Stream from posix shared memory, either a ring written by the shmem output or a single frame buffer";
         }
         ParamSet Params() const override
         {
             return {{
-                {"fmt","RGB24","Pixel format: see pixel format help for all possible values"},
-                {"size","640x480","Image dimension"}
+                {"fmt","RGB24","Pixel format: see pixel format help for all possible values. Ignored for rings."},
+                {"size","640x480","Image dimension. Ignored for rings."}
             }};
         }
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
@@ -94,7 +283,7 @@ PANGOLIN_REGISTER_FACTORY(SharedMemoryVideo)
             const std::string shmem_name = std::string("/") + uri.url;
             std::shared_ptr<SharedMemoryBufferInterface> shmem_buffer =
                 open_named_shared_memory_buffer(shmem_name, true);
-            if (dim.x == 0 || dim.y == 0 || !shmem_buffer) {
+            if (!shmem_buffer) {
                 throw VideoException("invalid shared memory parameters");
             }
 
@@ -102,6 +291,16 @@ PANGOLIN_REGISTER_FACTORY(SharedMemoryVideo)
             std::shared_ptr<ConditionVariableInterface> buffer_full =
                 open_named_condition_variable(cond_name);
 
+            if (SharedMemoryVideo::IsRing(shmem_buffer)) {
+                return std::unique_ptr<VideoInterface>(
+                    new SharedMemoryVideo(shmem_buffer, buffer_full)
+                );
+            }
+
+            if (dim.x == 0 || dim.y == 0) {
+                throw VideoException("invalid shared memory parameters");
+            }
+
             return std::unique_ptr<VideoInterface>(
                 new SharedMemoryVideo(dim.x, dim.y, fmt, shmem_buffer,buffer_full)
             );
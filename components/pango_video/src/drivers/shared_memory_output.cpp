@@ -0,0 +1,170 @@
+#include <pangolin/factory/factory_registry.h>
+#include <pangolin/video/drivers/shared_memory_output.h>
+#include <pangolin/video/video_exception.h>
+#include <pangolin/utils/timer.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace pangolin
+{
+
+SharedMemoryVideoOutput::SharedMemoryVideoOutput(const std::string& name, size_t num_slots) :
+    _name(name),
+    _num_slots(num_slots),
+    _ring(nullptr),
+    _frame(0),
+    _acquired(false)
+{
+    if(_num_slots < 2 || _num_slots > SharedMemoryRingHeader::kMaxSlots) {
+        throw VideoException(FormatString("SharedMemoryVideoOutput: slots must be between 2 and %", SharedMemoryRingHeader::kMaxSlots));
+    }
+}
+
+SharedMemoryVideoOutput::~SharedMemoryVideoOutput()
+{
+    if(_ring) {
+        // Readers still attached see the end of the stream
+        _ring->closed.store(1, std::memory_order_release);
+        _frame_ready->broadcast();
+    }
+}
+
+const std::vector<StreamInfo>& SharedMemoryVideoOutput::Streams() const
+{
+    return _streams;
+}
+
+void SharedMemoryVideoOutput::SetStreams(const std::vector<StreamInfo>& streams, const std::string& /*uri*/, const picojson::value& /*properties*/)
+{
+    if(_ring) {
+        throw VideoException("SharedMemoryVideoOutput: streams already set");
+    }
+    if(streams.empty() || streams.size() > SharedMemoryRingHeader::kMaxStreams) {
+        throw VideoException(FormatString("SharedMemoryVideoOutput: between 1 and % streams supported", SharedMemoryRingHeader::kMaxStreams));
+    }
+
+    _streams = streams;
+    size_t frame_bytes = 0;
+    for(const StreamInfo& s : _streams) {
+        frame_bytes = std::max(frame_bytes, (size_t)s.Offset() + s.SizeBytes());
+    }
+
+    const std::string shmem_name = "/" + _name;
+    _shared_memory = create_named_shared_memory_buffer(shmem_name, SharedMemoryRingHeader::TotalBytes(frame_bytes, _num_slots));
+    _frame_ready = create_named_condition_variable(shmem_name + "_cond");
+    if(!_shared_memory || !_frame_ready) {
+        throw VideoException("SharedMemoryVideoOutput: unable to create shared memory", shmem_name);
+    }
+
+    // The memory may be left over from an earlier writer of the same name,
+    // so invalidate the header before resetting the ring to empty.
+    _ring = reinterpret_cast<SharedMemoryRingHeader*>(_shared_memory->ptr());
+    _ring->magic.store(0, std::memory_order_release);
+    _ring->published.store(0, std::memory_order_relaxed);
+    _ring->closed.store(0, std::memory_order_relaxed);
+    for(size_t i=0; i < SharedMemoryRingHeader::kMaxSlots; ++i) {
+        _ring->slot_seq[i].store(0, std::memory_order_relaxed);
+        _ring->slot_time_us[i] = 0;
+    }
+    _ring->version = SharedMemoryRingHeader::kVersion;
+    _ring->num_slots = (uint32_t)_num_slots;
+    _ring->frame_bytes = frame_bytes;
+    _ring->slot_bytes = (frame_bytes + 63) & ~size_t(63);
+    _ring->data_offset = (sizeof(SharedMemoryRingHeader) + 63) & ~size_t(63);
+    _ring->num_streams = (uint32_t)_streams.size();
+    for(size_t i=0; i < _streams.size(); ++i) {
+        SharedMemoryRingHeader::Stream& s = _ring->streams[i];
+        const std::string fmt = _streams[i].PixFormat().format;
+        if(fmt.size() >= sizeof(s.fmt)) {
+            throw VideoException("SharedMemoryVideoOutput: pixel format name too long", fmt);
+        }
+        std::strncpy(s.fmt, fmt.c_str(), sizeof(s.fmt));
+        s.w = (uint32_t)_streams[i].Width();
+        s.h = (uint32_t)_streams[i].Height();
+        s.pitch = _streams[i].Pitch();
+        s.offset = (uint64_t)_streams[i].Offset();
+    }
+    _ring->magic.store(SharedMemoryRingHeader::kMagic, std::memory_order_release);
+}
+
+unsigned char* SharedMemoryVideoOutput::AcquireFrame()
+{
+    if(!_ring) {
+        throw VideoException("SharedMemoryVideoOutput: SetStreams() must be called first");
+    }
+
+    const size_t slot = _frame % _num_slots;
+    if(!_acquired) {
+        // Mark slot as being written so that readers discard partial copies
+        _ring->slot_seq[slot].store(2*_frame + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _acquired = true;
+    }
+    return _shared_memory->ptr() + _ring->data_offset + slot * _ring->slot_bytes;
+}
+
+int SharedMemoryVideoOutput::PublishFrame(int64_t capture_time_us)
+{
+    if(!_acquired) {
+        throw VideoException("SharedMemoryVideoOutput: no frame acquired");
+    }
+
+    const size_t slot = _frame % _num_slots;
+    _ring->slot_time_us[slot] = capture_time_us >= 0 ? capture_time_us : Time_us(TimeNow());
+    _ring->slot_seq[slot].store(2*_frame + 2, std::memory_order_release);
+    _ring->published.store(_frame + 1, std::memory_order_release);
+    _acquired = false;
+    _frame_ready->broadcast();
+    return (int)_frame++;
+}
+
+int SharedMemoryVideoOutput::WriteStreams(const unsigned char* data, const picojson::value& frame_properties)
+{
+    unsigned char* slot = AcquireFrame();
+    std::memcpy(slot, data, _ring->frame_bytes);
+
+    int64_t capture_time_us = -1;
+    if(frame_properties.contains(PANGO_CAPTURE_TIME_US)) {
+        capture_time_us = frame_properties[PANGO_CAPTURE_TIME_US].get<int64_t>();
+    }
+    return PublishFrame(capture_time_us);
+}
+
+bool SharedMemoryVideoOutput::IsPipe() const
+{
+    return true;
+}
+
+PANGOLIN_REGISTER_FACTORY(SharedMemoryVideoOutput)
+{
+    struct SharedMemoryVideoOutputFactory final : public TypedFactoryInterface<VideoOutputInterface> {
+        std::map<std::string,Precedence> Schemes() const override
+        {
+            return {{"shmem",10}};
+        }
+        const char* Description() const override
+        {
+            return "Publish frames to a ring in posix shared memory for local readers using shmem://name";
+        }
+        ParamSet Params() const override
+        {
+            return {{
+                {"slots","4","Number of frames in the ring. Readers more than this many frames behind drop frames."}
+            }};
+        }
+        std::unique_ptr<VideoOutputInterface> Open(const Uri& uri) override {
+            ParamReader reader(Params(), uri);
+            if(uri.url.empty()) {
+                throw VideoException("SharedMemoryVideoOutput: shared memory name required");
+            }
+            return std::unique_ptr<VideoOutputInterface>(
+                new SharedMemoryVideoOutput(uri.url, reader.Get<size_t>("slots"))
+            );
+        }
+    };
+
+    return FactoryRegistry::I()->RegisterFactory<VideoOutputInterface>(std::make_shared<SharedMemoryVideoOutputFactory>());
+}
+
+}
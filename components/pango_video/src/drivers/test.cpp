@@ -29,27 +29,213 @@
 #include <pangolin/factory/factory_registry.h>
 #include <pangolin/video/iostream_operators.h>
 
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
 namespace pangolin
 {
 
-void setRandomData(unsigned char * arr, size_t size){
-  for(size_t i = 0 ; i < size;i++) {
-//      arr[i] = (unsigned char)(i * 255.0 / size);
-      arr[i] = (unsigned char)(rand()/(RAND_MAX/255.0));
-  }
+namespace
+{
+
+uint64_t SplitMix64(uint64_t& x)
+{
+    uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Fill with reproducible white noise, 8 bytes at a time
+void setRandomData(unsigned char * arr, size_t size, uint64_t key)
+{
+    uint64_t state = SplitMix64(key) | 1;
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        // xorshift64*
+        state ^= state >> 12; state ^= state << 25; state ^= state >> 27;
+        const uint64_t r = state * 0x2545F4914F6CDD1Dull;
+        std::memcpy(arr + i, &r, sizeof(uint64_t));
+    }
+    for(; i < size; ++i) {
+        arr[i] = (unsigned char)SplitMix64(state);
+    }
+}
+
+bool IsFloatFormat(const PixelFormat& fmt)
+{
+    return fmt.format.back() == 'F';
+}
+
+// Formats whose pixels we know how to write from a colour
+bool CanRender(const PixelFormat& fmt)
+{
+    if(fmt.planar || fmt.channels == 0) return false;
+    for(unsigned int c=1; c < fmt.channels; ++c) {
+        if(fmt.channel_bits[c] != fmt.channel_bits[0]) return false;
+    }
+    const unsigned int bits = fmt.channel_bits[0];
+    if(IsFloatFormat(fmt)) {
+        return bits == 32 || bits == 64;
+    }else if(bits == 10 || bits == 12) {
+        return fmt.channels == 1;
+    }
+    return bits == 8 || bits == 16 || bits == 32;
 }
 
-TestVideo::TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt)
+// Write normalised value v to channel c of pixel x in row
+void WriteSample(unsigned char* row, size_t x, size_t c, const PixelFormat& fmt, double v)
+{
+    const size_t index = x * fmt.channels + c;
+    const unsigned int bits = fmt.channel_bits[0];
+    v = std::min(std::max(v, 0.0), 1.0);
+
+    if(IsFloatFormat(fmt)) {
+        if(bits == 32) {
+            ((float*)row)[index] = (float)v;
+        }else{
+            ((double*)row)[index] = v;
+        }
+    }else if(bits == 8) {
+        row[index] = (uint8_t)std::lround(v * 255.0);
+    }else if(bits == 16) {
+        ((uint16_t*)row)[index] = (uint16_t)std::lround(v * ((1u << fmt.channel_bit_depth) - 1));
+    }else if(bits == 32) {
+        ((uint32_t*)row)[index] = (uint32_t)std::llround(v * 4294967295.0);
+    }else{
+        // Little endian bit packing, as expected by UnpackVideo
+        const uint32_t val = (uint32_t)std::lround(v * ((1u << bits) - 1));
+        size_t bit = index * bits;
+        for(unsigned int i=0; i < bits; ++i, ++bit) {
+            if((val >> i) & 1) row[bit/8] |= (unsigned char)(1u << (bit%8));
+        }
+    }
+}
+
+}
+
+TestVideo::TestVideo(size_t w, size_t h, size_t n, std::string pix_fmt,
+                     const std::string& pattern, double fps,
+                     uint64_t seed, const std::string& bayer)
+    : pattern(pattern), bayer(bayer), seed(seed),
+      rendered_pitch(0), period_px(0), step_px(1),
+      frame_index(0), frame_period(0), started(false),
+      frame_properties_dirty(false)
 {
     const PixelFormat pfmt = PixelFormatFromString(pix_fmt);
 
     size_bytes = 0;
 
     for(size_t c=0; c < n; ++c) {
-        const StreamInfo stream_info(pfmt, w, h, (w*pfmt.bpp)/8, 0);
+        const StreamInfo stream_info(pfmt, w, h, (w*pfmt.bpp)/8, (unsigned char*)size_bytes);
         streams.push_back(stream_info);
         size_bytes += w*h*(pfmt.bpp)/8;
     }
+
+    if(pattern != "noise" && pattern != "gradient" && pattern != "checker" && pattern != "bar") {
+        throw VideoException("Unknown test pattern '" + pattern + "'", "Use one of noise, gradient, checker or bar");
+    }
+    if(pattern != "noise" && !CanRender(pfmt)) {
+        throw VideoException("Test pattern '" + pattern + "' not supported for format " + pfmt.format, "Use the noise pattern");
+    }
+    if(!bayer.empty() && (bayer.size() != 4 || pfmt.channels != 1)) {
+        throw VideoException("Bayer mosaic requires a single channel format and a pattern such as RGGB");
+    }
+
+    if(fps > 0.0) {
+        frame_period = std::chrono::duration_cast<basetime::duration>(std::chrono::duration<double>(1.0 / fps));
+    }
+
+    device_properties["pattern"] = picojson::value(pattern);
+    device_properties["fps"] = picojson::value(fps);
+    device_properties["seed"] = picojson::value((int64_t)seed);
+    device_properties[PANGO_HAS_TIMING_DATA] = true;
+    if(!bayer.empty()) {
+        device_properties["bayer"] = picojson::value(bayer);
+    }
+
+    if(pattern != "noise" && n > 0) {
+        // Smallest horizontal shift which keeps packed pixels byte aligned and
+        // the colour filter array in phase.
+        step_px = 8 / std::gcd(pfmt.bpp, 8u);
+        if(!bayer.empty()) step_px = std::lcm(step_px, (size_t)2);
+        RenderPattern();
+    }
+}
+
+void TestVideo::RenderPattern()
+{
+    const StreamInfo& si = streams[0];
+    const PixelFormat& fmt = si.PixFormat();
+    const size_t w = si.Width();
+    const size_t h = si.Height();
+
+    const size_t period = (pattern == "checker") ? 64 : w;
+    period_px = ((period + step_px - 1) / step_px) * step_px;
+
+    const size_t rendered_w = w + period_px;
+    rendered_pitch = (rendered_w * fmt.bpp + 7) / 8;
+    rendered.assign(rendered_pitch * h, 0);
+
+    const bool bgr = fmt.format[0] == 'B';
+    const bool alpha_first = fmt.format[0] == 'A';
+
+    for(size_t y=0; y < h; ++y) {
+        unsigned char* row = rendered.data() + y * rendered_pitch;
+        for(size_t x=0; x < rendered_w; ++x) {
+            const size_t px = x % period_px;
+            double rgb[3];
+            if(pattern == "gradient") {
+                const double t = double(px) / period_px;
+                rgb[0] = t;
+                rgb[1] = double(y) / std::max<size_t>(h-1, 1);
+                rgb[2] = 1.0 - t;
+            }else{
+                const bool on = (pattern == "checker")
+                    ? (((px / 32) + (y / 32)) & 1)
+                    : (px < std::max<size_t>(period_px / 8, 1));
+                rgb[0] = rgb[1] = rgb[2] = on ? 0.9 : 0.1;
+            }
+
+            for(size_t c=0; c < fmt.channels; ++c) {
+                double v;
+                if(fmt.channels <= 2) {
+                    if(c == 1) {
+                        v = 1.0;
+                    }else if(!bayer.empty()) {
+                        const char filter = bayer[(y % 2) * 2 + (x % 2)];
+                        v = rgb[filter == 'R' ? 0 : (filter == 'G' ? 1 : 2)];
+                    }else{
+                        v = (rgb[0] + rgb[1] + rgb[2]) / 3.0;
+                    }
+                }else if(alpha_first) {
+                    v = (c == 0) ? 1.0 : rgb[3 - c];
+                }else{
+                    v = (c == 3) ? 1.0 : rgb[bgr ? 2 - c : c];
+                }
+                WriteSample(row, x, c, fmt, v);
+            }
+        }
+    }
+}
+
+void TestVideo::FillFrame(unsigned char* image)
+{
+    for(size_t s=0; s < streams.size(); ++s) {
+        const StreamInfo& si = streams[s];
+        unsigned char* dst = image + (size_t)si.Offset();
+
+        if(rendered.empty()) {
+            setRandomData(dst, si.SizeBytes(), seed ^ (uint64_t(s) << 48) ^ (uint64_t(frame_index) * 0xD1B54A32D192ED03ull));
+        }else{
+            const size_t offset_bytes = ((frame_index * step_px) % period_px) * si.PixFormat().bpp / 8;
+            const size_t row_bytes = std::min(si.Pitch(), rendered_pitch - offset_bytes);
+            for(size_t r=0; r < si.Height(); ++r) {
+                std::memcpy(dst + r*si.Pitch(), rendered.data() + r*rendered_pitch + offset_bytes, row_bytes);
+            }
+        }
+    }
 }
 
 TestVideo::~TestVideo()
@@ -82,18 +268,66 @@ const std::vector<StreamInfo>& TestVideo::Streams() const
 }
 
 //! Implement VideoInput::GrabNext()
-bool TestVideo::GrabNext( unsigned char* image, bool /*wait*/ )
+bool TestVideo::GrabNext( unsigned char* image, bool wait )
 {
-    setRandomData(image, size_bytes);
+    const basetime now = TimeNow();
+    if(!started) {
+        start_time = now;
+        started = true;
+    }
+
+    basetime capture_time = now;
+    if(frame_period.count()) {
+        capture_time = start_time + frame_index * frame_period;
+        if(capture_time > now) {
+            if(!wait) {
+                return false;
+            }
+            WaitUntil(capture_time);
+        }
+    }
+
+    FillFrame(image);
+
+    frame_properties.Set(VideoFrameProperties::CaptureTimeUs, Time_us(capture_time));
+    frame_properties.Set(VideoFrameProperties::EstimatedCenterCaptureTimeUs, Time_us(capture_time));
+    frame_properties.Set(VideoFrameProperties::HostReceptionTimeUs, Time_us(TimeNow()));
+    frame_properties.Set(VideoFrameProperties::FrameIndex, (int64_t)frame_index);
+    frame_properties_dirty = true;
+    ++frame_index;
     return true;
 }
 
 //! Implement VideoInput::GrabNewest()
 bool TestVideo::GrabNewest( unsigned char* image, bool wait )
 {
+    if(frame_period.count() && started) {
+        // Skip frames which would already have been delivered
+        const size_t latest = (size_t)((TimeNow() - start_time) / frame_period);
+        frame_index = std::max(frame_index, latest);
+    }
     return GrabNext(image,wait);
 }
 
+const picojson::value& TestVideo::DeviceProperties() const
+{
+    return device_properties;
+}
+
+const picojson::value& TestVideo::FrameProperties() const
+{
+    if(frame_properties_dirty) {
+        frame_properties_json = frame_properties.Json();
+        frame_properties_dirty = false;
+    }
+    return frame_properties_json;
+}
+
+VideoFrameProperties TestVideo::TypedFrameProperties() const
+{
+    return frame_properties;
+}
+
 PANGOLIN_REGISTER_FACTORY(TestVideo)
 {
     struct TestVideoFactory final : public TypedFactoryInterface<VideoInterface> {
@@ -103,14 +337,18 @@ PANGOLIN_REGISTER_FACTORY(TestVideo)
         }
         const char* Description() const override
         {
-            return "A test video feed with pixel-wise white noise.";
+            return "A deterministic test video feed of white noise or moving test patterns.";
         }
         ParamSet Params() const override
         {
             return {{
                 {"size","640x480","Image dimension"},
                 {"n","1","Number of streams"},
-                {"fmt","RGB24","Pixel format: see pixel format help for all possible values"}
+                {"fmt","RGB24","Pixel format: see pixel format help for all possible values"},
+                {"pattern","noise","One of noise, gradient, checker or bar. Patterns other than noise scroll horizontally."},
+                {"fps","0","Frame rate to deliver frames at, or 0 to deliver them as fast as possible"},
+                {"seed","0","Seed for the noise pattern"},
+                {"bayer","","Colour filter array (e.g. RGGB) to render single channel formats as a bayer mosaic"}
             }};
         }
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
@@ -118,7 +356,11 @@ PANGOLIN_REGISTER_FACTORY(TestVideo)
             const ImageDim dim = reader.Get<ImageDim>("size");
             const int n = reader.Get<int>("n");
             std::string fmt  = reader.Get<std::string>("fmt");
-            return std::unique_ptr<VideoInterface>(new TestVideo(dim.x,dim.y,n,fmt));
+            const std::string pattern = reader.Get<std::string>("pattern");
+            const double fps = reader.Get<double>("fps");
+            const uint64_t seed = reader.Get<uint64_t>("seed");
+            const std::string bayer = reader.Get<std::string>("bayer");
+            return std::unique_ptr<VideoInterface>(new TestVideo(dim.x,dim.y,n,fmt,pattern,fps,seed,bayer));
         }
     };
 
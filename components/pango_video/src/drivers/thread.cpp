@@ -48,7 +48,8 @@ const uint64_t grab_fail_thread_sleep_us = 1000;
 const uint64_t capture_timout_ms = 5000;
 
 ThreadVideo::ThreadVideo(std::unique_ptr<VideoInterface> &src_, size_t num_buffers, const std::string& name)
-    : src(std::move(src_)), quit_grab_thread(true), thread_name(name)
+    : src(std::move(src_)), quit_grab_thread(true), thread_name(name),
+      frame_properties_dirty(false)
 {
     if(!src) {
         throw VideoException("ThreadVideo: VideoInterface in must not be null");
@@ -110,6 +111,15 @@ const picojson::value& ThreadVideo::DeviceProperties() const
 }
 
 const picojson::value& ThreadVideo::FrameProperties() const
+{
+    if(frame_properties_dirty) {
+        frame_properties_json = frame_properties.Json();
+        frame_properties_dirty = false;
+    }
+    return frame_properties_json;
+}
+
+VideoFrameProperties ThreadVideo::TypedFrameProperties() const
 {
     return frame_properties;
 }
@@ -160,6 +170,7 @@ bool ThreadVideo::GrabNext( unsigned char* image, bool wait )
             const size_t buffer_size = videoin[0]->SizeBytes();
             std::memcpy(image, grab.buffer.get(), buffer_size);
             frame_properties = grab.frame_properties;
+            frame_properties_dirty = true;
         }else{
             DBGPRINT("GrabNext returned false")
         }
@@ -197,6 +208,7 @@ bool ThreadVideo::GrabNewest( unsigned char* image, bool wait )
         if(success) {
             std::memcpy(image, grab.buffer.get(), videoin[0]->SizeBytes());
             frame_properties = grab.frame_properties;
+            frame_properties_dirty = true;
         }
         queue.returnOrAddUsedBuffer(std::move(grab));
         TGRABANDPRINT("GrabNewest memcpy of available frame took")
@@ -235,7 +247,7 @@ void ThreadVideo::operator()()
             }
 
             if(grab.return_status){
-                grab.frame_properties = GetVideoFrameProperties(videoin[0]);
+                grab.frame_properties = GetTypedVideoFrameProperties(videoin[0]);
             }else{
                 std::this_thread::sleep_for(std::chrono::microseconds(grab_fail_thread_sleep_us) );
             }
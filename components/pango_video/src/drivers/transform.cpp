@@ -30,20 +30,32 @@
 #include <pangolin/video/iostream_operators.h>
 #include <pangolin/video/video.h>
 
+#include <algorithm>
+#include <cstring>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 namespace pangolin
 {
 
 
-TransformVideo::TransformVideo(std::unique_ptr<VideoInterface>& src, const std::vector<TransformOptions>& flips)
-    : videoin(std::move(src)), flips(flips), size_bytes(0),buffer(0)
+TransformVideo::TransformVideo(std::unique_ptr<VideoInterface>& src, const std::vector<TransformOptions>& flips, size_t num_threads)
+    : videoin(std::move(src)), flips(flips), size_bytes(0),buffer(0), num_threads(num_threads),
+      bands_out(nullptr), bands_in(nullptr), next_band(0), bands_done(0), quit_workers(false)
 {
     if(!videoin) {
         throw VideoException("TransformVideo: VideoInterface in must not be null");
     }
 
+    if(this->num_threads == 0) {
+        this->num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
     inputs.push_back(videoin.get());
 
     for(size_t i=0;i<videoin->Streams().size();i++)
@@ -70,13 +82,49 @@ TransformVideo::TransformVideo(std::unique_ptr<VideoInterface>& src, const std::
 
     size_bytes = videoin->SizeBytes();
     buffer = new unsigned char[size_bytes];
+
+    try {
+        for(size_t i=1; i < this->num_threads; ++i) {
+            workers.emplace_back(&TransformVideo::WorkerLoop, this);
+        }
+    }catch(...) {
+        StopWorkers();
+        delete[] buffer;
+        throw;
+    }
 }
 
 TransformVideo::~TransformVideo()
 {
+    StopWorkers();
     delete[] buffer;
 }
 
+void TransformVideo::WorkerLoop()
+{
+    std::unique_lock<std::mutex> l(work_lock);
+    while(!quit_workers) {
+        if(next_band < bands.size()) {
+            ProcessBands(l);
+        }else{
+            work_cond.wait(l);
+        }
+    }
+}
+
+void TransformVideo::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> l(work_lock);
+        quit_workers = true;
+    }
+    work_cond.notify_all();
+    for(std::thread& t : workers) {
+        t.join();
+    }
+    workers.clear();
+}
+
 //! Implement VideoInput::Start()
 void TransformVideo::Start()
 {
@@ -101,377 +149,362 @@ const std::vector<StreamInfo>& TransformVideo::Streams() const
     return streams;
 }
 
-void PitchedImageCopy(
-    Image<unsigned char>& img_out,
-    const Image<unsigned char>& img_in,
-    size_t bytes_per_pixel
-) {
-    if( img_out.w != img_in.w || img_out.h != img_in.h ) {
-        throw std::runtime_error("PitchedImageCopy: Incompatible image sizes");
-    }
+namespace
+{
 
-    for(size_t y=0; y < img_out.h; ++y) {
-        std::memcpy(img_out.RowPtr((int)y), img_in.RowPtr((int)y), bytes_per_pixel * img_in.w);
+// Image with a signed pitch so that rows can be walked bottom to top
+struct Plane
+{
+    Plane(const Image<unsigned char>& img, bool flip_rows)
+        : ptr(flip_rows && img.h ? img.ptr + (img.h-1) * img.pitch : img.ptr),
+          pitch(flip_rows ? -(ptrdiff_t)img.pitch : (ptrdiff_t)img.pitch),
+          w(img.w), h(img.h)
+    {
     }
-}
 
-void FlipY(
-    Image<unsigned char>& img_out,
-    const Image<unsigned char>& img_in,
-    size_t bytes_per_pixel
-) {
-    if( img_out.w != img_in.w || img_out.h != img_in.h ) {
-        throw std::runtime_error("FlipY: Incompatible image sizes");
+    unsigned char* Row(size_t y) const
+    {
+        return ptr + (ptrdiff_t)y * pitch;
     }
 
-    for(size_t y_out=0; y_out < img_out.h; ++y_out) {
-        const size_t y_in = (img_in.h-1) - y_out;
-        std::memcpy(img_out.RowPtr((int)y_out), img_in.RowPtr((int)y_in), bytes_per_pixel * img_in.w);
-    }
-}
+    unsigned char* ptr;
+    ptrdiff_t pitch;
+    size_t w;
+    size_t h;
+};
 
-template <typename T>
-void ChainSwap2(T& a, T& b)
-{
-    T t = a;
-    a = b;
-    b = t;
-}
+template<size_t BPP> struct PixelType { struct type { unsigned char d[BPP]; }; };
+template<> struct PixelType<1> { typedef uint8_t type; };
+template<> struct PixelType<2> { typedef uint16_t type; };
+template<> struct PixelType<4> { typedef uint32_t type; };
+template<> struct PixelType<8> { typedef uint64_t type; };
 
-template <typename T>
-void ChainSwap4(T& a, T& b, T& c, T& d)
+// In-register transpose of a KxK block of BPP byte pixels, where K*BPP is
+// the SIMD width (or 8 bytes for BPP=1). Available is false where no SIMD
+// version exists.
+template<size_t BPP> struct BlockTranspose
 {
-    T t = a;
-    a = b;
-    b = c;
-    c = d;
-    d = t;
-}
+    static constexpr bool Available = false;
+    static constexpr size_t K = 1;
+    static void Run(unsigned char*, ptrdiff_t, const unsigned char*, ptrdiff_t) {}
+};
 
-template <size_t BPP, size_t TSZ>
-void TiledFlipX(Image<unsigned char>& img_out, const Image<unsigned char>& img_in)
+// Reverse the order of the pixels in a 16 byte register
+template<size_t BPP> struct BlockReverse
 {
-    const size_t w = img_in.w;
-    const size_t h = img_in.h;
-
-    typedef struct
-    {
-        unsigned char d[BPP];
-    } T;
-    T d[TSZ][TSZ];
-
-    for(size_t xin = 0; xin < w; xin += TSZ)
-        for(size_t yin = 0; yin < h; yin += TSZ)
-        {
-            const size_t xspan = std::min(TSZ, w - xin);
-            const size_t yspan = std::min(TSZ, h - yin);
-            const size_t xout = w - xin - TSZ;
-            const size_t yout = yin;
-
-            for(size_t y = 0; y < yspan; y++)
-                memcpy(d[y], img_in.RowPtr(yin + y) + xin * BPP, xspan * BPP);
+    static constexpr bool Available = false;
+    static constexpr size_t K = 1;
+    static void Run(unsigned char*, const unsigned char*) {}
+};
 
-            for(size_t y = 0; y < TSZ; y++)
-                for(size_t x = 0; x < TSZ / 2; x++)
-                    ChainSwap2(d[y][x], d[y][TSZ - 1 - x]);
+#ifdef __SSE2__
+inline __m128i Load(const unsigned char* p) { return _mm_loadu_si128((const __m128i*)p); }
+inline void Store(unsigned char* p, __m128i v) { _mm_storeu_si128((__m128i*)p, v); }
 
-            for(size_t y = 0; y < yspan; y++)
-                memcpy(img_out.RowPtr(yout + y) + (xout + TSZ - xspan) * BPP, d[y] + TSZ - xspan, xspan * BPP);
-        }
-}
-
-template <size_t BPP, size_t TSZ>
-void TiledRotate180(Image<unsigned char>& img_out, const Image<unsigned char>& img_in)
+template<> struct BlockTranspose<1>
 {
-    static_assert(!(TSZ & 1), "Tilesize must be even.");
-
-    const size_t w = img_in.w;
-    const size_t h = img_in.h;
-
-    typedef struct
+    static constexpr bool Available = true;
+    static constexpr size_t K = 8;
+    static void Run(unsigned char* out, ptrdiff_t out_pitch, const unsigned char* in, ptrdiff_t in_pitch)
     {
-        unsigned char d[BPP];
-    } T;
-    T d[TSZ][TSZ];
-
-    for(size_t xin = 0; xin < w; xin += TSZ)
-        for(size_t yin = 0; yin < h; yin += TSZ)
-        {
-            const size_t xspan = std::min(TSZ, w - xin);
-            const size_t yspan = std::min(TSZ, h - yin);
-            const size_t xout = w - xin - TSZ;
-            const size_t yout = h - yin - TSZ;
-
-            for(size_t y = 0; y < yspan; y++)
-                memcpy(d[y], img_in.RowPtr(yin + y) + xin * BPP, xspan * BPP);
-
-            for(size_t y = 0; y < TSZ / 2; y++)
-                for(size_t x = 0; x < TSZ; x++)
-                    ChainSwap2(d[y][x], d[TSZ - 1 - y][TSZ - 1 - x]);
-
-            for(size_t y = TSZ - yspan; y < TSZ; y++)
-                memcpy(img_out.RowPtr(yout + y) + (xout + TSZ - xspan) * BPP, d[y] + TSZ - xspan, xspan * BPP);
+        __m128i r[8];
+        for(int i=0; i < 8; ++i) r[i] = _mm_loadl_epi64((const __m128i*)(in + i*in_pitch));
+        const __m128i a0 = _mm_unpacklo_epi8(r[0], r[1]);
+        const __m128i a1 = _mm_unpacklo_epi8(r[2], r[3]);
+        const __m128i a2 = _mm_unpacklo_epi8(r[4], r[5]);
+        const __m128i a3 = _mm_unpacklo_epi8(r[6], r[7]);
+        const __m128i b0 = _mm_unpacklo_epi16(a0, a1);
+        const __m128i b1 = _mm_unpackhi_epi16(a0, a1);
+        const __m128i b2 = _mm_unpacklo_epi16(a2, a3);
+        const __m128i b3 = _mm_unpackhi_epi16(a2, a3);
+        const __m128i c[4] = {
+            _mm_unpacklo_epi32(b0, b2), _mm_unpackhi_epi32(b0, b2),
+            _mm_unpacklo_epi32(b1, b3), _mm_unpackhi_epi32(b1, b3)
+        };
+        for(int i=0; i < 4; ++i) {
+            _mm_storel_epi64((__m128i*)(out + (2*i+0)*out_pitch), c[i]);
+            _mm_storel_epi64((__m128i*)(out + (2*i+1)*out_pitch), _mm_unpackhi_epi64(c[i], c[i]));
         }
-}
+    }
+};
 
-template <size_t BPP, size_t TSZ>
-void TiledTranspose(Image<unsigned char>& img_out, const Image<unsigned char>& img_in)
+template<> struct BlockTranspose<2>
 {
-    const size_t w = img_in.w;
-    const size_t h = img_in.h;
-
-    typedef struct
+    static constexpr bool Available = true;
+    static constexpr size_t K = 8;
+    static void Run(unsigned char* out, ptrdiff_t out_pitch, const unsigned char* in, ptrdiff_t in_pitch)
     {
-        unsigned char d[BPP];
-    } T;
-    T d[TSZ][TSZ];
-
-    for(size_t xin = 0; xin < w; xin += TSZ)
-        for(size_t yin = 0; yin < h; yin += TSZ)
-        {
-            const size_t xspan = std::min(TSZ, w - xin);
-            const size_t yspan = std::min(TSZ, h - yin);
-            const size_t dmin = std::min(xspan, yspan);
-            const size_t dmax = std::max(xspan, yspan);
-            const size_t xout = yin;
-            const size_t yout = xin;
-
-            for(size_t y = 0; y < yspan; y++)
-                memcpy(d[y], img_in.RowPtr(yin + y) + xin * BPP, xspan * BPP);
-
-            for(size_t x = 0; x < dmin; x++)
-                for(size_t y = x + 1; y < dmax; y++)
-                    ChainSwap2(d[x][y], d[y][x]);
-
-            for(size_t y = 0; y < xspan; y++)
-                memcpy(img_out.RowPtr(yout + y) + xout * BPP, d[y], yspan * BPP);
+        __m128i r[8];
+        for(int i=0; i < 8; ++i) r[i] = Load(in + i*in_pitch);
+        __m128i a[8], b[8];
+        for(int i=0; i < 4; ++i) {
+            a[2*i+0] = _mm_unpacklo_epi16(r[2*i], r[2*i+1]);
+            a[2*i+1] = _mm_unpackhi_epi16(r[2*i], r[2*i+1]);
         }
-}
+        for(int i=0; i < 2; ++i) {
+            b[4*i+0] = _mm_unpacklo_epi32(a[4*i+0], a[4*i+2]);
+            b[4*i+1] = _mm_unpackhi_epi32(a[4*i+0], a[4*i+2]);
+            b[4*i+2] = _mm_unpacklo_epi32(a[4*i+1], a[4*i+3]);
+            b[4*i+3] = _mm_unpackhi_epi32(a[4*i+1], a[4*i+3]);
+        }
+        for(int i=0; i < 4; ++i) {
+            Store(out + (2*i+0)*out_pitch, _mm_unpacklo_epi64(b[i], b[i+4]));
+            Store(out + (2*i+1)*out_pitch, _mm_unpackhi_epi64(b[i], b[i+4]));
+        }
+    }
+};
 
-template <size_t BPP, size_t TSZ>
-void TiledRotateCW(Image<unsigned char>& img_out, const Image<unsigned char>& img_in)
+template<> struct BlockTranspose<4>
 {
-    static_assert(!(TSZ & 1), "Tilesize must be even.");
-
-    const size_t w = img_in.w;
-    const size_t h = img_in.h;
-
-    typedef struct
+    static constexpr bool Available = true;
+    static constexpr size_t K = 4;
+    static void Run(unsigned char* out, ptrdiff_t out_pitch, const unsigned char* in, ptrdiff_t in_pitch)
     {
-        unsigned char d[BPP];
-    } T;
-    T d[TSZ][TSZ];
-
-    for(size_t xin = 0; xin < w; xin += TSZ)
-        for(size_t yin = 0; yin < h; yin += TSZ)
-        {
-            const size_t xspan = std::min(TSZ, w - xin);
-            const size_t yspan = std::min(TSZ, h - yin);
-            const size_t xout = h - yin - TSZ;
-            const size_t yout = xin;
-
-            for(size_t y = 0; y < yspan; y++)
-                memcpy(d[y], img_in.RowPtr(yin + y) + xin * BPP, xspan * BPP);
+        const __m128i r0 = Load(in), r1 = Load(in + in_pitch), r2 = Load(in + 2*in_pitch), r3 = Load(in + 3*in_pitch);
+        const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+        Store(out, _mm_unpacklo_epi64(t0, t1));
+        Store(out + out_pitch, _mm_unpackhi_epi64(t0, t1));
+        Store(out + 2*out_pitch, _mm_unpacklo_epi64(t2, t3));
+        Store(out + 3*out_pitch, _mm_unpackhi_epi64(t2, t3));
+    }
+};
 
-            for(size_t y = 0; y < TSZ / 2; y++)
-                for(size_t x = 0; x < TSZ / 2; x++)
-                    ChainSwap4(d[TSZ - 1 - x][y], d[TSZ - 1 - y][TSZ - 1 - x], d[x][TSZ - 1 - y], d[y][x]);
+template<> struct BlockTranspose<8>
+{
+    static constexpr bool Available = true;
+    static constexpr size_t K = 2;
+    static void Run(unsigned char* out, ptrdiff_t out_pitch, const unsigned char* in, ptrdiff_t in_pitch)
+    {
+        const __m128i r0 = Load(in), r1 = Load(in + in_pitch);
+        Store(out, _mm_unpacklo_epi64(r0, r1));
+        Store(out + out_pitch, _mm_unpackhi_epi64(r0, r1));
+    }
+};
 
-            for(size_t y = 0; y < xspan; y++)
-                memcpy(img_out.RowPtr(yout + y) + (xout + TSZ - yspan) * BPP, d[y] + TSZ - yspan, yspan * BPP);
-        }
+inline __m128i Reverse16(__m128i v)
+{
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0,1,2,3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0,1,2,3));
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(1,0,3,2));
 }
 
-template <size_t BPP, size_t TSZ>
-void TiledRotateCCW(Image<unsigned char>& img_out, const Image<unsigned char>& img_in)
+template<> struct BlockReverse<1>
 {
-    static_assert(!(TSZ & 1), "Tilesize must be even.");
-
-    const size_t w = img_in.w;
-    const size_t h = img_in.h;
-
-    typedef struct
+    static constexpr bool Available = true;
+    static constexpr size_t K = 16;
+    static void Run(unsigned char* out, const unsigned char* in)
     {
-        unsigned char d[BPP];
-    } T;
-    T d[TSZ][TSZ];
+        const __m128i v = Load(in);
+        Store(out, Reverse16(_mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8))));
+    }
+};
 
-    for(size_t xin = 0; xin < w; xin += TSZ)
-        for(size_t yin = 0; yin < h; yin += TSZ)
-        {
-            const size_t xspan = std::min(TSZ, w - xin);
-            const size_t yspan = std::min(TSZ, h - yin);
-            const size_t xout = yin;
-            const size_t yout = w - xin - TSZ;
+template<> struct BlockReverse<2>
+{
+    static constexpr bool Available = true;
+    static constexpr size_t K = 8;
+    static void Run(unsigned char* out, const unsigned char* in)
+    {
+        Store(out, Reverse16(Load(in)));
+    }
+};
 
-            for(size_t y = 0; y < yspan; y++)
-                memcpy(d[y], img_in.RowPtr(yin + y) + xin * BPP, xspan * BPP);
+template<> struct BlockReverse<4>
+{
+    static constexpr bool Available = true;
+    static constexpr size_t K = 4;
+    static void Run(unsigned char* out, const unsigned char* in)
+    {
+        Store(out, _mm_shuffle_epi32(Load(in), _MM_SHUFFLE(0,1,2,3)));
+    }
+};
 
-            for(size_t y = 0; y < TSZ / 2; y++)
-                for(size_t x = 0; x < TSZ / 2; x++)
-                    ChainSwap4(d[y][x], d[x][TSZ - 1 - y], d[TSZ - 1 - y][TSZ - 1 - x], d[TSZ - 1 - x][y]);
+template<> struct BlockReverse<8>
+{
+    static constexpr bool Available = true;
+    static constexpr size_t K = 2;
+    static void Run(unsigned char* out, const unsigned char* in)
+    {
+        Store(out, _mm_shuffle_epi32(Load(in), _MM_SHUFFLE(1,0,3,2)));
+    }
+};
+#endif // __SSE2__
 
-            for(size_t y = TSZ - xspan; y < TSZ; y++)
-                memcpy(img_out.RowPtr(yout + y) + xout * BPP, d[y], yspan * BPP);
+// out(y,x) = in(y,w-1-x) for rows [y0,y1)
+template<size_t BPP>
+void ReverseRows(const Plane& out, const Plane& in, size_t y0, size_t y1)
+{
+    typedef typename PixelType<BPP>::type T;
+    typedef BlockReverse<BPP> Block;
+    const size_t w = out.w;
+
+    for(size_t y = y0; y < y1; ++y) {
+        unsigned char* pout = out.Row(y);
+        const unsigned char* pin = in.Row(y);
+        size_t x = 0;
+        if(Block::Available) {
+            for(; x + Block::K <= w; x += Block::K) {
+                Block::Run(pout + (w - x - Block::K) * BPP, pin + x * BPP);
+            }
         }
+        for(; x < w; ++x) {
+            std::memcpy(pout + (w - 1 - x) * BPP, pin + x * BPP, sizeof(T));
+        }
+    }
 }
 
-void FlipX(Image<unsigned char>& img_out, const Image<unsigned char>& img_in, size_t bytes_per_pixel)
-{
-    if(bytes_per_pixel == 1)
-        TiledFlipX<1, 160>(img_out, img_in);
-    else if(bytes_per_pixel == 2)
-        TiledFlipX<2, 120>(img_out, img_in);
-    else if(bytes_per_pixel == 3)
-        TiledFlipX<3, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 4)
-        TiledFlipX<4, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 6)
-        TiledFlipX<6, 64>(img_out, img_in);
-    else {
-        for(size_t y = 0; y < img_out.h; ++y) {
-            for(size_t x = 0; x < img_out.w; ++x) {
-                memcpy(img_out.RowPtr((int)y) + (img_out.w - 1 - x) * bytes_per_pixel,
-                       img_in.RowPtr((int)y) + x * bytes_per_pixel,
-                       bytes_per_pixel);
+// out(y,x) = in(x,y) for output rows [y0,y1), processed in square tiles so
+// that the input columns being read stay in cache.
+template<size_t BPP>
+void TransposeRows(const Plane& out, const Plane& in, size_t y0, size_t y1)
+{
+    typedef typename PixelType<BPP>::type T;
+    typedef BlockTranspose<BPP> Block;
+    constexpr size_t TSZ = BPP <= 2 ? 64 : 32;
+    static_assert(TSZ % Block::K == 0, "Tile must be a whole number of blocks");
+
+    for(size_t ty = y0; ty < y1; ty += TSZ) {
+        const size_t ty_end = std::min(ty + TSZ, y1);
+        for(size_t tx = 0; tx < out.w; tx += TSZ) {
+            const size_t tx_end = std::min(tx + TSZ, out.w);
+            size_t y = ty;
+            if(Block::Available) {
+                for(; y + Block::K <= ty_end; y += Block::K) {
+                    size_t x = tx;
+                    for(; x + Block::K <= tx_end; x += Block::K) {
+                        Block::Run(out.Row(y) + x * BPP, out.pitch, in.Row(x) + y * BPP, in.pitch);
+                    }
+                    // Partial block on the right edge
+                    for(size_t yy = y; yy < y + Block::K; ++yy) {
+                        for(size_t xx = x; xx < tx_end; ++xx) {
+                            std::memcpy(out.Row(yy) + xx * BPP, in.Row(xx) + yy * BPP, sizeof(T));
+                        }
+                    }
+                }
+            }
+            for(; y < ty_end; ++y) {
+                unsigned char* pout = out.Row(y);
+                for(size_t x = tx; x < tx_end; ++x) {
+                    std::memcpy(pout + x * BPP, in.Row(x) + y * BPP, sizeof(T));
+                }
             }
         }
     }
 }
 
-void FlipXY(Image<unsigned char>& img_out, const Image<unsigned char>& img_in, size_t bytes_per_pixel)
-{
-    if(bytes_per_pixel == 1)
-        TiledRotate180<1, 160>(img_out, img_in);
-    else if(bytes_per_pixel == 2)
-        TiledRotate180<2, 120>(img_out, img_in);
-    else if(bytes_per_pixel == 3)
-        TiledRotate180<3, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 4)
-        TiledRotate180<4, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 6)
-        TiledRotate180<6, 64>(img_out, img_in);
-    else {
-        for(size_t y_out = 0; y_out < img_out.h; ++y_out) {
-            for(size_t x = 0; x < img_out.w; ++x) {
-                const size_t y_in = (img_in.h - 1) - y_out;
-                memcpy(img_out.RowPtr((int)y_out) + (img_out.w - 1 - x) * bytes_per_pixel,
-                       img_in.RowPtr((int)y_in) + x * bytes_per_pixel,
-                       bytes_per_pixel);
-            }
+template<size_t BPP>
+void TransformRows(TransformOptions t, const Plane& out, const Plane& in, size_t y0, size_t y1)
+{
+    switch (t) {
+    case TransformOptions::None:
+    case TransformOptions::FlipY:
+        for(size_t y = y0; y < y1; ++y) {
+            std::memcpy(out.Row(y), in.Row(y), out.w * BPP);
         }
+        break;
+    case TransformOptions::FlipX:
+    case TransformOptions::FlipXY:
+        ReverseRows<BPP>(out, in, y0, y1);
+        break;
+    case TransformOptions::Transpose:
+    case TransformOptions::RotateCW:
+    case TransformOptions::RotateCCW:
+        TransposeRows<BPP>(out, in, y0, y1);
+        break;
     }
 }
 
-void RotateCW(Image<unsigned char>& img_out, const Image<unsigned char>& img_in, size_t bytes_per_pixel)
-{
-    if(bytes_per_pixel == 1)
-        TiledRotateCW<1, 160>(img_out, img_in);
-    else if(bytes_per_pixel == 2)
-        TiledRotateCW<2, 120>(img_out, img_in);
-    else if(bytes_per_pixel == 3)
-        TiledRotateCW<3, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 4)
-        TiledRotateCW<4, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 6)
-        TiledRotateCW<6, 64>(img_out, img_in);
-    else {
-        for(size_t yout = 0; yout < img_out.h; ++yout)
-            for(size_t xout = 0; xout < img_out.w; ++xout) {
-                size_t xin = yout;
-                size_t yin = img_out.w - 1 - xout;
-                memcpy(img_out.RowPtr((int)yout) + xout * bytes_per_pixel,
-                       img_in.RowPtr((int)yin) + xin * bytes_per_pixel,
-                       bytes_per_pixel);
-            }
+// Formats with other pixel sizes, one pixel at a time
+void TransformRowsGeneric(TransformOptions t, const Plane& out, const Plane& in, size_t bpp, size_t y0, size_t y1)
+{
+    for(size_t y = y0; y < y1; ++y) {
+        unsigned char* pout = out.Row(y);
+        for(size_t x = 0; x < out.w; ++x) {
+            const unsigned char* pin =
+                (t == TransformOptions::None || t == TransformOptions::FlipY) ? in.Row(y) + x * bpp :
+                (t == TransformOptions::FlipX || t == TransformOptions::FlipXY) ? in.Row(y) + (out.w - 1 - x) * bpp :
+                in.Row(x) + y * bpp;
+            std::memcpy(pout + x * bpp, pin, bpp);
+        }
     }
 }
 
-void Transpose(Image<unsigned char>& img_out, const Image<unsigned char>& img_in, size_t bytes_per_pixel)
-{
-    if(bytes_per_pixel == 1)
-        TiledTranspose<1, 160>(img_out, img_in);
-    else if(bytes_per_pixel == 2)
-        TiledTranspose<2, 120>(img_out, img_in);
-    else if(bytes_per_pixel == 3)
-        TiledTranspose<3, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 4)
-        TiledTranspose<4, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 6)
-        TiledTranspose<6, 64>(img_out, img_in);
-    else {
-        for(size_t yout = 0; yout < img_out.h; ++yout)
-            for(size_t xout = 0; xout < img_out.w; ++xout) {
-                size_t xin = yout;
-                size_t yin = xout;
-                memcpy(img_out.RowPtr((int)yout) + xout * bytes_per_pixel,
-                       img_in.RowPtr((int)yin) + xin * bytes_per_pixel,
-                       bytes_per_pixel);
-            }
+void TransformRows(TransformOptions t, const Plane& out, const Plane& in, size_t bpp, size_t y0, size_t y1)
+{
+    switch (bpp) {
+    case 1: TransformRows<1>(t, out, in, y0, y1); break;
+    case 2: TransformRows<2>(t, out, in, y0, y1); break;
+    case 3: TransformRows<3>(t, out, in, y0, y1); break;
+    case 4: TransformRows<4>(t, out, in, y0, y1); break;
+    case 6: TransformRows<6>(t, out, in, y0, y1); break;
+    case 8: TransformRows<8>(t, out, in, y0, y1); break;
+    case 12: TransformRows<12>(t, out, in, y0, y1); break;
+    case 16: TransformRows<16>(t, out, in, y0, y1); break;
+    default: TransformRowsGeneric(t, out, in, bpp, y0, y1); break;
     }
 }
 
-void RotateCCW(Image<unsigned char>& img_out, const Image<unsigned char>& img_in, size_t bytes_per_pixel)
-{
-    if(bytes_per_pixel == 1)
-        TiledRotateCCW<1, 160>(img_out, img_in);
-    else if(bytes_per_pixel == 2)
-        TiledRotateCCW<2, 120>(img_out, img_in);
-    else if(bytes_per_pixel == 3)
-        TiledRotateCCW<3, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 4)
-        TiledRotateCCW<4, 80>(img_out, img_in);
-    else if(bytes_per_pixel == 6)
-        TiledRotateCCW<6, 64>(img_out, img_in);
-    else {
-        for(size_t yout = 0; yout < img_out.h; ++yout)
-            for(size_t xout = 0; xout < img_out.w; ++xout) {
-                size_t xin = img_out.h - 1 - yout;
-                size_t yin = xout;
-                memcpy(img_out.RowPtr((int)yout) + xout * bytes_per_pixel,
-                       img_in.RowPtr((int)yin) + xin * bytes_per_pixel,
-                       bytes_per_pixel);
-            }
-    }
 }
 
+void TransformVideo::ProcessBands(std::unique_lock<std::mutex>& l)
+{
+    while(next_band < bands.size()) {
+        const Band band = bands[next_band++];
+        l.unlock();
+
+        const Image<unsigned char> img_out = Streams()[band.stream].StreamImage(bands_out);
+        const Image<unsigned char> img_in  = videoin->Streams()[band.stream].StreamImage(bands_in);
+        const size_t bytes_per_pixel = Streams()[band.stream].PixFormat().bpp / 8;
+        const TransformOptions t = flips[band.stream];
+
+        // Flips and rotations are expressed as a copy, row reversal or
+        // transpose between row flipped views of the input and output.
+        const Plane in(img_in, t == TransformOptions::FlipY || t == TransformOptions::FlipXY || t == TransformOptions::RotateCW);
+        const Plane out(img_out, t == TransformOptions::RotateCCW);
+        TransformRows(t, out, in, bytes_per_pixel, band.y0, band.y1);
+
+        l.lock();
+        if(++bands_done == bands.size()) {
+            done_cond.notify_all();
+        }
+    }
+}
 
 void TransformVideo::Process(unsigned char* buffer_out, const unsigned char* buffer_in)
 {
+    std::vector<Band> frame_bands;
 
     for(size_t s=0; s<streams.size(); ++s) {
-        Image<unsigned char> img_out = Streams()[s].StreamImage(buffer_out);
-        const Image<unsigned char> img_in  = videoin->Streams()[s].StreamImage(buffer_in);
-        const size_t bytes_per_pixel = Streams()[s].PixFormat().bpp / 8;
+        const StreamInfo& si_out = Streams()[s];
+        const StreamInfo& si_in = videoin->Streams()[s];
 
-        switch (flips[s]) {
-        case TransformOptions::FlipX:
-            FlipX(img_out, img_in, bytes_per_pixel);
-            break;
-        case TransformOptions::FlipY:
-            FlipY(img_out, img_in, bytes_per_pixel);
-            break;
-        case TransformOptions::FlipXY:
-            FlipXY(img_out, img_in, bytes_per_pixel);
-            break;
-        case TransformOptions::RotateCW:
-            RotateCW(img_out, img_in, bytes_per_pixel);
-            break;
-        case TransformOptions::RotateCCW:
-            RotateCCW(img_out, img_in, bytes_per_pixel);
-            break;
-        case TransformOptions::Transpose:
-            Transpose(img_out, img_in, bytes_per_pixel);
-            break;
-        case TransformOptions::None:
-            PitchedImageCopy(img_out, img_in, bytes_per_pixel);
-            break;
-        default:
-            pango_print_warn("TransformVideo::Process(): Invalid enum %i.\n", int(flips[s]));
-            break;
+        if(si_out.Width() * si_out.Height() != si_in.Width() * si_in.Height()) {
+            throw std::runtime_error("TransformVideo: Incompatible image sizes");
+        }
+
+        // Bands of whole 64 row tiles
+        const size_t h = si_out.Height();
+        const size_t num_bands = std::max<size_t>(1, std::min(num_threads, h / 64));
+        const size_t band_h = ((h + num_bands - 1) / num_bands + 63) & ~size_t(63);
+
+        for(size_t y = 0; y < h; y += band_h) {
+            frame_bands.push_back(Band{s, y, std::min(y + band_h, h)});
         }
     }
 
+    std::unique_lock<std::mutex> l(work_lock);
+    bands.swap(frame_bands);
+    bands_out = buffer_out;
+    bands_in = buffer_in;
+    next_band = 0;
+    bands_done = 0;
+    work_cond.notify_all();
+
+    ProcessBands(l);
+    done_cond.wait(l, [this]{ return bands_done == bands.size(); });
 }
 
 //! Implement VideoInput::GrabNext()
@@ -568,8 +601,11 @@ PANGOLIN_REGISTER_FACTORY(TransformVideo) {
         }
         ParamSet Params() const override
         {
-            return {{ {"stream\\d+","none (or scheme name)", "Transform to apply to stream. One of "
-                        "(None,FlipX,FlipY,FlipXY,Transpose,RotateCW,RotateCCW)."} }};
+            return {{
+                {"stream\\d+","none (or scheme name)", "Transform to apply to stream. One of "
+                        "(None,FlipX,FlipY,FlipXY,Transpose,RotateCW,RotateCCW)."},
+                {"threads","1","Number of threads, each transforming a band of output rows. 0 for one per core."},
+            }};
         }
         std::unique_ptr<VideoInterface> Open(const Uri& uri) override {
             std::unique_ptr<VideoInterface> subvid = pangolin::OpenVideo(uri.url);
@@ -587,7 +623,9 @@ PANGOLIN_REGISTER_FACTORY(TransformVideo) {
                 transforms.push_back(reader.Get<TransformOptions>(key, default_transform) );
             }
 
-            return std::unique_ptr<VideoInterface> (new TransformVideo(subvid, transforms));
+            const size_t num_threads = reader.Get<size_t>("threads");
+
+            return std::unique_ptr<VideoInterface> (new TransformVideo(subvid, transforms, num_threads));
         }
     };
 
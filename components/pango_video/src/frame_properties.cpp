@@ -0,0 +1,177 @@
+/* This file is part of the Pangolin Project.
+ * http://github.com/stevenlovegrove/Pangolin
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pangolin/video/frame_properties.h>
+#include <pangolin/video/video_interface.h>
+
+#include <cstring>
+
+namespace pangolin {
+
+static const char* field_keys[VideoFrameProperties::NumFields] = {
+    PANGO_HOST_RECEPTION_TIME_US,
+    PANGO_CAPTURE_TIME_US,
+    PANGO_ESTIMATED_CENTER_CAPTURE_TIME_US,
+    PANGO_JOIN_OFFSET_US,
+    PANGO_EXPOSURE_US,
+    PANGO_ANALOG_GAIN,
+    PANGO_ANALOG_BLACK_LEVEL,
+    PANGO_GAMMA,
+    PANGO_SENSOR_TEMPERATURE_C,
+    PANGO_FRAME_COUNTER,
+    "frame_index",
+    "sequence"
+};
+
+static int FieldForKey(const std::string& key)
+{
+    for(int f=0; f < VideoFrameProperties::NumFields; ++f) {
+        if(key == field_keys[f]) return f;
+    }
+    return -1;
+}
+
+const char* VideoFrameProperties::Key(Field field)
+{
+    return field < NumFields ? field_keys[field] : "";
+}
+
+VideoFrameProperties::VideoFrameProperties()
+    : present(0), is_double(0)
+{
+    std::memset(values, 0, sizeof(values));
+}
+
+VideoFrameProperties::VideoFrameProperties(const picojson::value& json)
+    : VideoFrameProperties()
+{
+    if(!json.is<picojson::null>()) {
+        overflow = std::make_shared<const picojson::value>(json);
+    }
+}
+
+const picojson::value* VideoFrameProperties::OverflowNumber(Field field) const
+{
+    if(overflow && overflow->is<picojson::object>()) {
+        const picojson::object& o = overflow->get<picojson::object>();
+        const auto it = o.find(field_keys[field]);
+        if(it != o.end() && it->second.is<double>()) {
+            return &it->second;
+        }
+    }
+    return nullptr;
+}
+
+bool VideoFrameProperties::Has(Field field) const
+{
+    return (present & (1u << field)) || OverflowNumber(field);
+}
+
+int64_t VideoFrameProperties::GetInt(Field field, int64_t default_val) const
+{
+    if(present & (1u << field)) {
+        return (is_double & (1u << field)) ? static_cast<int64_t>(values[field].d) : values[field].i;
+    }else if(const picojson::value* v = OverflowNumber(field)) {
+        // get<double>() converts int64 in place, so avoid it for those
+        return v->is<int64_t>() ? v->get<int64_t>() : static_cast<int64_t>(v->get<double>());
+    }
+    return default_val;
+}
+
+double VideoFrameProperties::GetDouble(Field field, double default_val) const
+{
+    if(present & (1u << field)) {
+        return (is_double & (1u << field)) ? values[field].d : static_cast<double>(values[field].i);
+    }else if(const picojson::value* v = OverflowNumber(field)) {
+        return v->is<int64_t>() ? static_cast<double>(v->get<int64_t>()) : v->get<double>();
+    }
+    return default_val;
+}
+
+void VideoFrameProperties::Set(Field field, int64_t val)
+{
+    values[field].i = val;
+    present |= (1u << field);
+    is_double &= ~(1u << field);
+}
+
+void VideoFrameProperties::Set(Field field, double val)
+{
+    values[field].d = val;
+    present |= (1u << field);
+    is_double |= (1u << field);
+}
+
+void VideoFrameProperties::Set(const std::string& key, const picojson::value& val)
+{
+    const int field = FieldForKey(key);
+    if(field >= 0) {
+        if(val.is<int64_t>()) {
+            Set(Field(field), val.get<int64_t>());
+            return;
+        }else if(val.is<double>()) {
+            Set(Field(field), val.get<double>());
+            return;
+        }
+        // Otherwise keep the unusual type as it is, in place of any slot
+        present &= ~(1u << field);
+    }
+
+    // Copy on write, since other copies may share the overflow
+    std::shared_ptr<picojson::value> obj;
+    if(overflow && overflow->is<picojson::object>()) {
+        obj = std::make_shared<picojson::value>(*overflow);
+    }else{
+        obj = std::make_shared<picojson::value>(picojson::object_type, true);
+    }
+    obj->get<picojson::object>()[key] = val;
+    overflow = std::move(obj);
+}
+
+void VideoFrameProperties::Clear()
+{
+    present = 0;
+    is_double = 0;
+    overflow.reset();
+}
+
+picojson::value VideoFrameProperties::Json() const
+{
+    if(!present) {
+        return overflow ? *overflow : picojson::value();
+    }
+
+    picojson::value json = (overflow && overflow->is<picojson::object>()) ?
+        *overflow : picojson::value(picojson::object_type, true);
+    picojson::object& o = json.get<picojson::object>();
+    for(int f=0; f < NumFields; ++f) {
+        if(!(present & (1u << f))) continue;
+        o[field_keys[f]] = (is_double & (1u << f)) ?
+            picojson::value(values[f].d) : picojson::value(values[f].i);
+    }
+    return json;
+}
+
+}
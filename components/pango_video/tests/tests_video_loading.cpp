@@ -7,6 +7,20 @@
 
 #include <pangolin/video/video.h>
 #include <pangolin/factory/factory_registry.h>
+#include <pangolin/image/image_io.h>
+#include <pangolin/video/drivers/join.h>
+#include <pangolin/video/drivers/pango.h>
+#ifdef __unix__
+#include <pangolin/video/drivers/shared_memory.h>
+#include <pangolin/video/drivers/test.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <thread>
 
 TEST_CASE( "Loading built in video driver" ) {
     // If this throws, we've probably messed up the factory loading stuff again...
@@ -28,3 +42,541 @@ TEST_CASE( "Error when providing the wrong arguments" )
 {
     REQUIRE_THROWS_AS(pangolin::OpenVideo("test:[width=123,height=345,n=3,fmt=RGB24]//"), pangolin::FactoryRegistry::ParameterMismatchException);
 }
+
+TEST_CASE( "Threaded join of built in video drivers" )
+{
+    auto video = pangolin::OpenVideo("join:[threaded=true,buffers=2]//{test:[size=64x48,fmt=GRAY8]//}{test:[size=32x16,fmt=RGB24]//}");
+
+    REQUIRE(video.get());
+    REQUIRE(video->Streams().size() == 2);
+    REQUIRE(video->SizeBytes() == 64*48 + 32*16*3);
+
+    std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+    video->Start();
+    for(int i=0; i < 5; ++i) {
+        REQUIRE(video->GrabNext(image.get(), true));
+    }
+    REQUIRE(video->GrabNewest(image.get(), true));
+    video->Stop();
+}
+
+TEST_CASE( "Threaded join matches frames by capture time" )
+{
+    // Stream 0 runs at twice the rate of stream 1. With a tolerance of half
+    // its period, every frame of stream 1 has exactly one partner in stream 0
+    // whatever the relative start times, and the frames in between can't be
+    // matched.
+    const int64_t tolerance_us = 5000;
+    auto video = pangolin::OpenVideo(
+        "join:[threaded=true,buffers=16,sync_tolerance_us=5000]//"
+        "{test:[size=64x48,fmt=GRAY8,fps=100]//}{test:[size=32x16,fmt=RGB24,fps=50]//}");
+    auto join = dynamic_cast<pangolin::JoinVideo*>(video.get());
+    REQUIRE(join);
+
+    const size_t num_sets = 10;
+    std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+    int64_t first_index[2] = {0, 0};
+    video->Start();
+    for(size_t i=0; i < num_sets; ++i) {
+        REQUIRE(video->GrabNext(image.get(), true));
+
+        const picojson::value& streams = join->FrameProperties()["streams"];
+        REQUIRE(streams.size() == 2);
+        const int64_t t0 = streams[0][PANGO_ESTIMATED_CENTER_CAPTURE_TIME_US].get<int64_t>();
+        const int64_t t1 = streams[1][PANGO_ESTIMATED_CENTER_CAPTURE_TIME_US].get<int64_t>();
+        REQUIRE(std::abs(t0 - t1) <= tolerance_us);
+
+        const int64_t index0 = streams[0]["frame_index"].get<int64_t>();
+        const int64_t index1 = streams[1]["frame_index"].get<int64_t>();
+        if(i == 0) {
+            first_index[0] = index0;
+            first_index[1] = index1;
+        }
+        REQUIRE(index1 == first_index[1] + (int64_t)i);
+        REQUIRE(index0 == first_index[0] + 2*(int64_t)i);
+    }
+    const pangolin::JoinVideo::Stats stats = join->GetStats();
+    video->Stop();
+
+    REQUIRE(stats.sets_delivered == num_sets);
+    REQUIRE(stats.max_set_span_us <= tolerance_us);
+    REQUIRE(stats.frames_received.size() == 2);
+    REQUIRE(stats.frames_received[0] >= (size_t)first_index[0] + 2*num_sets - 1);
+    REQUIRE(stats.frames_received[1] >= (size_t)first_index[1] + num_sets);
+    // Every frame before the last set was either delivered or found unmatched
+    REQUIRE(stats.frames_unmatched[0] == (size_t)first_index[0] + num_sets - 1);
+    REQUIRE(stats.frames_unmatched[1] == (size_t)first_index[1]);
+    REQUIRE(stats.frames_dropped[0] == 0);
+    REQUIRE(stats.frames_dropped[1] == 0);
+}
+
+TEST_CASE( "Prefetched image sequence matches synchronous decode" )
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "pangolin_test_images_prefetch";
+    std::filesystem::create_directories(dir);
+
+    const size_t num_frames = 20;
+    const pangolin::PixelFormat fmt = pangolin::PixelFormatFromString("GRAY8");
+    for(size_t i=0; i < num_frames; ++i) {
+        pangolin::ManagedImage<unsigned char> img(16, 8);
+        img.Fill((unsigned char)i);
+        pangolin::SaveImage(img, fmt, (dir / ("frame_" + std::to_string(i) + ".pgm")).string());
+    }
+
+    const std::string files = (dir / "frame_*.pgm").string();
+    auto video = pangolin::OpenVideo("images:[prefetch=3,threads=2]//" + files);
+    auto* playback = pangolin::FindFirstMatchingVideoInterface<pangolin::VideoPlaybackInterface>(*video);
+    REQUIRE(playback);
+    REQUIRE(video->SizeBytes() == 16*8);
+
+    std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+    for(size_t i=0; i < 5; ++i) {
+        REQUIRE(video->GrabNext(image.get(), true));
+        REQUIRE(image[0] == i);
+    }
+
+    // Seek backwards and forwards, discarding any prefetched frames
+    playback->Seek(2);
+    REQUIRE(video->GrabNext(image.get(), true));
+    REQUIRE(image[0] == 2);
+    playback->Seek(15);
+    for(size_t i=15; i < num_frames; ++i) {
+        REQUIRE(video->GrabNext(image.get(), true));
+        REQUIRE(image[0] == i);
+        REQUIRE(playback->GetCurrentFrameId() == i);
+    }
+    REQUIRE(!video->GrabNext(image.get(), true));
+
+    video.reset();
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE( "Parallel image sequence writer produces an ordered index" )
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "pangolin_test_images_out";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    const size_t num_frames = 30;
+    {
+        auto video = pangolin::OpenVideo("test:[size=32x16,fmt=RGB24]//");
+        auto output = pangolin::OpenVideoOutput("images:[fmt=ppm,threads=4,queue=3]//" + dir.string());
+        output->SetStreams(video->Streams(), "test://", picojson::value());
+
+        std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+        for(size_t i=0; i < num_frames; ++i) {
+            std::memset(image.get(), (int)i, video->SizeBytes());
+            picojson::value props;
+            props["index"] = picojson::value((int64_t)i);
+            REQUIRE(output->WriteStreams(image.get(), props) == 0);
+        }
+    }
+
+    auto video = pangolin::OpenVideo("images:[prefetch=0]//" + (dir / "archive.json").string());
+    auto* playback = pangolin::FindFirstMatchingVideoInterface<pangolin::VideoPlaybackInterface>(*video);
+    REQUIRE(playback->GetTotalFrames() == num_frames);
+
+    std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+    for(size_t i=0; i < num_frames; ++i) {
+        REQUIRE(video->GrabNext(image.get(), true));
+        REQUIRE(image[0] == i);
+        REQUIRE(pangolin::GetVideoFrameProperties(video.get())["index"].get<int64_t>() == (int64_t)i);
+    }
+
+    video.reset();
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE( "Pango video reads ahead of playback and counts read time" )
+{
+    const std::filesystem::path file = std::filesystem::temp_directory_path() / "pangolin_test_readahead.pango";
+
+    const size_t num_frames = 60;
+    {
+        auto video = pangolin::OpenVideo("test:[size=64x32,fmt=RGB24]//");
+        auto output = pangolin::OpenVideoOutput("pango://" + file.string());
+        output->SetStreams(video->Streams(), "test://", picojson::value());
+
+        std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+        for(size_t i=0; i < num_frames; ++i) {
+            std::memset(image.get(), (int)i, video->SizeBytes());
+            REQUIRE(output->WriteStreams(image.get(), picojson::value()) == 0);
+        }
+    }
+
+    auto video = pangolin::OpenVideo("pango:[readahead_ms=1000]//" + file.string());
+    auto* pango = pangolin::FindFirstMatchingVideoInterface<pangolin::PangoVideo>(*video);
+    REQUIRE(pango);
+
+#ifdef __unix__
+    // The readahead thread advises the first frames without waiting for
+    // playback. Wait for it so that grabbing can't overtake it.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(pango->GetStats().packets_advised == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+#endif
+
+    std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+    for(size_t i=0; i < 20; ++i) {
+        REQUIRE(video->GrabNext(image.get(), true));
+        REQUIRE(image[0] == i);
+    }
+
+    // Readahead follows seeks
+    REQUIRE(pango->Seek(40) == 40);
+    for(size_t i=40; i < num_frames; ++i) {
+        REQUIRE(video->GrabNext(image.get(), true));
+        REQUIRE(image[0] == i);
+    }
+    REQUIRE(!video->GrabNext(image.get(), true));
+
+    const pangolin::PangoVideo::Stats stats = pango->GetStats();
+    REQUIRE(stats.frames == 40);
+    REQUIRE(stats.read_us >= stats.max_read_us);
+    REQUIRE(stats.stalled_us <= stats.read_us);
+#ifdef __unix__
+    REQUIRE(stats.packets_advised > 0);
+    REQUIRE(stats.bytes_advised >= stats.packets_advised * video->SizeBytes());
+#endif
+
+    video.reset();
+    std::filesystem::remove(file);
+}
+
+TEST_CASE( "Typed frame properties match their json form" )
+{
+    using Props = pangolin::VideoFrameProperties;
+
+    Props props;
+    REQUIRE(props.Json().is<picojson::null>());
+    props.Set(Props::CaptureTimeUs, int64_t(1234567890123));
+    props.Set(Props::AnalogGain, 2.5);
+    props.Set("label", picojson::value("left"));
+
+    const picojson::value& json = props.Json();
+    REQUIRE(json[PANGO_CAPTURE_TIME_US].get<int64_t>() == 1234567890123);
+    REQUIRE(json[PANGO_ANALOG_GAIN].get<double>() == 2.5);
+    REQUIRE(json["label"].get<std::string>() == "left");
+    REQUIRE(json.get<picojson::object>().size() == 3);
+
+    // Copies share storage until changed
+    Props copy = props;
+    copy.Set("label", picojson::value("right"));
+    copy.Set(Props::CaptureTimeUs, int64_t(7));
+    REQUIRE(props.Json()["label"].get<std::string>() == "left");
+    REQUIRE(props.GetInt(Props::CaptureTimeUs) == 1234567890123);
+    REQUIRE(copy.Json()["label"].get<std::string>() == "right");
+    REQUIRE(copy.Json()[PANGO_CAPTURE_TIME_US].get<int64_t>() == 7);
+
+    // Adapted json round trips, and its numbers are readable as fields
+    Props adapted(json);
+    REQUIRE(adapted.Json().serialize() == json.serialize());
+    REQUIRE(adapted.Has(Props::AnalogGain));
+    REQUIRE(!adapted.Has(Props::ExposureUs));
+    REQUIRE(adapted.GetDouble(Props::CaptureTimeUs) == 1234567890123.0);
+    adapted.Set(Props::ExposureUs, int64_t(500));
+    REQUIRE(adapted.Json()[PANGO_EXPOSURE_US].get<int64_t>() == 500);
+    REQUIRE(adapted.Json()["label"].get<std::string>() == "left");
+
+    // Drivers storing typed properties agree with their json, also through
+    // the threaded wrapper. The json reference stays valid across frames.
+    for(const std::string uri : {"test:[size=32x16,fmt=GRAY8]//", "thread:[num_buffers=2]//test:[size=32x16,fmt=GRAY8]//"}) {
+        auto video = pangolin::OpenVideo(uri);
+        auto* vpi = pangolin::FindFirstMatchingVideoInterface<pangolin::VideoPropertiesInterface>(*video);
+        REQUIRE(vpi);
+        const picojson::value& live = vpi->FrameProperties();
+        std::unique_ptr<unsigned char[]> image(new unsigned char[video->SizeBytes()]);
+        video->Start();
+        for(int64_t i=0; i < 3; ++i) {
+            REQUIRE(video->GrabNext(image.get(), true));
+            const Props typed = pangolin::GetTypedVideoFrameProperties(video.get());
+            const picojson::value frame = pangolin::GetVideoFrameProperties(video.get());
+            REQUIRE(typed.GetInt(Props::FrameIndex, -1) == i);
+            REQUIRE(frame["frame_index"].get<int64_t>() == i);
+            REQUIRE(typed.Json().serialize() == frame.serialize());
+            REQUIRE(live.serialize() == frame.serialize());
+        }
+        video->Stop();
+    }
+}
+
+TEST_CASE( "Typed frame properties don't build json" )
+{
+    using Props = pangolin::VideoFrameProperties;
+
+    struct JsonTrackingTestVideo : public pangolin::TestVideo
+    {
+        using pangolin::TestVideo::TestVideo;
+        bool JsonPending() const { return frame_properties_dirty; }
+    };
+
+    JsonTrackingTestVideo video(32, 16, 1, "GRAY8");
+    std::unique_ptr<unsigned char[]> image(new unsigned char[video.SizeBytes()]);
+    video.Start();
+    for(int64_t i=0; i < 3; ++i) {
+        REQUIRE(video.GrabNext(image.get(), true));
+        REQUIRE(pangolin::GetTypedVideoFrameProperties(&video).GetInt(Props::FrameIndex, -1) == i);
+        REQUIRE(video.JsonPending());
+    }
+
+    // Json is built for the latest frame once asked for
+    REQUIRE(video.FrameProperties()["frame_index"].get<int64_t>() == 2);
+    REQUIRE(!video.JsonPending());
+    REQUIRE(video.GrabNext(image.get(), true));
+    REQUIRE(video.JsonPending());
+    REQUIRE(video.FrameProperties()["frame_index"].get<int64_t>() == 3);
+    video.Stop();
+}
+
+TEST_CASE( "Test video patterns are deterministic" )
+{
+    for(const std::string pattern : {"noise", "gradient", "checker", "bar"}) {
+        const std::string uri = "test:[size=64x32,n=2,fmt=RGB24,seed=7,pattern=" + pattern + "]//";
+        auto a = pangolin::OpenVideo(uri);
+        auto b = pangolin::OpenVideo(uri);
+        REQUIRE(a->SizeBytes() == 2*64*32*3);
+        REQUIRE((size_t)a->Streams()[1].Offset() == 64*32*3);
+
+        std::vector<unsigned char> img_a(a->SizeBytes()), img_b(b->SizeBytes()), first(a->SizeBytes());
+        for(int i=0; i < 3; ++i) {
+            REQUIRE(a->GrabNext(img_a.data()));
+            REQUIRE(b->GrabNext(img_b.data()));
+            REQUIRE(img_a == img_b);
+            if(i == 0) first = img_a;
+            else REQUIRE(img_a != first);
+        }
+    }
+}
+
+TEST_CASE( "Test video renders packed and bayer formats" )
+{
+    // 4 pixels in 5 bytes, 0.1 intensity outside of the bar
+    auto video = pangolin::OpenVideo("test:[size=64x4,fmt=GRAY10,pattern=bar]//");
+    std::vector<unsigned char> img(video->SizeBytes());
+    REQUIRE(img.size() == 64*4*10/8);
+    REQUIRE(video->GrabNext(img.data()));
+    const uint64_t dark = std::lround(0.1 * 1023);
+    const uint64_t bright = std::lround(0.9 * 1023);
+    uint64_t packed = 0;
+    std::memcpy(&packed, img.data() + 40*10/8, 5);
+    REQUIRE((packed & 0x3FF) == dark);
+    std::memcpy(&packed, img.data(), 5);
+    REQUIRE((packed & 0x3FF) == bright);
+
+    REQUIRE_THROWS(pangolin::OpenVideo("test:[fmt=RGB24,bayer=RGGB,pattern=gradient]//"));
+    auto bayer = pangolin::OpenVideo("test:[size=64x32,fmt=GRAY8,bayer=RGGB,pattern=gradient]//");
+    std::vector<unsigned char> mosaic(bayer->SizeBytes());
+    REQUIRE(bayer->GrabNext(mosaic.data()));
+    // Red increases along the row, blue decreases
+    REQUIRE(mosaic[0] < mosaic[62]);
+    REQUIRE(mosaic[64+1] > mosaic[64+63]);
+}
+
+TEST_CASE( "Test video delivers frames at the requested rate" )
+{
+    auto video = pangolin::OpenVideo("test:[size=16x16,fmt=GRAY8,fps=50]//");
+    std::vector<unsigned char> img(video->SizeBytes());
+    std::vector<int64_t> times;
+    for(int i=0; i < 4; ++i) {
+        REQUIRE(video->GrabNext(img.data(), true));
+        const picojson::value props = pangolin::GetVideoFrameProperties(video.get());
+        REQUIRE(props["frame_index"].get<int64_t>() == i);
+        times.push_back(props[PANGO_CAPTURE_TIME_US].get<int64_t>());
+    }
+    for(size_t i=1; i < times.size(); ++i) {
+        REQUIRE(std::abs(times[i] - times[i-1] - 20000) <= 1);
+    }
+    REQUIRE(!video->GrabNext(img.data(), false));
+}
+
+TEST_CASE( "Profile wrapper records stage timings" )
+{
+    auto video = pangolin::OpenVideo("profile://profile:[name=source]//test:[size=16x16,fmt=GRAY8]//");
+    std::vector<unsigned char> img(video->SizeBytes());
+    REQUIRE(video->GrabNext(img.data()));
+
+    const picojson::value props = pangolin::GetVideoFrameProperties(video.get());
+    REQUIRE(props.contains(PANGO_CAPTURE_TIME_US));
+    const picojson::value& profile = props["profile"];
+    REQUIRE(profile.size() == 2);
+    REQUIRE(profile[0]["stage"].get<std::string>() == "source");
+    REQUIRE(profile[1]["stage"].get<std::string>() == "profile");
+    REQUIRE(profile[1]["bytes"].get<int64_t>() == 16*16);
+    REQUIRE(profile[1]["grab_us"].get<int64_t>() >= profile[0]["grab_us"].get<int64_t>());
+}
+
+TEST_CASE( "Gamma filter maps pixels through per-stream tables" )
+{
+    const std::string src = "test:[size=96x200,fmt=GRAY16LE,n=2,seed=3]//";
+    auto plain = pangolin::OpenVideo(src);
+    auto gamma = pangolin::OpenVideo("gamma:[gamma1=2.2,threads=3]//" + src);
+    REQUIRE(gamma->SizeBytes() == plain->SizeBytes());
+
+    std::vector<unsigned char> in(plain->SizeBytes()), out(gamma->SizeBytes());
+    REQUIRE(plain->GrabNext(in.data()));
+    REQUIRE(gamma->GrabNext(out.data()));
+
+    const uint16_t* pin = (const uint16_t*)in.data();
+    const uint16_t* pout = (const uint16_t*)out.data();
+    for(size_t i=0; i < 96*200; ++i) {
+        const long expected = std::lround(std::pow(pin[i] / 65535.0, 2.2) * 65535.0);
+        REQUIRE(std::abs(pout[i] - expected) <= 1);
+    }
+    // Second stream has no curve and is copied
+    REQUIRE(std::memcmp(in.data() + in.size()/2, out.data() + out.size()/2, in.size()/2) == 0);
+
+    // Packed 12 bit input with an inverting tone curve
+    auto packed = pangolin::OpenVideo("test:[size=64x8,fmt=GRAY12,seed=5]//");
+    auto inverted = pangolin::OpenVideo("gamma:[curve1=0:1;1:0]//test:[size=64x8,fmt=GRAY12,seed=5]//");
+    std::vector<unsigned char> p_in(packed->SizeBytes()), p_out(inverted->SizeBytes());
+    REQUIRE(packed->GrabNext(p_in.data()));
+    REQUIRE(inverted->GrabNext(p_out.data()));
+    for(size_t b=0; b < p_in.size(); b += 3) {
+        const uint32_t a = p_in[b] | (p_in[b+1] << 8) | (p_in[b+2] << 16);
+        const uint32_t c = p_out[b] | (p_out[b+1] << 8) | (p_out[b+2] << 16);
+        REQUIRE((c & 0xFFF) == 4095 - (a & 0xFFF));
+        REQUIRE((c >> 12) == 4095 - (a >> 12));
+    }
+
+    REQUIRE_THROWS(pangolin::OpenVideo("gamma:[gamma1=2.0]//test:[fmt=GRAY32F]//"));
+}
+
+TEST_CASE( "Transform filter matches per-pixel reference" )
+{
+    const size_t w = 131, h = 150;
+    for(const std::string fmt : {"GRAY8", "GRAY16LE", "RGB24", "RGBA32", "RGB48", "RGBA64", "RGB96F"}) {
+        const std::string src = "test:[size=131x150,fmt=" + fmt + ",seed=11]//";
+        auto plain = pangolin::OpenVideo(src);
+        std::vector<unsigned char> in(plain->SizeBytes());
+        REQUIRE(plain->GrabNext(in.data()));
+        const size_t bpp = plain->Streams()[0].PixFormat().bpp / 8;
+
+        for(const std::string t : {"transform", "flipx", "flipy", "flipxy", "transpose", "rotatecw", "rotateccw"}) {
+            auto video = pangolin::OpenVideo(t + ":[threads=3]//" + src);
+            std::vector<unsigned char> out(video->SizeBytes());
+            REQUIRE(video->GrabNext(out.data()));
+
+            const bool transposed = t == "transpose" || t == "rotatecw" || t == "rotateccw";
+            const size_t ow = transposed ? h : w;
+            const size_t oh = transposed ? w : h;
+            REQUIRE(video->Streams()[0].Width() == ow);
+            for(size_t y=0; y < oh; ++y) {
+                for(size_t x=0; x < ow; ++x) {
+                    size_t xi = x, yi = y;
+                    if(t == "flipx")     { xi = w-1-x; }
+                    if(t == "flipy")     { yi = h-1-y; }
+                    if(t == "flipxy")    { xi = w-1-x; yi = h-1-y; }
+                    if(t == "transpose") { xi = y; yi = x; }
+                    if(t == "rotatecw")  { xi = y; yi = h-1-x; }
+                    if(t == "rotateccw") { xi = w-1-y; yi = x; }
+                    REQUIRE(std::memcmp(&out[(y*ow + x)*bpp], &in[(yi*w + xi)*bpp], bpp) == 0);
+                }
+            }
+        }
+    }
+}
+
+#ifdef __unix__
+TEST_CASE( "Shared memory ring fans frames out to independent readers" )
+{
+    const std::string name = "pango_test_ring_" + std::to_string(getpid());
+    auto src = pangolin::OpenVideo("test:[size=32x16,fmt=GRAY8,n=2,seed=9]//");
+    std::vector<unsigned char> frame(src->SizeBytes()), out(src->SizeBytes());
+
+    auto writer = pangolin::OpenVideoOutput("shmem:[slots=4]//" + name);
+    writer->SetStreams(src->Streams());
+
+    auto fast = pangolin::OpenVideo("shmem://" + name);
+    auto slow = pangolin::OpenVideo("shmem://" + name);
+    REQUIRE(fast->Streams().size() == 2);
+    REQUIRE(fast->SizeBytes() == src->SizeBytes());
+    REQUIRE(!fast->GrabNext(out.data(), false));
+
+    std::vector<std::vector<unsigned char>> written;
+    for(int i=0; i < 10; ++i) {
+        REQUIRE(src->GrabNext(frame.data()));
+        writer->WriteStreams(frame.data());
+        written.push_back(frame);
+
+        // Fast reader keeps up and sees every frame
+        REQUIRE(fast->GrabNext(out.data(), false));
+        REQUIRE(out == written.back());
+    }
+
+    // Slow reader has fallen behind: only the last 4 frames remain
+    for(int i=6; i < 10; ++i) {
+        REQUIRE(slow->GrabNext(out.data(), false));
+        REQUIRE(out == written[i]);
+    }
+    REQUIRE(!slow->GrabNext(out.data(), false));
+    REQUIRE(dynamic_cast<pangolin::SharedMemoryVideo*>(slow.get())->FramesDropped() == 6);
+
+    // Readers see the end of the stream once the writer is closed
+    writer.reset();
+    REQUIRE(!fast->GrabNext(out.data(), true));
+}
+
+TEST_CASE( "Shared memory ring is reset when created again under the same name" )
+{
+    const std::string name = "pango_test_ring_reuse_" + std::to_string(getpid());
+    auto src = pangolin::OpenVideo("test:[size=32x16,fmt=GRAY8,seed=3]//");
+    std::vector<unsigned char> frame(src->SizeBytes()), out(src->SizeBytes());
+
+    // Leave a ring behind which has published frames
+    auto stale = pangolin::OpenVideoOutput("shmem:[slots=4]//" + name);
+    stale->SetStreams(src->Streams());
+    for(int i=0; i < 6; ++i) {
+        REQUIRE(src->GrabNext(frame.data()));
+        stale->WriteStreams(frame.data());
+    }
+
+    // A new writer of the same memory starts from an empty ring
+    auto writer = pangolin::OpenVideoOutput("shmem:[slots=4]//" + name);
+    writer->SetStreams(src->Streams());
+    auto reader = pangolin::OpenVideo("shmem://" + name);
+    REQUIRE(!reader->GrabNext(out.data(), false));
+
+    REQUIRE(src->GrabNext(frame.data()));
+    writer->WriteStreams(frame.data());
+    REQUIRE(reader->GrabNext(out.data(), false));
+    REQUIRE(out == frame);
+    REQUIRE(dynamic_cast<pangolin::SharedMemoryVideo*>(reader.get())->FramesDropped() == 0);
+}
+
+TEST_CASE( "Shared memory ring reader rejects headers which don't fit the memory" )
+{
+    const std::string name = "pango_test_ring_bad_" + std::to_string(getpid());
+    auto src = pangolin::OpenVideo("test:[size=32x16,fmt=GRAY8]//");
+    auto writer = pangolin::OpenVideoOutput("shmem:[slots=4]//" + name);
+    writer->SetStreams(src->Streams());
+
+    auto shmem = pangolin::open_named_shared_memory_buffer(name, true);
+    REQUIRE(shmem);
+    auto ring = reinterpret_cast<pangolin::SharedMemoryRingHeader*>(shmem->ptr());
+
+    const uint32_t num_slots = ring->num_slots;
+    const uint32_t num_streams = ring->num_streams;
+    const uint64_t slot_bytes = ring->slot_bytes;
+    const uint32_t stream_h = ring->streams[0].h;
+    REQUIRE_NOTHROW(pangolin::OpenVideo("shmem://" + name));
+
+    ring->num_slots = pangolin::SharedMemoryRingHeader::kMaxSlots + 1;
+    REQUIRE_THROWS(pangolin::OpenVideo("shmem://" + name));
+    ring->num_slots = num_slots;
+
+    ring->num_streams = pangolin::SharedMemoryRingHeader::kMaxStreams + 1;
+    REQUIRE_THROWS(pangolin::OpenVideo("shmem://" + name));
+    ring->num_streams = num_streams;
+
+    ring->slot_bytes = shmem->size();
+    REQUIRE_THROWS(pangolin::OpenVideo("shmem://" + name));
+    ring->slot_bytes = slot_bytes;
+
+    ring->streams[0].h = stream_h + 1;
+    REQUIRE_THROWS(pangolin::OpenVideo("shmem://" + name));
+    ring->streams[0].h = stream_h;
+
+    REQUIRE_NOTHROW(pangolin::OpenVideo("shmem://" + name));
+}
+#endif
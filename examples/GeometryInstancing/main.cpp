@@ -0,0 +1,194 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <pangolin/display/display.h>
+#include <pangolin/display/view.h>
+#include <pangolin/display/widgets.h>
+#include <pangolin/geometry/glgeometry.h>
+#include <pangolin/gl/glsl.h>
+#include <pangolin/handler/handler.h>
+#include <pangolin/var/var.h>
+
+// Draws a grid of objects three ways so that their cost can be compared:
+//   0: one GlDraw() per object with the transform as a uniform (as before)
+//   1: a single instanced GlDraw() with per-instance transforms
+//   2: a GlGeometryBatch, drawn with glMultiDrawElementsIndirect
+// Run with '--benchmark' to time each mode and exit.
+
+const std::string shader = R"Shader(
+@start vertex
+#version 130
+#expect INSTANCED
+
+uniform mat4 T_cam_world;
+in vec3 vertex;
+in vec3 normal;
+#if INSTANCED
+in mat4 instance_T;
+in vec4 instance_color;
+#else
+uniform mat4 instance_T;
+uniform vec4 instance_color;
+#endif
+out vec4 vColor;
+
+void main() {
+    vec3 n = normalize(mat3(instance_T) * normal);
+    vColor = vec4(instance_color.rgb * (0.4 + 0.6 * abs(n.z)), 1.0);
+    gl_Position = T_cam_world * instance_T * vec4(vertex, 1.0);
+}
+
+@start fragment
+#version 130
+in vec4 vColor;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vColor;
+}
+)Shader";
+
+// Unit cube with per-face normals, 24 vertices and 12 triangles
+pangolin::Geometry MakeCube()
+{
+    const float n[6][3] = {{1,0,0},{-1,0,0},{0,1,0},{0,-1,0},{0,0,1},{0,0,-1}};
+
+    pangolin::Geometry geom;
+    auto& vbo = geom.buffers["geometry"];
+    vbo.Reinitialise(6*sizeof(float), 24);
+    for(int f=0; f < 6; ++f) {
+        // Two axes spanning the face
+        const int a = (f/2 + 1) % 3;
+        const int b = (f/2 + 2) % 3;
+        for(int v=0; v < 4; ++v) {
+            float* p = (float*)vbo.RowPtr(4*f+v);
+            for(int i=0; i < 3; ++i) {
+                p[i] = 0.5f * n[f][i];
+                p[3+i] = n[f][i];
+            }
+            p[a] = (v & 1) ? 0.5f : -0.5f;
+            p[b] = (v & 2) ? 0.5f : -0.5f;
+        }
+    }
+    vbo.attributes["vertex"] = pangolin::Image<float>((float*)vbo.ptr, 3, 24, vbo.pitch);
+    vbo.attributes["normal"] = pangolin::Image<float>((float*)vbo.ptr + 3, 3, 24, vbo.pitch);
+
+    auto& ibo = geom.objects.emplace("cube", pangolin::Geometry::Element(3*sizeof(uint32_t), 12))->second;
+    for(uint32_t f=0; f < 6; ++f) {
+        uint32_t* t = (uint32_t*)ibo.RowPtr(2*f);
+        t[0] = 4*f; t[1] = 4*f+1; t[2] = 4*f+3;
+        t[3] = 4*f; t[4] = 4*f+3; t[5] = 4*f+2;
+    }
+    ibo.attributes["vertex_indices"] = pangolin::Image<uint32_t>((uint32_t*)ibo.ptr, 3, 12, ibo.pitch);
+
+    return geom;
+}
+
+int main( int argc, char** argv )
+{
+    bool benchmark = false;
+    int grid = 64;
+    for(int i=1; i < argc; ++i) {
+        if(!std::strcmp(argv[i], "--benchmark")) benchmark = true;
+        else grid = std::atoi(argv[i]);
+    }
+    const size_t num_objects = (size_t)grid * grid;
+
+    const int UI_WIDTH = 180;
+    pangolin::CreateWindowAndBind("Main",640+UI_WIDTH,480);
+    glEnable(GL_DEPTH_TEST);
+
+    pangolin::OpenGlRenderState s_cam(
+        pangolin::ProjectionMatrix(640,480,420,420,320,240,0.1,1000),
+        pangolin::ModelViewLookAt(-grid,grid,-grid, 0,0,0, pangolin::AxisY)
+    );
+
+    pangolin::View& d_cam = pangolin::CreateDisplay()
+        .SetBounds(0.0, 1.0, pangolin::Attach::Pix(UI_WIDTH), 1.0, 640.0f/480.0f)
+        .SetHandler(new pangolin::Handler3D(s_cam));
+
+    pangolin::CreatePanel("ui")
+        .SetBounds(0.0, 1.0, 0.0, pangolin::Attach::Pix(UI_WIDTH));
+
+    pangolin::Var<int> mode("ui.mode", 1, 0, 2);
+    pangolin::Var<double> draw_ms("ui.draw_ms", 0.0);
+
+    // Object transforms and colours on a grid centred on the origin
+    std::vector<Eigen::Matrix4f> T_wo(num_objects, Eigen::Matrix4f::Identity());
+    std::vector<Eigen::Vector4f> colors(num_objects);
+    for(size_t i=0; i < num_objects; ++i) {
+        T_wo[i].block<3,1>(0,3) = Eigen::Vector3f(2.0f*(i % grid) - grid, 0.0f, 2.0f*(i / grid) - grid);
+        colors[i] = Eigen::Vector4f(float(i % grid) / grid, float(i / grid) / grid, 0.5f, 1.0f);
+    }
+
+    const pangolin::Geometry cube = MakeCube();
+    const pangolin::GlGeometry glcube = pangolin::ToGlGeometry(cube);
+
+    pangolin::GlGeometryInstances instances;
+    instances.Update(T_wo, colors);
+
+    pangolin::GlGeometryBatch batch;
+    for(size_t i=0; i < num_objects; ++i) {
+        batch.Add(cube, T_wo[i].data(), colors[i].data());
+    }
+
+    pangolin::GlSlProgram progs[2];
+    for(int instanced=0; instanced < 2; ++instanced) {
+        progs[instanced].AddShader(pangolin::GlSlAnnotatedShader, shader, {{"INSTANCED", std::to_string(instanced)}});
+        progs[instanced].Link();
+    }
+
+    auto render = [&](int m) {
+        pangolin::GlSlProgram& prog = progs[m == 0 ? 0 : 1];
+        prog.Bind();
+        prog.SetUniform("T_cam_world", s_cam.GetProjectionModelViewMatrix());
+        if(m == 0) {
+            for(size_t i=0; i < num_objects; ++i) {
+                prog.SetUniform("instance_T", T_wo[i]);
+                prog.SetUniform("instance_color", colors[i]);
+                pangolin::GlDraw(prog, glcube, nullptr);
+            }
+        }else if(m == 1) {
+            pangolin::GlDraw(prog, glcube, instances, nullptr);
+        }else{
+            batch.Draw(prog);
+        }
+        prog.Unbind();
+    };
+
+    if(benchmark) {
+        const int frames = 50;
+        const char* names[] = {"GlDraw loop", "Instanced", "Batch"};
+        for(int m=0; m < 3; ++m) {
+            render(m); glFinish(); // warm up
+            const auto start = std::chrono::steady_clock::now();
+            for(int f=0; f < frames; ++f) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                d_cam.Activate(s_cam);
+                render(m);
+                glFinish();
+            }
+            const double ms = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+            std::cout << names[m] << ": " << num_objects << " objects, " << ms << " ms / frame" << std::endl;
+        }
+        return 0;
+    }
+
+    while( !pangolin::ShouldQuit() )
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        d_cam.Activate(s_cam);
+
+        const auto start = std::chrono::steady_clock::now();
+        render(mode);
+        glFinish();
+        draw_ms = 0.9 * draw_ms + 0.1 * std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        pangolin::FinishFrame();
+    }
+
+    return 0;
+}
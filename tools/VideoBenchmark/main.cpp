@@ -0,0 +1,223 @@
+#include <pangolin/video/video.h>
+#include <pangolin/video/video_help.h>
+#include <pangolin/utils/argagg.hpp>
+#include <pangolin/utils/timer.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+// Wrap each stage of a filter chain, e.g. thread://debayer://test://, with a
+// profile:// stage so that every GrabNext() is timed. Stages with several
+// inputs (join://{a}{b}) are profiled as a whole.
+std::string InstrumentUri(const std::string& uri)
+{
+    const size_t sep = uri.find("//");
+    if(sep == std::string::npos) {
+        return "profile://" + uri;
+    }
+
+    const std::string head = uri.substr(0, sep + 2);
+    const std::string url = uri.substr(sep + 2);
+    const std::string scheme = head.substr(0, head.find_first_of(":["));
+
+    // Nested video uri if url starts with scheme[:[params]]//
+    const size_t url_sep = url.find("//");
+    const std::string url_head = url.substr(0, url_sep);
+    const bool url_is_video = url_sep != std::string::npos && !url.empty() && url[0] != '{' &&
+        url_head.find('/') == std::string::npos && (url_head.back() == ':' || url_head.back() == ']');
+    return "profile:[name=" + scheme + "]//" + head + (url_is_video ? InstrumentUri(url) : url);
+}
+
+struct Samples
+{
+    std::vector<double> values;
+
+    double Percentile(double p) const
+    {
+        if(values.empty()) return 0.0;
+        std::vector<double> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        const size_t i = std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5));
+        return sorted[i];
+    }
+
+    double Mean() const
+    {
+        double sum = 0.0;
+        for(double v : values) sum += v;
+        return values.empty() ? 0.0 : sum / values.size();
+    }
+};
+
+struct StageStats
+{
+    std::string name;
+    size_t bytes = 0;
+    Samples inclusive_ms;
+    Samples exclusive_ms;
+};
+
+void PrintSamples(const std::string& label, const Samples& s)
+{
+    std::cout << std::setw(24) << std::left << label << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << s.Mean()
+              << std::setw(10) << s.Percentile(0.5)
+              << std::setw(10) << s.Percentile(0.9)
+              << std::setw(10) << s.Percentile(0.99)
+              << std::setw(10) << s.Percentile(1.0) << "\n";
+}
+
+struct BenchmarkResult
+{
+    double fps = 0.0;
+    double mb_per_s = 0.0;
+    Samples frame_ms;
+};
+
+BenchmarkResult Benchmark(const std::string& input_uri, size_t num_frames, size_t warmup_frames, bool newest, bool instrument)
+{
+    const std::string uri = instrument ? InstrumentUri(input_uri) : input_uri;
+    std::cout << "Pipeline: " << uri << "\n";
+
+    std::unique_ptr<pangolin::VideoInterface> video = pangolin::OpenVideo(uri);
+    std::vector<unsigned char> buffer(video->SizeBytes());
+    video->Start();
+
+    std::vector<StageStats> stages;
+    Samples frame_ms;
+    Samples latency_ms;
+    size_t frames = 0;
+
+    pangolin::basetime start = pangolin::TimeNow();
+    for(size_t f=0; f < warmup_frames + num_frames; ++f) {
+        if(f == warmup_frames) {
+            start = pangolin::TimeNow();
+        }
+
+        const pangolin::basetime grab_start = pangolin::TimeNow();
+        const bool success = newest ? video->GrabNewest(buffer.data(), true) : video->GrabNext(buffer.data(), true);
+        const pangolin::basetime grab_end = pangolin::TimeNow();
+        if(!success) {
+            std::cerr << "Video ended after " << f << " frames\n";
+            break;
+        }
+        if(f < warmup_frames) {
+            continue;
+        }
+
+        ++frames;
+        frame_ms.values.push_back(pangolin::TimeDiff_us(grab_start, grab_end) / 1000.0);
+
+        const picojson::value props = pangolin::GetVideoFrameProperties(video.get());
+        if(props.contains(PANGO_CAPTURE_TIME_US)) {
+            latency_ms.values.push_back((pangolin::Time_us(grab_end) - props[PANGO_CAPTURE_TIME_US].get<int64_t>()) / 1000.0);
+        }
+
+        // Profile entries run from the innermost stage outwards
+        if(props.contains("profile")) {
+            const picojson::value& profile = props["profile"];
+            stages.resize(std::max(stages.size(), profile.size()));
+            double inner_ms = 0.0;
+            for(size_t s=0; s < profile.size(); ++s) {
+                const double ms = profile[s]["grab_us"].get<int64_t>() / 1000.0;
+                stages[s].name = profile[s]["stage"].get<std::string>();
+                stages[s].bytes = (size_t)profile[s]["bytes"].get<int64_t>();
+                stages[s].inclusive_ms.values.push_back(ms);
+                // Stages behind a thread:// are timed on their grab thread
+                stages[s].exclusive_ms.values.push_back(std::max(0.0, ms - inner_ms));
+                inner_ms = ms;
+            }
+        }
+    }
+    const double seconds = pangolin::TimeDiff_us(start, pangolin::TimeNow()) / 1e6;
+    video->Stop();
+
+    std::cout << "\n" << frames << " frames in " << std::setprecision(3) << seconds << "s: "
+              << frames / seconds << " fps, "
+              << frames * buffer.size() / seconds / 1e6 << " MB/s\n\n";
+
+    std::cout << std::setw(24) << std::left << "Time (ms)" << std::right
+              << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p90"
+              << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+    PrintSamples("grab", frame_ms);
+    if(!latency_ms.values.empty()) {
+        PrintSamples("capture to delivery", latency_ms);
+    }
+    for(const StageStats& stage : stages) {
+        PrintSamples(stage.name + " (self)", stage.exclusive_ms);
+        PrintSamples(stage.name + " (total)", stage.inclusive_ms);
+    }
+
+    if(!stages.empty()) {
+        std::cout << "\n" << std::setw(24) << std::left << "Stage" << std::right
+                  << std::setw(14) << "bytes/frame" << std::setw(14) << "MB copied" << std::setw(14) << "MB/s (self)" << "\n";
+        for(const StageStats& stage : stages) {
+            const double self_s = stage.exclusive_ms.Mean() / 1000.0;
+            std::cout << std::setw(24) << std::left << stage.name << std::right
+                      << std::setw(14) << stage.bytes
+                      << std::setw(14) << stage.bytes * stage.inclusive_ms.values.size() / 1e6
+                      << std::setw(14) << (self_s > 0.0 ? stage.bytes / self_s / 1e6 : 0.0) << "\n";
+        }
+    }
+
+    BenchmarkResult result;
+    result.fps = frames / seconds;
+    result.mb_per_s = frames * buffer.size() / seconds / 1e6;
+    result.frame_ms = frame_ms;
+    return result;
+}
+
+int main( int argc, char* argv[] )
+{
+    argagg::parser argparser = {{
+        { "help", {"-h", "--help"}, "shows this help", 0},
+        { "frames", {"-n", "--frames"}, "number of frames to time (default 300)", 1},
+        { "warmup", {"-w", "--warmup"}, "number of frames to grab before timing (default 10)", 1},
+        { "newest", {"--newest"}, "use GrabNewest() instead of GrabNext()", 0},
+        { "raw", {"--no-profile"}, "don't wrap each stage with profile://", 0},
+    }};
+
+    argagg::parser_results args = argparser.parse(argc, argv);
+    if( args["help"] || args.pos.size() == 0 ){
+        std::cerr << "Usage:\n";
+        std::cerr << "  VideoBenchmark [options] VideoInputUri [VideoInputUri ...]\n\n";
+        std::cerr << "Examples:\n";
+        std::cerr << "  VideoBenchmark thread://debayer:[tile=rggb,method=downsample]//test:[size=1920x1080,fmt=GRAY8,pattern=gradient,bayer=RGGB]//\n";
+        std::cerr << "  VideoBenchmark -n 1000 unpack:[fmt=GRAY16LE]//test:[fmt=GRAY10,pattern=bar]//\n";
+        std::cerr << "  VideoBenchmark --no-profile flipx://test:[size=4000x3000]// rotatecw://test:[size=4000x3000]// rotatecw:[threads=0]//test:[size=4000x3000]//\n\n";
+        std::cerr << "Options:\n";
+        std::cerr << argparser << std::endl;
+        return 0;
+    }
+
+    try{
+        // Each uri is benchmarked in turn, followed by a comparison when there are several
+        std::vector<BenchmarkResult> results;
+        for(size_t i=0; i < args.pos.size(); ++i) {
+            if(i) std::cout << "\n";
+            results.push_back(Benchmark(
+                args.pos[i], args["frames"].as<size_t>(300), args["warmup"].as<size_t>(10),
+                (bool)args["newest"], !args["raw"]
+            ));
+        }
+
+        if(results.size() > 1) {
+            std::cout << "\n" << std::setw(10) << "fps" << std::setw(10) << "MB/s" << std::setw(10) << "p50 ms"
+                      << std::setw(10) << "p99 ms" << "  Pipeline\n";
+            for(size_t i=0; i < results.size(); ++i) {
+                std::cout << std::fixed << std::setprecision(1)
+                          << std::setw(10) << results[i].fps << std::setw(10) << results[i].mb_per_s
+                          << std::setprecision(3)
+                          << std::setw(10) << results[i].frame_ms.Percentile(0.5)
+                          << std::setw(10) << results[i].frame_ms.Percentile(0.99)
+                          << "  " << args.pos[i] << "\n";
+            }
+        }
+        return 0;
+    } catch (const pangolin::VideoException& e) {
+        std::cout << e.what() << std::endl;
+        return -1;
+    }
+}
@@ -0,0 +1,97 @@
+#include <pangolin/log/packetstream_copy.h>
+#include <pangolin/utils/argagg.hpp>
+#include <pangolin/utils/format_string.h>
+#include <pangolin/utils/timer.h>
+
+#include <algorithm>
+#include <limits>
+#include <iostream>
+#include <sstream>
+
+// Copies part of a .pango recording packet by packet, without decoding frames,
+// so that trimming or splitting is limited only by disk bandwidth.
+
+std::vector<pangolin::PacketStreamSourceId> ParseSources(const std::string& list)
+{
+    std::vector<pangolin::PacketStreamSourceId> sources;
+    std::stringstream ss(list);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        sources.push_back(std::stoul(item));
+    }
+    return sources;
+}
+
+int main( int argc, char* argv[] )
+{
+    argagg::parser argparser = {{
+        { "help", {"-h", "--help"}, "shows this help", 0},
+        { "begin", {"-b", "--begin"}, "seconds after the start of the recording to copy from", 1},
+        { "end", {"-e", "--end"}, "seconds after the start of the recording to copy until", 1},
+        { "frames", {"-f", "--frames"}, "range of frames A:B of the first selected source to copy", 1},
+        { "sources", {"-s", "--sources"}, "comma separated list of sources to copy (default all)", 1},
+        { "split", {"-m", "--split"}, "split into files of this many minutes, named output_N.pango", 1},
+    }};
+
+    argagg::parser_results args = argparser.parse(argc, argv);
+    if( args["help"] || args.pos.size() != 2 ){
+        std::cerr << "Usage:\n";
+        std::cerr << "  VideoExtract [options] input.pango output.pango\n\n";
+        std::cerr << "Examples:\n";
+        std::cerr << "  VideoExtract -b 60 -e 90 in.pango thirty_seconds.pango\n";
+        std::cerr << "  VideoExtract -s 0,2 -f 1000:2000 in.pango cameras.pango\n";
+        std::cerr << "  VideoExtract -m 10 in.pango segment.pango\n\n";
+        std::cerr << "Options:\n";
+        std::cerr << argparser << std::endl;
+        return 0;
+    }
+
+    try{
+        const std::string input = args.pos[0];
+        const std::string output = args.pos[1];
+        pangolin::PacketStreamReader reader(input);
+
+        pangolin::PacketStreamSelection selection;
+        if(args["sources"]) {
+            selection.sources = ParseSources(args["sources"].as<std::string>());
+        }
+
+        // Times are given relative to the first packet of the recording
+        int64_t start_us = std::numeric_limits<int64_t>::max();
+        for(const auto& src : reader.Sources()) {
+            if(!src.index.empty()) start_us = std::min(start_us, src.index.front().capture_time);
+        }
+        if(args["begin"]) {
+            selection.begin_us = start_us + int64_t(args["begin"].as<double>() * 1e6);
+        }
+        if(args["end"]) {
+            selection.end_us = start_us + int64_t(args["end"].as<double>() * 1e6);
+        }
+        if(args["frames"]) {
+            const std::string range = args["frames"].as<std::string>();
+            const size_t sep = range.find(':');
+            const size_t begin = std::stoul(range.substr(0, sep));
+            const size_t end = sep == std::string::npos ? begin + 1 : std::stoul(range.substr(sep + 1));
+            selection.SetFrames(reader, selection.sources.empty() ? 0 : selection.sources[0], begin, end);
+        }
+
+        const pangolin::basetime start = pangolin::TimeNow();
+        if(args["split"]) {
+            const int64_t segment_us = int64_t(args["split"].as<double>() * 60e6);
+            const std::string stem = output.substr(0, output.rfind(".pango"));
+            const size_t num_files = pangolin::SplitPackets(reader, segment_us, [&](size_t n) {
+                return pangolin::FormatString("%_%.pango", stem, n);
+            }, selection);
+            std::cout << "Wrote " << num_files << " files" << std::endl;
+        }else{
+            pangolin::PacketStreamWriter writer(output);
+            const size_t num_packets = pangolin::CopyPackets(reader, writer, selection);
+            std::cout << "Copied " << num_packets << " packets" << std::endl;
+        }
+        std::cout << "Took " << pangolin::TimeDiff_us(start, pangolin::TimeNow()) / 1e6 << " s" << std::endl;
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return -1;
+    }
+}